@@ -30,6 +30,7 @@
 #endif // __MBED__
 
 #include <pico/multicore.h>
+#include "core1_queue.h"
 #include "scsi_accel_rp2040.h"
 #include "hardware/i2c.h"
 
@@ -469,6 +470,43 @@ static void usb_log_poll()
 #endif // __MBED__
 }
 
+// Sending to USB can take a while if the host is slow to read,
+// so the transfer is done by core1 when the work queue is running.
+static CoreQueueFlag g_usb_log_done(true);
+
+static void usb_log_job(void *param)
+{
+    usb_log_poll();
+}
+
+// Core1 is started for the log transfer only when a host has the
+// USB serial port open, otherwise the log is not read by anyone.
+static bool usb_log_connected()
+{
+#ifndef __MBED__
+    return (bool)Serial;
+#else
+    return _SerialUSB.connected();
+#endif // __MBED__
+}
+
+static void usb_log_request()
+{
+    if (!core1_queue_running())
+    {
+        usb_log_poll();
+        if (usb_log_connected())
+        {
+            core1_queue_start();
+        }
+    }
+    else if (coreQueueDone(g_usb_log_done))
+    {
+        // Only one transfer in flight, usb_log_poll() is not reentrant
+        core1_queue_push(usb_log_job, NULL, &g_usb_log_done);
+    }
+}
+
 // Use ADC to implement supply voltage monitoring for the +3.0V rail.
 // This works by sampling the temperature sensor channel, which has
 // a voltage of 0.7 V, allowing to calculate the VDD voltage.
@@ -550,8 +588,9 @@ static void watchdog_callback(unsigned alarm_num)
 
     if (g_watchdog_timeout < WATCHDOG_CRASH_TIMEOUT - 1000)
     {
-        // Been stuck for at least a second, start dumping USB log
-        usb_log_poll();
+        // Been stuck for at least a second, start dumping USB log.
+        // Core1 may still be finishing a transfer queued before the hang.
+        if (coreQueueDone(g_usb_log_done)) usb_log_poll();
     }
 
     if (g_watchdog_timeout <= WATCHDOG_CRASH_TIMEOUT - WATCHDOG_BUS_RESET_TIMEOUT)
@@ -607,7 +646,7 @@ static void watchdog_callback(unsigned alarm_num)
                 p += 4;
             }
 
-            usb_log_poll();
+            if (coreQueueDone(g_usb_log_done)) usb_log_poll();
 
             platform_emergency_log_save();
 
@@ -648,14 +687,14 @@ void platform_reset_watchdog()
 
     // USB log is polled here also to make sure any log messages in fault states
     // get passed to USB.
-    usb_log_poll();
+    usb_log_request();
 }
 
 // Poll function that is called every few milliseconds.
 // Can be left empty or used for platform-specific processing.
 void platform_poll()
 {
-    usb_log_poll();
+    usb_log_request();
 
     adc_poll();
     
@@ -735,6 +774,9 @@ bool platform_rewrite_flash_page(uint32_t offset, uint8_t buffer[PLATFORM_FLASH_
     assert(offset % PLATFORM_FLASH_PAGE_SIZE == 0);
     assert(offset >= PLATFORM_BOOTLOADER_SIZE);
 
+    // Core1 must not execute from flash while it is being written
+    core1_queue_lockout_start();
+
     // Avoid any mbed timer interrupts triggering during the flashing.
     __disable_irq();
 
@@ -760,11 +802,13 @@ bool platform_rewrite_flash_page(uint32_t offset, uint8_t buffer[PLATFORM_FLASH_
         {
             log("Flash verify failed at offset ", offset + i * 4, " got ", actual, " expected ", expected);
             __enable_irq();
+            core1_queue_lockout_end();
             return false;
         }
     }
 
     __enable_irq();
+    core1_queue_lockout_end();
 
     return true;
 }
@@ -859,10 +903,13 @@ bool platform_write_romdrive(const uint8_t *data, uint32_t start, uint32_t count
     assert(start < platform_get_romdrive_maxsize());
     assert((count % PLATFORM_ROMDRIVE_PAGE_SIZE) == 0);
 
+    // Core1 must not execute from flash while it is being written
+    core1_queue_lockout_start();
     __disable_irq();
     flash_range_erase(start + ROMDRIVE_OFFSET, count);
     flash_range_program(start + ROMDRIVE_OFFSET, data, count);
     __enable_irq();
+    core1_queue_lockout_end();
     return true;
 }
 
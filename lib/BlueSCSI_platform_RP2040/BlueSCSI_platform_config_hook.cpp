@@ -76,7 +76,7 @@ static bool isValidMacintoshImage(image_config_t *img)
 // Called from BlueSCSI_disk after image is initalized.
 void platformConfigHook(image_config_t *img)
 {
-    if(ini_getbool("SCSI", "DisableConfigHook", false, CONFIGFILE))
+    if(g_settings.global.disableConfigHook.get(false))
     {
         debuglog("Skipping platformConfigHook due to DisableConfigHook");
         return;
@@ -22,8 +22,8 @@
 #include <hardware/dma.h>
 #include <hardware/irq.h>
 #include <hardware/spi.h>
-#include <pico/multicore.h>
 #include "audio.h"
+#include "core1_queue.h"
 #include "BlueSCSI_audio.h"
 #include "BlueSCSI_config.h"
 #include "BlueSCSI_log.h"
@@ -152,6 +152,13 @@ static volatile uint16_t channels[8] = {
 
 // mechanism for cleanly stopping DMA units
 static volatile bool audio_stopping = false;
+// chunks not encoded because the core1 queue was full, the previous
+// wire buffer contents are then played again
+static volatile uint32_t audio_dropped = 0;
+static uint32_t audio_dropped_logged = 0;
+
+// told about SD card use, see audio_set_sd_callback()
+static audio_sd_callback_t audio_sd_callback = NULL;
 
 // trackers for the below function call
 static uint16_t sfcnt = 0; // sub-frame count; 2 per frame, 192 frames/block
@@ -249,7 +256,7 @@ static void snd_encode(uint8_t* samples, uint16_t* wire_patterns, uint16_t len,
 }
 
 // functions for passing to Core1
-static void snd_process_a() {
+static void snd_process_a(void *param) {
     if (sbufsel == A) {
         if (sbufst_a == READY) {
             snd_encode(sample_buf_a + sbufpos, wire_buf_a, SAMPLE_CHUNK_SIZE, sbufswap);
@@ -276,7 +283,7 @@ static void snd_process_a() {
         }
     }
 }
-static void snd_process_b() {
+static void snd_process_b(void *param) {
     // clone of above for the other wire buffer
     if (sbufsel == A) {
         if (sbufst_a == READY) {
@@ -305,15 +312,6 @@ static void snd_process_b() {
     }
 }
 
-// Allows execution on Core1 via function pointers. Each function can take
-// no parameters and should return nothing, operating via side-effects only.
-static void core1_handler() {
-    while (1) {
-        void (*function)() = (void (*)()) multicore_fifo_pop_blocking();
-        (*function)();
-    }
-}
-
 /* ------------------------------------------------------------------------ */
 /* ---------- VISIBLE FUNCTIONS ------------------------------------------- */
 /* ------------------------------------------------------------------------ */
@@ -321,7 +319,7 @@ static void core1_handler() {
 void audio_dma_irq() {
     if (dma_hw->intr & (1 << SOUND_DMA_CHA)) {
         dma_hw->ints0 = (1 << SOUND_DMA_CHA);
-        multicore_fifo_push_blocking((uintptr_t) &snd_process_a);
+        if (!core1_queue_push_irq(snd_process_a)) audio_dropped++;
         if (audio_stopping) {
             channel_config_set_chain_to(&snd_dma_a_cfg, SOUND_DMA_CHA);
         }
@@ -333,7 +331,7 @@ void audio_dma_irq() {
                 false);
     } else if (dma_hw->intr & (1 << SOUND_DMA_CHB)) {
         dma_hw->ints0 = (1 << SOUND_DMA_CHB);
-        multicore_fifo_push_blocking((uintptr_t) &snd_process_b);
+        if (!core1_queue_push_irq(snd_process_b)) audio_dropped++;
         if (audio_stopping) {
             channel_config_set_chain_to(&snd_dma_b_cfg, SOUND_DMA_CHB);
         }
@@ -366,11 +364,15 @@ void audio_setup() {
     dma_channel_claim(SOUND_DMA_CHA);
 	dma_channel_claim(SOUND_DMA_CHB);
 
-    log("Starting Core1 for audio");
-    multicore_launch_core1(core1_handler);
+    // sample encoding runs on core1, queued from audio_dma_irq()
+    core1_queue_start();
 }
 
 void audio_poll() {
+    if (audio_dropped != audio_dropped_logged) {
+        audio_dropped_logged = audio_dropped;
+        log("Audio encoding fell behind, dropped chunks: ", (int)audio_dropped_logged);
+    }
     if (!audio_is_active()) return;
     if (audio_paused) return;
     if (fleft == 0 && sbufst_a == STALE && sbufst_b == STALE) {
@@ -415,6 +417,7 @@ void audio_poll() {
     if (audio_file->read(audiobuf, toRead) != toRead) {
         log("Audio sample data underrun");
     }
+    if (audio_sd_callback) audio_sd_callback(toRead, AUDIO_BUFFER_SIZE);
     fpos += toRead;
     fleft -= toRead;
 
@@ -489,6 +492,9 @@ bool audio_play(uint8_t owner, ImageBackingStore* img, uint64_t start, uint64_t
     audio_last_status[audio_owner] = ASC_PLAYING;
     audio_paused = false;
 
+    // keep other SD card users from delaying the next buffer refill
+    if (audio_sd_callback) audio_sd_callback(0, AUDIO_BUFFER_SIZE);
+
     // prepare the wire buffers
     for (uint16_t i = 0; i < WIRE_BUFFER_SIZE; i++) {
         wire_buf_a[i] = 0;
@@ -559,6 +565,11 @@ void audio_stop(uint8_t id) {
     audio_last_status[audio_owner] = ASC_COMPLETED;
     audio_paused = false;
     audio_owner = 0xFF;
+    if (audio_sd_callback) audio_sd_callback(0, 0);
+}
+
+void audio_set_sd_callback(audio_sd_callback_t func) {
+    audio_sd_callback = func;
 }
 
 audio_status_code audio_get_status_code(uint8_t id) {
@@ -0,0 +1,80 @@
+// Work queue for running latency-insensitive jobs on the second core.
+
+#include "core1_queue.h"
+#include "BlueSCSI_log.h"
+#include <pico/multicore.h>
+#include <hardware/sync.h>
+
+// Each producer context has its own queue, as CoreQueue supports only
+// one producer. Interrupt jobs (audio encoding) have tight deadlines,
+// so that queue is always emptied first.
+static CoreQueue<8> g_core1_irq_queue;
+static CoreQueue<16> g_core1_queue;
+static bool g_core1_running;
+
+static void core1_worker()
+{
+    // Allow core0 to pause this core during flash writes
+    multicore_lockout_victim_init();
+
+    while (1)
+    {
+        if (!g_core1_irq_queue.runOne() && !g_core1_queue.runOne())
+        {
+            // Sleep until core0 signals a new job with __sev()
+            __wfe();
+        }
+    }
+}
+
+void core1_queue_start()
+{
+    if (g_core1_running) return;
+
+    log("Starting Core1 work queue");
+    multicore_launch_core1(core1_worker);
+    g_core1_running = true;
+}
+
+bool core1_queue_running()
+{
+    return g_core1_running;
+}
+
+bool core1_queue_push(void (*function)(void *param), void *param, CoreQueueFlag *done)
+{
+    if (!g_core1_running || !g_core1_queue.push(function, param, done))
+    {
+        return false;
+    }
+
+    __sev();
+    return true;
+}
+
+bool core1_queue_push_irq(void (*function)(void *param), void *param, CoreQueueFlag *done)
+{
+    if (!g_core1_running || !g_core1_irq_queue.push(function, param, done))
+    {
+        return false;
+    }
+
+    __sev();
+    return true;
+}
+
+void core1_queue_lockout_start()
+{
+    if (g_core1_running)
+    {
+        multicore_lockout_start_blocking();
+    }
+}
+
+void core1_queue_lockout_end()
+{
+    if (g_core1_running)
+    {
+        multicore_lockout_end_blocking();
+    }
+}
@@ -0,0 +1,26 @@
+// Work queue for running latency-insensitive jobs on the second core.
+// Core0 handles the SCSI bus, core1 runs whatever is queued here.
+// The queue itself is implemented in lib/CoreQueue.
+
+#pragma once
+
+#include <CoreQueue.h>
+
+// Launch the worker on core1. Does nothing if it is already running.
+void core1_queue_start();
+
+// Returns true if the worker has been started
+bool core1_queue_running();
+
+// Queue a job from the main loop on core0.
+// Returns false if the queue is full or the worker is not running.
+bool core1_queue_push(void (*function)(void *param), void *param = NULL, CoreQueueFlag *done = NULL);
+
+// Queue a job from an interrupt handler on core0.
+// These jobs are run before the main loop jobs.
+bool core1_queue_push_irq(void (*function)(void *param), void *param = NULL, CoreQueueFlag *done = NULL);
+
+// Park core1 in RAM while flash is being erased or programmed.
+// Does nothing if the worker is not running.
+void core1_queue_lockout_start();
+void core1_queue_lockout_end();
@@ -16,6 +16,7 @@
 #include <hardware/gpio.h>
 #include <BlueSCSI_platform.h>
 #include <BlueSCSI_log.h>
+#include <SDIOCRC.h>
 
 #define SDIO_PIO pio1
 #define SDIO_CMD_SM 0
@@ -41,7 +42,6 @@ static struct {
     uint32_t blocks_done; // Number of blocks transferred so far
     uint32_t total_blocks; // Total number of blocks to transfer
     uint32_t blocks_checksumed; // Number of blocks that have had CRC calculated
-    uint32_t checksum_errors; // Number of checksum errors detected
 
     // Variables for block writes
     uint64_t next_wr_block_checksum;
@@ -59,6 +59,7 @@ static struct {
         uint32_t top;
         uint32_t bottom;
     } received_checksums[SDIO_MAX_BLOCKS];
+    SDIOCRCVerifier rx_verifier;
 } g_sdio;
 
 void rp2040_sdio_dma_irq();
@@ -91,43 +92,7 @@ static const uint8_t crc7_table[256] = {
 	0x1c, 0x0e, 0x38, 0x2a, 0x54, 0x46, 0x70, 0x62,	0x8c, 0x9e, 0xa8, 0xba, 0xc4, 0xd6, 0xe0, 0xf2
 };
 
-// Calculate the CRC16 checksum for parallel 4 bit lines separately.
-// When the SDIO bus operates in 4-bit mode, the CRC16 algorithm
-// is applied to each line separately and generates total of
-// 4 x 16 = 64 bits of checksum.
-__attribute__((optimize("O3")))
-uint64_t sdio_crc16_4bit_checksum(uint32_t *data, uint32_t num_words)
-{
-    uint64_t crc = 0;
-    uint32_t *end = data + num_words;
-    while (data < end)
-    {
-        for (int unroll = 0; unroll < 4; unroll++)
-        {
-            // Each 32-bit word contains 8 bits per line.
-            // Reverse the bytes because SDIO protocol is big-endian.
-            uint32_t data_in = __builtin_bswap32(*data++);
-
-            // Shift out 8 bits for each line
-            uint32_t data_out = crc >> 32;
-            crc <<= 32;
-
-            // XOR outgoing data to itself with 4 bit delay
-            data_out ^= (data_out >> 16);
-
-            // XOR incoming data to outgoing data with 4 bit delay
-            data_out ^= (data_in >> 16);
-
-            // XOR outgoing and incoming data to accumulator at each tap
-            uint64_t xorred = data_out ^ data_in;
-            crc ^= xorred;
-            crc ^= xorred << (5 * 4);
-            crc ^= xorred << (12 * 4);
-        }
-    }
-
-    return crc;
-}
+// The CRC16 checksum for data blocks is implemented in lib/SDIOCRC
 
 /*******************************************************
  * Basic SDIO command execution
@@ -359,8 +324,7 @@ sdio_status_t rp2040_sdio_rx_start(uint8_t *buffer, uint32_t num_blocks)
     g_sdio.data_buf = (uint32_t*)buffer;
     g_sdio.blocks_done = 0;
     g_sdio.total_blocks = num_blocks;
-    g_sdio.blocks_checksumed = 0;
-    g_sdio.checksum_errors = 0;
+    g_sdio.rx_verifier.start((const uint32_t*)buffer, (const uint32_t*)g_sdio.received_checksums, num_blocks);
 
     // Create DMA block descriptors to store each block of 512 bytes of data to buffer
     // and then 8 bytes to g_sdio.received_checksums.
@@ -413,30 +377,27 @@ sdio_status_t rp2040_sdio_rx_start(uint8_t *buffer, uint32_t num_blocks)
     return SDIO_OK;
 }
 
-// Check checksums for received blocks
-static void sdio_verify_rx_checksums(uint32_t maxcount)
+// Checksum the received data while the rest of the transfer is still
+// streaming in. Any part of the block that DMA is currently writing is
+// included, so that the checksum of a block is ready soon after it completes.
+static void sdio_verify_rx_checksums(uint32_t max_words)
 {
-    while (g_sdio.blocks_checksumed < g_sdio.blocks_done && maxcount-- > 0)
+    uint32_t partial_words = 0;
+    uint32_t block_start = (uint32_t)(g_sdio.data_buf + g_sdio.blocks_done * SDIO_WORDS_PER_BLOCK);
+    uint32_t write_addr = dma_hw->ch[SDIO_DMA_CH].write_addr;
+    if (write_addr >= block_start && write_addr < block_start + SDIO_BLOCK_SIZE)
     {
-        // Calculate checksum from received data
-        int blockidx = g_sdio.blocks_checksumed++;
-        uint64_t checksum = sdio_crc16_4bit_checksum(g_sdio.data_buf + blockidx * SDIO_WORDS_PER_BLOCK,
-                                                     SDIO_WORDS_PER_BLOCK);
+        partial_words = (write_addr - block_start) / sizeof(uint32_t);
+    }
 
-        // Convert received checksum to little-endian format
-        uint32_t top = __builtin_bswap32(g_sdio.received_checksums[blockidx].top);
-        uint32_t bottom = __builtin_bswap32(g_sdio.received_checksums[blockidx].bottom);
-        uint64_t expected = ((uint64_t)top << 32) | bottom;
+    uint32_t errors_before = g_sdio.rx_verifier.errors();
+    g_sdio.rx_verifier.update(g_sdio.blocks_done, partial_words, max_words);
 
-        if (checksum != expected)
-        {
-            g_sdio.checksum_errors++;
-            if (g_sdio.checksum_errors == 1)
-            {
-                log("SDIO checksum error in reception: block ", blockidx,
-                      " calculated ", checksum, " expected ", expected);
-            }
-        }
+    if (errors_before == 0 && g_sdio.rx_verifier.errors() != 0)
+    {
+        log("SDIO checksum error in reception: block ", g_sdio.rx_verifier.firstErrorBlock(),
+              " calculated ", g_sdio.rx_verifier.firstErrorCalculated(),
+              " expected ", g_sdio.rx_verifier.firstErrorExpected());
     }
 }
 
@@ -449,9 +410,6 @@ sdio_status_t rp2040_sdio_rx_poll(uint32_t *bytes_complete)
     }
     else
     {
-        // Use the idle time to calculate checksums
-        sdio_verify_rx_checksums(4);
-
         // Check how many DMA control blocks have been consumed
         uint32_t dma_ctrl_block_count = (dma_hw->ch[SDIO_DMA_CHB].read_addr - (uint32_t)&g_sdio.dma_blocks);
         dma_ctrl_block_count /= sizeof(g_sdio.dma_blocks[0]);
@@ -460,6 +418,10 @@ sdio_status_t rp2040_sdio_rx_poll(uint32_t *bytes_complete)
         // When transfer ends, dma_ctrl_block_count == g_sdio.total_blocks * 2 + 1
         g_sdio.blocks_done = (dma_ctrl_block_count - 1) / 2;
 
+        // Use the idle time to calculate checksums of the blocks that
+        // have arrived so far, while the next ones are being received.
+        sdio_verify_rx_checksums(SDIO_WORDS_PER_BLOCK * 4);
+
         // NOTE: When all blocks are done, rx_poll() still returns SDIO_BUSY once.
         // This provides a chance to start the SCSI transfer before the last checksums
         // are computed. Any checksum failures can be indicated in SCSI status after
@@ -474,9 +436,9 @@ sdio_status_t rp2040_sdio_rx_poll(uint32_t *bytes_complete)
     if (g_sdio.transfer_state == SDIO_IDLE)
     {
         // Verify all remaining checksums.
-        sdio_verify_rx_checksums(g_sdio.total_blocks);
+        sdio_verify_rx_checksums(g_sdio.total_blocks * SDIO_WORDS_PER_BLOCK);
 
-        if (g_sdio.checksum_errors == 0)
+        if (g_sdio.rx_verifier.errors() == 0)
             return SDIO_OK;
         else
             return SDIO_ERR_DATA_CRC;
@@ -568,7 +530,6 @@ sdio_status_t rp2040_sdio_tx_start(const uint8_t *buffer, uint32_t num_blocks)
     g_sdio.blocks_done = 0;
     g_sdio.total_blocks = num_blocks;
     g_sdio.blocks_checksumed = 0;
-    g_sdio.checksum_errors = 0;
 
     // Compute first block checksum
     sdio_compute_next_tx_checksum();
@@ -8,6 +8,7 @@
 #include <assert.h>
 
 #include <scsi2sd.h>
+#include <SCSIParity.h>
 extern "C" {
 #include <scsi.h>
 }
@@ -176,7 +177,7 @@ static inline uint8_t scsiHostReadOneByte(int* parityError)
     SCSIHOST_WAIT_INACTIVE(REQ);
     SCSI_OUT(ACK, 0);
 
-    if (parityError && r != (g_scsi_parity_lookup[r & 0xFF] ^ SCSI_IO_DATA_MASK))
+    if (parityError && !scsiParityValid(r))
     {
         log("Parity error in scsiReadOneByte(): ", (uint32_t)r);
         *parityError = 1;
@@ -210,14 +211,38 @@ uint32_t scsiHostWrite(const uint8_t *data, uint32_t count)
     return count;
 }
 
+// Read bytes one at a time, stopping if the target leaves DATA_IN phase.
+// Phase signals are checked when REQ is asserted, so that the first byte
+// of the next phase is not taken as data.
+static uint32_t scsiHostReadBytes(uint8_t *data, uint32_t count, int *parityError)
+{
+    int cd_start = SCSI_IN(CD);
+    int msg_start = SCSI_IN(MSG);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        while (!SCSI_IN(REQ))
+        {
+            if (g_scsiHostPhyReset) return i;
+        }
+
+        if (!SCSI_IN(IO) || SCSI_IN(CD) != cd_start || SCSI_IN(MSG) != msg_start)
+        {
+            // Target switched out of DATA_IN mode, REQ is for the next phase
+            return i;
+        }
+
+        data[i] = scsiHostReadOneByte(parityError);
+    }
+
+    return count;
+}
+
 uint32_t scsiHostRead(uint8_t *data, uint32_t count)
 {
     int parityError = 0;
     uint32_t fullcount = count;
 
-    int cd_start = SCSI_IN(CD);
-    int msg_start = SCSI_IN(MSG);
-
     if ((count & 1) == 0 && ((uint32_t)data & 1) == 0)
     {
         // Even number of bytes, use accelerated routine
@@ -225,19 +250,7 @@ uint32_t scsiHostRead(uint8_t *data, uint32_t count)
     }
     else
     {
-        for (uint32_t i = 0; i < count; i++)
-        {
-            while (!SCSI_IN(REQ))
-            {
-                if (g_scsiHostPhyReset || !SCSI_IN(IO) || SCSI_IN(CD) != cd_start || SCSI_IN(MSG) != msg_start)
-                {
-                    // Target switched out of DATA_IN mode
-                    count = i;
-                }
-            }
-
-            data[i] = scsiHostReadOneByte(&parityError);
-        }
+        count = scsiHostReadBytes(data, count, &parityError);
     }
 
     scsiLogDataIn(data, count);
@@ -257,6 +270,65 @@ uint32_t scsiHostRead(uint8_t *data, uint32_t count)
     }
 }
 
+// Wait for REQ and check that the target is still in DATA_IN phase
+static bool scsiHostDataInRequest()
+{
+    while (!SCSI_IN(REQ))
+    {
+        if (g_scsiHostPhyReset) return false;
+    }
+
+    return SCSI_IN(IO) && !SCSI_IN(CD) && !SCSI_IN(MSG);
+}
+
+uint32_t scsiHostReadUntilPhaseChange(uint8_t *data, uint32_t count, uint32_t min_count, uint32_t blocksize)
+{
+    int parityError = 0;
+    uint32_t received = 0;
+
+    // Parts that the target is known to send are read with the accelerated
+    // routine, which would take the status byte as data if the phase ended
+    // in the middle of them.
+    while (received < count && !g_scsiHostPhyReset && !parityError)
+    {
+        uint32_t chunk = blocksize ? blocksize : (received == 0 ? min_count : 0);
+        if (chunk < 2 || (chunk & 1) || chunk > count - received ||
+            ((uint32_t)(data + received) & 1))
+        {
+            break;
+        }
+
+        if (!scsiHostDataInRequest())
+        {
+            break;
+        }
+
+        uint32_t got = scsi_accel_host_read(data + received, chunk, &parityError, &g_scsiHostPhyReset);
+        received += got;
+        if (got < chunk) break;
+    }
+
+    // The rest is handshaked one byte at a time
+    if (received < count && !g_scsiHostPhyReset && !parityError)
+    {
+        received += scsiHostReadBytes(data + received, count - received, &parityError);
+    }
+
+    scsiLogDataIn(data, received);
+
+    if (g_scsiHostPhyReset || parityError)
+    {
+        return 0;
+    }
+
+    if (received < count)
+    {
+        debuglog("scsiHostReadUntilPhaseChange: received ", (int)received, " bytes of ", (int)count);
+    }
+
+    return received;
+}
+
 // Release all bus signals
 void scsiHostPhyRelease()
 {
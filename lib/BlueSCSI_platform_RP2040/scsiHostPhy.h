@@ -28,5 +28,16 @@ bool scsiHostRequestWaiting();
 uint32_t scsiHostWrite(const uint8_t *data, uint32_t count);
 uint32_t scsiHostRead(uint8_t *data, uint32_t count);
 
+// Read up to count bytes, for transfers that the target can end early,
+// such as short records from a tape drive. The target must send at least
+// min_count bytes, and if blocksize is given only whole blocks of that size.
+// Those are read with the accelerated routine, the phase is checked before
+// each block. Any remainder is handshaked one byte at a time with the phase
+// checked before each byte, which is slower but never takes the status byte
+// as data.
+// Returns 0 on reset or parity error.
+uint32_t scsiHostReadUntilPhaseChange(uint8_t *data, uint32_t count,
+                                      uint32_t min_count = 0, uint32_t blocksize = 0);
+
 // Release all bus signals
 void scsiHostPhyRelease();
@@ -11,8 +11,10 @@
 #include "BlueSCSI_config.h"
 #include "scsi_accel_rp2040.h"
 #include "hardware/structs/iobank0.h"
+#include "hardware/timer.h"
 
 #include <scsi2sd.h>
+#include <SCSIParity.h>
 extern "C" {
 #include <scsi.h>
 #include <scsi2sd_time.h>
@@ -38,28 +40,21 @@ extern "C" bool scsiStatusBSY()
 
 volatile uint8_t g_scsi_sts_selection;
 volatile uint8_t g_scsi_ctrl_bsy;
+static volatile uint32_t g_scsi_sel_time_us;
 
 void scsi_bsy_deassert_interrupt()
 {
     if (SCSI_IN(SEL) && !SCSI_IN(BSY))
     {
-        // Check if any of the targets we simulate is selected
-        uint8_t sel_bits = SCSI_IN_DATA();
-        int sel_id = -1;
-        for (int i = 0; i < S2S_MAX_TARGETS; i++)
-        {
-            if (scsiDev.targets[i].targetId <= 7 && scsiDev.targets[i].cfg)
-            {
-                if (sel_bits & (1 << scsiDev.targets[i].targetId))
-                {
-                    sel_id = scsiDev.targets[i].targetId;
-                    break;
-                }
-            }
-        }
+        g_scsi_sel_time_us = time_us_32();
 
-        if (sel_id >= 0)
+        // Check if any of the targets we simulate is selected.
+        // The lowest ID wins if the initiator selects several at once.
+        uint8_t sel_bits = SCSI_IN_DATA() & scsiDev.targetIdMask;
+        if (sel_bits)
         {
+            int sel_id = __builtin_ctz(sel_bits);
+
             // Set ATN flag here unconditionally, real value is only known after
             // OUT_BSY is enabled in scsiStatusSEL() below.
             g_scsi_sts_selection = SCSI_STS_SELECTION_SUCCEEDED | SCSI_STS_SELECTION_ATN | sel_id;
@@ -85,6 +80,8 @@ extern "C" bool scsiStatusSEL()
         SCSI_ENABLE_CONTROL_OUT();
         SCSI_OUT(BSY, 1);
 
+        uint32_t latency = time_us_32() - g_scsi_sel_time_us;
+
         // On RP2040 hardware the ATN signal is only available after OUT_BSY enables
         // the IO buffer U105, so check the signal status here.
         delay_100ns();
@@ -95,6 +92,9 @@ extern "C" bool scsiStatusSEL()
             scsiDev.target->unitAttention = 0;
             scsiDev.compatMode = COMPAT_SCSI1;
         }
+
+        // New longest latency is logged later from the main loop
+        scsiRecordSelLatency(latency);
     }
 
     return SCSI_IN(SEL);
@@ -314,15 +314,40 @@ extern "C" void scsiWriteByte(uint8_t value)
     scsiWriteOneByte(value);
 }
 
+extern "C" bool scsiWriteStatusMessage(uint8_t status, uint8_t message)
+{
+    scsiEnterPhase(STATUS);
+    scsiLogDataIn(&status, 1);
+    scsiWriteOneByte(status);
+
+    if (SCSI_IN(ATN) || scsiDev.resetFlag)
+    {
+        return false;
+    }
+
+    scsiEnterPhase(MESSAGE_IN);
+    scsiLogDataIn(&message, 1);
+    scsiWriteOneByte(message);
+    return true;
+}
+
 extern "C" void scsiWrite(const uint8_t* data, uint32_t count)
 {
+    // Short responses are written directly to PIO without DMA setup
+    if (scsi_accel_rp2040_writeShort(data, count, &scsiDev.resetFlag))
+    {
+        scsiLogDataIn(data, count);
+        return;
+    }
+
     scsiStartWrite(data, count);
     scsiFinishWrite();
 }
 
 extern "C" void scsiStartWrite(const uint8_t* data, uint32_t count)
 {
-    scsiLogDataIn(data, count);
+    // Checksum is computed by DMA, see scsi_accel_rp2040.cpp
+    scsiLogDataIn(data, count, true);
     scsi_accel_rp2040_startWrite(data, count, &scsiDev.resetFlag);
 }
 
@@ -350,7 +375,7 @@ static inline uint8_t scsiReadOneByte(int* parityError)
     SCSI_OUT(REQ, 0);
     SCSI_WAIT_INACTIVE(ACK);
 
-    if (parityError && r != (g_scsi_parity_lookup[r & 0xFF] ^ SCSI_IO_DATA_MASK))
+    if (parityError && !scsiParityValid(r))
     {
         debuglog("Parity error in scsiReadOneByte(): ", (uint32_t)r);
         *parityError = 1;
@@ -369,6 +394,14 @@ extern "C" uint8_t scsiReadByte(void)
 extern "C" void scsiRead(uint8_t* data, uint32_t count, int* parityError)
 {
     *parityError = 0;
+
+    // Commands and messages are read directly from PIO without DMA setup
+    if (scsi_accel_rp2040_readShort(data, count, parityError, &scsiDev.resetFlag))
+    {
+        scsiLogDataOut(data, count);
+        return;
+    }
+
     scsiStartRead(data, count, parityError);
     scsiFinishRead(data, count, parityError);
 }
@@ -381,7 +414,7 @@ extern "C" void scsiStartRead(uint8_t* data, uint32_t count, int *parityError)
 extern "C" void scsiFinishRead(uint8_t* data, uint32_t count, int *parityError)
 {
     scsi_accel_rp2040_finishRead(data, count, parityError, &scsiDev.resetFlag);
-    scsiLogDataOut(data, count);
+    scsiLogDataOut(data, count, true);
 }
 
 extern "C" bool scsiIsReadFinished(const uint8_t *data)
@@ -10,6 +10,7 @@
 
 #include "BlueSCSI_platform.h"
 #include "BlueSCSI_log.h"
+#include "BlueSCSI_log_trace.h"
 #include "scsi_accel_rp2040.h"
 #include "scsi_accel.pio.h"
 #include <hardware/pio.h>
@@ -18,6 +19,7 @@
 #include <hardware/structs/iobank0.h>
 #include <hardware/sync.h>
 #include <audio.h>
+#include <SCSIParity.h>
 #include <pico/multicore.h>
 
 // SCSI bus write acceleration uses up to 3 PIO state machines:
@@ -131,6 +133,51 @@ void scsi_accel_log_state()
     log("GPIO states: ", sio_hw->gpio_in);
 }
 
+/****************************************/
+/* Debug checksum of DMA transfers      */
+/****************************************/
+
+// When debug logging is enabled, the DMA sniffer computes the CRC-32 of the
+// data bytes that channel A moves, so that the CPU does not have to go
+// through the data again. The sniffer continues from the checksum that
+// BlueSCSI_log_trace.cpp has computed so far, and the result is stored back
+// when the transfer stops. Short transfers are checksummed by the CPU.
+//
+// The sniffer implements the non-reflected form of the CRC on bit reversed
+// data, so the seed is reversed and inverted here, and the hardware does
+// the same for the result.
+static bool g_scsi_dma_checksum_active;
+
+static uint32_t reverse_bits32(uint32_t x)
+{
+    x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+    x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F) | ((x & 0x0F0F0F0F) << 4);
+    return __builtin_bswap32(x);
+}
+
+static void scsi_dma_checksum_start()
+{
+    g_scsi_dma_checksum_active = g_log_debug;
+    if (!g_scsi_dma_checksum_active) return;
+
+    dma_hw->sniff_data = reverse_bits32(~scsiLogDataChecksum());
+    dma_hw->sniff_ctrl = (SCSI_DMA_CH_A << DMA_SNIFF_CTRL_DMACH_LSB)
+                       | (DMA_SNIFF_CTRL_CALC_VALUE_CRC32R << DMA_SNIFF_CTRL_CALC_LSB)
+                       | DMA_SNIFF_CTRL_OUT_REV_BITS
+                       | DMA_SNIFF_CTRL_OUT_INV_BITS
+                       | DMA_SNIFF_CTRL_EN_BITS;
+}
+
+static void scsi_dma_checksum_stop()
+{
+    if (!g_scsi_dma_checksum_active) return;
+
+    scsiLogSetDataChecksum(dma_hw->sniff_data);
+    dma_hw->sniff_ctrl = 0;
+    g_scsi_dma_checksum_active = false;
+}
+
 /****************************************/
 /* Accelerated writes to SCSI bus       */
 /****************************************/
@@ -252,6 +299,7 @@ void scsi_accel_rp2040_startWrite(const uint8_t* data, uint32_t count, volatile
     
     if (must_reconfig_gpio)
     {
+        scsi_dma_checksum_start();
         SCSI_ENABLE_DATA_OUT();
 
         if (g_scsi_dma.syncOffset == 0)
@@ -396,6 +444,7 @@ static void scsi_accel_rp2040_stopWrite(volatile int *resetFlag)
     dma_channel_abort(SCSI_DMA_CH_D);
     dma_channel_set_irq0_enabled(SCSI_DMA_CH_A, false);
     g_scsi_dma_state = SCSIDMA_IDLE;
+    scsi_dma_checksum_stop();
     SCSI_RELEASE_DATA_REQ();
     scsidma_config_gpio();
     pio_sm_set_enabled(SCSI_DMA_PIO, SCSI_PARITY_SM, false);
@@ -637,6 +686,7 @@ void scsi_accel_rp2040_startRead(uint8_t *data, uint32_t count, int *parityError
 
     if (must_reconfig_gpio)
     {
+        scsi_dma_checksum_start();
         config_parity_sm_for_read();
         scsidma_config_gpio();
         dma_channel_set_irq0_enabled(SCSI_DMA_CH_A, true);
@@ -683,6 +733,7 @@ static void scsi_accel_rp2040_stopRead()
     dma_channel_abort(SCSI_DMA_CH_D);
     dma_channel_set_irq0_enabled(SCSI_DMA_CH_A, false);
     g_scsi_dma_state = SCSIDMA_IDLE;
+    scsi_dma_checksum_stop();
     SCSI_RELEASE_DATA_REQ();
     scsidma_config_gpio();
     pio_sm_set_enabled(SCSI_DMA_PIO, SCSI_PARITY_SM, false);
@@ -719,6 +770,125 @@ void scsi_accel_rp2040_finishRead(const uint8_t *data, uint32_t count, int *pari
     }
 }
 
+/****************************************/
+/* Short transfers without DMA          */
+/****************************************/
+
+// Commands, status and messages are only a few bytes long. Configuring the
+// parity state machine and the DMA chain for them takes longer than the
+// transfer itself, so the CPU moves the bytes directly to and from the data
+// state machine FIFOs. Parity is added with the lookup table and checked
+// with the functions from SCSIParity.h.
+
+// Wait for the async write state machine to send all bytes and the ACK of the last one
+static bool scsi_accel_rp2040_isShortWriteDone()
+{
+    return pio_sm_is_tx_fifo_empty(SCSI_DMA_PIO, SCSI_DATA_SM) &&
+           pio_sm_get_pc(SCSI_DMA_PIO, SCSI_DATA_SM) == g_scsi_dma.pio_offset_async_write &&
+           !SCSI_IN(ACK);
+}
+
+bool scsi_accel_rp2040_writeShort(const uint8_t *data, uint32_t count, volatile int *resetFlag)
+{
+    if (count > SCSI_ACCEL_SHORT_MAX || g_scsi_dma_state != SCSIDMA_IDLE || g_scsi_dma.syncOffset != 0)
+    {
+        return false;
+    }
+
+    SCSI_ENABLE_DATA_OUT();
+    pio_sm_init(SCSI_DMA_PIO, SCSI_DATA_SM, g_scsi_dma.pio_offset_async_write, &g_scsi_dma.pio_cfg_async_write);
+
+    // Pins are configured the same way as for DMA writes
+    g_scsi_dma_state = SCSIDMA_WRITE;
+    scsidma_config_gpio();
+    pio_sm_set_enabled(SCSI_DMA_PIO, SCSI_DATA_SM, true);
+
+    // TX FIFO is joined, so it has space for 8 bytes
+    uint32_t start = millis();
+    uint32_t sent = 0;
+    while (!*resetFlag)
+    {
+        if (sent < count && !pio_sm_is_tx_fifo_full(SCSI_DMA_PIO, SCSI_DATA_SM))
+        {
+            pio_sm_put(SCSI_DMA_PIO, SCSI_DATA_SM, g_scsi_parity_lookup[data[sent++]]);
+        }
+        else if (sent == count && scsi_accel_rp2040_isShortWriteDone())
+        {
+            break;
+        }
+        else if ((uint32_t)(millis() - start) > 5000)
+        {
+            log("scsi_accel_rp2040_writeShort() timeout");
+            scsi_accel_log_state();
+            *resetFlag = 1;
+            break;
+        }
+    }
+
+    g_scsi_dma_state = SCSIDMA_IDLE;
+    SCSI_RELEASE_DATA_REQ();
+    scsidma_config_gpio();
+    pio_sm_set_enabled(SCSI_DMA_PIO, SCSI_DATA_SM, false);
+    return true;
+}
+
+bool scsi_accel_rp2040_readShort(uint8_t *data, uint32_t count, int *parityError, volatile int *resetFlag)
+{
+    if (count > SCSI_ACCEL_SHORT_MAX || g_scsi_dma_state != SCSIDMA_IDLE || g_scsi_dma.syncOffset != 0)
+    {
+        return false;
+    }
+
+    // The lookup table address in register Y is not needed, the CPU
+    // checks the parity from the raw bus state instead.
+    pio_sm_init(SCSI_DMA_PIO, SCSI_DATA_SM, g_scsi_dma.pio_offset_read, &g_scsi_dma.pio_cfg_read);
+    pio_sm_exec(SCSI_DMA_PIO, SCSI_DATA_SM, pio_encode_set(pio_y, 0) | pio_encode_sideset(1, 1));
+
+    // Pins are configured the same way as for DMA reads
+    g_scsi_dma_state = SCSIDMA_READ;
+    scsidma_config_gpio();
+    pio_sm_set_enabled(SCSI_DMA_PIO, SCSI_DATA_SM, true);
+
+    // One dummy word in TX FIFO requests one byte
+    uint32_t start = millis();
+    uint32_t requested = 0;
+    uint32_t received = 0;
+    while (received < count && !*resetFlag)
+    {
+        if (requested < count && !pio_sm_is_tx_fifo_full(SCSI_DMA_PIO, SCSI_DATA_SM))
+        {
+            pio_sm_put(SCSI_DMA_PIO, SCSI_DATA_SM, 0);
+            requested++;
+        }
+
+        if (!pio_sm_is_rx_fifo_empty(SCSI_DMA_PIO, SCSI_DATA_SM))
+        {
+            // Bits 1-9 contain data and parity as active low
+            uint32_t word = pio_sm_get(SCSI_DMA_PIO, SCSI_DATA_SM);
+            uint16_t r = (~word >> 1) & SCSI_IO_DATA_MASK;
+            if (!scsiParityValid(r))
+            {
+                debuglog("Parity error in scsi_accel_rp2040_readShort(): ", (uint32_t)r);
+                *parityError = 1;
+            }
+            data[received++] = (uint8_t)r;
+        }
+        else if ((uint32_t)(millis() - start) > 5000)
+        {
+            log("scsi_accel_rp2040_readShort() timeout");
+            scsi_accel_log_state();
+            *resetFlag = 1;
+            break;
+        }
+    }
+
+    g_scsi_dma_state = SCSIDMA_IDLE;
+    SCSI_RELEASE_DATA_REQ();
+    scsidma_config_gpio();
+    pio_sm_set_enabled(SCSI_DMA_PIO, SCSI_DATA_SM, false);
+    return true;
+}
+
 /*******************************************************/
 /* Initialization functions common to read/write       */
 /*******************************************************/
@@ -917,6 +1087,7 @@ void scsi_accel_rp2040_init()
     channel_config_set_read_increment(&cfg, true);
     channel_config_set_write_increment(&cfg, false);
     channel_config_set_dreq(&cfg, pio_get_dreq(SCSI_DMA_PIO, SCSI_PARITY_SM, true));
+    channel_config_set_sniff_enable(&cfg, true);
     g_scsi_dma.dmacfg_write_chA = cfg;
 
     // Channel B: Addresses from scsi_parity PIO to lookup DMA READ_ADDR register
@@ -955,6 +1126,7 @@ void scsi_accel_rp2040_init()
     channel_config_set_read_increment(&cfg, false);
     channel_config_set_write_increment(&cfg, true);
     channel_config_set_dreq(&cfg, pio_get_dreq(SCSI_DMA_PIO, SCSI_PARITY_SM, false));
+    channel_config_set_sniff_enable(&cfg, true);
     g_scsi_dma.dmacfg_read_chA = cfg;
 
     // Channel B: Lookup from g_scsi_parity_check_lookup and copy to scsi_read_parity PIO
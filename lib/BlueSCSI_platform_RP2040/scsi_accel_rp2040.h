@@ -46,3 +46,13 @@ bool scsi_accel_rp2040_isReadFinished(const uint8_t* data);
 // If a parity error has been noticed in any buffer since starting the read, parityError is set to 1.
 void scsi_accel_rp2040_finishRead(const uint8_t *data, uint32_t count, int *parityError, volatile int *resetFlag);
 
+// Largest transfer for the short transfer functions below
+#define SCSI_ACCEL_SHORT_MAX 16
+
+// Transfer a few bytes, such as command or status, using the data state machine
+// directly from CPU without DMA. These block until the transfer is complete.
+// Returns false without doing anything if the count is too large, another
+// transfer is active or synchronous mode is enabled. In that case the caller
+// should use the functions above.
+bool scsi_accel_rp2040_writeShort(const uint8_t *data, uint32_t count, volatile int *resetFlag);
+bool scsi_accel_rp2040_readShort(uint8_t *data, uint32_t count, int *parityError, volatile int *resetFlag);
@@ -26,6 +26,7 @@ void platform_log(const char *s);
 // Timing and delay functions.
 // Arduino platform already provides these
 unsigned long millis(void);
+unsigned long micros(void);
 void delay(unsigned long ms);
 
 // Short delays, can be called from interrupt mode
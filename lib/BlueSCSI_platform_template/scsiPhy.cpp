@@ -8,6 +8,7 @@
 #include "BlueSCSI_config.h"
 
 #include <scsi2sd.h>
+#include <SCSIParity.h>
 extern "C" {
 #include <scsi.h>
 #include <scsi2sd_time.h>
@@ -33,28 +34,20 @@ extern "C" bool scsiStatusBSY()
 
 volatile uint8_t g_scsi_sts_selection;
 volatile uint8_t g_scsi_ctrl_bsy;
+static volatile uint32_t g_scsi_sel_time_us;
 
 void scsi_bsy_deassert_interrupt()
 {
     if (SCSI_IN(SEL) && !SCSI_IN(BSY))
     {
-        // Check if any of the targets we simulate is selected
-        uint8_t sel_bits = SCSI_IN_DATA();
-        int sel_id = -1;
-        for (int i = 0; i < S2S_MAX_TARGETS; i++)
-        {
-            if (scsiDev.targets[i].targetId <= 7 && scsiDev.targets[i].cfg)
-            {
-                if (sel_bits & (1 << scsiDev.targets[i].targetId))
-                {
-                    sel_id = scsiDev.targets[i].targetId;
-                    break;
-                }
-            }
-        }
+        g_scsi_sel_time_us = micros();
 
-        if (sel_id >= 0)
+        // Check if any of the targets we simulate is selected.
+        // The lowest ID wins if the initiator selects several at once.
+        uint8_t sel_bits = SCSI_IN_DATA() & scsiDev.targetIdMask;
+        if (sel_bits)
         {
+            int sel_id = __builtin_ctz(sel_bits);
             uint8_t atn_flag = SCSI_IN(ATN) ? SCSI_STS_SELECTION_ATN : 0;
             g_scsi_sts_selection = SCSI_STS_SELECTION_SUCCEEDED | atn_flag | sel_id;
         }
@@ -75,6 +68,9 @@ extern "C" bool scsiStatusSEL()
         // Releasing happens with bus release.
         g_scsi_ctrl_bsy = 0;
         SCSI_OUT(BSY, 1);
+
+        // Time from SEL to BSY, new longest one is logged from the main loop
+        scsiRecordSelLatency(micros() - g_scsi_sel_time_us);
     }
 
     return SCSI_IN(SEL);
@@ -230,6 +226,23 @@ extern "C" void scsiWriteByte(uint8_t value)
     scsiWriteOneByte(value);
 }
 
+extern "C" bool scsiWriteStatusMessage(uint8_t status, uint8_t message)
+{
+    scsiEnterPhase(STATUS);
+    scsiLogDataIn(&status, 1);
+    scsiWriteOneByte(status);
+
+    if (SCSI_IN(ATN) || scsiDev.resetFlag)
+    {
+        return false;
+    }
+
+    scsiEnterPhase(MESSAGE_IN);
+    scsiLogDataIn(&message, 1);
+    scsiWriteOneByte(message);
+    return true;
+}
+
 extern "C" void scsiWrite(const uint8_t* data, uint32_t count)
 {
     scsiLogDataIn(data, count);
@@ -266,12 +279,13 @@ extern "C" void scsiFinishWrite()
 /*********************/
 
 // Read one byte from SCSI host using the handshake mechanism.
-static inline uint8_t scsiReadOneByte(void)
+// Returns the data byte and DBP in bit 8.
+static inline uint16_t scsiReadOneByte(void)
 {
     SCSI_OUT(REQ, 1);
     SCSI_WAIT_ACTIVE(ACK);
     delay_100ns();
-    uint8_t r = SCSI_IN_DATA();
+    uint16_t r = SCSI_IN_DATA();
     SCSI_OUT(REQ, 0);
     SCSI_WAIT_INACTIVE(ACK);
 
@@ -280,7 +294,7 @@ static inline uint8_t scsiReadOneByte(void)
 
 extern "C" uint8_t scsiReadByte(void)
 {
-    uint8_t r = scsiReadOneByte();
+    uint8_t r = (uint8_t)scsiReadOneByte();
     scsiLogDataOut(&r, 1);
     return r;
 }
@@ -289,11 +303,35 @@ extern "C" void scsiRead(uint8_t* data, uint32_t count, int* parityError)
 {
     *parityError = 0;
 
-    for (uint32_t i = 0; i < count; i++)
+    // The handshake loop only collects the received bytes and parity bits,
+    // they are checked four bytes at a time.
+    uint32_t dataword = 0;
+    uint32_t parityword = 0;
+    uint32_t i;
+    for (i = 0; i < count; i++)
     {
         if (scsiDev.resetFlag) break;
 
-        data[i] = scsiReadOneByte();
+        uint16_t r = scsiReadOneByte();
+        data[i] = (uint8_t)r;
+
+        uint32_t shift = (i & 3) * 8;
+        dataword |= (uint32_t)(r & 0xFF) << shift;
+        parityword |= (uint32_t)(r >> 8) << shift;
+
+        if ((i & 3) == 3)
+        {
+            if (!scsiParityValid32(dataword, parityword)) *parityError = 1;
+            dataword = 0;
+            parityword = 0;
+        }
+    }
+
+    if ((i & 3) != 0)
+    {
+        // Bytes of the last partial word, unused bytes have DBP set
+        uint32_t unused = 0x01010101 << ((i & 3) * 8);
+        if (!scsiParityValid32(dataword, parityword | unused)) *parityError = 1;
     }
 
     scsiLogDataOut(data, count);
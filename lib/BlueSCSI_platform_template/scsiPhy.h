@@ -46,6 +46,12 @@ void scsiEnterBusFree(void);
 void scsiWrite(const uint8_t* data, uint32_t count);
 void scsiRead(uint8_t* data, uint32_t count, int* parityError);
 void scsiWriteByte(uint8_t value);
+
+// Send status byte and the message following it at the end of a command,
+// changing phases directly from STATUS to MESSAGE IN.
+// Returns false without sending the message if the initiator asserted ATN
+// after the status byte.
+bool scsiWriteStatusMessage(uint8_t status, uint8_t message);
 uint8_t scsiReadByte(void);
 
 // Non-blocking data transfer.
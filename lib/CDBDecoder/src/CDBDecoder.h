@@ -0,0 +1,125 @@
+/*
+ * Decoding helpers for SCSI command descriptor block fields.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// The field layout of a CDB depends only on its group code (top 3 bits
+// of the opcode), so the same accessors work for READ/WRITE/VERIFY/SEEK
+// and friends in all of their 6, 10, 12 and 16 byte forms.
+// All functions are inline and usable from both C and C++ code.
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CDB_FLAG_RELADR 0x01
+#define CDB_FLAG_FUA    0x08
+#define CDB_FLAG_DPO    0x10
+
+// Big-endian field readers
+static inline uint32_t cdbGet16(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 8) | p[1];
+}
+
+static inline uint32_t cdbGet24(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+}
+
+static inline uint32_t cdbGet32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint64_t cdbGet64(const uint8_t *p)
+{
+    return ((uint64_t)cdbGet32(p) << 32) | cdbGet32(p + 4);
+}
+
+// Length of the CDB for given opcode according to its group code.
+// Returns 0 for the reserved and vendor specific groups.
+static inline uint8_t cdbLength(uint8_t opcode)
+{
+    switch (opcode >> 5)
+    {
+        case 0: return 6;
+        case 1: return 10;
+        case 2: return 10;
+        case 4: return 16;
+        case 5: return 12;
+        default: return 0;
+    }
+}
+
+// Logical block address of a READ/WRITE style command.
+// 6-byte commands carry a 21-bit address in bytes 1..3.
+static inline uint64_t cdbLBA(const uint8_t *cdb)
+{
+    switch (cdbLength(cdb[0]))
+    {
+        case 6: return cdbGet24(cdb + 1) & 0x1FFFFF;
+        case 10: return cdbGet32(cdb + 2);
+        case 12: return cdbGet32(cdb + 2);
+        case 16: return cdbGet64(cdb + 2);
+        default: return 0;
+    }
+}
+
+// Raw transfer length field, as stored in the CDB.
+static inline uint32_t cdbTransferLength(const uint8_t *cdb)
+{
+    switch (cdbLength(cdb[0]))
+    {
+        case 6: return cdb[4];
+        case 10: return cdbGet16(cdb + 7);
+        case 12: return cdbGet32(cdb + 6);
+        case 16: return cdbGet32(cdb + 10);
+        default: return 0;
+    }
+}
+
+// Number of blocks for READ(6)/WRITE(6) style commands,
+// where a transfer length of 0 means 256 blocks.
+static inline uint32_t cdbBlockCount(const uint8_t *cdb)
+{
+    uint32_t length = cdbTransferLength(cdb);
+    if (length == 0 && cdbLength(cdb[0]) == 6)
+    {
+        length = 256;
+    }
+    return length;
+}
+
+// Flag bits (DPO/FUA/RELADR) of byte 1, only defined for 10 byte and longer forms.
+static inline uint8_t cdbFlags(const uint8_t *cdb)
+{
+    return (cdbLength(cdb[0]) > 6) ? (cdb[1] & (CDB_FLAG_DPO | CDB_FLAG_FUA | CDB_FLAG_RELADR)) : 0;
+}
+
+// Logical unit number from byte 1, as used by SCSI-1 hosts.
+static inline uint8_t cdbLUN(const uint8_t *cdb)
+{
+    return cdb[1] >> 5;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,134 @@
+#include "CDBDecoder.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+bool test_lengths()
+{
+    bool status = true;
+
+    COMMENT("test_lengths()");
+    TEST(cdbLength(0x00) == 6);  // TEST UNIT READY
+    TEST(cdbLength(0x08) == 6);  // READ(6)
+    TEST(cdbLength(0x1F) == 6);
+    TEST(cdbLength(0x28) == 10); // READ(10)
+    TEST(cdbLength(0x5A) == 10); // MODE SENSE(10)
+    TEST(cdbLength(0x88) == 16); // READ(16)
+    TEST(cdbLength(0xA8) == 12); // READ(12)
+    TEST(cdbLength(0x7F) == 0);  // Reserved group
+    TEST(cdbLength(0xC0) == 0);  // Vendor specific
+    TEST(cdbLength(0xFF) == 0);
+
+    return status;
+}
+
+bool test_read6()
+{
+    bool status = true;
+
+    COMMENT("test_read6()");
+    const uint8_t cdb[6] = {0x08, 0xFF, 0x34, 0x56, 0x10, 0x00};
+    TEST(cdbLBA(cdb) == 0x1F3456);
+    TEST(cdbLUN(cdb) == 7);
+    TEST(cdbTransferLength(cdb) == 0x10);
+    TEST(cdbBlockCount(cdb) == 0x10);
+    TEST(cdbFlags(cdb) == 0);
+
+    COMMENT("Transfer length 0 means 256 blocks");
+    const uint8_t cdb0[6] = {0x0A, 0x00, 0x00, 0x01, 0x00, 0x00};
+    TEST(cdbLBA(cdb0) == 1);
+    TEST(cdbTransferLength(cdb0) == 0);
+    TEST(cdbBlockCount(cdb0) == 256);
+
+    return status;
+}
+
+bool test_read10()
+{
+    bool status = true;
+
+    COMMENT("test_read10()");
+    const uint8_t cdb[10] = {0x28, 0x18, 0x89, 0xAB, 0xCD, 0xEF, 0x00, 0x12, 0x34, 0x00};
+    TEST(cdbLBA(cdb) == 0x89ABCDEF);
+    TEST(cdbTransferLength(cdb) == 0x1234);
+    TEST(cdbBlockCount(cdb) == 0x1234);
+    TEST(cdbFlags(cdb) == (CDB_FLAG_DPO | CDB_FLAG_FUA));
+
+    COMMENT("Transfer length 0 means no blocks");
+    const uint8_t cdb0[10] = {0x2A, 0x01, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00};
+    TEST(cdbLBA(cdb0) == 2);
+    TEST(cdbBlockCount(cdb0) == 0);
+    TEST(cdbFlags(cdb0) == CDB_FLAG_RELADR);
+
+    return status;
+}
+
+bool test_read12()
+{
+    bool status = true;
+
+    COMMENT("test_read12()");
+    const uint8_t cdb[12] = {0xA8, 0x08, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x00, 0x00};
+    TEST(cdbLBA(cdb) == 0x00010203);
+    TEST(cdbTransferLength(cdb) == 0x04050607);
+    TEST(cdbFlags(cdb) == CDB_FLAG_FUA);
+
+    return status;
+}
+
+bool test_read16()
+{
+    bool status = true;
+
+    COMMENT("test_read16()");
+    const uint8_t cdb[16] = {0x88, 0x00,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF,
+        0x00, 0x01, 0x00, 0x00, 0x00, 0x00};
+    TEST(cdbLBA(cdb) == 0x0123456789ABCDEFULL);
+    TEST(cdbTransferLength(cdb) == 0x00010000);
+    TEST(cdbBlockCount(cdb) == 0x00010000);
+
+    return status;
+}
+
+bool test_fields()
+{
+    bool status = true;
+
+    COMMENT("test_fields()");
+    const uint8_t data[8] = {0xFE, 0xDC, 0xBA, 0x98, 0x76, 0x54, 0x32, 0x10};
+    TEST(cdbGet16(data) == 0xFEDC);
+    TEST(cdbGet24(data) == 0xFEDCBA);
+    TEST(cdbGet32(data) == 0xFEDCBA98);
+    TEST(cdbGet64(data) == 0xFEDCBA9876543210ULL);
+
+    COMMENT("Unknown groups decode as zero");
+    const uint8_t vendor[10] = {0xCD, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    TEST(cdbLBA(vendor) == 0);
+    TEST(cdbTransferLength(vendor) == 0);
+
+    return status;
+}
+
+int main()
+{
+    if (test_lengths() && test_read6() && test_read10() &&
+        test_read12() && test_read16() && test_fields())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -0,0 +1,183 @@
+/*
+ * Track bookkeeping for CD-R/RW recorder emulation.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "CDRecorder.h"
+#include <string.h>
+
+void CDRecorder::reset()
+{
+    m_track_open = false;
+    m_track_mode = 0;
+    m_track_count = 0;
+    m_opened_by_write = false;
+    m_cue_sheet = false;
+    m_block_size = 0;
+    m_nwa = 0;
+    m_track_start = 0;
+    m_write_blocks = 0;
+    memset(m_tracks, 0, sizeof(m_tracks));
+}
+
+bool CDRecorder::addCueTrack(uint32_t start, uint8_t mode, uint16_t block_size)
+{
+    if (m_track_count >= CDRECORDER_MAX_TRACKS ||
+        (m_block_size != 0 && m_block_size != block_size))
+    {
+        return false;
+    }
+
+    if (m_track_count == 0)
+    {
+        m_track_mode = mode;
+    }
+
+    m_cue_sheet = true;
+    m_block_size = block_size;
+    m_tracks[m_track_count].start = start;
+    m_tracks[m_track_count].mode = mode;
+    m_track_count++;
+    return true;
+}
+
+bool CDRecorder::writeStart(uint32_t lba, uint32_t blocks, uint8_t mode, uint16_t block_size, bool sao)
+{
+    m_write_blocks = 0;
+    m_opened_by_write = false;
+
+    if (lba != m_nwa || (!m_track_open && !sao && m_track_count >= CDRECORDER_MAX_TRACKS))
+    {
+        return false;
+    }
+
+    if (!m_track_open)
+    {
+        m_track_open = true;
+        m_opened_by_write = true;
+        m_track_start = lba;
+        m_track_mode = mode;
+        m_block_size = block_size;
+    }
+
+    m_write_blocks = blocks;
+    return true;
+}
+
+void CDRecorder::writeDone(bool ok)
+{
+    if (ok)
+    {
+        m_nwa += m_write_blocks;
+    }
+    else if (m_opened_by_write)
+    {
+        // Nothing was recorded, the track is still blank
+        m_track_open = false;
+        if (m_track_count == 0)
+        {
+            m_block_size = 0;
+        }
+    }
+
+    m_write_blocks = 0;
+    m_opened_by_write = false;
+}
+
+bool CDRecorder::closeTrack()
+{
+    if (!m_track_open || m_track_count >= CDRECORDER_MAX_TRACKS)
+    {
+        return false;
+    }
+
+    m_tracks[m_track_count].start = m_track_start;
+    m_tracks[m_track_count].mode = m_track_mode;
+    m_track_count++;
+    m_track_open = false;
+    return true;
+}
+
+bool CDRecorder::trackInfo(bool by_number, uint32_t value, uint32_t capacity, uint8_t mode,
+                           CDRecorderTrackInfo *info) const
+{
+    // Data written in Session-At-Once mode belongs to the cue sheet tracks
+    uint32_t count = m_track_count;
+    uint32_t invisible_start = (m_track_open && !m_cue_sheet) ? m_track_start : m_nwa;
+
+    uint32_t idx = count;
+    if (by_number)
+    {
+        idx = (value == 0xFF) ? count : value - 1;
+    }
+    else
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t end = (i + 1 < count) ? m_tracks[i + 1].start : invisible_start;
+            if (value < end)
+            {
+                idx = i;
+                break;
+            }
+        }
+    }
+
+    if (idx > count)
+    {
+        return false;
+    }
+
+    memset(info, 0, sizeof(*info));
+    info->number = idx + 1;
+
+    if (idx < count)
+    {
+        uint32_t end = (idx + 1 < count) ? m_tracks[idx + 1].start : invisible_start;
+        info->mode = m_tracks[idx].mode;
+        info->start = m_tracks[idx].start;
+        info->size = end - info->start;
+    }
+    else
+    {
+        info->invisible = true;
+        info->blank = !m_track_open;
+        info->mode = m_track_open ? m_track_mode : mode;
+        info->start = invisible_start;
+        info->nwa = m_nwa;
+        info->free_blocks = (capacity > m_nwa) ? capacity - m_nwa : 0;
+        info->size = (capacity > invisible_start) ? capacity - invisible_start : 0;
+    }
+
+    return true;
+}
+
+bool CDRecorder::blankTrackInfo(bool by_number, uint32_t value, uint32_t capacity, uint8_t mode,
+                                CDRecorderTrackInfo *info)
+{
+    if (by_number && value != 1 && value != 0xFF)
+    {
+        return false;
+    }
+
+    memset(info, 0, sizeof(*info));
+    info->number = 1;
+    info->mode = mode;
+    info->invisible = true;
+    info->blank = true;
+    info->free_blocks = capacity;
+    info->size = capacity;
+    return true;
+}
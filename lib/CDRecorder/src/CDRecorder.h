@@ -0,0 +1,114 @@
+/*
+ * Track bookkeeping for CD-R/RW recorder emulation.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Tracks are recorded sequentially from the next writable address (NWA).
+// A write is first checked with writeStart() and the NWA moves only when
+// writeDone() reports that the data was stored, so a failed write can be
+// retried by the host at the same address.
+//
+// The track after the last closed one is the invisible track, which extends
+// to the end of the disc. Refer to T10/1545-D MMC-4 Revision 5a,
+// READ TRACK INFORMATION.
+
+#pragma once
+
+#include <stdint.h>
+
+#define CDRECORDER_MAX_TRACKS 99
+
+struct CDRecorderTrack
+{
+    uint32_t start;
+    uint8_t mode; // CUETrackMode
+};
+
+// Values reported by READ TRACK INFORMATION
+struct CDRecorderTrackInfo
+{
+    uint8_t number;
+    uint8_t mode; // CUETrackMode
+    bool invisible; // Track after the last closed one
+    bool blank; // Nothing has been written to the invisible track
+    uint32_t start;
+    uint32_t size;
+    uint32_t nwa; // Only for the invisible track
+    uint32_t free_blocks; // Only for the invisible track
+};
+
+class CDRecorder
+{
+public:
+    CDRecorder() { reset(); }
+
+    // Forget all tracks, disc is blank
+    void reset();
+
+    // Tracks closed, or listed in the Session-At-Once cue sheet
+    uint8_t trackCount() const { return m_track_count; }
+    const CDRecorderTrack &track(int idx) const { return m_tracks[idx]; }
+
+    // Data has been written after the last closed track
+    bool trackOpen() const { return m_track_open; }
+    uint32_t trackStart() const { return m_track_start; }
+    uint8_t trackMode() const { return m_track_mode; }
+
+    // True if anything has been recorded or listed in a cue sheet
+    bool recorded() const { return m_track_count > 0 || m_track_open; }
+
+    // Block size shared by all tracks of the disc, 0 if not set yet
+    uint16_t blockSize() const { return m_block_size; }
+
+    uint32_t nextWritable() const { return m_nwa; }
+
+    // Add a track from SEND CUE SHEET. Returns false if the block size
+    // differs from earlier tracks or there are too many tracks.
+    bool addCueTrack(uint32_t start, uint8_t mode, uint16_t block_size);
+
+    // Check a write of blocks at lba. In Track-At-Once mode the first write
+    // opens a new track, in Session-At-Once mode the tracks are already
+    // known from the cue sheet. Returns false if lba is not the NWA or no
+    // more tracks can be added.
+    bool writeStart(uint32_t lba, uint32_t blocks, uint8_t mode, uint16_t block_size, bool sao);
+
+    // Result of the write checked last with writeStart()
+    void writeDone(bool ok);
+
+    // Close the open track. Returns false if there is no open track.
+    bool closeTrack();
+
+    // Find track by number (0xFF for the invisible track) or by an address
+    // in it. capacity is the disc size in blocks, mode is reported for a
+    // blank invisible track. Returns false if there is no such track.
+    bool trackInfo(bool by_number, uint32_t value, uint32_t capacity, uint8_t mode,
+                   CDRecorderTrackInfo *info) const;
+
+    // Same as trackInfo() of a blank disc
+    static bool blankTrackInfo(bool by_number, uint32_t value, uint32_t capacity, uint8_t mode,
+                               CDRecorderTrackInfo *info);
+
+private:
+    bool m_track_open;
+    uint8_t m_track_mode;
+    uint8_t m_track_count;
+    bool m_opened_by_write; // Track was opened by the pending write
+    bool m_cue_sheet; // Tracks are from Session-At-Once cue sheet
+    uint16_t m_block_size;
+    uint32_t m_nwa;
+    uint32_t m_track_start;
+    uint32_t m_write_blocks; // Blocks of the pending write
+    CDRecorderTrack m_tracks[CDRECORDER_MAX_TRACKS];
+};
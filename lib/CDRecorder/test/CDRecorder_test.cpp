@@ -0,0 +1,194 @@
+#include "CDRecorder.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+// Track modes are stored as given, same values as CUETrackMode
+#define MODE_AUDIO 0
+#define MODE_DATA 1
+
+#define CAPACITY 300000
+
+// Write in chunks the way a host does, failing the given chunk once
+static bool write_track(CDRecorder &cdr, uint32_t blocks, uint32_t chunk, uint8_t mode, int fail_chunk = -1)
+{
+    uint16_t block_size = (mode == MODE_AUDIO) ? 2352 : 2048;
+    uint32_t written = 0;
+    int n = 0;
+    while (written < blocks)
+    {
+        uint32_t len = (blocks - written < chunk) ? blocks - written : chunk;
+        if (!cdr.writeStart(cdr.nextWritable(), len, mode, block_size, false)) return false;
+        if (n++ == fail_chunk)
+        {
+            cdr.writeDone(false);
+            continue;
+        }
+        cdr.writeDone(true);
+        written += len;
+    }
+    return true;
+}
+
+/*****************/
+/* Test cases    */
+/*****************/
+
+bool test_track_at_once()
+{
+    bool status = true;
+    COMMENT("test_track_at_once()");
+
+    CDRecorder cdr;
+    CDRecorderTrackInfo info;
+    TEST(!cdr.recorded());
+    TEST(cdr.trackInfo(true, 0xFF, CAPACITY, MODE_DATA, &info));
+    TEST(info.number == 1 && info.invisible && info.blank);
+    TEST(info.start == 0 && info.nwa == 0 && info.free_blocks == CAPACITY);
+
+    COMMENT("Blank disc without recorder state");
+    CDRecorderTrackInfo blank;
+    uint32_t queries[][2] = {{1, 0xFF}, {1, 1}, {1, 2}, {1, 0}, {0, 0}, {0, 5000}};
+    for (auto &q : queries)
+    {
+        bool found = cdr.trackInfo(q[0], q[1], CAPACITY, MODE_AUDIO, &info);
+        TEST(CDRecorder::blankTrackInfo(q[0], q[1], CAPACITY, MODE_AUDIO, &blank) == found);
+        TEST(!found || memcmp(&info, &blank, sizeof(info)) == 0);
+    }
+
+    COMMENT("NWA follows written data");
+    TEST(write_track(cdr, 1000, 32, MODE_DATA));
+    TEST(cdr.nextWritable() == 1000);
+    TEST(cdr.trackOpen() && cdr.blockSize() == 2048);
+    TEST(cdr.trackInfo(true, 0xFF, CAPACITY, MODE_DATA, &info));
+    TEST(info.number == 1 && info.invisible && !info.blank);
+    TEST(info.start == 0 && info.nwa == 1000 && info.free_blocks == CAPACITY - 1000);
+
+    COMMENT("Closed track and next invisible track");
+    TEST(cdr.closeTrack());
+    TEST(!cdr.closeTrack());
+    TEST(cdr.trackCount() == 1);
+    TEST(cdr.trackInfo(true, 1, CAPACITY, MODE_DATA, &info));
+    TEST(!info.invisible && info.start == 0 && info.size == 1000 && info.mode == MODE_DATA);
+    TEST(cdr.trackInfo(true, 2, CAPACITY, MODE_AUDIO, &info));
+    TEST(info.invisible && info.blank && info.start == 1000 && info.nwa == 1000);
+    TEST(info.mode == MODE_AUDIO && info.size == CAPACITY - 1000);
+    TEST(!cdr.trackInfo(true, 3, CAPACITY, MODE_DATA, &info));
+    TEST(!cdr.trackInfo(true, 0, CAPACITY, MODE_DATA, &info));
+
+    COMMENT("Writes must start at NWA");
+    TEST(!cdr.writeStart(999, 10, MODE_DATA, 2048, false));
+    TEST(!cdr.writeStart(1001, 10, MODE_DATA, 2048, false));
+    TEST(!cdr.trackOpen());
+
+    COMMENT("Track lookup by address");
+    TEST(write_track(cdr, 500, 27, MODE_DATA));
+    TEST(cdr.closeTrack());
+    TEST(cdr.trackInfo(false, 999, CAPACITY, MODE_DATA, &info) && info.number == 1);
+    TEST(cdr.trackInfo(false, 1000, CAPACITY, MODE_DATA, &info) && info.number == 2);
+    TEST(info.start == 1000 && info.size == 500);
+    TEST(cdr.trackInfo(false, 1500, CAPACITY, MODE_DATA, &info) && info.number == 3 && info.invisible);
+
+    return status;
+}
+
+bool test_failed_writes()
+{
+    bool status = true;
+    COMMENT("test_failed_writes()");
+
+    CDRecorder cdr;
+    CDRecorderTrackInfo info;
+
+    COMMENT("Failed write in middle of track is retried at same address");
+    TEST(write_track(cdr, 1000, 32, MODE_DATA, 5));
+    TEST(cdr.nextWritable() == 1000);
+    TEST(cdr.closeTrack());
+    TEST(cdr.trackInfo(true, 1, CAPACITY, MODE_DATA, &info) && info.size == 1000);
+
+    COMMENT("Failed first write leaves the track blank");
+    TEST(cdr.writeStart(1000, 32, MODE_AUDIO, 2352, false));
+    cdr.writeDone(false);
+    TEST(!cdr.trackOpen());
+    TEST(cdr.nextWritable() == 1000);
+    TEST(cdr.trackInfo(true, 0xFF, CAPACITY, MODE_DATA, &info));
+    TEST(info.number == 2 && info.blank && info.start == 1000 && info.nwa == 1000);
+    TEST(!cdr.closeTrack());
+    TEST(cdr.trackCount() == 1);
+
+    COMMENT("Failed first write on blank disc does not fix block size");
+    CDRecorder blank;
+    TEST(blank.writeStart(0, 16, MODE_AUDIO, 2352, false));
+    blank.writeDone(false);
+    TEST(!blank.recorded() && blank.blockSize() == 0);
+
+    COMMENT("Rejected write does not move NWA");
+    TEST(!cdr.writeStart(1234, 32, MODE_DATA, 2048, false));
+    cdr.writeDone(true);
+    TEST(cdr.nextWritable() == 1000);
+
+    return status;
+}
+
+bool test_session_at_once()
+{
+    bool status = true;
+    COMMENT("test_session_at_once()");
+
+    CDRecorder cdr;
+    CDRecorderTrackInfo info;
+    TEST(cdr.addCueTrack(0, MODE_AUDIO, 2352));
+    TEST(cdr.addCueTrack(15000, MODE_AUDIO, 2352));
+    TEST(!cdr.addCueTrack(30000, MODE_DATA, 2048));
+    TEST(cdr.trackCount() == 2 && cdr.trackMode() == MODE_AUDIO);
+
+    COMMENT("Failed chunk is retried at same address");
+    int failed = 0;
+    while (cdr.nextWritable() < 20000 && status)
+    {
+        uint32_t lba = cdr.nextWritable();
+        TEST(cdr.writeStart(lba, 27, cdr.trackMode(), cdr.blockSize(), true));
+        cdr.writeDone(!(lba == 2700 && failed++ == 0));
+    }
+    TEST(failed == 2);
+    TEST(cdr.nextWritable() == 20007);
+    TEST(cdr.trackInfo(false, 16000, CAPACITY, MODE_DATA, &info));
+    TEST(info.number == 2 && info.start == 15000);
+    TEST(cdr.trackInfo(true, 0xFF, CAPACITY, MODE_DATA, &info));
+    TEST(info.number == 3 && info.invisible && !info.blank && info.start == 20007);
+
+    COMMENT("Track list is full");
+    CDRecorder full;
+    for (int i = 0; i < CDRECORDER_MAX_TRACKS; i++)
+    {
+        full.addCueTrack(i * 1000, MODE_DATA, 2048);
+    }
+    TEST(!full.addCueTrack(CDRECORDER_MAX_TRACKS * 1000, MODE_DATA, 2048));
+    TEST(full.trackCount() == CDRECORDER_MAX_TRACKS);
+    TEST(!full.writeStart(0, 10, MODE_DATA, 2048, false));
+    TEST(full.writeStart(0, 10, MODE_DATA, 2048, true));
+
+    return status;
+}
+
+int main()
+{
+    if (test_track_at_once() && test_failed_writes() && test_session_at_once())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
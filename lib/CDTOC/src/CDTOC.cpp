@@ -0,0 +1,307 @@
+/*
+ * READ TOC responses for a CD image described by a cue sheet.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "CDTOC.h"
+#include <string.h>
+
+static const uint8_t SessionTOC[] =
+{
+    0x00, // toc length, MSB
+    0x0A, // toc length, LSB
+    0x01, // First session number
+    0x01, // Last session number,
+    // TRACK 1 Descriptor
+    0x00, // reserved
+    0x14, // Q sub-channel encodes current position, Digital track
+    0x01, // First track number in last complete session
+    0x00, // Reserved
+    0x00,0x00,0x00,0x00 // LBA of first track in last session
+};
+
+// Header and A0, A1, A2 descriptors of full TOC
+static const uint8_t FullTOCHeader[] =
+{
+    0x00, //  0: toc length, MSB
+    0x2E, //  1: toc length, LSB
+    0x01, //  2: First session number
+    0x01, //  3: Last session number,
+    // A0 Descriptor
+    0x01, //  4: session number
+    0x14, //  5: ADR/Control
+    0x00, //  6: TNO
+    0xA0, //  7: POINT
+    0x00, //  8: Min
+    0x00, //  9: Sec
+    0x00, // 10: Frame
+    0x00, // 11: Zero
+    0x01, // 12: First Track number.
+    0x00, // 13: Disc type 00 = Mode 1
+    0x00, // 14: PFRAME
+    // A1
+    0x01, // 15: session number
+    0x14, // 16: ADR/Control
+    0x00, // 17: TNO
+    0xA1, // 18: POINT
+    0x00, // 19: Min
+    0x00, // 20: Sec
+    0x00, // 21: Frame
+    0x00, // 22: Zero
+    0x01, // 23: Last Track number
+    0x00, // 24: PSEC
+    0x00, // 25: PFRAME
+    // A2
+    0x01, // 26: session number
+    0x14, // 27: ADR/Control
+    0x00, // 28: TNO
+    0xA2, // 29: POINT
+    0x00, // 30: Min
+    0x00, // 31: Sec
+    0x00, // 32: Frame
+    0x00, // 33: Zero
+    0x00, // 34: LEADOUT position
+    0x00, // 35: leadout PSEC
+    0x00, // 36: leadout PFRAME
+};
+
+void CDTOC::LBA2MSF(int32_t LBA, uint8_t* MSF, bool relative)
+{
+    if (!relative) {
+        LBA += 150;
+    }
+    uint32_t ulba = LBA;
+    if (LBA < 0) {
+        ulba = LBA * -1;
+    }
+
+    MSF[2] = ulba % 75; // Frames
+    uint32_t rem = ulba / 75;
+
+    MSF[1] = rem % 60; // Seconds
+    MSF[0] = rem / 60; // Minutes
+}
+
+void CDTOC::LBA2MSFBCD(int32_t LBA, uint8_t* MSF, bool relative)
+{
+    LBA2MSF(LBA, MSF, relative);
+    MSF[0] = ((MSF[0] / 10) << 4) | (MSF[0] % 10);
+    MSF[1] = ((MSF[1] / 10) << 4) | (MSF[1] % 10);
+    MSF[2] = ((MSF[2] / 10) << 4) | (MSF[2] % 10);
+}
+
+static uint8_t controlADR(uint8_t mode)
+{
+    return (mode == CUETrack_AUDIO) ? 0x10 : 0x14; // Audio or digital track
+}
+
+// Track descriptor of formatted TOC
+static void formatTrackInfo(uint8_t number, uint8_t mode, uint32_t data_start, uint8_t *dest, bool use_MSF_time)
+{
+    dest[0] = 0; // Reserved
+    dest[1] = controlADR(mode);
+    dest[2] = number;
+    dest[3] = 0; // Reserved
+
+    if (use_MSF_time)
+    {
+        // Time in minute-second-frame format
+        dest[4] = 0;
+        CDTOC::LBA2MSF(data_start, &dest[5], false);
+    }
+    else
+    {
+        // Time as logical block address
+        dest[4] = (data_start >> 24) & 0xFF;
+        dest[5] = (data_start >> 16) & 0xFF;
+        dest[6] = (data_start >>  8) & 0xFF;
+        dest[7] = (data_start >>  0) & 0xFF;
+    }
+}
+
+// Track descriptor of raw TOC
+static void formatRawTrackInfo(const CDTOCTrack *track, uint8_t *dest, bool useBCD)
+{
+    dest[0] = 0x01; // Session always 1
+    dest[1] = controlADR(track->mode);
+    dest[2] = 0x00; // "TNO", always 0?
+    dest[3] = track->number; // "POINT", contains track number
+    // Next three are ATIME. The spec doesn't directly address how these
+    // should be reported in the TOC, just giving a description of Q-channel
+    // data from Red Book/ECMA-130. On all disks tested so far these are
+    // given as 00/00/00.
+    dest[4] = 0x00;
+    dest[5] = 0x00;
+    dest[6] = 0x00;
+    dest[7] = 0; // HOUR
+
+    if (useBCD) {
+        CDTOC::LBA2MSFBCD(track->data_start, &dest[8], false);
+    } else {
+        CDTOC::LBA2MSF(track->data_start, &dest[8], false);
+    }
+}
+
+CDTOC::CDTOC()
+{
+    m_trackcount = 0;
+    m_leadout = 1;
+    m_catalog[0] = '\0';
+}
+
+uint8_t CDTOC::firstTrack() const
+{
+    return (m_trackcount > 0) ? m_tracks[0].number : 0;
+}
+
+uint8_t CDTOC::lastTrack() const
+{
+    return (m_trackcount > 0) ? m_tracks[m_trackcount - 1].number : 0;
+}
+
+void CDTOC::build(CUEParser &parser, uint64_t image_size, uint32_t leadout)
+{
+    m_trackcount = 0;
+
+    CUETrackInfo lasttrack = {};
+    const CUETrackInfo *trackinfo;
+    while ((trackinfo = parser.next_track()) != NULL && m_trackcount < CDTOC_MAX_TRACKS)
+    {
+        CDTOCTrack &track = m_tracks[m_trackcount++];
+        track.number = trackinfo->track_number;
+        track.mode = trackinfo->track_mode;
+        track.track_start = trackinfo->track_start;
+        track.data_start = trackinfo->data_start;
+        lasttrack = *trackinfo;
+    }
+
+    memcpy(m_catalog, parser.catalog(), sizeof(m_catalog));
+
+    // Lead-out starts after the data of last track in the image
+    if (m_trackcount == 0)
+    {
+        m_leadout = 1;
+    }
+    else if (leadout != 0)
+    {
+        m_leadout = leadout;
+    }
+    else
+    {
+        uint32_t lastTrackBlocks = (image_size - lasttrack.file_offset) / lasttrack.sector_length;
+        m_leadout = lasttrack.track_start + lastTrackBlocks;
+    }
+}
+
+int CDTOC::findTrack(uint32_t lba, int hint) const
+{
+    if (m_trackcount == 0 || lba < m_tracks[0].track_start)
+    {
+        return -1;
+    }
+
+    int i = hint;
+    if (i < 0) i = 0;
+    if (i >= m_trackcount) i = m_trackcount - 1;
+
+    while (i > 0 && lba < m_tracks[i].track_start)
+    {
+        i--;
+    }
+
+    while (i + 1 < m_trackcount && lba >= m_tracks[i + 1].track_start)
+    {
+        i++;
+    }
+
+    return i;
+}
+
+uint32_t CDTOC::formattedTOC(bool msf, uint8_t track, uint8_t *dest) const
+{
+    // Descriptors of requested track and the ones after it
+    int count = 0;
+    for (int i = 0; i < m_trackcount; i++)
+    {
+        if (track <= m_tracks[i].number)
+        {
+            formatTrackInfo(m_tracks[i].number, m_tracks[i].mode, m_tracks[i].data_start,
+                            &dest[4 + 8 * count], msf);
+            count++;
+        }
+    }
+
+    if (track != 0xAA && count == 0)
+    {
+        // Unknown track requested
+        return 0;
+    }
+
+    uint8_t leadout_mode = (m_trackcount > 0) ? m_tracks[m_trackcount - 1].mode : (uint8_t)CUETrack_MODE1_2048;
+    formatTrackInfo(0xAA, leadout_mode, m_leadout, &dest[4 + 8 * count], msf);
+    count++;
+
+    uint16_t toc_length = 2 + count * 8;
+    dest[0] = toc_length >> 8;
+    dest[1] = toc_length & 0xFF;
+    dest[2] = (m_trackcount > 0) ? m_tracks[0].number : 0xFF;
+    dest[3] = lastTrack();
+    return 2 + toc_length;
+}
+
+uint32_t CDTOC::sessionInfo(uint8_t *dest) const
+{
+    // Session info reports the first track
+    memcpy(dest, SessionTOC, sizeof(SessionTOC));
+    if (m_trackcount > 0)
+    {
+        formatTrackInfo(m_tracks[0].number, m_tracks[0].mode, m_tracks[0].data_start, &dest[4], false);
+    }
+    return sizeof(SessionTOC);
+}
+
+uint32_t CDTOC::fullTOC(bool bcd, uint8_t *dest) const
+{
+    memcpy(dest, FullTOCHeader, sizeof(FullTOCHeader));
+    uint32_t len = sizeof(FullTOCHeader);
+
+    for (int i = 0; i < m_trackcount; i++)
+    {
+        formatRawTrackInfo(&m_tracks[i], &dest[len], bcd);
+        len += 11;
+    }
+
+    // First and last track numbers
+    dest[12] = (m_trackcount > 0) ? m_tracks[0].number : 0xFF;
+    if (m_trackcount > 0)
+    {
+        dest[5] = controlADR(m_tracks[0].mode);
+        dest[16] = dest[27] = controlADR(m_tracks[m_trackcount - 1].mode);
+        dest[23] = m_tracks[m_trackcount - 1].number;
+    }
+
+    // Leadout track position
+    if (bcd) {
+        LBA2MSFBCD(m_leadout, &dest[34], false);
+    } else {
+        LBA2MSF(m_leadout, &dest[34], false);
+    }
+
+    // Correct the record length in header
+    uint16_t toclen = len - 2;
+    dest[0] = toclen >> 8;
+    dest[1] = toclen & 0xFF;
+    return len;
+}
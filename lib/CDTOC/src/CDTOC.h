@@ -0,0 +1,87 @@
+/*
+ * READ TOC responses for a CD image described by a cue sheet.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Hosts read the TOC in several formats repeatedly when mounting a disc.
+// The cue sheet is parsed once and only the track boundaries are kept, the
+// responses are formatted from them on each request without reading the
+// SD card. Refer to T10/1545-D MMC-4 Revision 5a, READ TOC/PMA/ATIP.
+
+#pragma once
+
+#include <stdint.h>
+#include "CUEParser.h"
+
+#define CDTOC_MAX_TRACKS 99
+
+// Track boundaries kept from the cue sheet
+struct CDTOCTrack
+{
+    uint8_t number;
+    uint8_t mode; // CUETrackMode
+    uint32_t track_start; // INDEX 00, or INDEX 01 if there is no pregap
+    uint32_t data_start; // INDEX 01
+};
+
+class CDTOC
+{
+public:
+    CDTOC();
+
+    // Parse all tracks from the cue sheet and cache their boundaries,
+    // responses are formatted from them on demand.
+    // End of the last track is computed from image_size, unless leadout
+    // is given.
+    void build(CUEParser &parser, uint64_t image_size, uint32_t leadout = 0);
+
+    int trackCount() const { return m_trackcount; }
+    const CDTOCTrack &track(int idx) const { return m_tracks[idx]; }
+
+    // Find index of the track that contains the LBA, or -1 if it is before
+    // the first track. The search starts from hint, so when it is the result
+    // of the previous lookup, following the play position is constant time.
+    int findTrack(uint32_t lba, int hint = 0) const;
+
+    // Media catalog number, empty if not given in cue sheet
+    const char *catalog() const { return m_catalog; }
+
+    // First and last track numbers, 0 if there are no tracks
+    uint8_t firstTrack() const;
+    uint8_t lastTrack() const;
+
+    // Start of lead-out area
+    uint32_t leadOut() const { return m_leadout; }
+
+    // READ TOC format 0000b, starting from the given track number.
+    // Returns length of response, or 0 if there is no such track.
+    uint32_t formattedTOC(bool msf, uint8_t track, uint8_t *dest) const;
+
+    // READ TOC format 0001b
+    uint32_t sessionInfo(uint8_t *dest) const;
+
+    // READ TOC format 0010b, session 1
+    uint32_t fullTOC(bool bcd, uint8_t *dest) const;
+
+    // Convert logical block address to CD-ROM time
+    static void LBA2MSF(int32_t LBA, uint8_t* MSF, bool relative);
+    static void LBA2MSFBCD(int32_t LBA, uint8_t* MSF, bool relative);
+
+private:
+    CDTOCTrack m_tracks[CDTOC_MAX_TRACKS];
+    int m_trackcount;
+    uint32_t m_leadout;
+    char m_catalog[CUE_CATALOG_LENGTH + 1];
+};
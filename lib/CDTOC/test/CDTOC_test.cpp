@@ -0,0 +1,410 @@
+#include "CDTOC.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+/******************************************************/
+/* Reference implementation, formats response on each */
+/* request by parsing the cue sheet.                  */
+/******************************************************/
+
+static const uint8_t SessionTOC[] =
+{
+    0x00, 0x0A, 0x01, 0x01,
+    0x00, 0x14, 0x01, 0x00,
+    0x00, 0x00, 0x00, 0x00
+};
+
+static const uint8_t FullTOC[] =
+{
+    0x00, 0x2E, 0x01, 0x01,
+    0x01, 0x14, 0x00, 0xA0, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00,
+    0x01, 0x14, 0x00, 0xA1, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00,
+    0x01, 0x14, 0x00, 0xA2, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+struct ref_image_t
+{
+    uint64_t size;
+    uint32_t cdr_leadout;
+};
+
+static uint32_t refLeadOutLBA(const ref_image_t &img, const CUETrackInfo* lasttrack)
+{
+    if (lasttrack != nullptr && lasttrack->track_number != 0)
+    {
+        if (img.cdr_leadout != 0)
+        {
+            return img.cdr_leadout;
+        }
+
+        uint32_t lastTrackBlocks = (img.size - lasttrack->file_offset)
+                / lasttrack->sector_length;
+        return lasttrack->track_start + lastTrackBlocks;
+    }
+    else
+    {
+        return 1;
+    }
+}
+
+static void refFormatTrackInfo(const CUETrackInfo *track, uint8_t *dest, bool use_MSF_time)
+{
+    uint8_t control_adr = 0x14;
+    if (track->track_mode == CUETrack_AUDIO)
+    {
+        control_adr = 0x10;
+    }
+
+    dest[0] = 0;
+    dest[1] = control_adr;
+    dest[2] = track->track_number;
+    dest[3] = 0;
+
+    if (use_MSF_time)
+    {
+        dest[4] = 0;
+        CDTOC::LBA2MSF(track->data_start, &dest[5], false);
+    }
+    else
+    {
+        dest[4] = (track->data_start >> 24) & 0xFF;
+        dest[5] = (track->data_start >> 16) & 0xFF;
+        dest[6] = (track->data_start >>  8) & 0xFF;
+        dest[7] = (track->data_start >>  0) & 0xFF;
+    }
+}
+
+static uint32_t refReadTOC(const ref_image_t &img, const char *cue, bool MSF, uint8_t track, uint8_t *data)
+{
+    CUEParser parser(cue);
+    uint8_t *trackdata = &data[4];
+    int trackcount = 0;
+    int firsttrack = -1;
+    CUETrackInfo lasttrack = {};
+    const CUETrackInfo *trackinfo;
+    while ((trackinfo = parser.next_track()) != NULL)
+    {
+        if (firsttrack < 0) firsttrack = trackinfo->track_number;
+        lasttrack = *trackinfo;
+
+        if (track <= trackinfo->track_number)
+        {
+            refFormatTrackInfo(trackinfo, &trackdata[8 * trackcount], MSF);
+            trackcount += 1;
+        }
+    }
+
+    CUETrackInfo leadout = {};
+    leadout.track_number = 0xAA;
+    leadout.track_mode = (lasttrack.track_number != 0) ? lasttrack.track_mode : CUETrack_MODE1_2048;
+    leadout.data_start = refLeadOutLBA(img, &lasttrack);
+    refFormatTrackInfo(&leadout, &trackdata[8 * trackcount], MSF);
+    trackcount += 1;
+
+    uint16_t toc_length = 2 + trackcount * 8;
+    data[0] = toc_length >> 8;
+    data[1] = toc_length & 0xFF;
+    data[2] = firsttrack;
+    data[3] = lasttrack.track_number;
+
+    if (track != 0xAA && trackcount < 2)
+    {
+        return 0;
+    }
+    return 2 + toc_length;
+}
+
+static uint32_t refReadSessionInfo(const char *cue, uint8_t *data)
+{
+    CUEParser parser(cue);
+    uint32_t len = sizeof(SessionTOC);
+    memcpy(data, SessionTOC, len);
+
+    const CUETrackInfo *trackinfo = parser.next_track();
+    if (trackinfo)
+    {
+        refFormatTrackInfo(trackinfo, &data[4], false);
+    }
+    return len;
+}
+
+static void refFormatRawTrackInfo(const CUETrackInfo *track, uint8_t *dest, bool useBCD)
+{
+    uint8_t control_adr = 0x14;
+    if (track->track_mode == CUETrack_AUDIO)
+    {
+        control_adr = 0x10;
+    }
+
+    dest[0] = 0x01;
+    dest[1] = control_adr;
+    dest[2] = 0x00;
+    dest[3] = track->track_number;
+    dest[4] = 0x00;
+    dest[5] = 0x00;
+    dest[6] = 0x00;
+    dest[7] = 0;
+
+    if (useBCD) {
+        CDTOC::LBA2MSFBCD(track->data_start, &dest[8], false);
+    } else {
+        CDTOC::LBA2MSF(track->data_start, &dest[8], false);
+    }
+}
+
+static uint32_t refReadFullTOC(const ref_image_t &img, const char *cue, bool useBCD, uint8_t *data)
+{
+    CUEParser parser(cue);
+    uint32_t len = 4 + 11 * 3;
+    memcpy(data, FullTOC, len);
+
+    int firsttrack = -1;
+    CUETrackInfo lasttrack = {};
+    const CUETrackInfo *trackinfo;
+    while ((trackinfo = parser.next_track()) != NULL)
+    {
+        if (firsttrack < 0)
+        {
+            firsttrack = trackinfo->track_number;
+            if (trackinfo->track_mode == CUETrack_AUDIO)
+            {
+                data[5] = 0x10;
+            }
+        }
+        lasttrack = *trackinfo;
+
+        refFormatRawTrackInfo(trackinfo, &data[len], useBCD);
+        len += 11;
+    }
+
+    data[12] = firsttrack;
+    if (lasttrack.track_number != 0)
+    {
+        data[23] = lasttrack.track_number;
+        if (lasttrack.track_mode == CUETrack_AUDIO)
+        {
+            data[16] = 0x10;
+            data[27] = 0x10;
+        }
+    }
+
+    if (useBCD) {
+        CDTOC::LBA2MSFBCD(refLeadOutLBA(img, &lasttrack), &data[34], false);
+    } else {
+        CDTOC::LBA2MSF(refLeadOutLBA(img, &lasttrack), &data[34], false);
+    }
+
+    uint16_t toclen = len - 2;
+    data[0] = toclen >> 8;
+    data[1] = toclen & 0xFF;
+    return len;
+}
+
+/***************/
+/* Test corpus */
+/***************/
+
+struct cue_case_t
+{
+    const char *name;
+    const char *cue;
+    ref_image_t img;
+};
+
+static const cue_case_t g_corpus[] = {
+    {"single data track",
+        "FILE \"data.bin\" BINARY\n"
+        "  TRACK 01 MODE1/2048\n"
+        "    INDEX 01 00:00:00\n",
+        {2048 * 12345, 0}},
+    {"raw data track",
+        "FILE \"data.bin\" BINARY\n"
+        "  TRACK 01 MODE1/2352\n"
+        "    INDEX 01 00:00:00\n",
+        {2352 * 300000ULL, 0}},
+    {"mixed mode with pregaps",
+        "FILE \"mixed.bin\" BINARY\n"
+        "  TRACK 01 MODE1/2352\n"
+        "    INDEX 01 00:00:00\n"
+        "  TRACK 02 AUDIO\n"
+        "    PREGAP 00:02:00\n"
+        "    INDEX 01 02:47:20\n"
+        "  TRACK 03 AUDIO\n"
+        "    INDEX 00 07:55:58\n"
+        "    INDEX 01 07:55:65\n",
+        {2352ULL * 75 * 60 * 12, 0}},
+    {"audio only",
+        "FILE \"Audio CD.bin\" BINARY\n"
+        "  TRACK 01 AUDIO\n"
+        "    INDEX 01 00:00:00\n"
+        "  TRACK 02 AUDIO\n"
+        "    INDEX 00 03:10:12\n"
+        "    INDEX 01 03:12:12\n"
+        "  TRACK 03 AUDIO\n"
+        "    INDEX 01 06:01:74\n"
+        "  TRACK 04 AUDIO\n"
+        "    INDEX 01 09:59:01\n",
+        {2352ULL * 75 * 60 * 14, 0}},
+    {"multiple files",
+        "FILE \"track1.bin\" BINARY\n"
+        "  TRACK 01 MODE1/2048\n"
+        "    INDEX 01 00:00:00\n"
+        "FILE \"track2.bin\" BINARY\n"
+        "  TRACK 02 AUDIO\n"
+        "    INDEX 00 00:00:00\n"
+        "    INDEX 01 00:02:00\n",
+        {2048 * 5000, 0}},
+    {"recorded CD-R",
+        "REM LEADOUT 4000\n"
+        "FILE \"cdr.bin\" BINARY\n"
+        "  TRACK 01 MODE1/2048\n"
+        "    INDEX 01 00:00:00\n"
+        "  TRACK 02 MODE1/2048\n"
+        "    INDEX 01 00:30:00\n",
+        {2048ULL * 400000, 4000}},
+    {"no tracks",
+        "FILE \"empty.bin\" BINARY\n",
+        {2048 * 100, 0}},
+};
+
+bool test_corpus()
+{
+    bool status = true;
+    static uint8_t expected[4096];
+    static uint8_t actual[4096];
+
+    COMMENT("test_corpus()");
+    for (size_t i = 0; i < sizeof(g_corpus) / sizeof(g_corpus[0]); i++)
+    {
+        const cue_case_t &c = g_corpus[i];
+        printf("\nCue sheet: %s\n", c.name);
+
+        CUEParser parser(c.cue);
+        CDTOC toc;
+        toc.build(parser, c.img.size, c.img.cdr_leadout);
+
+        bool toc_ok = true;
+        const uint8_t start_tracks[] = {0, 1, 2, 3, 4, 5, 99, 0xAA};
+        for (size_t j = 0; j < sizeof(start_tracks); j++)
+        {
+            for (int msf = 0; msf < 2; msf++)
+            {
+                memset(expected, 0xEE, sizeof(expected));
+                memset(actual, 0xEE, sizeof(actual));
+                uint32_t len1 = refReadTOC(c.img, c.cue, msf, start_tracks[j], expected);
+                uint32_t len2 = toc.formattedTOC(msf, start_tracks[j], actual);
+                if (len1 != len2 || memcmp(expected, actual, len1) != 0)
+                {
+                    printf("Mismatch for track %d, MSF %d\n", start_tracks[j], msf);
+                    toc_ok = false;
+                }
+            }
+        }
+        TEST(toc_ok);
+
+        uint32_t len1 = refReadSessionInfo(c.cue, expected);
+        uint32_t len2 = toc.sessionInfo(actual);
+        TEST(len1 == len2 && memcmp(expected, actual, len1) == 0);
+
+        for (int bcd = 0; bcd < 2; bcd++)
+        {
+            len1 = refReadFullTOC(c.img, c.cue, bcd, expected);
+            len2 = toc.fullTOC(bcd, actual);
+            TEST(len1 == len2 && memcmp(expected, actual, len1) == 0);
+        }
+    }
+
+    return status;
+}
+
+bool test_tracks()
+{
+    bool status = true;
+
+    COMMENT("test_tracks()");
+    CUEParser parser(g_corpus[2].cue);
+    CDTOC toc;
+    toc.build(parser, g_corpus[2].img.size);
+    TEST(toc.trackCount() == 3);
+    TEST(toc.firstTrack() == 1);
+    TEST(toc.lastTrack() == 3);
+    TEST(toc.track(1).mode == CUETrack_AUDIO);
+    TEST(toc.track(1).data_start == ((2 * 60) + 47) * 75 + 20);
+    TEST(toc.track(1).track_start == toc.track(1).data_start);
+    TEST(toc.track(2).track_start == ((7 * 60) + 55) * 75 + 58);
+    TEST(toc.track(2).data_start == ((7 * 60) + 55) * 75 + 65);
+
+    COMMENT("Lead-out follows the last track");
+    uint64_t last_offset = (uint64_t)toc.track(2).track_start * 2352;
+    TEST(toc.leadOut() == toc.track(2).track_start + (g_corpus[2].img.size - last_offset) / 2352);
+
+    return status;
+}
+
+bool test_findtrack()
+{
+    bool status = true;
+
+    COMMENT("test_findtrack()");
+    CUEParser parser(g_corpus[2].cue);
+    CDTOC toc;
+    toc.build(parser, g_corpus[2].img.size);
+    uint32_t start2 = toc.track(1).track_start;
+    uint32_t start3 = toc.track(2).track_start;
+
+    COMMENT("Lookup without hint");
+    TEST(toc.findTrack(0) == 0);
+    TEST(toc.findTrack(start2 - 1) == 0);
+    TEST(toc.findTrack(start2) == 1);
+    TEST(toc.findTrack(start3 - 1) == 1);
+    TEST(toc.findTrack(start3) == 2);
+    TEST(toc.findTrack(toc.leadOut() + 1000) == 2);
+
+    COMMENT("Following playback position");
+    int hint = 0;
+    bool ok = true;
+    for (uint32_t lba = 0; lba < start3 + 100; lba += 7)
+    {
+        hint = toc.findTrack(lba, hint);
+        int expected = (lba >= start3) ? 2 : (lba >= start2) ? 1 : 0;
+        if (hint != expected) ok = false;
+    }
+    TEST(ok);
+
+    COMMENT("Seeking backwards and invalid hints");
+    TEST(toc.findTrack(10, 2) == 0);
+    TEST(toc.findTrack(start2, -5) == 1);
+    TEST(toc.findTrack(start3, 99) == 2);
+
+    COMMENT("Empty TOC");
+    CUEParser empty("");
+    CDTOC empty_toc;
+    empty_toc.build(empty, 0);
+    TEST(empty_toc.findTrack(0) == -1);
+    TEST(strcmp(empty_toc.catalog(), "") == 0);
+
+    return status;
+}
+
+int main()
+{
+    if (test_corpus() && test_tracks() && test_findtrack())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -20,10 +20,12 @@
 // Refer to e.g. https://www.gnu.org/software/ccd2cue/manual/html_node/CUE-sheet-format.html#CUE-sheet-format
 //
 // Example of a CUE file:
+// CATALOG 0123456789012
 // FILE "foo bar.bin" BINARY
 //   TRACK 01 MODE1/2048
 //     INDEX 01 00:00:00
 //   TRACK 02 AUDIO
+//     ISRC USRC17607839
 //     PREGAP 00:02:00
 //     INDEX 01 02:47:20
 //   TRACK 03 AUDIO
@@ -52,6 +54,7 @@ void CUEParser::restart()
 {
     m_parse_pos = m_cue_sheet;
     memset(&m_track_info, 0, sizeof(m_track_info));
+    m_catalog[0] = '\0';
 }
 
 const CUETrackInfo *CUEParser::next_track()
@@ -84,10 +87,19 @@ const CUETrackInfo *CUEParser::next_track()
             m_track_info.unstored_pregap_length = 0;
             m_track_info.data_start = 0;
             m_track_info.track_start = 0;
+            m_track_info.isrc[0] = '\0';
             got_track = true;
             got_data = false;
             got_pause = false;
         }
+        else if (strncasecmp(m_parse_pos, "CATALOG ", 8) == 0)
+        {
+            read_code(skip_space(m_parse_pos + 8), m_catalog, sizeof(m_catalog));
+        }
+        else if (strncasecmp(m_parse_pos, "ISRC ", 5) == 0)
+        {
+            read_code(skip_space(m_parse_pos + 5), m_track_info.isrc, sizeof(m_track_info.isrc));
+        }
         else if (strncasecmp(m_parse_pos, "PREGAP ", 7) == 0)
         {
             const char *time_str = skip_space(m_parse_pos + 7);
@@ -202,6 +214,17 @@ const char *CUEParser::read_quoted(const char *src, char *dest, int dest_size)
     return src;
 }
 
+void CUEParser::read_code(const char *src, char *dest, int dest_size)
+{
+    int len = 0;
+    while (isalnum(*src) && len < dest_size - 1)
+    {
+        dest[len++] = *src++;
+    }
+
+    dest[len] = '\0';
+}
+
 uint32_t CUEParser::parse_time(const char *src)
 {
     char *endptr;
@@ -25,6 +25,10 @@
 #define CUE_MAX_FILENAME 64
 #endif
 
+// Length of ISRC and media catalog number (UPC/EAN) codes
+#define CUE_ISRC_LENGTH 12
+#define CUE_CATALOG_LENGTH 13
+
 enum CUEFileMode
 {
     CUEFile_BINARY = 0,
@@ -72,6 +76,9 @@ struct CUETrackInfo
     // LBA for the beginning of the track, which will be INDEX 00 if that is present.
     // Otherwise this will be INDEX 01 matching data_start above.
     uint32_t track_start;
+
+    // International Standard Recording Code of the track, or empty string if not given.
+    char isrc[CUE_ISRC_LENGTH+1];
 };
 
 class CUEParser
@@ -92,10 +99,15 @@ public:
     // or destruction of this object.
     const CUETrackInfo *next_track();
 
+    // Media catalog number from CATALOG line, or empty string if not given.
+    // The line precedes the tracks, so this is valid after first call to next_track().
+    const char *catalog() const { return m_catalog; }
+
 protected:
     const char *m_cue_sheet;
     const char *m_parse_pos;
     CUETrackInfo m_track_info;
+    char m_catalog[CUE_CATALOG_LENGTH+1];
 
     // Skip any whitespace at beginning of line.
     // Returns false if at end of string.
@@ -111,6 +123,9 @@ protected:
     // Returns pointer to character after ending quote.
     const char *read_quoted(const char *src, char *dest, int dest_size);
 
+    // Read alphanumeric code such as ISRC, ending at first other character
+    void read_code(const char *src, char *dest, int dest_size);
+
     // Parse time from MM:SS:FF format to frame number
     uint32_t parse_time(const char *src);
 
@@ -177,10 +177,67 @@ TRACK 03 MODE1/2352
     return status;
 }
 
+bool test_codes()
+{
+    bool status = true;
+    const char *cue_sheet = R"(
+CATALOG 0724384260620
+FILE "Album.bin" BINARY
+  TRACK 01 AUDIO
+    ISRC GBAYE0000351
+    INDEX 01 00:00:00
+  TRACK 02 AUDIO
+    INDEX 01 03:12:40
+  TRACK 03 AUDIO
+    ISRC GBAYE0000353
+    INDEX 00 06:40:10
+    INDEX 01 06:42:10
+    )";
+
+    CUEParser parser(cue_sheet);
+
+    COMMENT("test_codes()");
+    TEST(strcmp(parser.catalog(), "") == 0);
+
+    COMMENT("Test TRACK 01 (with ISRC)");
+    const CUETrackInfo *track = parser.next_track();
+    TEST(track != NULL);
+    TEST(strcmp(parser.catalog(), "0724384260620") == 0);
+    if (track)
+    {
+        TEST(track->track_number == 1);
+        TEST(strcmp(track->isrc, "GBAYE0000351") == 0);
+    }
+
+    COMMENT("Test TRACK 02 (no ISRC)");
+    track = parser.next_track();
+    TEST(track != NULL);
+    if (track)
+    {
+        TEST(track->track_number == 2);
+        TEST(strcmp(track->isrc, "") == 0);
+    }
+
+    COMMENT("Test TRACK 03 (ISRC before INDEX 00)");
+    track = parser.next_track();
+    TEST(track != NULL);
+    if (track)
+    {
+        TEST(track->track_number == 3);
+        TEST(strcmp(track->isrc, "GBAYE0000353") == 0);
+        TEST(track->track_start == ((6 * 60) + 40) * 75 + 10);
+    }
+
+    COMMENT("Test restart()");
+    parser.restart();
+    TEST(strcmp(parser.catalog(), "") == 0);
+
+    return status;
+}
 
 int main()
 {
-    if (test_basics() && test_datatracks())
+    if (test_basics() && test_datatracks() && test_codes())
     {
         return 0;
     }
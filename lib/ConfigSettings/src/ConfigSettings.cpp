@@ -0,0 +1,221 @@
+/*
+ * Typed copy of the settings in the ini file.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ConfigSettings.h"
+#include <stdlib.h>
+#include <string.h>
+
+void ConfigSettings::clear()
+{
+    memset(&global, 0, sizeof(global));
+    memset(&allTargets, 0, sizeof(allTargets));
+    memset(target, 0, sizeof(target));
+    m_pool[0] = '\0';
+    m_pool_used = 1;
+
+    // Every key is read from an empty file to mark the values not set
+    m_read = &readNothing;
+    m_ini = NULL;
+    loadAll();
+    m_read = NULL;
+}
+
+const char *ConfigSettings::str(ConfigStr ref, const char *dflt) const
+{
+    return (ref == 0) ? dflt : &m_pool[ref];
+}
+
+int ConfigSettings::readNothing(void *, const char *, const char *, char *buf, int)
+{
+    buf[0] = '\0';
+    return 0;
+}
+
+void ConfigSettings::targetSection(char *section, int id)
+{
+    strcpy(section, "SCSI0");
+    section[4] = '0' + id;
+}
+
+void ConfigSettings::imgKey(char *key, int idx)
+{
+    strcpy(key, "IMG0");
+    key[3] = '0' + idx;
+}
+
+void ConfigSettings::dirKey(char *key, int idx)
+{
+    strcpy(key, "Dir0");
+    key[3] = (idx == 0) ? '\0' : '0' + idx;
+}
+
+int ConfigSettings::readLazy(ReadFunc read, void *ini, const char *section, const char *key,
+                             bool given, char *buf, int size)
+{
+    buf[0] = '\0';
+    if (!given) return 0;
+
+    return read(ini, section, key, buf, size);
+}
+
+void ConfigSettings::loadAll()
+{
+    const char *s = "SCSI";
+    readStr(s, "System", global.system);
+    for (int i = 0; i < CONFIG_DIR_COUNT; i++)
+    {
+        char key[5];
+        dirKey(key, i);
+        readGiven(s, key, global.dirSet, i);
+    }
+    readStr(s, "ToolBoxSharedDir", global.toolBoxSharedDir);
+    readBool(s, "Debug", global.debug);
+    readBool(s, "TestMode", global.testMode);
+    readBool(s, "DisableStatusLED", global.disableStatusLED);
+    readBool(s, "DisableROMDrive", global.disableROMDrive);
+    readInt(s, "ROMDriveSCSIID", global.romDriveSCSIID);
+    readBool(s, "DisableConfigHook", global.disableConfigHook);
+    readInt(s, "SelectionDelay", global.selectionDelay);
+    readInt(s, "MaxSyncSpeed", global.maxSyncSpeed);
+    readBool(s, "EnableUnitAttention", global.enableUnitAttention);
+    readBool(s, "EnableSCSI2", global.enableSCSI2);
+    readBool(s, "EnableSelLatch", global.enableSelLatch);
+    readBool(s, "MapLunsToIDs", global.mapLunsToIDs);
+    readBool(s, "EnableParity", global.enableParity);
+    readBool(s, "BootCacheWarmup", global.bootCacheWarmup);
+    readInt(s, "SDThroughputKB", global.sdThroughputKB);
+    readBool(s, "ImageScrub", global.imageScrub);
+    readBool(s, "InitiatorMode", global.initiatorMode);
+    readInt(s, "InitiatorID", global.initiatorID);
+    readInt(s, "InitiatorMaxRetry", global.initiatorMaxRetry);
+    readBool(s, "InitiatorSurfaceScan", global.initiatorSurfaceScan);
+    readStr(s, "WiFiMACAddress", global.wifiMACAddress);
+    readStr(s, "WiFiSSID", global.wifiSSID);
+    readStr(s, "WiFiPassword", global.wifiPassword);
+
+    loadTargetKeys(s, allTargets);
+
+    for (int id = 0; id < CONFIG_TARGET_COUNT; id++)
+    {
+        char section[6];
+        targetSection(section, id);
+        ConfigTarget &t = target[id];
+        loadTargetKeys(section, t.keys);
+        readStr(section, "ImgDir", t.imgDir);
+        for (int i = 0; i < CONFIG_IMAGE_COUNT; i++)
+        {
+            char key[5];
+            imgKey(key, i);
+            readGiven(section, key, t.imgSet, i);
+        }
+        readStr(section, "CreateImage", t.createImage);
+        readInt(section, "CreateImageSizeMB", t.createImageSizeMB);
+    }
+}
+
+void ConfigSettings::loadTargetKeys(const char *section, ConfigTargetKeys &keys)
+{
+    readInt(section, "Type", keys.type);
+    readInt(section, "TypeModifier", keys.typeModifier);
+    readInt(section, "SectorsPerTrack", keys.sectorsPerTrack);
+    readInt(section, "HeadsPerCylinder", keys.headsPerCylinder);
+    readInt(section, "BlockSize", keys.blockSize);
+    readInt(section, "Quirks", keys.quirks);
+    readBool(section, "RightAlignStrings", keys.rightAlignStrings);
+    readBool(section, "NameFromImage", keys.nameFromImage);
+    readInt(section, "PrefetchBytes", keys.prefetchBytes);
+    readBool(section, "ReinsertCDOnInquiry", keys.reinsertCDOnInquiry);
+    readBool(section, "ReinsertAfterEject", keys.reinsertAfterEject);
+    readInt(section, "EjectButton", keys.ejectButton);
+    readBool(section, "CDRecorder", keys.cdRecorder);
+    readInt(section, "CDAVolume", keys.cdaVolume);
+    readChars(section, "Vendor", keys.vendor, sizeof(keys.vendor));
+    readChars(section, "Product", keys.product, sizeof(keys.product));
+    readChars(section, "Version", keys.version, sizeof(keys.version));
+    readChars(section, "Serial", keys.serial, sizeof(keys.serial));
+}
+
+void ConfigSettings::readInt(const char *section, const char *key, ConfigInt &out)
+{
+    out.value = CONFIG_INT_UNSET;
+    char buf[CONFIG_MAX_VALUE];
+    int len = m_read(m_ini, section, key, buf, sizeof(buf));
+    if (len == 0) return;
+
+    // Same as ini_getl(), hexadecimal with 0x prefix
+    bool hex = (len >= 2 && (buf[1] == 'x' || buf[1] == 'X'));
+    long value = strtol(buf, NULL, hex ? 16 : 10);
+    if (value < INT32_MIN + 1) value = INT32_MIN + 1;
+    if (value > INT32_MAX) value = INT32_MAX;
+    out.value = value;
+}
+
+void ConfigSettings::readBool(const char *section, const char *key, ConfigBool &out)
+{
+    out.value = CONFIG_BOOL_UNSET;
+    char buf[CONFIG_MAX_VALUE];
+    if (m_read(m_ini, section, key, buf, sizeof(buf)) == 0) return;
+
+    char c = buf[0];
+    if (c == 'Y' || c == 'y' || c == 'T' || c == 't' || c == '1')
+    {
+        out.value = 1;
+    }
+    else if (c == 'N' || c == 'n' || c == 'F' || c == 'f' || c == '0')
+    {
+        out.value = 0;
+    }
+}
+
+void ConfigSettings::readStr(const char *section, const char *key, ConfigStr &out)
+{
+    out = 0;
+    char buf[CONFIG_MAX_VALUE];
+    int len = m_read(m_ini, section, key, buf, sizeof(buf));
+    if (len == 0) return;
+
+    // Only if a string key was added without updating CONFIG_STRING_COUNT
+    if (m_pool_used + len + 1 > CONFIG_STRING_POOL) return;
+
+    memcpy(&m_pool[m_pool_used], buf, len);
+    m_pool[m_pool_used + len] = '\0';
+    out = m_pool_used;
+    m_pool_used += len + 1;
+}
+
+void ConfigSettings::readGiven(const char *section, const char *key, uint16_t &mask, int bit)
+{
+    char buf[CONFIG_MAX_VALUE];
+    if (m_read(m_ini, section, key, buf, sizeof(buf)) != 0)
+    {
+        mask |= (1 << bit);
+    }
+    else
+    {
+        mask &= ~(1 << bit);
+    }
+}
+
+void ConfigSettings::readChars(const char *section, const char *key, char *out, size_t size)
+{
+    memset(out, 0, size);
+    char buf[CONFIG_MAX_VALUE];
+    int len = m_read(m_ini, section, key, buf, sizeof(buf));
+    if (len == 0) return;
+
+    memcpy(out, buf, ((size_t)len < size) ? len : size);
+}
@@ -0,0 +1,218 @@
+/*
+ * Typed copy of the settings in the ini file.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// All keys used by the firmware are read once when the SD card is mounted.
+// The rest of the code reads the fields below instead of searching the ini
+// file again, and the key names are spelled out only in ConfigSettings.cpp.
+// The exception are the IMG0-IMG9 and Dir-Dir9 file paths, which would need
+// several kilobytes to keep. Only their presence is stored and the value is
+// read from the file with readImg() and readDir() when it is needed.
+//
+// The file is accessed through an adapter class with a single method:
+//     int gets(const char *section, const char *key, char *buf, int size);
+// that returns the length of the value, or 0 if the key does not exist.
+// Numbers and booleans are parsed the same way as ini_getl() and
+// ini_getbool() in minIni.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CONFIG_TARGET_COUNT 8
+#define CONFIG_IMAGE_COUNT 10   // IMG0 to IMG9
+#define CONFIG_DIR_COUNT 10     // Dir, Dir1 to Dir9
+#define CONFIG_MAX_VALUE 64     // Longer values are truncated
+
+// String keys kept in the pool: System, ToolBoxSharedDir, three WiFi keys,
+// ImgDir and CreateImage of each target. The pool fits all of them at
+// full length, so no value is ever dropped.
+#define CONFIG_STRING_COUNT (5 + 2 * CONFIG_TARGET_COUNT)
+#define CONFIG_STRING_POOL (1 + CONFIG_STRING_COUNT * CONFIG_MAX_VALUE)
+
+#define CONFIG_INT_UNSET INT32_MIN
+#define CONFIG_BOOL_UNSET 0xFF
+
+// Offset of a string value in the string pool, 0 is an empty string
+typedef uint16_t ConfigStr;
+
+// Integer value, CONFIG_INT_UNSET if the key was not present
+struct ConfigInt
+{
+    int32_t value;
+
+    bool isSet() const { return value != CONFIG_INT_UNSET; }
+    int32_t get(int32_t dflt) const { return isSet() ? value : dflt; }
+};
+
+// Boolean value, starting with Y, T, 1 or N, F, 0.
+// Other values are ignored as if the key was not present.
+struct ConfigBool
+{
+    uint8_t value; // 0, 1 or CONFIG_BOOL_UNSET
+
+    bool isSet() const { return value != CONFIG_BOOL_UNSET; }
+    bool get(bool dflt) const { return isSet() ? value != 0 : dflt; }
+};
+
+// Keys that can be given for all targets in [SCSI] and for one target in [SCSIx]
+struct ConfigTargetKeys
+{
+    ConfigInt type;
+    ConfigInt typeModifier;
+    ConfigInt sectorsPerTrack;
+    ConfigInt headsPerCylinder;
+    ConfigInt blockSize;
+    ConfigInt quirks;
+    ConfigBool rightAlignStrings;
+    ConfigBool nameFromImage;
+    ConfigInt prefetchBytes;
+    ConfigBool reinsertCDOnInquiry;
+    ConfigBool reinsertAfterEject;
+    ConfigInt ejectButton;
+    ConfigBool cdRecorder;
+    ConfigInt cdaVolume;
+
+    // Inquiry strings, padded with zeros and not terminated at full length.
+    // Empty if not given.
+    char vendor[8];
+    char product[16];
+    char version[4];
+    char serial[16];
+};
+
+// Keys that are only valid in [SCSIx]
+struct ConfigTarget
+{
+    ConfigTargetKeys keys;
+    ConfigStr imgDir;
+    ConfigStr createImage;
+    uint16_t imgSet; // Bit for each IMGn key given, see readImg()
+    ConfigInt createImageSizeMB;
+};
+
+// Keys in [SCSI] that apply to the whole device
+struct ConfigGlobal
+{
+    ConfigStr system;
+    uint16_t dirSet; // Bit for each DirN key given, see readDir()
+    ConfigStr toolBoxSharedDir;
+    ConfigBool debug;
+    ConfigBool testMode;
+    ConfigBool disableStatusLED;
+    ConfigBool disableROMDrive;
+    ConfigInt romDriveSCSIID;
+    ConfigBool disableConfigHook;
+    ConfigInt selectionDelay;
+    ConfigInt maxSyncSpeed;
+    ConfigBool enableUnitAttention;
+    ConfigBool enableSCSI2;
+    ConfigBool enableSelLatch;
+    ConfigBool mapLunsToIDs;
+    ConfigBool enableParity;
+    ConfigBool bootCacheWarmup;
+    ConfigInt sdThroughputKB;
+    ConfigBool imageScrub;
+    ConfigBool initiatorMode;
+    ConfigInt initiatorID;
+    ConfigInt initiatorMaxRetry;
+    ConfigBool initiatorSurfaceScan;
+    ConfigStr wifiMACAddress;
+    ConfigStr wifiSSID;
+    ConfigStr wifiPassword;
+};
+
+class ConfigSettings
+{
+public:
+    ConfigSettings() { clear(); }
+
+    // Forget all values, as if the ini file was empty
+    void clear();
+
+    // Replace all values with the ones read through the adapter
+    template <class Ini>
+    void load(Ini &ini);
+
+    // Value of a string key, or dflt if it was not given
+    const char *str(ConfigStr ref, const char *dflt = "") const;
+
+    // Read IMGn of a target or DirN (Dir for index 0) from the file.
+    // The value is copied to buf, returns its length or 0 if not given.
+    template <class Ini>
+    int readImg(Ini &ini, int id, int idx, char *buf, int size) const
+    {
+        char section[6], key[5];
+        targetSection(section, id);
+        imgKey(key, idx);
+        bool given = (target[id].imgSet >> idx) & 1;
+        return readLazy(&readAdapter<Ini>, &ini, section, key, given, buf, size);
+    }
+
+    template <class Ini>
+    int readDir(Ini &ini, int idx, char *buf, int size) const
+    {
+        char key[5];
+        dirKey(key, idx);
+        bool given = (global.dirSet >> idx) & 1;
+        return readLazy(&readAdapter<Ini>, &ini, "SCSI", key, given, buf, size);
+    }
+
+    ConfigGlobal global;
+    ConfigTargetKeys allTargets;                // [SCSI]
+    ConfigTarget target[CONFIG_TARGET_COUNT];   // [SCSI0] to [SCSI7]
+
+private:
+    typedef int (*ReadFunc)(void *ini, const char *section, const char *key, char *buf, int size);
+
+    template <class Ini>
+    static int readAdapter(void *ini, const char *section, const char *key, char *buf, int size)
+    {
+        return static_cast<Ini*>(ini)->gets(section, key, buf, size);
+    }
+
+    static int readNothing(void *ini, const char *section, const char *key, char *buf, int size);
+    static void targetSection(char *section, int id);
+    static void imgKey(char *key, int idx);
+    static void dirKey(char *key, int idx);
+    static int readLazy(ReadFunc read, void *ini, const char *section, const char *key,
+                        bool given, char *buf, int size);
+
+    void loadAll();
+    void loadTargetKeys(const char *section, ConfigTargetKeys &keys);
+    void readInt(const char *section, const char *key, ConfigInt &out);
+    void readBool(const char *section, const char *key, ConfigBool &out);
+    void readStr(const char *section, const char *key, ConfigStr &out);
+    void readGiven(const char *section, const char *key, uint16_t &mask, int bit);
+    void readChars(const char *section, const char *key, char *out, size_t size);
+
+    ReadFunc m_read;
+    void *m_ini;
+    uint16_t m_pool_used;
+    char m_pool[CONFIG_STRING_POOL];
+};
+
+template <class Ini>
+void ConfigSettings::load(Ini &ini)
+{
+    clear();
+    m_read = &readAdapter<Ini>;
+    m_ini = &ini;
+    loadAll();
+    m_read = NULL;
+    m_ini = NULL;
+}
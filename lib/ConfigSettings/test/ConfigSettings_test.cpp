@@ -0,0 +1,377 @@
+#include "ConfigSettings.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+/*************************************************/
+/* Ini file in memory, parsed like minIni does   */
+/*************************************************/
+
+class IniText
+{
+public:
+    IniText(const char *text): m_text(text), m_reads(0) {}
+
+    int gets(const char *section, const char *key, char *buf, int size)
+    {
+        m_reads++;
+        buf[0] = '\0';
+        bool in_section = false;
+        const char *p = m_text;
+        while (*p)
+        {
+            const char *end = strchr(p, '\n');
+            if (!end) end = p + strlen(p);
+            char line[256];
+            int len = end - p;
+            if (len >= (int)sizeof(line)) len = sizeof(line) - 1;
+            memcpy(line, p, len);
+            line[len] = '\0';
+            p = (*end) ? end + 1 : end;
+
+            char *comment = strpbrk(line, ";#");
+            if (comment) *comment = '\0';
+            char *s = trim(line);
+
+            if (s[0] == '[')
+            {
+                char *close = strchr(s, ']');
+                if (close) *close = '\0';
+                in_section = (strcasecmp(trim(s + 1), section) == 0);
+                continue;
+            }
+
+            char *eq = strchr(s, '=');
+            if (!in_section || !eq) continue;
+            *eq = '\0';
+            if (strcasecmp(trim(s), key) != 0) continue;
+
+            strncpy(buf, trim(eq + 1), size - 1);
+            buf[size - 1] = '\0';
+            return strlen(buf);
+        }
+        return 0;
+    }
+
+    int reads() const { return m_reads; }
+
+private:
+    static char *trim(char *s)
+    {
+        while (isspace((unsigned char)*s)) s++;
+        char *e = s + strlen(s);
+        while (e > s && isspace((unsigned char)e[-1])) *--e = '\0';
+        return s;
+    }
+
+    const char *m_text;
+    int m_reads;
+};
+
+static ConfigSettings g_settings;
+
+/*****************/
+/* Test cases    */
+/*****************/
+
+bool test_empty()
+{
+    bool status = true;
+    COMMENT("test_empty()");
+
+    IniText ini("");
+    g_settings.load(ini);
+    TEST(!g_settings.global.debug.isSet());
+    TEST(g_settings.global.debug.get(true) == true);
+    TEST(g_settings.global.romDriveSCSIID.get(-1) == -1);
+    TEST(g_settings.global.dirSet == 0);
+    TEST(strcmp(g_settings.str(g_settings.global.toolBoxSharedDir, "/shared"), "/shared") == 0);
+    TEST(!g_settings.allTargets.blockSize.isSet());
+    TEST(g_settings.allTargets.vendor[0] == '\0');
+    TEST(!g_settings.target[7].keys.type.isSet());
+    TEST(g_settings.target[7].imgSet == 0);
+    TEST(strcmp(g_settings.str(g_settings.target[0].imgDir), "") == 0);
+
+    COMMENT("Every key is looked up once per load");
+    printf("Lookups per load: %d\n", ini.reads());
+    int reads = ini.reads();
+    g_settings.load(ini);
+    TEST(ini.reads() == 2 * reads);
+
+    return status;
+}
+
+static const char g_sample_ini[] =
+    "; Sample configuration\n"
+    "[SCSI]\n"
+    "System = Mac\n"
+    "Dir = /images\n"
+    "Dir2 = /more\n"
+    "ToolBoxSharedDir = /transfer\n"
+    "Debug = 1\n"
+    "TestMode = no\n"
+    "DisableStatusLED = Yes\n"
+    "DisableROMDrive = false\n"
+    "ROMDriveSCSIID = 3\n"
+    "DisableConfigHook = true\n"
+    "SelectionDelay = 0\n"
+    "MaxSyncSpeed = 5\n"
+    "EnableUnitAttention = 1\n"
+    "EnableSCSI2 = 0\n"
+    "EnableSelLatch = 1\n"
+    "MapLunsToIDs = 1\n"
+    "EnableParity = 0\n"
+    "BootCacheWarmup = 1\n"
+    "SDThroughputKB = 2500\n"
+    "ImageScrub = 1\n"
+    "InitiatorMode = 0\n"
+    "InitiatorID = 6\n"
+    "InitiatorMaxRetry = 2\n"
+    "InitiatorSurfaceScan = 1\n"
+    "WiFiMACAddress = 01:23:45:67:89:ab\n"
+    "WiFiSSID = Network\n"
+    "WiFiPassword = secret ; comment\n"
+    "Type = 0\n"
+    "Quirks = 1\n"
+    "PrefetchBytes = 0x4000\n"
+    "Vendor = QUANTUM\n"
+    "\n"
+    "[SCSI3]\n"
+    "Type = 2\n"
+    "TypeModifier = 4\n"
+    "SectorsPerTrack = 63\n"
+    "HeadsPerCylinder = 255\n"
+    "BlockSize = 2048\n"
+    "Quirks = 0\n"
+    "RightAlignStrings = 1\n"
+    "NameFromImage = 1\n"
+    "PrefetchBytes = 8192\n"
+    "ReinsertCDOnInquiry = 1\n"
+    "ReinsertAfterEject = 0\n"
+    "EjectButton = 2\n"
+    "CDRecorder = 1\n"
+    "CDAVolume = 0x3F\n"
+    "Vendor = SONY\n"
+    "Product = CD-ROM CDU-8003A\n"
+    "Version = 1.9a\n"
+    "Serial = 0123456789ABCDEF0123\n"
+    "IMG0 = CD3/first disc.iso\n"
+    "IMG9 = CD3/last disc.iso\n"
+    "\n"
+    "[SCSI5]\n"
+    "ImgDir = floppies\n"
+    "CreateImage = new.hda\n"
+    "CreateImageSizeMB = 100\n";
+
+bool test_sample()
+{
+    bool status = true;
+    COMMENT("test_sample()");
+
+    IniText ini(g_sample_ini);
+    g_settings.load(ini);
+    const ConfigGlobal &g = g_settings.global;
+
+    COMMENT("Global keys");
+    TEST(strcmp(g_settings.str(g.system), "Mac") == 0);
+    char buf[CONFIG_MAX_VALUE];
+    TEST(g.dirSet == 0x005);
+    TEST(g_settings.readDir(ini, 0, buf, sizeof(buf)) == 7 && strcmp(buf, "/images") == 0);
+    TEST(g_settings.readDir(ini, 1, buf, sizeof(buf)) == 0 && buf[0] == '\0');
+    TEST(g_settings.readDir(ini, 2, buf, sizeof(buf)) == 5 && strcmp(buf, "/more") == 0);
+    TEST(strcmp(g_settings.str(g.toolBoxSharedDir, "/shared"), "/transfer") == 0);
+    TEST(g.debug.isSet() && g.debug.value);
+    TEST(g.testMode.isSet() && !g.testMode.value);
+    TEST(g.disableStatusLED.get(false));
+    TEST(g.disableROMDrive.isSet() && !g.disableROMDrive.value);
+    TEST(g.romDriveSCSIID.get(-1) == 3);
+    TEST(g.disableConfigHook.get(false));
+    TEST(g.selectionDelay.isSet() && g.selectionDelay.value == 0);
+    TEST(g.maxSyncSpeed.get(10) == 5);
+    TEST(g.enableUnitAttention.get(false));
+    TEST(!g.enableSCSI2.get(true));
+    TEST(g.enableSelLatch.get(false));
+    TEST(g.mapLunsToIDs.get(false));
+    TEST(!g.enableParity.get(true));
+    TEST(g.bootCacheWarmup.get(false));
+    TEST(g.sdThroughputKB.get(4000) == 2500);
+    TEST(g.imageScrub.get(false));
+    TEST(!g.initiatorMode.get(true));
+    TEST(g.initiatorID.get(7) == 6);
+    TEST(g.initiatorMaxRetry.get(5) == 2);
+    TEST(g.initiatorSurfaceScan.get(false));
+    TEST(strcmp(g_settings.str(g.wifiMACAddress), "01:23:45:67:89:ab") == 0);
+    TEST(strcmp(g_settings.str(g.wifiSSID), "Network") == 0);
+    TEST(strcmp(g_settings.str(g.wifiPassword), "secret") == 0);
+
+    COMMENT("Keys for all targets");
+    const ConfigTargetKeys &all = g_settings.allTargets;
+    TEST(all.type.get(1) == 0);
+    TEST(all.quirks.get(0) == 1);
+    TEST(all.prefetchBytes.get(0) == 0x4000);
+    TEST(memcmp(all.vendor, "QUANTUM\0", 8) == 0);
+    TEST(all.product[0] == '\0');
+    TEST(!all.blockSize.isSet());
+
+    COMMENT("Keys for one target");
+    const ConfigTarget &t3 = g_settings.target[3];
+    TEST(t3.keys.type.get(0) == 2);
+    TEST(t3.keys.typeModifier.get(0) == 4);
+    TEST(t3.keys.sectorsPerTrack.get(0) == 63);
+    TEST(t3.keys.headsPerCylinder.get(0) == 255);
+    TEST(t3.keys.blockSize.get(512) == 2048);
+    TEST(t3.keys.quirks.isSet() && t3.keys.quirks.value == 0);
+    TEST(t3.keys.rightAlignStrings.get(false));
+    TEST(t3.keys.nameFromImage.get(false));
+    TEST(t3.keys.prefetchBytes.get(0) == 8192);
+    TEST(t3.keys.reinsertCDOnInquiry.get(false));
+    TEST(!t3.keys.reinsertAfterEject.get(true));
+    TEST(t3.keys.ejectButton.get(0) == 2);
+    TEST(t3.keys.cdRecorder.get(false));
+    TEST(t3.keys.cdaVolume.get(0) == 0x3F);
+    TEST(memcmp(t3.keys.vendor, "SONY\0\0\0\0", 8) == 0);
+    TEST(memcmp(t3.keys.product, "CD-ROM CDU-8003A", 16) == 0);
+    TEST(memcmp(t3.keys.version, "1.9a", 4) == 0);
+    TEST(memcmp(t3.keys.serial, "0123456789ABCDEF", 16) == 0);
+    TEST(t3.imgSet == 0x201);
+    TEST(g_settings.readImg(ini, 3, 0, buf, sizeof(buf)) && strcmp(buf, "CD3/first disc.iso") == 0);
+    TEST(g_settings.readImg(ini, 3, 1, buf, sizeof(buf)) == 0 && buf[0] == '\0');
+    TEST(g_settings.readImg(ini, 3, 9, buf, sizeof(buf)) && strcmp(buf, "CD3/last disc.iso") == 0);
+    TEST(t3.imgDir == 0);
+
+    const ConfigTarget &t5 = g_settings.target[5];
+    TEST(strcmp(g_settings.str(t5.imgDir), "floppies") == 0);
+    TEST(strcmp(g_settings.str(t5.createImage), "new.hda") == 0);
+    TEST(t5.createImageSizeMB.get(0) == 100);
+    TEST(!t5.keys.type.isSet());
+    TEST(t5.keys.vendor[0] == '\0');
+
+    COMMENT("Other targets are empty");
+    TEST(!g_settings.target[0].keys.type.isSet());
+    TEST(g_settings.target[0].imgSet == 0);
+
+    COMMENT("Loading another file replaces all values");
+    IniText ini2("[SCSI]\nDebug=0\n");
+    g_settings.load(ini2);
+    TEST(g_settings.global.debug.isSet() && !g_settings.global.debug.value);
+    TEST(g_settings.global.system == 0);
+    TEST(!g_settings.allTargets.quirks.isSet());
+    TEST(!g_settings.target[3].keys.type.isSet());
+    TEST(g_settings.target[3].imgSet == 0);
+
+    return status;
+}
+
+bool test_parsing()
+{
+    bool status = true;
+    COMMENT("test_parsing()");
+
+    IniText ini(
+        "[scsi]\n"
+        "Debug = maybe\n"
+        "TestMode =\n"
+        "SelectionDelay = 0X20\n"
+        "MaxSyncSpeed = -1\n"
+        "Dir = /a/very/long/path/that/does/not/fit/in/the/value/buffer/used/by/firmware\n"
+        "[SCSI0]\n"
+        "Vendor = EXACTLY8\n"
+        "Version = 12345\n");
+    g_settings.load(ini);
+
+    COMMENT("Section names are case insensitive in minIni");
+    TEST(g_settings.global.selectionDelay.get(0) == 0x20);
+    TEST(g_settings.global.maxSyncSpeed.get(0) == -1);
+
+    COMMENT("Unknown and empty values are ignored");
+    TEST(!g_settings.global.debug.isSet());
+    TEST(!g_settings.global.testMode.isSet());
+
+    COMMENT("Long values are truncated");
+    char buf[CONFIG_MAX_VALUE];
+    TEST(g_settings.readDir(ini, 0, buf, sizeof(buf)) == CONFIG_MAX_VALUE - 1);
+    TEST(memcmp(g_settings.target[0].keys.vendor, "EXACTLY8", 8) == 0);
+    TEST(memcmp(g_settings.target[0].keys.version, "1234", 4) == 0);
+
+    return status;
+}
+
+bool test_long_values()
+{
+    bool status = true;
+    COMMENT("test_long_values()");
+
+    // Every string key at full length
+    static char text[32768];
+    char value[CONFIG_MAX_VALUE];
+    memset(value, 'x', sizeof(value) - 1);
+    value[sizeof(value) - 1] = '\0';
+    char *p = text;
+    p += sprintf(p, "[SCSI]\nSystem = %s\nToolBoxSharedDir = %s\n", value, value);
+    p += sprintf(p, "WiFiMACAddress = %s\nWiFiSSID = %s\nWiFiPassword = %s\n", value, value, value);
+    for (int i = 0; i < CONFIG_DIR_COUNT; i++)
+    {
+        p += sprintf(p, "Dir%d = %s\n", i, value);
+    }
+    for (int id = 0; id < CONFIG_TARGET_COUNT; id++)
+    {
+        p += sprintf(p, "[SCSI%d]\nImgDir = %s\nCreateImage = %s\n", id, value, value);
+        for (int i = 0; i < CONFIG_IMAGE_COUNT; i++)
+        {
+            p += sprintf(p, "IMG%d = images/target%d/some_long_image_name_number_%d.hda\n", i, id, i);
+        }
+    }
+
+    IniText ini(text);
+    g_settings.load(ini);
+
+    COMMENT("Pooled strings are all kept");
+    const ConfigGlobal &g = g_settings.global;
+    TEST(strcmp(g_settings.str(g.system), value) == 0);
+    TEST(strcmp(g_settings.str(g.toolBoxSharedDir), value) == 0);
+    TEST(strcmp(g_settings.str(g.wifiPassword), value) == 0);
+    TEST(strcmp(g_settings.str(g_settings.target[7].imgDir), value) == 0);
+    TEST(strcmp(g_settings.str(g_settings.target[7].createImage), value) == 0);
+
+    COMMENT("IMGn values are read when needed");
+    char buf[CONFIG_MAX_VALUE];
+    TEST(g.dirSet == 0x3FE);
+    TEST(g_settings.target[7].imgSet == 0x3FF);
+    TEST(g_settings.readImg(ini, 0, 0, buf, sizeof(buf)) && strcmp(buf, "images/target0/some_long_image_name_number_0.hda") == 0);
+    TEST(g_settings.readImg(ini, 7, 9, buf, sizeof(buf)) && strcmp(buf, "images/target7/some_long_image_name_number_9.hda") == 0);
+
+    COMMENT("Keys not given are not looked up");
+    IniText ini2("[SCSI0]\nIMG0 = a.hda\n");
+    g_settings.load(ini2);
+    int reads = ini2.reads();
+    TEST(g_settings.readImg(ini2, 0, 0, buf, sizeof(buf)) == 5 && strcmp(buf, "a.hda") == 0);
+    TEST(g_settings.readImg(ini2, 0, 1, buf, sizeof(buf)) == 0 && buf[0] == '\0');
+    TEST(g_settings.readDir(ini2, 0, buf, sizeof(buf)) == 0);
+    TEST(ini2.reads() == reads + 1);
+
+    return status;
+}
+
+int main()
+{
+    if (test_empty() && test_sample() && test_parsing() && test_long_values())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
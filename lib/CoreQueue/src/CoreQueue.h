@@ -0,0 +1,117 @@
+/*
+ * Lock-free work queue for passing jobs from one core to another.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Single producer, single consumer ring buffer of jobs.
+// Only atomic loads and stores are used, so this works on Cortex-M0+ which
+// lacks atomic read-modify-write instructions. If jobs are submitted from
+// several contexts (e.g. main loop and interrupt handler), use one queue
+// per context and let the worker poll all of them.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// Completion flag of a job.
+// Cleared when the job is queued and set by the worker after the job has run.
+// Initialize to true so that a flag that has never been queued reads as done.
+typedef std::atomic<bool> CoreQueueFlag;
+
+struct CoreQueueJob
+{
+    void (*function)(void *param);
+    void *param;
+    CoreQueueFlag *done;
+};
+
+template <uint32_t N>
+class CoreQueue
+{
+public:
+    static_assert(N > 0 && (N & (N - 1)) == 0, "CoreQueue size must be a power of two");
+
+    CoreQueue(): m_head(0), m_tail(0) {}
+
+    // Queue a job, called by the producer only.
+    // Returns false if the queue is full.
+    bool push(void (*function)(void *param), void *param = NULL, CoreQueueFlag *done = NULL)
+    {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) >= N)
+        {
+            return false;
+        }
+
+        if (done)
+        {
+            done->store(false, std::memory_order_relaxed);
+        }
+
+        CoreQueueJob &job = m_jobs[head & (N - 1)];
+        job.function = function;
+        job.param = param;
+        job.done = done;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Run the oldest queued job, called by the consumer only.
+    // Returns false if there was nothing to do.
+    bool runOne()
+    {
+        uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        // Copy the job out so that the slot can be reused while the job runs
+        CoreQueueJob job = m_jobs[tail & (N - 1)];
+        m_tail.store(tail + 1, std::memory_order_release);
+
+        job.function(job.param);
+
+        if (job.done)
+        {
+            job.done->store(true, std::memory_order_release);
+        }
+        return true;
+    }
+
+    // Number of jobs waiting, may be stale by the time it returns
+    uint32_t count() const
+    {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+
+    bool empty() const
+    {
+        return count() == 0;
+    }
+
+private:
+    CoreQueueJob m_jobs[N];
+    std::atomic<uint32_t> m_head; // Written by producer only
+    std::atomic<uint32_t> m_tail; // Written by consumer only
+};
+
+// Check if a job has completed
+static inline bool coreQueueDone(const CoreQueueFlag &done)
+{
+    return done.load(std::memory_order_acquire);
+}
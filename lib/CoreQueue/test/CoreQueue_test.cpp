@@ -0,0 +1,148 @@
+#include "CoreQueue.h"
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+static void add_one(void *param)
+{
+    (*(int*)param)++;
+}
+
+bool test_basics()
+{
+    bool status = true;
+    CoreQueue<4> queue;
+    CoreQueueFlag done(true);
+    int counter = 0;
+
+    COMMENT("test_basics()");
+    TEST(queue.empty());
+    TEST(!queue.runOne());
+    TEST(coreQueueDone(done));
+
+    TEST(queue.push(add_one, &counter, &done));
+    TEST(!coreQueueDone(done));
+    TEST(queue.count() == 1);
+    TEST(queue.runOne());
+    TEST(coreQueueDone(done));
+    TEST(counter == 1);
+
+    COMMENT("Queue full");
+    TEST(queue.push(add_one, &counter));
+    TEST(queue.push(add_one, &counter));
+    TEST(queue.push(add_one, &counter));
+    TEST(queue.push(add_one, &counter));
+    TEST(!queue.push(add_one, &counter));
+    TEST(queue.count() == 4);
+
+    while (queue.runOne());
+    TEST(queue.empty());
+    TEST(counter == 5);
+
+    return status;
+}
+
+// Each job checks that it is run exactly once and in order
+struct sequence_t
+{
+    uint32_t expected;
+    uint32_t errors;
+};
+
+static sequence_t g_sequence[2];
+static uint32_t g_values[2][16];
+
+static void check_sequence(void *param)
+{
+    uint32_t *value = (uint32_t*)param;
+    int queue_idx = (value >= g_values[1]) ? 1 : 0;
+    sequence_t &seq = g_sequence[queue_idx];
+    if (*value != seq.expected) seq.errors++;
+    seq.expected++;
+}
+
+bool test_threads()
+{
+    bool status = true;
+    const uint32_t count = 200000;
+    CoreQueue<16> queues[2];
+    CoreQueueFlag flags[2] = {true, true};
+    std::atomic<bool> producers_done(false);
+    uint32_t waits[2] = {0, 0};
+
+    COMMENT("test_threads()");
+    memset(g_sequence, 0, sizeof(g_sequence));
+
+    // One worker thread serves two queues, like core1 serves both
+    // the interrupt and main loop queues.
+    std::thread worker([&]() {
+        while (true)
+        {
+            bool idle = !queues[0].runOne() && !queues[1].runOne();
+            if (idle && producers_done.load() && queues[0].empty() && queues[1].empty())
+                break;
+            if (idle) std::this_thread::yield();
+        }
+    });
+
+    auto producer = [&](int idx) {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            // The value slot is reused only after the job that
+            // used it has been run, which is checked with the done flag.
+            uint32_t *slot = &g_values[idx][i & 15];
+            if ((i & 15) == 0)
+            {
+                while (!coreQueueDone(flags[idx]))
+                {
+                    waits[idx]++;
+                    std::this_thread::yield();
+                }
+            }
+            *slot = i;
+
+            CoreQueueFlag *done = ((i & 15) == 15) ? &flags[idx] : NULL;
+            while (!queues[idx].push(check_sequence, slot, done)) std::this_thread::yield();
+        }
+    };
+
+    std::thread producer0(producer, 0);
+    std::thread producer1(producer, 1);
+    producer0.join();
+    producer1.join();
+    producers_done = true;
+    worker.join();
+
+    TEST(g_sequence[0].expected == count);
+    TEST(g_sequence[0].errors == 0);
+    TEST(g_sequence[1].expected == count);
+    TEST(g_sequence[1].errors == 0);
+    TEST(coreQueueDone(flags[0]));
+    TEST(coreQueueDone(flags[1]));
+    printf("Producers waited for completion %u + %u times\n", waits[0], waits[1]);
+
+    return status;
+}
+
+int main()
+{
+    if (test_basics() && test_threads())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
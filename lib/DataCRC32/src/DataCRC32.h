@@ -0,0 +1,33 @@
+/*
+ * CRC-32 of SCSI data for debug logging.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// This is the same CRC-32 as used by zlib and Ethernet (reflected polynomial
+// 0xEDB88320), so that the values in the log can be compared with checksums
+// computed on a PC. It is also the CRC that the RP2040 DMA sniffer can
+// compute, which lets the platform code checksum DMA transfers for free and
+// use this implementation only for the bytes that the CPU handles.
+//
+// Data is processed four bytes at a time with slicing-by-4 tables.
+// The word loads assume a little-endian CPU.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Continue CRC calculation, start with crc = 0.
+uint32_t crc32_update(uint32_t crc, const void *data, size_t length);
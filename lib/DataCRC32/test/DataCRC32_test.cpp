@@ -0,0 +1,187 @@
+#include "DataCRC32.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+/*************************************************/
+/* Reference implementations                     */
+/*************************************************/
+
+// Bit at a time CRC-32
+static uint32_t crc32_bitwise(uint32_t crc, const uint8_t *data, size_t length)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : (crc >> 1);
+        }
+    }
+    return ~crc;
+}
+
+// BSD checksum previously used by BlueSCSI_log_trace.cpp
+static uint16_t bsd_checksum(uint16_t sum, const uint8_t *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        sum = (sum >> 1) + ((sum & 1) << 15);
+        sum += data[i];
+    }
+    return sum;
+}
+
+static uint8_t g_data[65536 + 8];
+
+static void make_data()
+{
+    uint32_t seed = 1;
+    for (size_t i = 0; i < sizeof(g_data); i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        g_data[i] = seed >> 16;
+    }
+}
+
+/*****************/
+/* Test cases    */
+/*****************/
+
+bool test_check_value()
+{
+    bool status = true;
+    COMMENT("test_check_value()");
+
+    // Check value from the CRC catalogue, same as zlib crc32()
+    TEST(crc32_update(0, "123456789", 9) == 0xCBF43926);
+    TEST(crc32_update(0, "", 0) == 0);
+
+    COMMENT("Continuation gives the same result");
+    uint32_t crc = crc32_update(0, "1234", 4);
+    crc = crc32_update(crc, "56789", 5);
+    TEST(crc == 0xCBF43926);
+
+    return status;
+}
+
+bool test_alignment()
+{
+    bool status = true;
+    COMMENT("test_alignment()");
+
+    bool ok = true;
+    for (size_t offset = 0; offset < 8; offset++)
+    {
+        for (size_t length = 0; length < 100; length++)
+        {
+            const uint8_t *p = g_data + offset;
+            if (crc32_update(0, p, length) != crc32_bitwise(0, p, length)) ok = false;
+        }
+    }
+    TEST(ok);
+
+    COMMENT("Transfers split at odd positions");
+    ok = true;
+    uint32_t expected = crc32_bitwise(0, g_data, 65536);
+    for (size_t split = 1; split < 65536; split = split * 3 + 1)
+    {
+        uint32_t crc = crc32_update(0, g_data, split);
+        crc = crc32_update(crc, g_data + split, 65536 - split);
+        if (crc != expected) ok = false;
+    }
+    TEST(ok);
+
+    return status;
+}
+
+/*****************/
+/* Benchmark     */
+/*****************/
+
+static double elapsed_ns(const struct timespec &start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+}
+
+// Data is copied in 512 byte blocks as it would be from SCSI bus,
+// with and without the debug checksum.
+void benchmark()
+{
+    COMMENT("benchmark()");
+    const int blocksize = 512;
+    const int rounds = 256;
+    static uint8_t out[65536];
+    struct timespec start;
+    volatile uint32_t sink = 0;
+    double ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int i = 0; i < 65536; i += blocksize)
+        {
+            memcpy(&out[i], &g_data[i], blocksize);
+        }
+        sink = sink + out[r];
+    }
+    ns = elapsed_ns(start);
+    printf("Copy only:        %8.1f MB/s\n", 65536.0 * rounds / ns * 1e3);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < rounds; r++)
+    {
+        uint16_t sum = 0;
+        for (int i = 0; i < 65536; i += blocksize)
+        {
+            memcpy(&out[i], &g_data[i], blocksize);
+            sum = bsd_checksum(sum, &out[i], blocksize);
+        }
+        sink = sink + sum;
+    }
+    ns = elapsed_ns(start);
+    printf("Copy + BSD sum:   %8.1f MB/s\n", 65536.0 * rounds / ns * 1e3);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < rounds; r++)
+    {
+        uint32_t crc = 0;
+        for (int i = 0; i < 65536; i += blocksize)
+        {
+            memcpy(&out[i], &g_data[i], blocksize);
+            crc = crc32_update(crc, &out[i], blocksize);
+        }
+        sink = sink + crc;
+    }
+    ns = elapsed_ns(start);
+    printf("Copy + CRC-32:    %8.1f MB/s\n", 65536.0 * rounds / ns * 1e3);
+}
+
+int main()
+{
+    make_data();
+
+    if (test_check_value() && test_alignment())
+    {
+        benchmark();
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -0,0 +1,75 @@
+/*
+ * Contiguity check of FAT cluster chains with batched sector reads.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "FatChain.h"
+
+FatChain::FatChain(int fat_type, uint32_t fat_start_sector):
+    m_fat_type(fat_type), m_fat_start(fat_start_sector)
+{
+}
+
+bool FatChain::check(ReadFunc read, void *card, uint32_t first_cluster, uint32_t cluster_count,
+                     uint8_t *buf, uint32_t buf_sectors)
+{
+    if ((m_fat_type != 16 && m_fat_type != 32) || first_cluster < 2 ||
+        cluster_count == 0 || buf_sectors == 0)
+    {
+        return false;
+    }
+
+    uint32_t per_sector = FATCHAIN_SECTOR_SIZE / (m_fat_type / 8);
+    uint32_t last = first_cluster + cluster_count - 1;
+    uint32_t cluster = first_cluster;
+
+    // Entries of all but the last cluster must point to the next cluster
+    while (cluster < last)
+    {
+        uint32_t sector = cluster / per_sector;
+        uint32_t count = (last - 1) / per_sector - sector + 1;
+        if (count > buf_sectors) count = buf_sectors;
+
+        if (!read(card, m_fat_start + sector, buf, count))
+        {
+            return false;
+        }
+
+        uint32_t end = (sector + count) * per_sector;
+        if (end > last) end = last;
+        for (; cluster < end; cluster++)
+        {
+            uint32_t idx = cluster - sector * per_sector;
+            uint32_t next;
+            if (m_fat_type == 32)
+            {
+                const uint8_t *p = buf + idx * 4;
+                next = (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24)) & 0x0FFFFFFF;
+            }
+            else
+            {
+                const uint8_t *p = buf + idx * 2;
+                next = p[0] | (p[1] << 8);
+            }
+
+            if (next != cluster + 1)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,66 @@
+/*
+ * Contiguity check of FAT cluster chains with batched sector reads.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Images are accessed as raw SD card sectors when their clusters are
+// contiguous. SdFat checks this by following the cluster chain one entry at
+// a time through its single sector cache, so a multi-gigabyte image on FAT32
+// costs one card command per 128 clusters. Here the FAT sectors covering the
+// chain are read several at a time and every entry is checked, so the result
+// is exact and the number of card commands goes down by the batch size.
+//
+// Only the clusters that hold file data are checked. Clusters preallocated
+// after the end of the file may be anywhere, they are not accessed through
+// the raw mapping.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FATCHAIN_SECTOR_SIZE 512
+
+class FatChain
+{
+public:
+    // fat_type is 16 or 32, other volume types are not supported
+    FatChain(int fat_type, uint32_t fat_start_sector);
+
+    // Check that cluster_count clusters from first_cluster are chained in order.
+    // buf must hold buf_sectors sectors. Card needs a SdFat style method
+    // bool readSectors(uint32_t sector, uint8_t *dst, size_t count).
+    template <class Card>
+    bool contiguous(Card &card, uint32_t first_cluster, uint32_t cluster_count,
+                    uint8_t *buf, uint32_t buf_sectors)
+    {
+        return check(&readAdapter<Card>, &card, first_cluster, cluster_count, buf, buf_sectors);
+    }
+
+private:
+    typedef bool (*ReadFunc)(void *card, uint32_t sector, uint8_t *dst, uint32_t count);
+
+    template <class Card>
+    static bool readAdapter(void *card, uint32_t sector, uint8_t *dst, uint32_t count)
+    {
+        return static_cast<Card*>(card)->readSectors(sector, dst, count);
+    }
+
+    bool check(ReadFunc read, void *card, uint32_t first_cluster, uint32_t cluster_count,
+               uint8_t *buf, uint32_t buf_sectors);
+
+    int m_fat_type;
+    uint32_t m_fat_start;
+};
@@ -0,0 +1,219 @@
+#include "FatChain.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+/*************************************************/
+/* Simulated SD card with a FAT region           */
+/*************************************************/
+
+#define FAT_START 32
+#define EOC32 0x0FFFFFFF
+#define EOC16 0xFFFF
+
+class SimCard
+{
+public:
+    SimCard(int fat_type, uint32_t clusters):
+        m_fat_type(fat_type),
+        m_sectors(FAT_START + (clusters + 2) * (fat_type / 8) / FATCHAIN_SECTOR_SIZE + 1),
+        m_commands(0)
+    {
+        m_data.resize(m_sectors * FATCHAIN_SECTOR_SIZE);
+    }
+
+    bool readSectors(uint32_t sector, uint8_t *dst, size_t count)
+    {
+        if (sector + count > m_sectors) return false;
+        memcpy(dst, &m_data[sector * FATCHAIN_SECTOR_SIZE], count * FATCHAIN_SECTOR_SIZE);
+        m_commands++;
+        return true;
+    }
+
+    void setEntry(uint32_t cluster, uint32_t next)
+    {
+        uint8_t *p = &m_data[FAT_START * FATCHAIN_SECTOR_SIZE + cluster * (m_fat_type / 8)];
+        p[0] = (uint8_t)next;
+        p[1] = (uint8_t)(next >> 8);
+        if (m_fat_type == 32)
+        {
+            p[2] = (uint8_t)(next >> 16);
+            p[3] = (uint8_t)(next >> 24);
+        }
+    }
+
+    uint32_t getEntry(uint32_t cluster)
+    {
+        const uint8_t *p = &m_data[FAT_START * FATCHAIN_SECTOR_SIZE + cluster * (m_fat_type / 8)];
+        if (m_fat_type == 32) return (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24)) & 0x0FFFFFFF;
+        return p[0] | (p[1] << 8);
+    }
+
+    // Write a chain through the given clusters
+    void chain(const std::vector<uint32_t> &clusters)
+    {
+        for (size_t i = 0; i + 1 < clusters.size(); i++) setEntry(clusters[i], clusters[i + 1]);
+        setEntry(clusters.back(), m_fat_type == 32 ? EOC32 : EOC16);
+    }
+
+    void contiguousChain(uint32_t first, uint32_t count)
+    {
+        for (uint32_t c = first; c < first + count - 1; c++) setEntry(c, c + 1);
+        setEntry(first + count - 1, m_fat_type == 32 ? EOC32 : EOC16);
+    }
+
+    // SdFat walks the chain through a single sector cache,
+    // returns the number of sector reads that takes.
+    uint32_t sdfatReads(uint32_t first)
+    {
+        uint32_t per_sector = FATCHAIN_SECTOR_SIZE / (m_fat_type / 8);
+        uint32_t cached = 0xFFFFFFFF;
+        uint32_t reads = 0;
+        uint32_t eoc = (m_fat_type == 32) ? 0x0FFFFFF8 : 0xFFF8;
+        for (uint32_t c = first; c < eoc; c = getEntry(c))
+        {
+            if (c / per_sector != cached)
+            {
+                cached = c / per_sector;
+                reads++;
+            }
+        }
+        return reads;
+    }
+
+    uint32_t commands() const { return m_commands; }
+
+private:
+    int m_fat_type;
+    uint32_t m_sectors;
+    uint32_t m_commands;
+    std::vector<uint8_t> m_data;
+};
+
+static uint8_t g_buf[4 * FATCHAIN_SECTOR_SIZE];
+
+/*****************/
+/* Test cases    */
+/*****************/
+
+bool test_fat32()
+{
+    bool status = true;
+    COMMENT("test_fat32()");
+
+    SimCard card(32, 20000);
+    FatChain fat(32, FAT_START);
+
+    card.contiguousChain(100, 5000);
+    TEST(fat.contiguous(card, 100, 5000, g_buf, 4));
+    TEST(fat.contiguous(card, 100, 1, g_buf, 4));
+    TEST(fat.contiguous(card, 100, 128, g_buf, 4));
+
+    COMMENT("Clusters preallocated past end of file are not checked");
+    card.chain({5099, 9000, 9001});
+    TEST(fat.contiguous(card, 100, 5000, g_buf, 4));
+    TEST(!fat.contiguous(card, 100, 5001, g_buf, 4));
+
+    COMMENT("Image copied back to the same first cluster, fragmented");
+    std::vector<uint32_t> clusters;
+    for (uint32_t c = 100; c < 2600; c++) clusters.push_back(c);
+    for (uint32_t c = 12000; c < 14500; c++) clusters.push_back(c);
+    card.chain(clusters);
+    TEST(!fat.contiguous(card, 100, 5000, g_buf, 4));
+
+    COMMENT("Single entry out of order in the middle of a batch");
+    card.contiguousChain(100, 5000);
+    card.setEntry(3000, 3002);
+    TEST(!fat.contiguous(card, 100, 5000, g_buf, 4));
+    card.setEntry(3000, 3001);
+    TEST(fat.contiguous(card, 100, 5000, g_buf, 4));
+
+    COMMENT("Last data cluster is not checked, entry before it is");
+    card.setEntry(5098, 5098);
+    TEST(!fat.contiguous(card, 100, 5000, g_buf, 4));
+
+    COMMENT("Read failure");
+    TEST(!fat.contiguous(card, 30000, 100, g_buf, 4));
+
+    return status;
+}
+
+bool test_fat16()
+{
+    bool status = true;
+    COMMENT("test_fat16()");
+
+    SimCard card(16, 60000);
+    FatChain fat(16, FAT_START);
+
+    card.contiguousChain(2, 40000);
+    TEST(fat.contiguous(card, 2, 40000, g_buf, 4));
+    TEST(fat.contiguous(card, 255, 258, g_buf, 1));
+
+    card.setEntry(256, 0);
+    TEST(!fat.contiguous(card, 255, 258, g_buf, 1));
+    TEST(fat.contiguous(card, 257, 1000, g_buf, 1));
+
+    COMMENT("Other volume types");
+    FatChain fat12(12, FAT_START);
+    TEST(!fat12.contiguous(card, 2, 10, g_buf, 4));
+
+    return status;
+}
+
+// Compare card commands needed for a large image against SdFat.
+// Each SD card command costs about the same as transferring several
+// sectors, so the batch size is close to the speedup.
+bool test_simulated_boot()
+{
+    bool status = true;
+    COMMENT("test_simulated_boot()");
+
+    // 4 GB image and 2 GB image with 32 kB clusters
+    SimCard card(32, 200000);
+    card.contiguousChain(3, 131072);
+    card.contiguousChain(131075, 65536);
+
+    uint32_t sdfat = card.sdfatReads(3) + card.sdfatReads(131075);
+
+    FatChain fat(32, FAT_START);
+    uint32_t before = card.commands();
+    TEST(fat.contiguous(card, 3, 131072, g_buf, 4));
+    TEST(fat.contiguous(card, 131075, 65536, g_buf, 4));
+    uint32_t batched = card.commands() - before;
+
+    // Typical SDIO card: 250 us per command, 25 us per sector transferred
+    uint32_t sdfat_us = sdfat * (250 + 25);
+    uint32_t batched_us = batched * 250 + sdfat * 25;
+    printf("SdFat chain walk: %u reads, about %u ms\n", sdfat, sdfat_us / 1000);
+    printf("Batched check:    %u reads, about %u ms\n", batched, batched_us / 1000);
+
+    TEST(sdfat == 1538);
+    TEST(batched * 4 >= sdfat && batched * 4 <= sdfat + 8);
+    TEST(batched_us * 3 < sdfat_us);
+
+    return status;
+}
+
+int main()
+{
+    if (test_fat32() && test_fat16() && test_simulated_boot())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -0,0 +1,293 @@
+/*
+ * Background verification of disk images against stored checksums.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// SD cards can lose data without reporting an error. The scrubber reads
+// an image a little at a time while the SCSI bus is idle, computes CRC32C
+// of each chunk and compares it with the value stored on the previous pass.
+//
+// The checksums are kept in a sidecar file that starts with ImageScrubHeader,
+// followed by one 32-bit checksum per chunk. Chunks written by the host are
+// recorded in a small table of dirty ranges, and their checksum is stored
+// again instead of compared on the next pass. The table is saved in the
+// header, so that writes made just before power off are not reported as
+// corruption. A write made after the last header save is not covered.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define IMAGESCRUB_MAGIC 0x42524353 // "SCRB"
+#define IMAGESCRUB_VERSION 1
+#define IMAGESCRUB_CHUNK_SHIFT 20 // 1 MiB chunks
+#define IMAGESCRUB_CHUNK_SIZE (1UL << IMAGESCRUB_CHUNK_SHIFT)
+#define IMAGESCRUB_DIRTY_RANGES 8
+#define IMAGESCRUB_NO_CHUNK 0xFFFFFFFF
+
+// Castagnoli CRC32, continue from the previous value of crc.
+// Initial value is 0.
+uint32_t crc32c_update(uint32_t crc, const void *data, size_t len);
+
+// Inclusive range of chunk indexes
+struct ImageScrubRange
+{
+    uint32_t first;
+    uint32_t last;
+};
+
+struct ImageScrubHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t image_size;
+    uint32_t chunk_size;
+    uint32_t dirty_count;
+    ImageScrubRange dirty[IMAGESCRUB_DIRTY_RANGES];
+};
+
+enum ImageScrubResult
+{
+    IMAGESCRUB_BUSY,        // Chunk is partially read
+    IMAGESCRUB_CHUNK_OK,    // Chunk matched or its checksum was stored
+    IMAGESCRUB_MISMATCH,    // Chunk checksum differs from stored value
+    IMAGESCRUB_READ_ERROR,  // Reading the image failed
+    IMAGESCRUB_PASS_DONE,   // Last chunk of image was processed
+    IMAGESCRUB_FILE_ERROR   // Sidecar file could not be accessed
+};
+
+class ImageScrub
+{
+public:
+    ImageScrub() { reset(); }
+
+    // Forget all state, the sidecar is validated again on next step().
+    // If discard is true, stored checksums are replaced on the next pass.
+    void reset(bool discard = false);
+
+    // Record a write by the host, so that the affected chunks are not
+    // reported as mismatches.
+    void markWritten(uint64_t offset, uint64_t length);
+
+    // True if a chunk is in the dirty table
+    bool isDirty(uint32_t chunk) const;
+
+    // True if the dirty table has changed since it was saved to sidecar
+    bool headerPending() const { return m_header_pending; }
+
+    // Process the next part of the image, at most buflen bytes.
+    // The image file must support seek() and read(), and the sidecar
+    // also write(), size() and truncate().
+    template <class ImageFile, class SidecarFile>
+    ImageScrubResult step(ImageFile &image, SidecarFile &sidecar, uint64_t image_size,
+                          uint8_t *buffer, uint32_t buflen);
+
+    // Statistics
+    uint32_t chunkCount() const { return m_chunk_count; }
+    uint32_t currentChunk() const { return m_chunk; }
+    uint32_t passes() const { return m_passes; }
+    uint32_t mismatches() const { return m_mismatches; }
+    uint32_t readErrors() const { return m_read_errors; }
+    uint32_t firstBadChunk() const { return m_first_bad_chunk; }
+
+    // Chunk that the last returned result refers to
+    uint32_t lastChunk() const { return m_last_chunk; }
+
+private:
+    bool m_validated; // Sidecar header has been checked
+    bool m_discard;
+    bool m_header_pending;
+    uint64_t m_image_size;
+    uint32_t m_chunk_count;
+    uint32_t m_chunk;
+    uint32_t m_offset; // Bytes of m_chunk included in m_crc
+    uint32_t m_crc;
+    uint32_t m_last_chunk;
+
+    uint32_t m_passes;
+    uint32_t m_mismatches;
+    uint32_t m_read_errors;
+    uint32_t m_first_bad_chunk;
+
+    uint32_t m_dirty_count;
+    ImageScrubRange m_dirty[IMAGESCRUB_DIRTY_RANGES];
+
+    void addDirty(uint32_t first, uint32_t last);
+    void chunkDone(uint32_t chunk);
+    void recordBad(uint32_t chunk);
+    void fillHeader(ImageScrubHeader *header) const;
+
+    template <class SidecarFile>
+    bool validate(SidecarFile &sidecar, uint64_t image_size);
+
+    template <class SidecarFile>
+    bool storeChecksum(SidecarFile &sidecar, uint32_t chunk, uint32_t crc, uint32_t *stored);
+};
+
+/*******************************/
+/* Template method definitions */
+/*******************************/
+
+template <class SidecarFile>
+bool ImageScrub::validate(SidecarFile &sidecar, uint64_t image_size)
+{
+    m_image_size = image_size;
+    m_chunk_count = (image_size + IMAGESCRUB_CHUNK_SIZE - 1) >> IMAGESCRUB_CHUNK_SHIFT;
+    m_chunk = 0;
+    m_offset = 0;
+    m_crc = 0;
+
+    ImageScrubHeader header = {};
+    bool valid = !m_discard &&
+        sidecar.seek(0) &&
+        sidecar.read(&header, sizeof(header)) == (int)sizeof(header) &&
+        header.magic == IMAGESCRUB_MAGIC &&
+        header.version == IMAGESCRUB_VERSION &&
+        header.image_size == image_size &&
+        header.chunk_size == IMAGESCRUB_CHUNK_SIZE &&
+        header.dirty_count <= IMAGESCRUB_DIRTY_RANGES;
+
+    if (valid)
+    {
+        // Keep writes recorded before the sidecar was opened
+        for (uint32_t i = 0; i < header.dirty_count; i++)
+        {
+            addDirty(header.dirty[i].first, header.dirty[i].last);
+        }
+        m_header_pending = (m_dirty_count != header.dirty_count);
+    }
+    else
+    {
+        // Start a new baseline, nothing is dirty relative to it
+        m_dirty_count = 0;
+        m_discard = false;
+        if (!sidecar.truncate(0)) return false;
+        m_header_pending = true;
+    }
+
+    m_validated = true;
+    return true;
+}
+
+template <class SidecarFile>
+bool ImageScrub::storeChecksum(SidecarFile &sidecar, uint32_t chunk, uint32_t crc, uint32_t *stored)
+{
+    uint64_t pos = sizeof(ImageScrubHeader) + (uint64_t)chunk * sizeof(uint32_t);
+    bool exists = (sidecar.size() >= pos + sizeof(uint32_t));
+    bool dirty = isDirty(chunk);
+
+    if (exists && !dirty)
+    {
+        // Compare against previous pass
+        if (!sidecar.seek(pos) || sidecar.read(stored, sizeof(uint32_t)) != (int)sizeof(uint32_t)) return false;
+        return true;
+    }
+
+    // Store a new checksum
+    *stored = crc;
+    return sidecar.seek(pos) && sidecar.write(&crc, sizeof(crc)) == sizeof(crc);
+}
+
+template <class ImageFile, class SidecarFile>
+ImageScrubResult ImageScrub::step(ImageFile &image, SidecarFile &sidecar, uint64_t image_size,
+                                  uint8_t *buffer, uint32_t buflen)
+{
+    if (!m_validated || image_size != m_image_size)
+    {
+        if (!validate(sidecar, image_size)) return IMAGESCRUB_FILE_ERROR;
+    }
+
+    if (m_header_pending)
+    {
+        ImageScrubHeader header;
+        fillHeader(&header);
+        if (!sidecar.seek(0) || sidecar.write(&header, sizeof(header)) != sizeof(header))
+        {
+            return IMAGESCRUB_FILE_ERROR;
+        }
+        m_header_pending = false;
+    }
+
+    if (m_chunk_count == 0)
+    {
+        m_passes++;
+        return IMAGESCRUB_PASS_DONE;
+    }
+
+    uint64_t chunk_start = (uint64_t)m_chunk << IMAGESCRUB_CHUNK_SHIFT;
+    uint32_t chunk_len = IMAGESCRUB_CHUNK_SIZE;
+    if (image_size - chunk_start < chunk_len) chunk_len = image_size - chunk_start;
+
+    uint32_t len = chunk_len - m_offset;
+    if (len > buflen) len = buflen;
+
+    ImageScrubResult result = IMAGESCRUB_BUSY;
+    m_last_chunk = m_chunk;
+    if (!image.seek(chunk_start + m_offset) || image.read(buffer, len) != (int)len)
+    {
+        // Store the checksum again on next pass, the data may be rewritten
+        recordBad(m_chunk);
+        m_read_errors++;
+        addDirty(m_chunk, m_chunk);
+        m_offset = chunk_len;
+        result = IMAGESCRUB_READ_ERROR;
+
+        // Keep the sidecar without gaps
+        uint32_t stored;
+        storeChecksum(sidecar, m_chunk, 0, &stored);
+    }
+    else
+    {
+        m_crc = crc32c_update(m_crc, buffer, len);
+        m_offset += len;
+
+        if (m_offset == chunk_len)
+        {
+            uint32_t stored;
+            if (!storeChecksum(sidecar, m_chunk, m_crc, &stored))
+            {
+                return IMAGESCRUB_FILE_ERROR;
+            }
+            else if (stored != m_crc)
+            {
+                recordBad(m_chunk);
+                m_mismatches++;
+                result = IMAGESCRUB_MISMATCH;
+            }
+            else
+            {
+                result = IMAGESCRUB_CHUNK_OK;
+            }
+        }
+    }
+
+    if (m_offset == chunk_len)
+    {
+        if (result != IMAGESCRUB_READ_ERROR) chunkDone(m_chunk);
+        m_offset = 0;
+        m_crc = 0;
+        m_chunk++;
+
+        if (m_chunk >= m_chunk_count)
+        {
+            m_chunk = 0;
+            m_passes++;
+            if (result == IMAGESCRUB_CHUNK_OK) result = IMAGESCRUB_PASS_DONE;
+        }
+    }
+
+    return result;
+}
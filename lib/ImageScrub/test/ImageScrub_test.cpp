@@ -0,0 +1,330 @@
+#include "ImageScrub.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+/*************************************************/
+/* In-memory file with the SdFat FsFile methods  */
+/* used by the scrubber.                         */
+/*************************************************/
+
+class MemFile
+{
+public:
+    std::vector<uint8_t> data;
+    uint64_t pos = 0;
+    uint64_t fail_offset = (uint64_t)-1; // Reads covering this offset fail
+
+    bool seek(uint64_t p) { pos = p; return p <= data.size(); }
+    uint64_t size() const { return data.size(); }
+    bool truncate(uint64_t len) { data.resize(len); pos = len; return true; }
+
+    int read(void *buf, size_t len)
+    {
+        if (fail_offset >= pos && fail_offset < pos + len) return -1;
+        if (pos + len > data.size()) len = data.size() - pos;
+        memcpy(buf, &data[pos], len);
+        pos += len;
+        return len;
+    }
+
+    size_t write(const void *buf, size_t len)
+    {
+        if (pos + len > data.size()) data.resize(pos + len);
+        memcpy(&data[pos], buf, len);
+        pos += len;
+        return len;
+    }
+};
+
+static uint8_t g_buffer[4096];
+
+// Fill image with a pattern that differs in every chunk
+static void make_image(MemFile &image, uint64_t size)
+{
+    image.data.resize(size);
+    uint32_t seed = 1;
+    for (uint64_t i = 0; i < size; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        image.data[i] = seed >> 16;
+    }
+}
+
+// Run scrubber until end of pass, count results
+struct PassResult
+{
+    int ok;
+    int mismatch;
+    int read_error;
+    int file_error;
+    uint32_t bad_chunk;
+};
+
+static PassResult run_pass(ImageScrub &scrub, MemFile &image, MemFile &sidecar)
+{
+    PassResult r = {0, 0, 0, 0, IMAGESCRUB_NO_CHUNK};
+    uint32_t passes = scrub.passes();
+    int limit = 100000;
+    while (scrub.passes() == passes && limit-- > 0)
+    {
+        ImageScrubResult res = scrub.step(image, sidecar, image.size(), g_buffer, sizeof(g_buffer));
+        if (res == IMAGESCRUB_CHUNK_OK || res == IMAGESCRUB_PASS_DONE) r.ok++;
+        if (res == IMAGESCRUB_MISMATCH) { r.mismatch++; r.bad_chunk = scrub.lastChunk(); }
+        if (res == IMAGESCRUB_READ_ERROR) { r.read_error++; r.bad_chunk = scrub.lastChunk(); }
+        if (res == IMAGESCRUB_FILE_ERROR) { r.file_error++; break; }
+    }
+    return r;
+}
+
+/*****************/
+/* Test cases    */
+/*****************/
+
+bool test_crc32c()
+{
+    bool status = true;
+    COMMENT("test_crc32c()");
+
+    // Check value from the CRC catalogue
+    TEST(crc32c_update(0, "123456789", 9) == 0xE3069283);
+
+    COMMENT("Continuation gives the same result");
+    uint32_t crc = crc32c_update(0, "1234", 4);
+    crc = crc32c_update(crc, "56789", 5);
+    TEST(crc == 0xE3069283);
+
+    return status;
+}
+
+bool test_baseline()
+{
+    bool status = true;
+    COMMENT("test_baseline()");
+
+    // Partial last chunk
+    MemFile image, sidecar;
+    make_image(image, 5 * IMAGESCRUB_CHUNK_SIZE + IMAGESCRUB_CHUNK_SIZE / 2);
+    ImageScrub scrub;
+
+    PassResult r = run_pass(scrub, image, sidecar);
+    TEST(r.ok == 6 && r.mismatch == 0 && r.read_error == 0 && r.file_error == 0);
+    TEST(scrub.chunkCount() == 6);
+    TEST(sidecar.size() == sizeof(ImageScrubHeader) + 6 * sizeof(uint32_t));
+
+    uint32_t stored;
+    memcpy(&stored, &sidecar.data[sizeof(ImageScrubHeader)], 4);
+    TEST(stored == crc32c_update(0, &image.data[0], IMAGESCRUB_CHUNK_SIZE));
+
+    COMMENT("Second pass compares against stored values");
+    r = run_pass(scrub, image, sidecar);
+    TEST(r.ok == 6 && r.mismatch == 0);
+    TEST(scrub.passes() == 2);
+
+    COMMENT("Sidecar is reused by a new instance");
+    ImageScrub scrub2;
+    r = run_pass(scrub2, image, sidecar);
+    TEST(r.ok == 6 && r.mismatch == 0);
+    TEST(sidecar.size() == sizeof(ImageScrubHeader) + 6 * sizeof(uint32_t));
+
+    return status;
+}
+
+bool test_bitflip()
+{
+    bool status = true;
+    COMMENT("test_bitflip()");
+
+    MemFile image, sidecar;
+    make_image(image, 4 * IMAGESCRUB_CHUNK_SIZE);
+    ImageScrub scrub;
+    run_pass(scrub, image, sidecar);
+
+    image.data[2 * IMAGESCRUB_CHUNK_SIZE + 12345] ^= 0x10;
+    PassResult r = run_pass(scrub, image, sidecar);
+    TEST(r.mismatch == 1 && r.ok == 3);
+    TEST(r.bad_chunk == 2);
+    TEST(scrub.mismatches() == 1);
+    TEST(scrub.firstBadChunk() == 2);
+
+    COMMENT("Mismatch is reported again on the next pass");
+    r = run_pass(scrub, image, sidecar);
+    TEST(r.mismatch == 1 && r.bad_chunk == 2);
+
+    COMMENT("Reset with discard stores new checksums");
+    scrub.reset(true);
+    r = run_pass(scrub, image, sidecar);
+    TEST(r.mismatch == 0 && r.ok == 4);
+    r = run_pass(scrub, image, sidecar);
+    TEST(r.mismatch == 0 && r.ok == 4);
+
+    return status;
+}
+
+bool test_writes()
+{
+    bool status = true;
+    COMMENT("test_writes()");
+
+    MemFile image, sidecar;
+    make_image(image, 8 * IMAGESCRUB_CHUNK_SIZE);
+    ImageScrub scrub;
+    run_pass(scrub, image, sidecar);
+
+    // Write spanning chunks 1 and 2, and another in chunk 6
+    memset(&image.data[2 * IMAGESCRUB_CHUNK_SIZE - 512], 0xAA, 1024);
+    scrub.markWritten(2 * IMAGESCRUB_CHUNK_SIZE - 512, 1024);
+    image.data[6 * IMAGESCRUB_CHUNK_SIZE] ^= 1;
+    scrub.markWritten(6 * IMAGESCRUB_CHUNK_SIZE, 512);
+    TEST(scrub.isDirty(1) && scrub.isDirty(2) && scrub.isDirty(6));
+    TEST(!scrub.isDirty(0) && !scrub.isDirty(3));
+    TEST(scrub.headerPending());
+
+    PassResult r = run_pass(scrub, image, sidecar);
+    TEST(r.mismatch == 0 && r.ok == 8);
+    TEST(!scrub.isDirty(1) && !scrub.isDirty(2) && !scrub.isDirty(6));
+
+    COMMENT("New values are compared on the next pass");
+    image.data[IMAGESCRUB_CHUNK_SIZE + 5] ^= 0x80;
+    r = run_pass(scrub, image, sidecar);
+    TEST(r.mismatch == 1 && r.bad_chunk == 1);
+
+    COMMENT("Dirty table is saved in the sidecar header");
+    image.data[IMAGESCRUB_CHUNK_SIZE + 5] ^= 0x80;
+    ImageScrub scrub2;
+    run_pass(scrub2, image, sidecar);
+    image.data[7 * IMAGESCRUB_CHUNK_SIZE + 100] = ~image.data[7 * IMAGESCRUB_CHUNK_SIZE + 100];
+    scrub2.markWritten(7 * IMAGESCRUB_CHUNK_SIZE + 100, 1);
+    // Process one block so that the header is written
+    scrub2.step(image, sidecar, image.size(), g_buffer, sizeof(g_buffer));
+    TEST(!scrub2.headerPending());
+
+    ImageScrub scrub3;
+    r = run_pass(scrub3, image, sidecar);
+    TEST(r.mismatch == 0 && r.ok == 8);
+
+    COMMENT("Write into the chunk being read restarts it");
+    ImageScrub scrub5;
+    MemFile sidecar5;
+    run_pass(scrub5, image, sidecar5);
+    while (scrub5.currentChunk() != 3)
+    {
+        scrub5.step(image, sidecar5, image.size(), g_buffer, sizeof(g_buffer));
+    }
+    for (int i = 0; i < 10; i++)
+    {
+        scrub5.step(image, sidecar5, image.size(), g_buffer, sizeof(g_buffer));
+    }
+    memset(&image.data[3 * IMAGESCRUB_CHUNK_SIZE + 1000], 0x55, 512);
+    scrub5.markWritten(3 * IMAGESCRUB_CHUNK_SIZE + 1000, 512);
+    r = run_pass(scrub5, image, sidecar5);
+    TEST(r.mismatch == 0);
+    r = run_pass(scrub5, image, sidecar5);
+    TEST(r.mismatch == 0 && r.ok == 8);
+
+    COMMENT("Full dirty table widens the closest range");
+    ImageScrub scrub4;
+    for (uint32_t i = 0; i < IMAGESCRUB_DIRTY_RANGES + 2; i++)
+    {
+        scrub4.markWritten((uint64_t)i * 100 * IMAGESCRUB_CHUNK_SIZE, 1);
+    }
+    bool all_dirty = true;
+    for (uint32_t i = 0; i < IMAGESCRUB_DIRTY_RANGES + 2; i++)
+    {
+        if (!scrub4.isDirty(i * 100)) all_dirty = false;
+    }
+    TEST(all_dirty);
+
+    return status;
+}
+
+bool test_resize()
+{
+    bool status = true;
+    COMMENT("test_resize()");
+
+    MemFile image, sidecar;
+    make_image(image, 3 * IMAGESCRUB_CHUNK_SIZE);
+    ImageScrub scrub;
+    run_pass(scrub, image, sidecar);
+
+    // Image grows and its content changes, checksums are recomputed
+    make_image(image, 4 * IMAGESCRUB_CHUNK_SIZE + 512);
+    image.data[0] ^= 1;
+    PassResult r = run_pass(scrub, image, sidecar);
+    TEST(r.mismatch == 0 && r.ok == 5);
+    TEST(sidecar.size() == sizeof(ImageScrubHeader) + 5 * sizeof(uint32_t));
+
+    r = run_pass(scrub, image, sidecar);
+    TEST(r.mismatch == 0 && r.ok == 5);
+
+    COMMENT("Corrupted sidecar header starts a new baseline");
+    sidecar.data[0] ^= 0xFF;
+    ImageScrub scrub2;
+    r = run_pass(scrub2, image, sidecar);
+    TEST(r.mismatch == 0 && r.ok == 5);
+
+    COMMENT("Empty image");
+    MemFile empty, empty_sidecar;
+    ImageScrub scrub3;
+    r = run_pass(scrub3, empty, empty_sidecar);
+    TEST(r.file_error == 0 && scrub3.passes() == 1);
+
+    return status;
+}
+
+bool test_read_error()
+{
+    bool status = true;
+    COMMENT("test_read_error()");
+
+    MemFile image, sidecar;
+    make_image(image, 4 * IMAGESCRUB_CHUNK_SIZE);
+    ImageScrub scrub;
+    image.fail_offset = 3 * IMAGESCRUB_CHUNK_SIZE + 8192;
+
+    COMMENT("Error during baseline pass keeps sidecar without gaps");
+    PassResult r = run_pass(scrub, image, sidecar);
+    TEST(r.read_error == 1 && r.bad_chunk == 3 && r.ok == 3);
+    TEST(scrub.readErrors() == 1);
+    TEST(sidecar.size() == sizeof(ImageScrubHeader) + 4 * sizeof(uint32_t));
+
+    COMMENT("Chunk is baselined after the error clears");
+    image.fail_offset = (uint64_t)-1;
+    r = run_pass(scrub, image, sidecar);
+    TEST(r.read_error == 0 && r.mismatch == 0 && r.ok == 4);
+    r = run_pass(scrub, image, sidecar);
+    TEST(r.read_error == 0 && r.mismatch == 0 && r.ok == 4);
+
+    COMMENT("Error in middle chunk after baseline");
+    image.fail_offset = IMAGESCRUB_CHUNK_SIZE;
+    r = run_pass(scrub, image, sidecar);
+    TEST(r.read_error == 1 && r.bad_chunk == 1 && r.ok == 3);
+    TEST(scrub.firstBadChunk() == 3);
+
+    return status;
+}
+
+int main()
+{
+    if (test_crc32c() && test_baseline() && test_bitflip() &&
+        test_writes() && test_resize() && test_read_error())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -0,0 +1,192 @@
+/*
+ * Event state for MMC GET EVENT STATUS NOTIFICATION command.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Hosts poll GET EVENT STATUS NOTIFICATION several times per second, so
+// the 4-byte event descriptors are built when the state changes and a poll
+// only has to copy one of them out. Each event class has a small queue, so
+// that e.g. a media removal followed quickly by new media is reported to
+// the host as two separate events.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Notification class numbers, MMC-5 table 137
+#define MMC_EVENT_CLASS_OPERATIONAL 1
+#define MMC_EVENT_CLASS_POWER       2
+#define MMC_EVENT_CLASS_MEDIA       4
+#define MMC_EVENT_CLASS_BUSY        6
+
+// Bitmask of supported classes, as in the notification class request field
+#define MMC_EVENT_SUPPORTED_CLASSES ( \
+    (1 << MMC_EVENT_CLASS_OPERATIONAL) | (1 << MMC_EVENT_CLASS_POWER) | \
+    (1 << MMC_EVENT_CLASS_MEDIA) | (1 << MMC_EVENT_CLASS_BUSY))
+
+// Event codes
+#define MMC_EVENT_NO_CHANGE           0
+#define MMC_OPERATIONAL_NOTIFICATION  2
+#define MMC_MEDIA_NEW                 2
+#define MMC_MEDIA_REMOVAL             3
+
+// Operational change report codes
+#define MMC_OPERATIONAL_REPORT_FEATURE_CHANGE 2
+
+// Power status
+#define MMC_POWER_ACTIVE 1
+
+// Media status bits
+#define MMC_MEDIA_STATUS_TRAY_OPEN 0x01
+#define MMC_MEDIA_STATUS_PRESENT   0x02
+
+#define MMC_EVENT_QUEUE_LEN 4
+
+// Maximum size of response from MMCEvents::poll()
+#define MMC_EVENT_RESPONSE_LEN 8
+
+class MMCEvents
+{
+public:
+    MMCEvents()
+    {
+        memset(m_queues, 0, sizeof(m_queues));
+        m_queues[indexOf(MMC_EVENT_CLASS_POWER)].idle[1] = MMC_POWER_ACTIVE;
+        m_queues[indexOf(MMC_EVENT_CLASS_MEDIA)].idle[1] = MMC_MEDIA_STATUS_PRESENT;
+    }
+
+    // Medium was removed and the tray is open
+    void mediaRemoved()
+    {
+        setMediaStatus(MMC_MEDIA_STATUS_TRAY_OPEN);
+        postMedia(MMC_MEDIA_REMOVAL);
+    }
+
+    // Tray was closed with a medium in it
+    void mediaInserted()
+    {
+        setMediaStatus(MMC_MEDIA_STATUS_PRESENT);
+        postMedia(MMC_MEDIA_NEW);
+    }
+
+    // Drive features changed, e.g. after switching from CD-ROM to blank CD-R
+    void operationalChange(uint16_t report)
+    {
+        uint8_t event[4] = {MMC_OPERATIONAL_NOTIFICATION, 0, (uint8_t)(report >> 8), (uint8_t)report};
+        post(MMC_EVENT_CLASS_OPERATIONAL, event);
+    }
+
+    // Check if the class has events queued
+    bool pending(int event_class) const
+    {
+        return m_queues[indexOf(event_class)].count > 0;
+    }
+
+    // Build response to a polled GET EVENT STATUS NOTIFICATION.
+    // request is the notification class request field from the CDB.
+    // The lowest numbered requested class with a queued event is reported
+    // and the event is removed from the queue. If there are no events,
+    // current status of the lowest numbered requested class is reported.
+    // Returns number of bytes written to buf.
+    int poll(uint8_t request, uint8_t *buf)
+    {
+        uint8_t classes = request & MMC_EVENT_SUPPORTED_CLASSES;
+        buf[0] = 0;
+        buf[3] = MMC_EVENT_SUPPORTED_CLASSES;
+
+        if (classes == 0)
+        {
+            // No Event Available
+            buf[1] = 2;
+            buf[2] = 0x80;
+            return 4;
+        }
+
+        int report = -1;
+        for (int cls = 1; cls < 8; cls++)
+        {
+            if (!(classes & (1 << cls))) continue;
+            if (report < 0) report = cls;
+            if (pending(cls))
+            {
+                report = cls;
+                break;
+            }
+        }
+
+        queue_t &q = m_queues[indexOf(report)];
+        buf[1] = 6;
+        buf[2] = report;
+        if (q.count > 0)
+        {
+            memcpy(&buf[4], q.events[q.head], 4);
+            q.head = (q.head + 1) % MMC_EVENT_QUEUE_LEN;
+            q.count--;
+        }
+        else
+        {
+            memcpy(&buf[4], q.idle, 4);
+        }
+        return 8;
+    }
+
+private:
+    struct queue_t
+    {
+        uint8_t idle[4]; // Descriptor reported when there are no events
+        uint8_t events[MMC_EVENT_QUEUE_LEN][4];
+        uint8_t head;
+        uint8_t count;
+    };
+
+    queue_t m_queues[4];
+
+    static int indexOf(int event_class)
+    {
+        switch (event_class)
+        {
+            case MMC_EVENT_CLASS_OPERATIONAL: return 0;
+            case MMC_EVENT_CLASS_POWER: return 1;
+            case MMC_EVENT_CLASS_MEDIA: return 2;
+            default: return 3;
+        }
+    }
+
+    void setMediaStatus(uint8_t status)
+    {
+        m_queues[indexOf(MMC_EVENT_CLASS_MEDIA)].idle[1] = status;
+    }
+
+    void postMedia(uint8_t code)
+    {
+        uint8_t event[4] = {code, m_queues[indexOf(MMC_EVENT_CLASS_MEDIA)].idle[1], 0, 0};
+        post(MMC_EVENT_CLASS_MEDIA, event);
+    }
+
+    // Queue an event descriptor. If the queue is full, the oldest
+    // event is dropped so that the host sees the latest state.
+    void post(int event_class, const uint8_t event[4])
+    {
+        queue_t &q = m_queues[indexOf(event_class)];
+        if (q.count == MMC_EVENT_QUEUE_LEN)
+        {
+            q.head = (q.head + 1) % MMC_EVENT_QUEUE_LEN;
+            q.count--;
+        }
+        memcpy(q.events[(q.head + q.count) % MMC_EVENT_QUEUE_LEN], event, 4);
+        q.count++;
+    }
+};
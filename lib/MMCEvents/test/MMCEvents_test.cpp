@@ -0,0 +1,173 @@
+#include "MMCEvents.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+#define MEDIA_REQUEST (1 << MMC_EVENT_CLASS_MEDIA)
+
+bool test_idle()
+{
+    bool status = true;
+    MMCEvents events;
+    uint8_t buf[MMC_EVENT_RESPONSE_LEN];
+
+    COMMENT("test_idle()");
+    TEST(events.poll(MEDIA_REQUEST, buf) == 8);
+    TEST(buf[0] == 0 && buf[1] == 6);
+    TEST(buf[2] == MMC_EVENT_CLASS_MEDIA);
+    TEST(buf[3] == 0x56);
+    TEST(buf[4] == MMC_EVENT_NO_CHANGE);
+    TEST(buf[5] == MMC_MEDIA_STATUS_PRESENT);
+
+    COMMENT("Power class reports active state");
+    TEST(events.poll(1 << MMC_EVENT_CLASS_POWER, buf) == 8);
+    TEST(buf[2] == MMC_EVENT_CLASS_POWER);
+    TEST(buf[4] == MMC_EVENT_NO_CHANGE);
+    TEST(buf[5] == MMC_POWER_ACTIVE);
+
+    COMMENT("Lowest requested class is reported when idle");
+    TEST(events.poll(0x7E, buf) == 8);
+    TEST(buf[2] == MMC_EVENT_CLASS_OPERATIONAL);
+
+    COMMENT("Unsupported classes give No Event Available");
+    TEST(events.poll(0x08, buf) == 4);
+    TEST(buf[1] == 2);
+    TEST(buf[2] == 0x80);
+    TEST(buf[3] == 0x56);
+    TEST(events.poll(0, buf) == 4);
+    TEST(buf[2] == 0x80);
+
+    return status;
+}
+
+bool test_eject_insert()
+{
+    bool status = true;
+    MMCEvents events;
+    uint8_t buf[MMC_EVENT_RESPONSE_LEN];
+
+    COMMENT("test_eject_insert()");
+    events.mediaRemoved();
+    TEST(events.pending(MMC_EVENT_CLASS_MEDIA));
+    events.poll(MEDIA_REQUEST, buf);
+    TEST(buf[2] == MMC_EVENT_CLASS_MEDIA);
+    TEST(buf[4] == MMC_MEDIA_REMOVAL);
+    TEST(buf[5] == MMC_MEDIA_STATUS_TRAY_OPEN);
+    TEST(!events.pending(MMC_EVENT_CLASS_MEDIA));
+
+    COMMENT("Tray stays open until media is inserted");
+    events.poll(MEDIA_REQUEST, buf);
+    TEST(buf[4] == MMC_EVENT_NO_CHANGE);
+    TEST(buf[5] == MMC_MEDIA_STATUS_TRAY_OPEN);
+
+    events.mediaInserted();
+    events.poll(MEDIA_REQUEST, buf);
+    TEST(buf[4] == MMC_MEDIA_NEW);
+    TEST(buf[5] == MMC_MEDIA_STATUS_PRESENT);
+    events.poll(MEDIA_REQUEST, buf);
+    TEST(buf[4] == MMC_EVENT_NO_CHANGE);
+    TEST(buf[5] == MMC_MEDIA_STATUS_PRESENT);
+
+    return status;
+}
+
+bool test_switch_sequence()
+{
+    bool status = true;
+    MMCEvents events;
+    uint8_t buf[MMC_EVENT_RESPONSE_LEN];
+
+    COMMENT("test_switch_sequence()");
+    // Image switched twice before the host polls
+    events.mediaRemoved();
+    events.mediaInserted();
+    events.mediaRemoved();
+    events.mediaInserted();
+
+    COMMENT("Other classes do not consume media events");
+    events.poll(1 << MMC_EVENT_CLASS_BUSY, buf);
+    TEST(buf[2] == MMC_EVENT_CLASS_BUSY);
+    TEST(buf[4] == MMC_EVENT_NO_CHANGE);
+
+    const uint8_t expected[4] = {MMC_MEDIA_REMOVAL, MMC_MEDIA_NEW, MMC_MEDIA_REMOVAL, MMC_MEDIA_NEW};
+    for (int i = 0; i < 4; i++)
+    {
+        events.poll(MEDIA_REQUEST, buf);
+        TEST(buf[4] == expected[i]);
+    }
+    events.poll(MEDIA_REQUEST, buf);
+    TEST(buf[4] == MMC_EVENT_NO_CHANGE);
+
+    COMMENT("Full queue drops the oldest event");
+    for (int i = 0; i < MMC_EVENT_QUEUE_LEN; i++)
+    {
+        events.mediaRemoved();
+    }
+    events.mediaInserted();
+    for (int i = 0; i < MMC_EVENT_QUEUE_LEN - 1; i++)
+    {
+        events.poll(MEDIA_REQUEST, buf);
+        TEST(buf[4] == MMC_MEDIA_REMOVAL);
+    }
+    events.poll(MEDIA_REQUEST, buf);
+    TEST(buf[4] == MMC_MEDIA_NEW);
+    TEST(!events.pending(MMC_EVENT_CLASS_MEDIA));
+
+    return status;
+}
+
+bool test_class_priority()
+{
+    bool status = true;
+    MMCEvents events;
+    uint8_t buf[MMC_EVENT_RESPONSE_LEN];
+
+    COMMENT("test_class_priority()");
+    events.mediaRemoved();
+    events.operationalChange(MMC_OPERATIONAL_REPORT_FEATURE_CHANGE);
+
+    COMMENT("Only requested classes are reported");
+    events.poll(MMC_EVENT_SUPPORTED_CLASSES & ~(1 << MMC_EVENT_CLASS_OPERATIONAL), buf);
+    TEST(buf[2] == MMC_EVENT_CLASS_MEDIA);
+    TEST(buf[4] == MMC_MEDIA_REMOVAL);
+
+    COMMENT("Lowest numbered class with events is reported first");
+    events.mediaInserted();
+    events.poll(MMC_EVENT_SUPPORTED_CLASSES, buf);
+    TEST(buf[2] == MMC_EVENT_CLASS_OPERATIONAL);
+    TEST(buf[4] == MMC_OPERATIONAL_NOTIFICATION);
+    TEST(buf[6] == 0 && buf[7] == MMC_OPERATIONAL_REPORT_FEATURE_CHANGE);
+
+    COMMENT("Pending class is reported before idle lower class");
+    events.poll(MMC_EVENT_SUPPORTED_CLASSES, buf);
+    TEST(buf[2] == MMC_EVENT_CLASS_MEDIA);
+    TEST(buf[4] == MMC_MEDIA_NEW);
+
+    events.poll(MMC_EVENT_SUPPORTED_CLASSES, buf);
+    TEST(buf[2] == MMC_EVENT_CLASS_OPERATIONAL);
+    TEST(buf[4] == MMC_EVENT_NO_CHANGE);
+
+    return status;
+}
+
+int main()
+{
+    if (test_idle() && test_eject_insert() && test_switch_sequence() && test_class_priority())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -0,0 +1,151 @@
+/*
+ * Per-target copy of the mode page values set by the host.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ModeShadow.h"
+#include <string.h>
+
+static const uint8_t g_page_codes[MODESHADOW_PAGE_COUNT] = {0x01, 0x08, 0x0E};
+
+// Bits that the host can change, same layout as the pages
+static const uint8_t g_page_masks[MODESHADOW_PAGE_COUNT][MODESHADOW_PAGE_BYTES] =
+{
+    // Read-Write Error Recovery: flags, read retry count, write retry count
+    // and recovery time limit.
+    {0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x00, 0xFF, 0xFF},
+
+    // Caching: WCE and RCD bits
+    {0x00, 0x00, 0x05},
+
+    // CD Audio Control: Immed and SOTC bits, port channels and volumes
+    {0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF},
+};
+
+static int findPage(uint8_t page_code)
+{
+    for (int i = 0; i < MODESHADOW_PAGE_COUNT; i++)
+    {
+        if (g_page_codes[i] == (page_code & 0x3F)) return i;
+    }
+    return -1;
+}
+
+// Replace changeable bits of page with the stored values
+static void overlay(uint8_t *page, int len, const ModeShadowPage &stored, const uint8_t *mask)
+{
+    if (len > stored.len) len = stored.len;
+    for (int i = 2; i < len; i++)
+    {
+        page[i] = (page[i] & ~mask[i]) | (stored.data[i] & mask[i]);
+    }
+}
+
+void ModeShadow::reset()
+{
+    memset(&m_saved, 0, sizeof(m_saved));
+    m_saved.magic = MODESHADOW_MAGIC;
+    m_saved.version = MODESHADOW_VERSION;
+    memset(m_current, 0, sizeof(m_current));
+}
+
+bool ModeShadow::sense(int pc, uint8_t *page, int len) const
+{
+    int idx = findPage(page[0]);
+    if (idx < 0) return false;
+
+    const uint8_t *mask = g_page_masks[idx];
+    if (pc == MODESHADOW_PC_CURRENT)
+    {
+        overlay(page, len, m_current[idx], mask);
+    }
+    else if (pc == MODESHADOW_PC_CHANGEABLE)
+    {
+        for (int i = 2; i < len && i < MODESHADOW_PAGE_BYTES; i++)
+        {
+            page[i] = mask[i];
+        }
+    }
+    else if (pc == MODESHADOW_PC_SAVED)
+    {
+        overlay(page, len, m_saved.pages[idx], mask);
+    }
+
+    return true;
+}
+
+bool ModeShadow::select(const uint8_t *page, int len, bool save, bool *saved_changed)
+{
+    if (saved_changed) *saved_changed = false;
+
+    int idx = findPage(page[0]);
+    if (idx < 0) return false;
+
+    if (len > MODESHADOW_PAGE_BYTES) len = MODESHADOW_PAGE_BYTES;
+
+    ModeShadowPage &current = m_current[idx];
+    memset(&current, 0, sizeof(current));
+    current.len = len;
+    for (int i = 0; i < len; i++)
+    {
+        current.data[i] = page[i] & ((i < 2) ? 0xFF : g_page_masks[idx][i]);
+    }
+    current.data[0] &= 0x3F; // PS bit is not part of the value
+
+    if (save && memcmp(&m_saved.pages[idx], &current, sizeof(current)) != 0)
+    {
+        m_saved.pages[idx] = current;
+        if (saved_changed) *saved_changed = true;
+    }
+
+    return true;
+}
+
+bool ModeShadow::changed(uint8_t page_code) const
+{
+    int idx = findPage(page_code);
+    return idx >= 0 && m_current[idx].len > 0;
+}
+
+bool ModeShadow::saveBlockSize(uint32_t block_size)
+{
+    if (m_saved.block_size == block_size) return false;
+    m_saved.block_size = block_size;
+    return true;
+}
+
+bool ModeShadow::restore(const ModeShadowSaved &saved)
+{
+    reset();
+
+    if (saved.magic != MODESHADOW_MAGIC || saved.version != MODESHADOW_VERSION)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < MODESHADOW_PAGE_COUNT; i++)
+    {
+        const ModeShadowPage &page = saved.pages[i];
+        if (page.len > MODESHADOW_PAGE_BYTES ||
+            (page.len > 0 && (page.len < 2 || page.data[0] != g_page_codes[i])))
+        {
+            return false;
+        }
+    }
+
+    m_saved = saved;
+    memcpy(m_current, m_saved.pages, sizeof(m_current));
+    return true;
+}
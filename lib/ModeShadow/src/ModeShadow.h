@@ -0,0 +1,103 @@
+/*
+ * Per-target copy of the mode page values set by the host.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// MODE SENSE builds pages from constant tables. For the pages listed below
+// the changeable bits received with MODE SELECT are stored here and laid
+// over the table values, so that the host reads back what it has set.
+// Bits that cannot be changed are ignored in MODE SELECT, as many hosts
+// send back pages with default values in them.
+//
+// Pages selected with the SP (save pages) bit, and the block length from
+// the block descriptor, are also kept as saved values. ModeShadowSaved is
+// stored as such in a sidecar file next to the image.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MODESHADOW_MAGIC 0x45444F4D // "MODE"
+#define MODESHADOW_VERSION 1
+#define MODESHADOW_PAGE_BYTES 16 // Including page code and length
+
+// MODE SENSE page control field
+#define MODESHADOW_PC_CURRENT 0
+#define MODESHADOW_PC_CHANGEABLE 1
+#define MODESHADOW_PC_DEFAULT 2
+#define MODESHADOW_PC_SAVED 3
+
+enum ModeShadowPageIndex
+{
+    MODESHADOW_ERROR_RECOVERY,  // 0x01 Read-Write Error Recovery
+    MODESHADOW_CACHING,         // 0x08 Caching
+    MODESHADOW_CD_AUDIO,        // 0x0E CD Audio Control
+    MODESHADOW_PAGE_COUNT
+};
+
+// Page bytes from MODE SELECT, len is 0 if the page has not been set
+struct ModeShadowPage
+{
+    uint8_t len;
+    uint8_t data[MODESHADOW_PAGE_BYTES];
+};
+
+struct ModeShadowSaved
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_size; // 0 if not set
+    ModeShadowPage pages[MODESHADOW_PAGE_COUNT];
+};
+
+class ModeShadow
+{
+public:
+    ModeShadow() { reset(); }
+
+    // Forget all values, MODE SENSE reports the defaults
+    void reset();
+
+    // Update a page built by MODE SENSE from its default table.
+    // len is the page length including the two header bytes.
+    // Returns false if the page is not kept here.
+    bool sense(int pc, uint8_t *page, int len) const;
+
+    // Store changeable bits of a page received with MODE SELECT.
+    // len is the page length including the two header bytes.
+    // Returns false if the page is not kept here. If saved_changed is
+    // given, it is set to true when the saved values were modified.
+    bool select(const uint8_t *page, int len, bool save, bool *saved_changed = NULL);
+
+    // True if the host has set the page since reset
+    bool changed(uint8_t page_code) const;
+
+    // Block length set with MODE SELECT or FORMAT UNIT.
+    // Returns true if the saved value changed.
+    bool saveBlockSize(uint32_t block_size);
+    uint32_t savedBlockSize() const { return m_saved.block_size; }
+
+    // Saved values, as stored in the sidecar file
+    const ModeShadowSaved &saved() const { return m_saved; }
+
+    // Set current and saved values from the sidecar file.
+    // Returns false if the data is not valid, values are then reset.
+    bool restore(const ModeShadowSaved &saved);
+
+private:
+    ModeShadowSaved m_saved;
+    ModeShadowPage m_current[MODESHADOW_PAGE_COUNT];
+};
@@ -0,0 +1,263 @@
+#include "ModeShadow.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+/*************************************************/
+/* Default pages, same as in mode.c              */
+/*************************************************/
+
+static const uint8_t ErrorRecoveryPage[] =
+{
+    0x01, 0x0A, 0x26, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+static const uint8_t ErrorRecoveryPage_SCSI1[] =
+{
+    0x01, 0x06, 0x26, 0x00, 0x00, 0x00, 0x00, 0xFF
+};
+
+static const uint8_t CachingPage[] =
+{
+    0x08, 0x0A, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+static const uint8_t CDAudioPage[] =
+{
+    0x0E, 0x0E, 0x04, 0x00, 0x00, 0x80, 0x00, 0x4B,
+    0x01, 0xFF, 0x02, 0xFF, 0x00, 0x00, 0x00, 0x00
+};
+
+static const uint8_t ControlModePage[] =
+{
+    0x0A, 0x06, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00
+};
+
+// MODE SENSE of one page: copy table and let the shadow update it
+static void sense(const ModeShadow &shadow, int pc, const uint8_t *table, int len, uint8_t *out)
+{
+    memcpy(out, table, len);
+    if (pc == MODESHADOW_PC_CHANGEABLE) memset(out + 2, 0, len - 2);
+    shadow.sense(pc, out, len);
+}
+
+/*****************/
+/* Test cases    */
+/*****************/
+
+bool test_defaults()
+{
+    bool status = true;
+    COMMENT("test_defaults()");
+
+    ModeShadow shadow;
+    uint8_t page[16];
+
+    sense(shadow, MODESHADOW_PC_CURRENT, CachingPage, sizeof(CachingPage), page);
+    TEST(memcmp(page, CachingPage, sizeof(CachingPage)) == 0);
+    sense(shadow, MODESHADOW_PC_SAVED, ErrorRecoveryPage, sizeof(ErrorRecoveryPage), page);
+    TEST(memcmp(page, ErrorRecoveryPage, sizeof(ErrorRecoveryPage)) == 0);
+    TEST(!shadow.changed(0x08));
+
+    COMMENT("Changeable values");
+    sense(shadow, MODESHADOW_PC_CHANGEABLE, CachingPage, sizeof(CachingPage), page);
+    TEST(page[0] == 0x08 && page[1] == 0x0A);
+    TEST(page[2] == 0x05);
+    TEST(page[3] == 0x00);
+    sense(shadow, MODESHADOW_PC_CHANGEABLE, CDAudioPage, sizeof(CDAudioPage), page);
+    TEST(page[2] == 0x06 && page[8] == 0xFF && page[11] == 0xFF && page[12] == 0x00);
+
+    COMMENT("Other pages are not kept");
+    memcpy(page, ControlModePage, sizeof(ControlModePage));
+    TEST(!shadow.sense(MODESHADOW_PC_CHANGEABLE, page, sizeof(ControlModePage)));
+    TEST(memcmp(page, ControlModePage, sizeof(ControlModePage)) == 0);
+    TEST(!shadow.select(ControlModePage, sizeof(ControlModePage), false));
+
+    return status;
+}
+
+bool test_round_trip()
+{
+    bool status = true;
+    COMMENT("test_round_trip()");
+
+    ModeShadow shadow;
+    uint8_t page[16];
+
+    COMMENT("Host enables write cache and read cache");
+    uint8_t caching[sizeof(CachingPage)];
+    memcpy(caching, CachingPage, sizeof(caching));
+    caching[2] = 0x04; // WCE set, RCD clear
+    caching[4] = 0x12; // Pre-fetch length cannot be changed
+    TEST(shadow.select(caching, sizeof(caching), false));
+    TEST(shadow.changed(0x08));
+    sense(shadow, MODESHADOW_PC_CURRENT, CachingPage, sizeof(CachingPage), page);
+    TEST(page[2] == 0x04);
+    TEST(page[4] == 0x00);
+    TEST(memcmp(page + 5, CachingPage + 5, sizeof(CachingPage) - 5) == 0);
+
+    COMMENT("Not saved without SP bit");
+    sense(shadow, MODESHADOW_PC_SAVED, CachingPage, sizeof(CachingPage), page);
+    TEST(page[2] == 0x01);
+    sense(shadow, MODESHADOW_PC_DEFAULT, CachingPage, sizeof(CachingPage), page);
+    TEST(page[2] == 0x01);
+
+    COMMENT("PS bit in page code is accepted");
+    caching[0] = 0x88;
+    caching[2] = 0x05;
+    TEST(shadow.select(caching, sizeof(caching), true));
+    sense(shadow, MODESHADOW_PC_SAVED, CachingPage, sizeof(CachingPage), page);
+    TEST(page[0] == 0x08 && page[2] == 0x05);
+
+    COMMENT("Error recovery retry counts");
+    uint8_t recovery[sizeof(ErrorRecoveryPage)];
+    memcpy(recovery, ErrorRecoveryPage, sizeof(recovery));
+    recovery[2] = 0xC0;
+    recovery[3] = 8;
+    recovery[8] = 4;
+    recovery[10] = 0x01; recovery[11] = 0xF4;
+    recovery[4] = 0x55; // Correction span cannot be changed
+    shadow.select(recovery, sizeof(recovery), false);
+    sense(shadow, MODESHADOW_PC_CURRENT, ErrorRecoveryPage, sizeof(ErrorRecoveryPage), page);
+    TEST(page[2] == 0xC0 && page[3] == 8 && page[8] == 4);
+    TEST(page[10] == 0x01 && page[11] == 0xF4);
+    TEST(page[4] == 0x00);
+
+    COMMENT("SCSI-1 page is shorter");
+    sense(shadow, MODESHADOW_PC_CURRENT, ErrorRecoveryPage_SCSI1, sizeof(ErrorRecoveryPage_SCSI1), page);
+    TEST(page[1] == 0x06 && page[2] == 0xC0 && page[3] == 8);
+    TEST(page[7] == 0xFF);
+
+    uint8_t recovery1[sizeof(ErrorRecoveryPage_SCSI1)];
+    memcpy(recovery1, ErrorRecoveryPage_SCSI1, sizeof(recovery1));
+    recovery1[3] = 2;
+    shadow.select(recovery1, sizeof(recovery1), false);
+    sense(shadow, MODESHADOW_PC_CURRENT, ErrorRecoveryPage, sizeof(ErrorRecoveryPage), page);
+    TEST(page[2] == 0x26 && page[3] == 2);
+    TEST(page[8] == 0 && page[10] == 0 && page[11] == 0);
+
+    COMMENT("CD audio volume");
+    uint8_t audio[sizeof(CDAudioPage)];
+    memcpy(audio, CDAudioPage, sizeof(audio));
+    audio[2] = 0x00; // Immed clear
+    audio[9] = 0x40; audio[11] = 0x80;
+    audio[7] = 0x10; // LBAs per second cannot be changed
+    shadow.select(audio, sizeof(audio), true);
+    sense(shadow, MODESHADOW_PC_CURRENT, CDAudioPage, sizeof(CDAudioPage), page);
+    TEST(page[2] == 0x00 && page[9] == 0x40 && page[11] == 0x80);
+    TEST(page[7] == 0x4B);
+
+    COMMENT("Reset returns to defaults");
+    shadow.reset();
+    sense(shadow, MODESHADOW_PC_CURRENT, CDAudioPage, sizeof(CDAudioPage), page);
+    TEST(memcmp(page, CDAudioPage, sizeof(CDAudioPage)) == 0);
+    TEST(!shadow.changed(0x0E));
+
+    return status;
+}
+
+bool test_saved()
+{
+    bool status = true;
+    COMMENT("test_saved()");
+
+    ModeShadow shadow;
+    uint8_t page[16];
+
+    uint8_t caching[sizeof(CachingPage)];
+    memcpy(caching, CachingPage, sizeof(caching));
+    caching[2] = 0x04;
+    bool saved_changed = false;
+    TEST(shadow.select(caching, sizeof(caching), true, &saved_changed));
+    TEST(saved_changed);
+
+    COMMENT("Saving the same page again does not change saved values");
+    TEST(shadow.select(caching, sizeof(caching), true, &saved_changed));
+    TEST(!saved_changed);
+    TEST(shadow.select(caching, sizeof(caching), false, &saved_changed));
+    TEST(!saved_changed);
+
+    COMMENT("Bits that cannot be changed do not count as a change");
+    caching[3] = 0xFF;
+    TEST(shadow.select(caching, sizeof(caching), true, &saved_changed));
+    TEST(!saved_changed);
+    caching[3] = 0x00;
+
+    COMMENT("Block size is saved once");
+    TEST(shadow.saveBlockSize(1024));
+    TEST(!shadow.saveBlockSize(1024));
+    TEST(shadow.savedBlockSize() == 1024);
+
+    // Values not saved are not stored in the file
+    uint8_t recovery[sizeof(ErrorRecoveryPage)];
+    memcpy(recovery, ErrorRecoveryPage, sizeof(recovery));
+    recovery[3] = 8;
+    shadow.select(recovery, sizeof(recovery), false);
+
+    COMMENT("Sidecar file contents survive reboot");
+    uint8_t file[sizeof(ModeShadowSaved)];
+    memcpy(file, &shadow.saved(), sizeof(file));
+
+    ModeShadow after;
+    ModeShadowSaved loaded;
+    memcpy(&loaded, file, sizeof(loaded));
+    TEST(after.restore(loaded));
+    TEST(after.savedBlockSize() == 1024);
+    TEST(after.changed(0x08));
+    TEST(!after.changed(0x01));
+    sense(after, MODESHADOW_PC_CURRENT, CachingPage, sizeof(CachingPage), page);
+    TEST(page[2] == 0x04);
+    sense(after, MODESHADOW_PC_SAVED, CachingPage, sizeof(CachingPage), page);
+    TEST(page[2] == 0x04);
+    sense(after, MODESHADOW_PC_CURRENT, ErrorRecoveryPage, sizeof(ErrorRecoveryPage), page);
+    TEST(page[3] == 0);
+
+    COMMENT("Invalid file is ignored");
+    ModeShadowSaved bad = loaded;
+    bad.magic = 0;
+    TEST(!after.restore(bad));
+    TEST(after.savedBlockSize() == 0);
+    TEST(!after.changed(0x08));
+
+    bad = loaded;
+    bad.version = MODESHADOW_VERSION + 1;
+    TEST(!after.restore(bad));
+
+    bad = loaded;
+    bad.pages[MODESHADOW_CACHING].len = MODESHADOW_PAGE_BYTES + 1;
+    TEST(!after.restore(bad));
+
+    bad = loaded;
+    bad.pages[MODESHADOW_CACHING].data[0] = 0x0E;
+    TEST(!after.restore(bad));
+
+    COMMENT("Empty file from a reset shadow");
+    ModeShadow empty;
+    TEST(after.restore(empty.saved()));
+    TEST(after.savedBlockSize() == 0);
+    TEST(!after.changed(0x08));
+
+    return status;
+}
+
+int main()
+{
+    if (test_defaults() && test_round_trip() && test_saved())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ * Bookkeeping of the read prefetch buffer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "PrefetchCache.h"
+
+PrefetchCache::PrefetchCache(uint32_t buffer_size):
+    m_buffer_size(buffer_size)
+{
+    m_scsiId = 0;
+    clear();
+}
+
+void PrefetchCache::clear()
+{
+    m_sector = 0;
+    m_bytes = 0;
+    m_warm = false;
+}
+
+void PrefetchCache::busReset()
+{
+    if (!m_warm)
+    {
+        clear();
+    }
+}
+
+void PrefetchCache::warmUp(uint8_t scsiId, uint32_t sector, uint32_t bytes)
+{
+    m_scsiId = scsiId;
+    m_sector = sector;
+    m_bytes = (bytes > m_buffer_size) ? m_buffer_size : bytes;
+    m_warm = true;
+}
+
+uint32_t PrefetchCache::lookup(uint8_t scsiId, uint32_t lba, uint32_t blocks, uint32_t bytesPerSector,
+                               uint32_t *offset)
+{
+    // Hit or miss, the warmed up region is now treated as normal prefetch
+    m_warm = false;
+
+    uint32_t sectors = m_bytes / bytesPerSector;
+    if (scsiId != m_scsiId || lba < m_sector || lba >= m_sector + sectors)
+    {
+        return 0;
+    }
+
+    uint32_t start = lba - m_sector;
+    uint32_t count = sectors - start;
+    if (count > blocks) count = blocks;
+    *offset = start * bytesPerSector;
+    return count;
+}
+
+uint32_t PrefetchCache::begin(uint8_t scsiId, uint32_t next_sector, uint32_t max_sectors,
+                              uint32_t image_sectors, uint32_t bytesPerSector)
+{
+    m_warm = false;
+    m_scsiId = scsiId;
+    m_sector = next_sector;
+    m_bytes = 0;
+
+    uint32_t count = max_sectors;
+    if (count > m_buffer_size / bytesPerSector) count = m_buffer_size / bytesPerSector;
+
+    // Don't try to read past image end
+    if (next_sector >= image_sectors) return 0;
+    if (count > image_sectors - next_sector) count = image_sectors - next_sector;
+    return count;
+}
@@ -0,0 +1,74 @@
+/*
+ * Bookkeeping of the read prefetch buffer.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// After a read has been sent to the host, the following sectors of the same
+// image are read into the prefetch buffer while the transfer finishes. The
+// next read is answered from the buffer if it starts inside it.
+//
+// At boot the buffer can be warmed up with a region from the read heatmap.
+// That region is kept over bus resets until the first read after it, which
+// either uses it or replaces it with normal prefetch.
+//
+// The buffer itself is owned by the caller, this class only tracks what it
+// holds and how much may be written to it.
+
+#pragma once
+
+#include <stdint.h>
+
+class PrefetchCache
+{
+public:
+    // buffer_size is the size of the prefetch buffer in bytes
+    explicit PrefetchCache(uint32_t buffer_size);
+
+    // Forget the buffer contents, e.g. after a write
+    void clear();
+
+    // Bus reset, keeps a warmed up region that has not been read yet
+    void busReset();
+
+    // Buffer was filled with bytes from sector onwards at boot
+    void warmUp(uint8_t scsiId, uint32_t sector, uint32_t bytes);
+    bool warm() const { return m_warm; }
+
+    // Start of a read. Returns the number of sectors at the start of the
+    // read found in the buffer, starting at *offset bytes in it.
+    // A warmed up region is kept only until this first read.
+    uint32_t lookup(uint8_t scsiId, uint32_t lba, uint32_t blocks, uint32_t bytesPerSector,
+                    uint32_t *offset);
+
+    // End of a read, the buffer is refilled from next_sector. Returns the
+    // number of sectors that may be prefetched, limited by max_sectors,
+    // the buffer size and the end of the image.
+    uint32_t begin(uint8_t scsiId, uint32_t next_sector, uint32_t max_sectors,
+                   uint32_t image_sectors, uint32_t bytesPerSector);
+
+    // Bytes were prefetched to the buffer at offset bytes()
+    void added(uint32_t count) { m_bytes += count; }
+
+    uint32_t sector() const { return m_sector; }
+    uint32_t bytes() const { return m_bytes; }
+    uint8_t scsiId() const { return m_scsiId; }
+
+private:
+    uint32_t m_buffer_size;
+    uint32_t m_sector;
+    uint32_t m_bytes;
+    uint8_t m_scsiId;
+    bool m_warm;
+};
@@ -0,0 +1,139 @@
+#include "PrefetchCache.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+#define BUFFER_SIZE 8192
+#define SECTOR 512
+#define BUFFER_SECTORS (BUFFER_SIZE / SECTOR)
+
+// Two fixed drives, the warmed up region is far past the end of the second one
+#define BIG_ID 0
+#define BIG_SECTORS 2000000
+#define SMALL_ID 1
+#define SMALL_SECTORS 1000
+#define HOT_SECTOR 1500000
+
+/*****************/
+/* Test cases    */
+/*****************/
+
+bool test_sequential()
+{
+    bool status = true;
+    COMMENT("test_sequential()");
+
+    PrefetchCache cache(BUFFER_SIZE);
+    uint32_t offset = 0;
+    TEST(cache.lookup(SMALL_ID, 0, 8, SECTOR, &offset) == 0);
+    TEST(cache.begin(SMALL_ID, 8, BUFFER_SECTORS, SMALL_SECTORS, SECTOR) == BUFFER_SECTORS);
+    cache.added(4 * SECTOR);
+
+    COMMENT("Next read starts inside prefetched data");
+    TEST(cache.lookup(SMALL_ID, 10, 8, SECTOR, &offset) == 2 && offset == 2 * SECTOR);
+    TEST(cache.lookup(SMALL_ID, 12, 8, SECTOR, &offset) == 0);
+    TEST(cache.lookup(BIG_ID, 8, 8, SECTOR, &offset) == 0);
+
+    COMMENT("Prefetch stops at image end");
+    TEST(cache.begin(SMALL_ID, SMALL_SECTORS - 3, BUFFER_SECTORS, SMALL_SECTORS, SECTOR) == 3);
+    TEST(cache.begin(SMALL_ID, SMALL_SECTORS, BUFFER_SECTORS, SMALL_SECTORS, SECTOR) == 0);
+    TEST(cache.begin(SMALL_ID, SMALL_SECTORS + 10, BUFFER_SECTORS, SMALL_SECTORS, SECTOR) == 0);
+
+    COMMENT("Prefetch is limited to buffer size");
+    TEST(cache.begin(BIG_ID, 0, 64, BIG_SECTORS, SECTOR) == BUFFER_SECTORS);
+    TEST(cache.begin(BIG_ID, 0, 64, BIG_SECTORS, 2048) == BUFFER_SIZE / 2048);
+
+    COMMENT("Write and bus reset clear the buffer");
+    cache.added(BUFFER_SIZE);
+    cache.clear();
+    TEST(cache.bytes() == 0);
+    cache.begin(BIG_ID, 0, 64, BIG_SECTORS, SECTOR);
+    cache.added(BUFFER_SIZE);
+    cache.busReset();
+    TEST(cache.bytes() == 0);
+
+    return status;
+}
+
+bool test_warm_miss()
+{
+    bool status = true;
+    COMMENT("test_warm_miss()");
+
+    PrefetchCache cache(BUFFER_SIZE);
+    uint32_t offset = 0;
+    cache.warmUp(BIG_ID, HOT_SECTOR, BUFFER_SIZE);
+    TEST(cache.warm());
+
+    COMMENT("Warmed region survives bus resets at boot");
+    cache.busReset();
+    cache.busReset();
+    TEST(cache.warm() && cache.bytes() == BUFFER_SIZE && cache.sector() == HOT_SECTOR);
+
+    COMMENT("First read from the smaller image misses and drops it");
+    TEST(cache.lookup(SMALL_ID, 100, 4, SECTOR, &offset) == 0);
+    TEST(!cache.warm());
+
+    COMMENT("Prefetch after the miss stays inside the smaller image and buffer");
+    uint32_t count = cache.begin(SMALL_ID, 104, BUFFER_SECTORS, SMALL_SECTORS, SECTOR);
+    TEST(count == BUFFER_SECTORS);
+    TEST(cache.bytes() == 0 && cache.sector() == 104 && cache.scsiId() == SMALL_ID);
+    cache.added(count * SECTOR);
+    TEST(cache.bytes() <= BUFFER_SIZE);
+
+    COMMENT("Sequential prefetch works right after the miss");
+    TEST(cache.lookup(SMALL_ID, 104, 4, SECTOR, &offset) == 4 && offset == 0);
+
+    COMMENT("Bus reset now clears the buffer");
+    cache.busReset();
+    TEST(cache.bytes() == 0);
+
+    return status;
+}
+
+bool test_warm_hit()
+{
+    bool status = true;
+    COMMENT("test_warm_hit()");
+
+    PrefetchCache cache(BUFFER_SIZE);
+    uint32_t offset = 0;
+    cache.warmUp(BIG_ID, HOT_SECTOR, BUFFER_SIZE);
+
+    COMMENT("Read inside warmed region is answered from it");
+    TEST(cache.lookup(BIG_ID, HOT_SECTOR + 4, 64, SECTOR, &offset) == BUFFER_SECTORS - 4);
+    TEST(offset == 4 * SECTOR);
+    TEST(!cache.warm());
+
+    COMMENT("Normal prefetch follows");
+    TEST(cache.begin(BIG_ID, HOT_SECTOR + 68, BUFFER_SECTORS, BIG_SECTORS, SECTOR) == BUFFER_SECTORS);
+    TEST(cache.sector() == HOT_SECTOR + 68 && cache.bytes() == 0);
+
+    COMMENT("Warm-up larger than the buffer is limited");
+    cache.warmUp(BIG_ID, 0, 2 * BUFFER_SIZE);
+    TEST(cache.bytes() == BUFFER_SIZE);
+
+    return status;
+}
+
+int main()
+{
+    if (test_sequential() && test_warm_miss() && test_warm_hit())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -24,9 +24,10 @@ static const uint8_t SupportedDiagnosticPages[] =
 {
 0x00, // Page Code
 0x00, // Reserved
-0x02, // Page length
+0x03, // Page length
 0x00, // Support "Supported diagnostic page"
-0x40  // Support "Translate address page"
+0x40, // Support "Translate address page"
+0x80  // Vendor specific "Selection latency page"
 };
 
 void scsiSendDiagnostic()
@@ -93,18 +94,17 @@ void scsiReceiveDiagnostic()
 
 		// Convert each supplied address back to a simple
 		// 64bit linear address, then convert back again.
+		const ScsiGeometry* geom = s2s_getGeometry();
 		uint64_t fromByteAddr =
 			scsiByteAddress(
-				scsiDev.target->liveCfg.bytesPerSector,
-				scsiDev.target->cfg->headsPerCylinder,
-				scsiDev.target->cfg->sectorsPerTrack,
+				geom->bytesPerSector,
+				geom->headsPerCylinder,
+				geom->sectorsPerTrack,
 				suppliedFmt,
 				&scsiDev.data[6]);
 
-		scsiSaveByteAddress(
-			scsiDev.target->liveCfg.bytesPerSector,
-			scsiDev.target->cfg->headsPerCylinder,
-			scsiDev.target->cfg->sectorsPerTrack,
+		scsiGeometrySaveByteAddress(
+			geom,
 			translateFmt,
 			fromByteAddr,
 			&scsiDev.data[6]);
@@ -117,6 +117,27 @@ void scsiReceiveDiagnostic()
 		scsiDev.dataLen = 14;
 		scsiDev.phase = DATA_IN;
 	}
+	else if (pageCode == 0x80)
+	{
+		// Vendor specific: time from SEL to BSY in microseconds.
+		// Longest seen, followed by histogram where bucket n counts
+		// selections answered in less than (SCSI_SEL_LATENCY_BASE_US << n).
+		int pageLen = 2 + 2 * SCSI_SEL_LATENCY_BUCKETS;
+		scsiDev.data[0] = 0x80;
+		scsiDev.data[1] = 0;
+		scsiDev.data[2] = 0;
+		scsiDev.data[3] = pageLen;
+		scsiDev.data[4] = scsiDev.selLatencyMax >> 8;
+		scsiDev.data[5] = scsiDev.selLatencyMax;
+		for (int i = 0; i < SCSI_SEL_LATENCY_BUCKETS; i++)
+		{
+			scsiDev.data[6 + i * 2] = scsiDev.selLatencyHist[i] >> 8;
+			scsiDev.data[7 + i * 2] = scsiDev.selLatencyHist[i];
+		}
+
+		scsiDev.dataLen = 4 + pageLen;
+		scsiDev.phase = DATA_IN;
+	}
 	else
 	{
 		// error.
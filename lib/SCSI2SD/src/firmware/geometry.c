@@ -151,17 +151,18 @@ uint64_t scsiByteAddress(
 }
 
 
-void scsiSaveByteAddress(
-	uint16_t bytesPerSector,
-	uint16_t headsPerCylinder,
-	uint16_t sectorsPerTrack,
+// Store the address in the requested format. cyl, head and sector
+// are only used for the physical formats.
+static void saveAddress(
 	int format,
-	uint64_t byteAddr,
+	uint32_t lba,
+	uint32_t byteOffset,
+	uint16_t bytesPerSector,
+	uint32_t cyl,
+	uint8_t head,
+	uint32_t sector,
 	uint8_t* buf)
 {
-	uint32_t lba = byteAddr / bytesPerSector;
-	uint32_t byteOffset = byteAddr % bytesPerSector;
-
 	switch (format)
 	{
 	case ADDRESS_BLOCK:
@@ -179,14 +180,7 @@ void scsiSaveByteAddress(
 
 	case ADDRESS_PHYSICAL_BYTE:
 	{
-		uint32_t cyl;
-		uint8_t head;
-		uint32_t sector;
-		uint32_t bytes;
-
-		LBA2CHS(lba, &cyl, &head, &sector, headsPerCylinder, sectorsPerTrack);
-
-		bytes = sector * bytesPerSector + byteOffset;
+		uint32_t bytes = sector * bytesPerSector + byteOffset;
 
 		buf[0] = cyl >> 16;
 		buf[1] = cyl >> 8;
@@ -202,12 +196,6 @@ void scsiSaveByteAddress(
 
 	case ADDRESS_PHYSICAL_SECTOR:
 	{
-		uint32_t cyl;
-		uint8_t head;
-		uint32_t sector;
-
-		LBA2CHS(lba, &cyl, &head, &sector, headsPerCylinder, sectorsPerTrack);
-
 		buf[0] = cyl >> 16;
 		buf[1] = cyl >> 8;
 		buf[2] = cyl;
@@ -223,6 +211,121 @@ void scsiSaveByteAddress(
 	default:
 		memset(buf, 0, 8);
 	}
+}
 
+void scsiSaveByteAddress(
+	uint16_t bytesPerSector,
+	uint16_t headsPerCylinder,
+	uint16_t sectorsPerTrack,
+	int format,
+	uint64_t byteAddr,
+	uint8_t* buf)
+{
+	uint32_t lba = byteAddr / bytesPerSector;
+	uint32_t byteOffset = byteAddr % bytesPerSector;
+
+	uint32_t cyl = 0;
+	uint8_t head = 0;
+	uint32_t sector = 0;
+	if (format == ADDRESS_PHYSICAL_BYTE || format == ADDRESS_PHYSICAL_SECTOR)
+	{
+		LBA2CHS(lba, &cyl, &head, &sector, headsPerCylinder, sectorsPerTrack);
+	}
+
+	saveAddress(format, lba, byteOffset, bytesPerSector, cyl, head, sector, buf);
 }
 
+void reciprocalInit(Reciprocal* recip, uint32_t divisor)
+{
+	// Invalid configuration, avoid dividing by zero
+	if (divisor == 0) divisor = 1;
+
+	recip->divisor = divisor;
+	recip->multiplier = 0xFFFFFFFF / divisor;
+}
+
+uint64_t reciprocalDivide64(
+	const Reciprocal* recip, uint64_t value, uint32_t* remainder)
+{
+	if ((value >> 32) == 0)
+	{
+		return reciprocalDivide(recip, value, remainder);
+	}
+
+	// Long division in 16 bit digits. The remainder is less than
+	// the divisor, so each partial dividend fits in 32 bits.
+	uint64_t quotient = 0;
+	uint32_t rem = 0;
+	for (int shift = 48; shift >= 0; shift -= 16)
+	{
+		uint32_t part = (rem << 16) | ((value >> shift) & 0xFFFF);
+		quotient = (quotient << 16) | reciprocalDivide(recip, part, &rem);
+	}
+
+	if (remainder) *remainder = rem;
+	return quotient;
+}
+
+void scsiGeometryInit(
+	ScsiGeometry* geom,
+	uint32_t sdSectorStart,
+	uint16_t bytesPerSector,
+	uint32_t scsiSectors,
+	uint16_t headsPerCylinder,
+	uint16_t sectorsPerTrack,
+	uint64_t imageBytes)
+{
+	geom->sdSectorStart = sdSectorStart;
+	geom->scsiSectors = scsiSectors;
+	geom->imageBytes = imageBytes;
+	geom->bytesPerSector = bytesPerSector;
+	geom->headsPerCylinder = headsPerCylinder;
+	geom->sectorsPerTrack = sectorsPerTrack;
+
+	reciprocalInit(&geom->bytesPerSectorRecip, bytesPerSector);
+	reciprocalInit(&geom->sectorsPerTrackRecip, sectorsPerTrack);
+	reciprocalInit(&geom->headsPerCylinderRecip, headsPerCylinder);
+	reciprocalInit(&geom->sectorsPerCylinderRecip,
+		((uint32_t) sectorsPerTrack) * headsPerCylinder);
+
+	geom->capacity = getScsiCapacity(sdSectorStart, bytesPerSector, scsiSectors);
+	geom->imageSectors = reciprocalDivide64(&geom->bytesPerSectorRecip, imageBytes, NULL);
+
+	uint8_t head;
+	uint32_t sector;
+	scsiGeometryLBA2CHS(geom, geom->capacity, &geom->cylinders, &head, &sector);
+}
+
+void scsiGeometryLBA2CHS(
+	const ScsiGeometry* geom,
+	uint32_t lba,
+	uint32_t* c,
+	uint8_t* h,
+	uint32_t* s)
+{
+	uint32_t sector;
+	uint32_t head;
+	uint32_t track = reciprocalDivide(&geom->sectorsPerTrackRecip, lba, &sector);
+	reciprocalDivide(&geom->headsPerCylinderRecip, track, &head);
+
+	*c = reciprocalDivide(&geom->sectorsPerCylinderRecip, lba, NULL);
+	*h = head;
+	*s = sector + 1;
+}
+
+void scsiGeometrySaveByteAddress(
+	const ScsiGeometry* geom,
+	int format,
+	uint64_t byteAddr,
+	uint8_t* buf)
+{
+	uint32_t byteOffset;
+	uint32_t lba = reciprocalDivide64(&geom->bytesPerSectorRecip, byteAddr, &byteOffset);
+
+	uint32_t cyl;
+	uint8_t head;
+	uint32_t sector;
+	scsiGeometryLBA2CHS(geom, lba, &cyl, &head, &sector);
+
+	saveAddress(format, lba, byteOffset, geom->bytesPerSector, cyl, head, sector, buf);
+}
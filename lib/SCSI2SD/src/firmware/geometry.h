@@ -74,5 +74,84 @@ void scsiSaveByteAddress(
 	uint64_t byteAddr,
 	uint8_t* buf);
 
+// Division by a constant that is known in advance, using a multiply
+// and at most one correction step.
+typedef struct
+{
+	uint32_t divisor;
+	uint32_t multiplier; // 0xFFFFFFFF / divisor
+} Reciprocal;
+
+void reciprocalInit(Reciprocal* recip, uint32_t divisor);
+
+static inline uint32_t reciprocalDivide(
+	const Reciprocal* recip, uint32_t value, uint32_t* remainder)
+{
+	// The estimate is either exact or one too small.
+	uint32_t quotient = ((uint64_t)value * recip->multiplier) >> 32;
+	uint32_t rem = value - quotient * recip->divisor;
+	if (rem >= recip->divisor)
+	{
+		quotient++;
+		rem -= recip->divisor;
+	}
+	if (remainder) *remainder = rem;
+	return quotient;
+}
+
+// 64 bit division, divisor must be less than 65536.
+uint64_t reciprocalDivide64(
+	const Reciprocal* recip, uint64_t value, uint32_t* remainder);
+
+// Capacity and geometry of a target, computed once when the image or
+// sector size changes, so that the commands that report or translate
+// addresses only need lookups and multiplications.
+typedef struct
+{
+	// Configuration the values were computed from
+	uint32_t sdSectorStart;
+	uint32_t scsiSectors;
+	uint64_t imageBytes;
+	uint16_t bytesPerSector;
+	uint16_t headsPerCylinder;
+	uint16_t sectorsPerTrack;
+
+	uint32_t capacity; // Same as getScsiCapacity()
+	uint32_t imageSectors; // Whole sectors in image at current sector size
+	uint32_t cylinders; // Cylinder of LBA capacity, as used in mode pages
+
+	Reciprocal bytesPerSectorRecip;
+	Reciprocal sectorsPerTrackRecip;
+	Reciprocal headsPerCylinderRecip;
+	Reciprocal sectorsPerCylinderRecip;
+} ScsiGeometry;
+
+void scsiGeometryInit(
+	ScsiGeometry* geom,
+	uint32_t sdSectorStart,
+	uint16_t bytesPerSector,
+	uint32_t scsiSectors,
+	uint16_t headsPerCylinder,
+	uint16_t sectorsPerTrack,
+	uint64_t imageBytes);
+
+// Same as LBA2CHS() and scsiSaveByteAddress(), using the precomputed geometry.
+// scsiByteAddress() only multiplies and needs no replacement.
+void scsiGeometryLBA2CHS(
+	const ScsiGeometry* geom,
+	uint32_t lba,
+	uint32_t* c,
+	uint8_t* h,
+	uint32_t* s);
+void scsiGeometrySaveByteAddress(
+	const ScsiGeometry* geom,
+	int format,
+	uint64_t byteAddr,
+	uint8_t* buf);
+
+// Geometry of the current target, provided by the platform code.
+// It is recomputed if the image or sector size has changed since last call.
+const ScsiGeometry* s2s_getGeometry(void);
+
 
 #endif
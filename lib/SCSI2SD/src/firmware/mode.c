@@ -378,11 +378,13 @@ static void doModeSense(
 		if ((scsiDev.compatMode >= COMPAT_SCSI2))
 		{
 			pageIn(pc, idx, ReadWriteErrorRecoveryPage, sizeof(ReadWriteErrorRecoveryPage));
+			modeSenseShadowPage(pc, idx, sizeof(ReadWriteErrorRecoveryPage));
 			idx += sizeof(ReadWriteErrorRecoveryPage);
 		}
 		else
 		{
 			pageIn(pc, idx, ReadWriteErrorRecoveryPage_SCSI1, sizeof(ReadWriteErrorRecoveryPage_SCSI1));
+			modeSenseShadowPage(pc, idx, sizeof(ReadWriteErrorRecoveryPage_SCSI1));
 			idx += sizeof(ReadWriteErrorRecoveryPage_SCSI1);
 		}
 	}
@@ -444,19 +446,7 @@ static void doModeSense(
 		if (pc != 0x01)
 		{
 			// Need to fill out the number of cylinders.
-			uint32_t cyl;
-			uint8_t head;
-			uint32_t sector;
-			LBA2CHS(
-				getScsiCapacity(
-					scsiDev.target->cfg->sdSectorStart,
-					scsiDev.target->liveCfg.bytesPerSector,
-					scsiDev.target->cfg->scsiSectors),
-				&cyl,
-				&head,
-				&sector,
-				scsiDev.target->cfg->headsPerCylinder,
-				scsiDev.target->cfg->sectorsPerTrack);
+			uint32_t cyl = s2s_getGeometry()->cylinders;
 
 			scsiDev.data[idx+2] = cyl >> 16;
 			scsiDev.data[idx+3] = cyl >> 8;
@@ -490,12 +480,14 @@ static void doModeSense(
 	// we have more data to send than the allocation length provided.
 	// (ie. Try not to output any more pages below this comment)
 
+	idx += modeSenseCDWriteParametersPage(pc, idx, pageCode, &pageFound);
 
 	if ((scsiDev.compatMode >= COMPAT_SCSI2) &&
 		(pageCode == 0x08 || pageCode == 0x3F))
 	{
 		pageFound = 1;
 		pageIn(pc, idx, CachingPage, sizeof(CachingPage));
+		modeSenseShadowPage(pc, idx, sizeof(CachingPage));
 		idx += sizeof(CachingPage);
 	}
 
@@ -628,8 +620,10 @@ static void doModeSelect(void)
 			else
 			{
 				scsiDev.target->liveCfg.bytesPerSector = bytesPerSector;
-				if (bytesPerSector != scsiDev.target->cfg->bytesPerSector)
+				if (scsiDev.cdb[1] & 1) // SP Save Pages flag
 				{
+					// Hosts such as Suns switch CD-ROMs to 512 bytes on
+					// every boot, which should not carry over to other hosts.
 					s2s_configSave(scsiDev.target->targetId, bytesPerSector);
 				}
 			}
@@ -673,6 +667,17 @@ static void doModeSelect(void)
 				}
 			}
 			break;
+			case 0x01: // Read-Write error recovery page
+			case 0x08: // Caching page
+			{
+				modeSelectShadowPage(pageLen, idx);
+			}
+			break;
+			case 0x05: // CD write parameters page
+			{
+				if (!modeSelectCDWriteParametersPage(pageLen, idx)) goto bad;
+			}
+			break;
 			case 0x0E: // CD audio control page
 			{
 				if (!modeSelectCDAudioControlPage(pageLen, idx)) goto bad;
@@ -703,8 +708,8 @@ int scsiModeCommand()
 
 	uint8_t command = scsiDev.cdb[0];
 
-	// We don't currently support the setting of any parameters.
-	// (ie. no MODE SELECT(6) or MODE SELECT(10) commands)
+	// MODE SELECT keeps the changeable values of a few pages per target,
+	// other pages are accepted and ignored.
 
 	if (command == 0x1A)
 	{
@@ -143,6 +143,7 @@ void process_Status()
 	scsiEnterPhase(STATUS);
 
 	uint8_t message;
+	int messageSent = 0;
 
 	uint8_t control = scsiDev.cdb[scsiDev.cdbLen - 1];
 
@@ -181,7 +182,15 @@ void process_Status()
 		message = MSG_COMMAND_COMPLETE;
 	}
 
-	if (scsiDev.target->cfg->quirks == S2S_CFG_QUIRKS_XEBEC)
+	if (scsiDev.target->cfg->quirks != S2S_CFG_QUIRKS_XEBEC &&
+		scsiDev.target->cfg->quirks != S2S_CFG_QUIRKS_OMTI &&
+		message == MSG_COMMAND_COMPLETE)
+	{
+		// Common case, send COMMAND COMPLETE right after the status
+		// without another pass through the main loop.
+		messageSent = scsiWriteStatusMessage(scsiDev.status, message);
+	}
+	else if (scsiDev.target->cfg->quirks == S2S_CFG_QUIRKS_XEBEC)
 	{
 		// More non-standardness. Expects 2 status bytes (really status + msg)
 		// 00 d 000 err 0
@@ -211,6 +220,13 @@ void process_Status()
 	scsiDev.lastSense = scsiDev.target->sense.code;
 	scsiDev.lastSenseASC = scsiDev.target->sense.asc;
 
+	if (messageSent)
+	{
+		scsiDev.msgIn = message;
+		enter_BusFree();
+		return;
+	}
+
 	// Command Complete occurs AFTER a valid status has been
 	// sent. then we go bus-free.
 	enter_MessageIn(message);
@@ -354,15 +370,11 @@ static void process_Command()
 	// http://bitsavers.trailing-edge.com/pdf/xebec/104524C_S1410Man_Aug83.pdf
 	if ((scsiDev.lun > 0) && (scsiDev.boardCfg.flags & S2S_CFG_MAP_LUNS_TO_IDS))
 	{
-		int tgtIndex;
-		for (tgtIndex = 0; tgtIndex < S2S_MAX_TARGETS; ++tgtIndex)
+		TargetState* target = scsiDev.targetById[scsiDev.lun & 7];
+		if (target != NULL)
 		{
-			if (scsiDev.targets[tgtIndex].targetId == scsiDev.lun)
-			{
-				scsiDev.target = &scsiDev.targets[tgtIndex];
-				scsiDev.lun = 0;
-				break;
-			}
+			scsiDev.target = target;
+			scsiDev.lun = 0;
 		}
 	}
 
@@ -830,16 +842,7 @@ static void process_SelectionPhase()
 		selStatus = scsiDev.selFlag;
 	}
 
-	int tgtIndex;
-	TargetState* target = NULL;
-	for (tgtIndex = 0; tgtIndex < S2S_MAX_TARGETS; ++tgtIndex)
-	{
-		if (scsiDev.targets[tgtIndex].targetId == (selStatus & 7))
-		{
-			target = &scsiDev.targets[tgtIndex];
-			break;
-		}
-	}
+	TargetState* target = scsiDev.targetById[selStatus & 7];
 	if ((target != NULL) && (selStatus & 0x40))
 	{
 		// We've been selected!
@@ -1303,6 +1306,8 @@ void scsiInit()
 	scsiDev.compatMode = COMPAT_UNKNOWN;
 	scsiDev.hostSpeedKBs = 0;
 	scsiDev.hostSpeedMeasured = 0;
+	scsiDev.targetIdMask = 0;
+	memset(scsiDev.targetById, 0, sizeof(scsiDev.targetById));
 
 	int i;
 	for (i = 0; i < S2S_MAX_TARGETS; ++i)
@@ -1313,6 +1318,14 @@ void scsiInit()
 			scsiDev.targets[i].targetId = cfg->scsiId & S2S_CFG_TARGET_ID_BITS;
 			scsiDev.targets[i].cfg = cfg;
 
+			// First target with the ID answers, as with the earlier search
+			uint8_t id = scsiDev.targets[i].targetId;
+			if (scsiDev.targetById[id] == NULL)
+			{
+				scsiDev.targetById[id] = &scsiDev.targets[i];
+				scsiDev.targetIdMask |= 1 << id;
+			}
+
 			scsiDev.targets[i].liveCfg.bytesPerSector = cfg->bytesPerSector;
 		}
 		else
@@ -1345,6 +1358,50 @@ void scsiInit()
 	firstInit = 0;
 }
 
+void scsiInitTarget(int index)
+{
+	const S2S_TargetCfg* cfg = s2s_getConfigByIndex(index);
+	if (!cfg || !(cfg->scsiId & S2S_CFG_TARGET_ENABLED))
+	{
+		return;
+	}
+
+	TargetState* target = &scsiDev.targets[index];
+	target->targetId = cfg->scsiId & S2S_CFG_TARGET_ID_BITS;
+	target->cfg = cfg;
+	target->liveCfg.bytesPerSector = cfg->bytesPerSector;
+
+	// Table entry is set before the mask that the selection interrupt reads
+	uint8_t id = target->targetId;
+	if (scsiDev.targetById[id] == NULL)
+	{
+		scsiDev.targetById[id] = target;
+		scsiDev.targetIdMask |= 1 << id;
+	}
+}
+
+int scsiRecordSelLatency(uint32_t us)
+{
+	int bucket = 0;
+	while (bucket < SCSI_SEL_LATENCY_BUCKETS - 1 &&
+		us >= ((uint32_t)SCSI_SEL_LATENCY_BASE_US << bucket))
+	{
+		bucket++;
+	}
+
+	if (scsiDev.selLatencyHist[bucket] < 0xFFFF)
+	{
+		scsiDev.selLatencyHist[bucket]++;
+	}
+
+	if (us > scsiDev.selLatencyMax)
+	{
+		scsiDev.selLatencyMax = (us > 0xFFFF) ? 0xFFFF : us;
+		return 1;
+	}
+	return 0;
+}
+
 /* TODO REENABLE
 void scsiDisconnect()
 {
@@ -84,6 +84,12 @@ typedef enum
 #define SCSI2SD_BUFFER_SIZE (MAX_SECTOR_SIZE * 8)
 #endif
 
+// Histogram of SEL to BSY latency. Bucket n counts selections answered
+// in less than (SCSI_SEL_LATENCY_BASE_US << n) microseconds, last bucket
+// counts the rest.
+#define SCSI_SEL_LATENCY_BUCKETS 8
+#define SCSI_SEL_LATENCY_BASE_US 8
+
 // Shadow parameters, possibly not saved to flash yet.
 // Set via Mode Select
 typedef struct
@@ -123,6 +129,11 @@ typedef struct
 
 	TargetState targets[S2S_MAX_TARGETS];
 	TargetState* target;
+
+	// Emulated SCSI IDs, precomputed by scsiInit() so that selection
+	// does not need to search the targets.
+	uint8_t targetIdMask;
+	TargetState* targetById[8];
 	S2S_BoardCfg boardCfg;
 
 
@@ -174,6 +185,9 @@ typedef struct
 	uint16_t lastSenseASC;
 	uint8_t minSyncPeriod; // Debug use only.
 
+	uint16_t selLatencyHist[SCSI_SEL_LATENCY_BUCKETS];
+	uint16_t selLatencyMax; // Microseconds
+
 	int needSyncNegotiationAck;
 	int sdUnderrunCount;
 
@@ -189,6 +203,12 @@ int process_MessageIn(int releaseBusFree);
 void enter_BusFree(void);
 
 void scsiInit(void);
+// Register a target whose configuration was enabled after scsiInit(),
+// without resetting the state of other targets. Call while bus is free.
+void scsiInitTarget(int index);
+// Called by platform code with the time from SEL to BSY assertion.
+// Returns 1 if this is the longest latency seen so far.
+int scsiRecordSelLatency(uint32_t us);
 void scsiPoll(void);
 void scsiDisconnect(void);
 int scsiReconnect(void);
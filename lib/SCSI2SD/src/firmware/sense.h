@@ -68,10 +68,12 @@ typedef enum
 	IO_PROCESS_TERMINATED                                  = 0x0006,
 	ID_CRC_OR_ECC_ERROR                                    = 0x1000,
 	ILLEGAL_FUNCTION                                       = 0x2200,
+	ILLEGAL_MODE_FOR_THIS_TRACK                            = 0x6400,
 	INCOMPATIBLE_MEDIUM_INSTALLED                          = 0x3000,
 	INITIATOR_DETECTED_ERROR_MESSAGE_RECEIVED              = 0x4800,
 	INQUIRY_DATA_HAS_CHANGED                               = 0x3F03,
 	INTERNAL_TARGET_FAILURE                                = 0x4400,
+	INVALID_ADDRESS_FOR_WRITE                              = 0x2102,
 	INVALID_BITS_IN_IDENTIFY_MESSAGE                       = 0x3D00,
 	INVALID_COMMAND_OPERATION_CODE                         = 0x2000,
 	INVALID_FIELD_IN_CDB                                   = 0x2400,
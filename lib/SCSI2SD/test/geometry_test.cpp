@@ -0,0 +1,221 @@
+#include "geometry.h"
+#include "scsi.h"
+#include "sd.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+/* Same emulated SD card size as in BlueSCSI_disk.cpp */
+SdDevice sdDev = {2, 256 * 1024 * 1024 * 2, {}, {}};
+ScsiDevice scsiDev;
+
+static uint32_t g_seed = 1;
+static uint32_t random32()
+{
+    g_seed = g_seed * 1103515245 + 12345;
+    uint32_t hi = g_seed >> 16;
+    g_seed = g_seed * 1103515245 + 12345;
+    return (hi << 16) | (g_seed >> 16);
+}
+
+// Values near the interesting boundaries for the divisor
+static uint32_t test_value(int i, uint32_t divisor)
+{
+    switch (i % 8)
+    {
+        case 0: return i / 8;
+        case 1: return divisor * (i / 8);
+        case 2: return divisor * (i / 8) - 1;
+        case 3: return 0xFFFFFFFF - i / 8;
+        case 4: return (0xFFFFFFFF / divisor) * divisor;
+        default: return random32();
+    }
+}
+
+/*****************/
+/* Test cases    */
+/*****************/
+
+bool test_reciprocal()
+{
+    bool status = true;
+    COMMENT("test_reciprocal()");
+
+    COMMENT("All 16 bit divisors");
+    bool ok = true;
+    for (uint32_t divisor = 1; divisor < 65536; divisor++)
+    {
+        Reciprocal recip;
+        reciprocalInit(&recip, divisor);
+        for (int i = 0; i < 64; i++)
+        {
+            uint32_t value = test_value(i, divisor);
+            uint32_t rem;
+            uint32_t quotient = reciprocalDivide(&recip, value, &rem);
+            if (quotient != value / divisor || rem != value % divisor) ok = false;
+        }
+    }
+    TEST(ok);
+
+    COMMENT("32 bit divisors");
+    ok = true;
+    for (int n = 0; n < 100000; n++)
+    {
+        uint32_t divisor = random32() >> (n % 32);
+        if (divisor == 0) continue;
+        Reciprocal recip;
+        reciprocalInit(&recip, divisor);
+        for (int i = 0; i < 16; i++)
+        {
+            uint32_t value = test_value(i, divisor);
+            uint32_t rem;
+            uint32_t quotient = reciprocalDivide(&recip, value, &rem);
+            if (quotient != value / divisor || rem != value % divisor) ok = false;
+        }
+    }
+    TEST(ok);
+
+    COMMENT("64 bit dividends");
+    ok = true;
+    for (uint32_t divisor = 1; divisor < 65536; divisor += 7)
+    {
+        Reciprocal recip;
+        reciprocalInit(&recip, divisor);
+        for (int i = 0; i < 64; i++)
+        {
+            uint64_t value = ((uint64_t)random32() << 32) | random32();
+            if (i & 1) value >>= (i % 32);
+            if (i == 0) value = (uint64_t)-1;
+            uint32_t rem;
+            uint64_t quotient = reciprocalDivide64(&recip, value, &rem);
+            if (quotient != value / divisor || rem != value % divisor) ok = false;
+        }
+    }
+    TEST(ok);
+
+    return status;
+}
+
+// Default geometry from BlueSCSI_presets.cpp, and some common
+// drive and controller geometries.
+static const struct {
+    uint16_t sectorsPerTrack;
+    uint16_t headsPerCylinder;
+} g_geometries[] = {
+    {63, 255}, {32, 64}, {17, 4}, {17, 8}, {26, 2},
+    {32, 8}, {35, 15}, {1, 1}, {255, 255}, {65535, 65535}
+};
+
+static const uint16_t g_sector_sizes[] = {
+    MIN_SECTOR_SIZE, 256, 512, 520, 1024, 2048, 2336, 2352, 4096, MAX_SECTOR_SIZE
+};
+
+// Includes one unsupported format
+static const int g_formats[] = {
+    ADDRESS_BLOCK, ADDRESS_PHYSICAL_BYTE, ADDRESS_PHYSICAL_SECTOR, 1
+};
+
+bool test_geometry()
+{
+    bool status = true;
+    COMMENT("test_geometry()");
+
+    int count = 0;
+    bool capacity_ok = true;
+    bool chs_ok = true;
+    bool address_ok = true;
+
+    for (auto &g : g_geometries)
+    {
+        for (uint16_t bytesPerSector : g_sector_sizes)
+        {
+            for (int n = 0; n < 200; n++)
+            {
+                // Image sizes from empty to terabytes
+                uint64_t imageBytes = (n < 8) ? (uint64_t)n * 4096 :
+                    (((uint64_t)random32() << 32) | random32()) >> (20 + n % 28);
+                uint32_t scsiSectors = imageBytes / bytesPerSector;
+                uint32_t sdSectorStart = (n % 5 == 0) ? random32() % 4096 : 0;
+                count++;
+
+                ScsiGeometry geom;
+                scsiGeometryInit(&geom, sdSectorStart, bytesPerSector, scsiSectors,
+                    g.headsPerCylinder, g.sectorsPerTrack, imageBytes);
+
+                uint32_t capacity = getScsiCapacity(sdSectorStart, bytesPerSector, scsiSectors);
+                uint32_t cyl;
+                uint8_t head;
+                uint32_t sector;
+                LBA2CHS(capacity, &cyl, &head, &sector, g.headsPerCylinder, g.sectorsPerTrack);
+
+                if (geom.capacity != capacity) capacity_ok = false;
+                if (geom.imageSectors != (uint32_t)(imageBytes / bytesPerSector)) capacity_ok = false;
+                if (geom.cylinders != cyl) capacity_ok = false;
+
+                // Addresses within and beyond the image
+                for (int i = 0; i < 16; i++)
+                {
+                    uint32_t lba = (i == 0) ? 0 : (i == 1) ? capacity : random32() >> (i % 16);
+                    uint32_t c1, c2, s1, s2;
+                    uint8_t h1, h2;
+                    LBA2CHS(lba, &c1, &h1, &s1, g.headsPerCylinder, g.sectorsPerTrack);
+                    scsiGeometryLBA2CHS(&geom, lba, &c2, &h2, &s2);
+                    if (c1 != c2 || h1 != h2 || s1 != s2) chs_ok = false;
+
+                    uint64_t byteAddr = (uint64_t)lba * bytesPerSector + random32() % (bytesPerSector * 2);
+                    if (i == 15) byteAddr = (uint64_t)-1;
+                    for (int format : g_formats)
+                    {
+                        uint8_t buf1[8], buf2[8];
+                        memset(buf1, 0xAA, 8);
+                        memset(buf2, 0x55, 8);
+                        scsiSaveByteAddress(bytesPerSector, g.headsPerCylinder, g.sectorsPerTrack,
+                            format, byteAddr, buf1);
+                        scsiGeometrySaveByteAddress(&geom, format, byteAddr, buf2);
+                        if (memcmp(buf1, buf2, 8) != 0) address_ok = false;
+                    }
+                }
+            }
+        }
+    }
+
+    printf("Compared %d image configurations\n", count);
+    TEST(capacity_ok);
+    TEST(chs_ok);
+    TEST(address_ok);
+
+    COMMENT("Start beyond end of SD card");
+    ScsiGeometry geom;
+    scsiGeometryInit(&geom, sdDev.capacity, 512, 1000, 255, 63, 512000);
+    TEST(geom.capacity == 0);
+    TEST(geom.cylinders == 0);
+    TEST(geom.imageSectors == 1000);
+
+    COMMENT("Invalid geometry does not crash");
+    scsiGeometryInit(&geom, 0, 512, 1000, 0, 0, 512000);
+    TEST(geom.capacity == 1000);
+
+    return status;
+}
+
+int main()
+{
+    if (test_reciprocal() && test_geometry())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ * Portable parity generation and checking for SCSI data bus.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// SCSI uses odd parity: DBP is set when the data byte has an even number
+// of one bits, so that the 9 bits together always have an odd count.
+//
+// The platform code uses 256-entry lookup tables that combine parity with
+// the GPIO pin mapping. These functions are for the places where only the
+// parity bit is needed, such as the byte-by-byte handshake loops, and avoid
+// touching the lookup tables that the DMA transfers are reading.
+// All values here are active high.
+
+#pragma once
+
+#include <stdint.h>
+
+// 16-entry table packed into a constant, bit n is the parity bit of nibble n
+#define SCSI_PARITY_NIBBLE_TABLE 0x9669
+
+// Parity bit for one byte
+static inline uint32_t scsiParityBit(uint32_t value)
+{
+    uint32_t v = value ^ (value >> 4);
+    return (SCSI_PARITY_NIBBLE_TABLE >> (v & 0x0F)) & 1;
+}
+
+// Parity bits for the two bytes of a halfword, returned in bits 0 and 8
+static inline uint32_t scsiParityBits16(uint32_t pair)
+{
+    uint32_t v = pair ^ (pair >> 4);
+    return ((SCSI_PARITY_NIBBLE_TABLE >> (v & 0x0F)) & 1) |
+           (((SCSI_PARITY_NIBBLE_TABLE >> ((v >> 8) & 0x0F)) & 1) << 8);
+}
+
+// Parity bits for the four bytes of a word, returned in bit 0 of each byte.
+// Folds each byte onto its lowest bit, without any table lookups.
+static inline uint32_t scsiParityBits32(uint32_t word)
+{
+    word ^= word >> 4;
+    word ^= word >> 2;
+    word ^= word >> 1;
+    return ~word & 0x01010101;
+}
+
+// Check a byte read from the bus, with DBP in bit 8
+static inline bool scsiParityValid(uint32_t value)
+{
+    return scsiParityBit(value & 0xFF) == ((value >> 8) & 1);
+}
+
+// Check four bytes read from the bus against the DBP bit received with
+// each of them, in bit 0 of the corresponding byte of parity.
+static inline bool scsiParityValid32(uint32_t data, uint32_t parity)
+{
+    return scsiParityBits32(data) == parity;
+}
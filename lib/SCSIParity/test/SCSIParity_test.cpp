@@ -0,0 +1,225 @@
+#include "SCSIParity.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+/*************************************************/
+/* Reference lookup tables, generated the same   */
+/* way as in BlueSCSI_platform_RP2040 with pins  */
+/* DB0-DB7 at GPIO 0-7 and DBP at GPIO 8.        */
+/*************************************************/
+
+#define PARITY(n) ((1 ^ (n) ^ ((n)>>1) ^ ((n)>>2) ^ ((n)>>3) ^ ((n)>>4) ^ ((n)>>5) ^ ((n)>>6) ^ ((n)>>7)) & 1)
+
+static uint16_t g_scsi_parity_lookup[256];
+static uint16_t g_scsi_parity_check_lookup[512];
+
+static void init_reference()
+{
+    for (int n = 0; n < 256; n++)
+    {
+        // Active low data and parity
+        g_scsi_parity_lookup[n] = (n ^ 0xFF) | (PARITY(n) ? 0 : (1 << 8));
+    }
+
+    for (int n = 0; n < 512; n++)
+    {
+        // Active high data and flag for valid parity
+        g_scsi_parity_check_lookup[n] = ((n & 0xFF) ^ 0xFF) | (((PARITY(n & 0xFF) ^ (n >> 8)) & 1) << 8);
+    }
+}
+
+/*****************/
+/* Test cases    */
+/*****************/
+
+bool test_bytes()
+{
+    bool status = true;
+    COMMENT("test_bytes()");
+
+    bool ok = true;
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        // DBP bit of the write table, converted to active high
+        uint32_t expected = ((g_scsi_parity_lookup[n] >> 8) & 1) ^ 1;
+        if (scsiParityBit(n) != expected) ok = false;
+    }
+    TEST(ok);
+
+    COMMENT("Received bytes with parity bit");
+    ok = true;
+    for (uint32_t raw = 0; raw < 512; raw++)
+    {
+        // The check table is indexed by active low bus state
+        bool expected = (g_scsi_parity_check_lookup[raw ^ 0x1FF] & 0x100) != 0;
+        if (scsiParityValid(raw) != expected) ok = false;
+    }
+    TEST(ok);
+
+    COMMENT("Same check as scsiReadOneByte() in RP2040 scsiPhy.cpp");
+    ok = true;
+    for (uint32_t r = 0; r < 512; r++)
+    {
+        bool expected = (r == (g_scsi_parity_lookup[r & 0xFF] ^ 0x1FF));
+        if (scsiParityValid(r) != expected) ok = false;
+    }
+    TEST(ok);
+
+    return status;
+}
+
+bool test_words()
+{
+    bool status = true;
+    COMMENT("test_words()");
+
+    COMMENT("All halfwords");
+    bool ok = true;
+    for (uint32_t n = 0; n < 65536; n++)
+    {
+        uint32_t expected = scsiParityBit(n & 0xFF) | (scsiParityBit(n >> 8) << 8);
+        if (scsiParityBits16(n) != expected) ok = false;
+    }
+    TEST(ok);
+
+    COMMENT("All byte values in every position of a word");
+    ok = true;
+    for (uint32_t n = 0; n < 65536; n++)
+    {
+        uint32_t lo = n | ((n ^ 0xA5C3) << 16);
+        uint32_t hi = (n << 16) | (n ^ 0x3C5A);
+        uint32_t words[2] = {lo, hi};
+        for (int w = 0; w < 2; w++)
+        {
+            uint32_t expected = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                expected |= scsiParityBit((words[w] >> (8 * i)) & 0xFF) << (8 * i);
+            }
+            if (scsiParityBits32(words[w]) != expected) ok = false;
+        }
+    }
+    TEST(ok);
+
+    COMMENT("Single bit errors are detected in each byte");
+    ok = true;
+    uint32_t data = 0x12345678;
+    uint32_t parity = scsiParityBits32(data);
+    if (!scsiParityValid32(data, parity)) ok = false;
+    for (int bit = 0; bit < 32; bit++)
+    {
+        if (scsiParityValid32(data ^ (1 << bit), parity)) ok = false;
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        if (scsiParityValid32(data, parity ^ (1 << (8 * i)))) ok = false;
+    }
+    TEST(ok);
+
+    return status;
+}
+
+/*****************/
+/* Benchmark     */
+/*****************/
+
+static double elapsed_ns(const struct timespec &start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+}
+
+void benchmark()
+{
+    COMMENT("benchmark()");
+    const int bufsize = 1024 * 1024;
+    const int rounds = 16;
+    static uint8_t buf[bufsize];
+    static uint8_t out[bufsize];
+    uint32_t seed = 1;
+    for (int i = 0; i < bufsize; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = seed >> 16;
+    }
+
+    struct timespec start;
+    volatile uint32_t sink = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int i = 0; i < bufsize; i++)
+        {
+            out[i] = g_scsi_parity_lookup[buf[i]] >> 8;
+        }
+        sink = sink + out[r];
+    }
+    printf("Lookup table:     %.3f ns/byte\n", elapsed_ns(start) / bufsize / rounds);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int i = 0; i < bufsize; i++)
+        {
+            out[i] = scsiParityBit(buf[i]);
+        }
+        sink = sink + out[r];
+    }
+    printf("Nibble table:     %.3f ns/byte\n", elapsed_ns(start) / bufsize / rounds);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int i = 0; i < bufsize; i += 2)
+        {
+            uint32_t p = scsiParityBits16(buf[i] | (buf[i + 1] << 8));
+            out[i] = p;
+            out[i + 1] = p >> 8;
+        }
+        sink = sink + out[r];
+    }
+    printf("Halfword pairs:   %.3f ns/byte\n", elapsed_ns(start) / bufsize / rounds);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int i = 0; i < bufsize; i += 4)
+        {
+            uint32_t word;
+            memcpy(&word, &buf[i], 4);
+            word = scsiParityBits32(word);
+            memcpy(&out[i], &word, 4);
+        }
+        sink = sink + out[r];
+    }
+    printf("Word at a time:   %.3f ns/byte\n", elapsed_ns(start) / bufsize / rounds);
+}
+
+int main()
+{
+    init_reference();
+
+    if (test_bytes() && test_words())
+    {
+        benchmark();
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
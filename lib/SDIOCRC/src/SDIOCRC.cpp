@@ -0,0 +1,119 @@
+/*
+ * CRC16 checksums of SD card data blocks on a 4-bit bus.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "SDIOCRC.h"
+
+// Calculate the CRC16 checksum for parallel 4 bit lines separately.
+__attribute__((optimize("O3")))
+uint64_t sdio_crc16_4bit_checksum(const uint32_t *data, uint32_t num_words, uint64_t crc)
+{
+    const uint32_t *end = data + num_words;
+    while (data < end)
+    {
+        for (int unroll = 0; unroll < SDIOCRC_WORDS_PER_CHUNK; unroll++)
+        {
+            // Each 32-bit word contains 8 bits per line.
+            // Reverse the bytes because SDIO protocol is big-endian.
+            uint32_t data_in = __builtin_bswap32(*data++);
+
+            // Shift out 8 bits for each line
+            uint32_t data_out = crc >> 32;
+            crc <<= 32;
+
+            // XOR outgoing data to itself with 4 bit delay
+            data_out ^= (data_out >> 16);
+
+            // XOR incoming data to outgoing data with 4 bit delay
+            data_out ^= (data_in >> 16);
+
+            // XOR outgoing and incoming data to accumulator at each tap
+            uint64_t xorred = data_out ^ data_in;
+            crc ^= xorred;
+            crc ^= xorred << (5 * 4);
+            crc ^= xorred << (12 * 4);
+        }
+    }
+
+    return crc;
+}
+
+SDIOCRCVerifier::SDIOCRCVerifier()
+{
+    start(nullptr, nullptr, 0);
+}
+
+void SDIOCRCVerifier::start(const uint32_t *data, const uint32_t *checksums, uint32_t num_blocks)
+{
+    m_data = data;
+    m_checksums = checksums;
+    m_total_blocks = num_blocks;
+    m_block = 0;
+    m_words = 0;
+    m_crc = 0;
+    m_errors = 0;
+    m_first_error_block = 0;
+    m_first_error_calculated = 0;
+    m_first_error_expected = 0;
+}
+
+void SDIOCRCVerifier::update(uint32_t blocks_done, uint32_t partial_words, uint32_t max_words)
+{
+    if (blocks_done > m_total_blocks) blocks_done = m_total_blocks;
+    if (partial_words > SDIOCRC_WORDS_PER_BLOCK) partial_words = SDIOCRC_WORDS_PER_BLOCK;
+
+    while (m_block < m_total_blocks)
+    {
+        // Words of the current block that are in the buffer
+        uint32_t available = (m_block < blocks_done) ? SDIOCRC_WORDS_PER_BLOCK : partial_words;
+        uint32_t count = (available > m_words) ? (available - m_words) : 0;
+        if (count > max_words) count = max_words;
+        count -= count % SDIOCRC_WORDS_PER_CHUNK;
+
+        if (count > 0)
+        {
+            m_crc = sdio_crc16_4bit_checksum(m_data + m_block * SDIOCRC_WORDS_PER_BLOCK + m_words, count, m_crc);
+            m_words += count;
+            max_words -= count;
+        }
+
+        if (m_words < SDIOCRC_WORDS_PER_BLOCK || m_block >= blocks_done)
+        {
+            // Waiting for more data or out of time
+            return;
+        }
+
+        // Convert received checksum to little-endian format
+        uint32_t top = __builtin_bswap32(m_checksums[m_block * 2]);
+        uint32_t bottom = __builtin_bswap32(m_checksums[m_block * 2 + 1]);
+        uint64_t expected = ((uint64_t)top << 32) | bottom;
+
+        if (m_crc != expected)
+        {
+            if (m_errors == 0)
+            {
+                m_first_error_block = m_block;
+                m_first_error_calculated = m_crc;
+                m_first_error_expected = expected;
+            }
+            m_errors++;
+        }
+
+        m_block++;
+        m_words = 0;
+        m_crc = 0;
+    }
+}
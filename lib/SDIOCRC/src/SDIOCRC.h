@@ -0,0 +1,80 @@
+/*
+ * CRC16 checksums of SD card data blocks on a 4-bit bus.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// When the SDIO bus operates in 4-bit mode, the CRC16 algorithm
+// is applied to each line separately and generates total of
+// 4 x 16 = 64 bits of checksum for each 512 byte block.
+//
+// A multiple block read (CMD18) streams the blocks into memory by DMA.
+// SDIOCRCVerifier follows the DMA progress and checksums the data that has
+// already arrived, including the first part of the block that is still being
+// received. When a block completes, only its last few words remain, so the
+// checksum result is available almost as soon as the data is.
+
+#pragma once
+
+#include <stdint.h>
+
+#define SDIOCRC_WORDS_PER_BLOCK 128
+
+// Checksum is computed in chunks of this many words
+#define SDIOCRC_WORDS_PER_CHUNK 4
+
+// Calculate the checksum of num_words, which must be a multiple of
+// SDIOCRC_WORDS_PER_CHUNK. Data is in the byte order it was received in.
+// A block can be processed in parts by passing the previous result as crc.
+uint64_t sdio_crc16_4bit_checksum(const uint32_t *data, uint32_t num_words, uint64_t crc = 0);
+
+class SDIOCRCVerifier
+{
+public:
+    SDIOCRCVerifier();
+
+    // Start verifying a new transfer. Each block of data is followed on the
+    // bus by 8 bytes of checksum, which are stored separately to checksums.
+    void start(const uint32_t *data, const uint32_t *checksums, uint32_t num_blocks);
+
+    // Continue checksum calculation with the data received so far.
+    // blocks_done is the number of blocks that have been received along with
+    // their checksums, and partial_words is how much of the next block is in
+    // the buffer already. Calculation stops after max_words, so that the
+    // caller can get back to servicing other transfers.
+    void update(uint32_t blocks_done, uint32_t partial_words, uint32_t max_words);
+
+    // Number of blocks that have been compared against received checksum
+    uint32_t blocksVerified() const { return m_block; }
+
+    // Number of blocks with mismatching checksum, and details of the first one
+    uint32_t errors() const { return m_errors; }
+    uint32_t firstErrorBlock() const { return m_first_error_block; }
+    uint64_t firstErrorCalculated() const { return m_first_error_calculated; }
+    uint64_t firstErrorExpected() const { return m_first_error_expected; }
+
+private:
+    const uint32_t *m_data;
+    const uint32_t *m_checksums;
+    uint32_t m_total_blocks;
+
+    uint32_t m_block; // Block currently being checksummed
+    uint32_t m_words; // Number of words of m_block included in m_crc
+    uint64_t m_crc;
+
+    uint32_t m_errors;
+    uint32_t m_first_error_block;
+    uint64_t m_first_error_calculated;
+    uint64_t m_first_error_expected;
+};
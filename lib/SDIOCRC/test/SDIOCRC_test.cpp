@@ -0,0 +1,281 @@
+#include "SDIOCRC.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+/*************************************************/
+/* Reference implementation, one bit at a time   */
+/* for each of the four data lines separately.   */
+/*************************************************/
+
+#define BLOCK_BYTES (SDIOCRC_WORDS_PER_BLOCK * 4)
+#define MAX_BLOCKS 8
+
+// CRC16-CCITT, polynomial x^16 + x^12 + x^5 + 1
+static uint16_t crc16_bit(uint16_t crc, int bit)
+{
+    int feedback = ((crc >> 15) & 1) ^ bit;
+    crc <<= 1;
+    if (feedback) crc ^= 0x1021;
+    return crc;
+}
+
+// Build the 8 bytes that the card sends after the data, in the order
+// they appear on the bus. Each byte is two clock cycles, high nibble first,
+// and bit n of each nibble is on line DATn.
+static void reference_checksum(const uint8_t *data, uint32_t len, uint8_t *dest)
+{
+    uint16_t crc[4] = {0, 0, 0, 0};
+    for (uint32_t i = 0; i < len; i++)
+    {
+        for (int line = 0; line < 4; line++)
+        {
+            crc[line] = crc16_bit(crc[line], (data[i] >> (4 + line)) & 1);
+            crc[line] = crc16_bit(crc[line], (data[i] >> line) & 1);
+        }
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        uint8_t byte = 0;
+        for (int line = 0; line < 4; line++)
+        {
+            byte |= ((crc[line] >> (15 - 2 * i)) & 1) << (4 + line);
+            byte |= ((crc[line] >> (14 - 2 * i)) & 1) << line;
+        }
+        dest[i] = byte;
+    }
+}
+
+/*************************************************/
+/* Recorded data stream, as it comes from card   */
+/*************************************************/
+
+// Blocks of data, each followed by its checksum
+static uint8_t g_stream[MAX_BLOCKS * (BLOCK_BYTES + 8)];
+
+// Memory areas that DMA stores the stream into
+static uint32_t g_data[MAX_BLOCKS * SDIOCRC_WORDS_PER_BLOCK];
+static uint32_t g_checksums[MAX_BLOCKS * 2];
+
+static void record_stream(uint32_t seed)
+{
+    for (int blk = 0; blk < MAX_BLOCKS; blk++)
+    {
+        uint8_t *block = &g_stream[blk * (BLOCK_BYTES + 8)];
+        for (int i = 0; i < BLOCK_BYTES; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            block[i] = seed >> 16;
+        }
+
+        // Also include some constant blocks
+        if (blk == 1) memset(block, 0x00, BLOCK_BYTES);
+        if (blk == 2) memset(block, 0xFF, BLOCK_BYTES);
+
+        reference_checksum(block, BLOCK_BYTES, block + BLOCK_BYTES);
+    }
+}
+
+// Copy bytes of stream to the data and checksum buffers like the DMA
+// descriptor chain in rp2040_sdio_rx_start() does.
+static void receive(uint32_t start, uint32_t end)
+{
+    for (uint32_t pos = start; pos < end; pos++)
+    {
+        uint32_t blk = pos / (BLOCK_BYTES + 8);
+        uint32_t offset = pos % (BLOCK_BYTES + 8);
+        if (offset < BLOCK_BYTES)
+            ((uint8_t*)g_data)[blk * BLOCK_BYTES + offset] = g_stream[pos];
+        else
+            ((uint8_t*)g_checksums)[blk * 8 + offset - BLOCK_BYTES] = g_stream[pos];
+    }
+}
+
+// Progress of the transfer as seen by rp2040_sdio_rx_poll()
+static void progress(uint32_t pos, uint32_t *blocks_done, uint32_t *partial_words)
+{
+    *blocks_done = pos / (BLOCK_BYTES + 8);
+    uint32_t offset = pos % (BLOCK_BYTES + 8);
+    *partial_words = (offset < BLOCK_BYTES) ? (offset / 4) : SDIOCRC_WORDS_PER_BLOCK;
+}
+
+// Feed the stream to verifier in steps of step_bytes and check that each
+// block is verified by the time its checksum has been received.
+static bool run_stream(SDIOCRCVerifier &verifier, uint32_t num_blocks, uint32_t step_bytes, uint32_t max_words)
+{
+    bool ok = true;
+    uint32_t total = num_blocks * (BLOCK_BYTES + 8);
+    verifier.start(g_data, g_checksums, num_blocks);
+    memset(g_data, 0xAA, sizeof(g_data));
+    memset(g_checksums, 0xAA, sizeof(g_checksums));
+
+    for (uint32_t pos = 0; pos < total; )
+    {
+        uint32_t next = pos + step_bytes;
+        if (next > total) next = total;
+        receive(pos, next);
+        pos = next;
+
+        uint32_t blocks_done, partial_words;
+        progress(pos, &blocks_done, &partial_words);
+        verifier.update(blocks_done, partial_words, max_words);
+
+        if (verifier.blocksVerified() > blocks_done) ok = false;
+        if (max_words >= SDIOCRC_WORDS_PER_BLOCK * num_blocks && verifier.blocksVerified() != blocks_done) ok = false;
+    }
+
+    // Verify all remaining
+    verifier.update(num_blocks, 0, SDIOCRC_WORDS_PER_BLOCK * num_blocks);
+    if (verifier.blocksVerified() != num_blocks) ok = false;
+
+    return ok;
+}
+
+/*****************/
+/* Test cases    */
+/*****************/
+
+bool test_checksum()
+{
+    bool status = true;
+    COMMENT("test_checksum()");
+    record_stream(1);
+    receive(0, sizeof(g_stream));
+
+    bool ok = true;
+    for (int blk = 0; blk < MAX_BLOCKS; blk++)
+    {
+        uint64_t crc = sdio_crc16_4bit_checksum(&g_data[blk * SDIOCRC_WORDS_PER_BLOCK], SDIOCRC_WORDS_PER_BLOCK);
+        uint64_t expected = ((uint64_t)__builtin_bswap32(g_checksums[blk * 2]) << 32) | __builtin_bswap32(g_checksums[blk * 2 + 1]);
+        if (crc != expected)
+        {
+            printf("Block %d: calculated %016llx expected %016llx\n", blk,
+                   (unsigned long long)crc, (unsigned long long)expected);
+            ok = false;
+        }
+    }
+    TEST(ok);
+
+    COMMENT("Calculation in parts gives the same result");
+    ok = true;
+    uint64_t whole = sdio_crc16_4bit_checksum(g_data, SDIOCRC_WORDS_PER_BLOCK);
+    for (int split = 0; split <= SDIOCRC_WORDS_PER_BLOCK; split += SDIOCRC_WORDS_PER_CHUNK)
+    {
+        uint64_t crc = sdio_crc16_4bit_checksum(g_data, split);
+        crc = sdio_crc16_4bit_checksum(g_data + split, SDIOCRC_WORDS_PER_BLOCK - split, crc);
+        if (crc != whole) ok = false;
+    }
+    TEST(ok);
+
+    return status;
+}
+
+bool test_pipeline()
+{
+    bool status = true;
+    COMMENT("test_pipeline()");
+    record_stream(2);
+    SDIOCRCVerifier verifier;
+
+    COMMENT("Stream received in various step sizes");
+    const uint32_t steps[] = {4, 7, 64, 100, 512, 520, 1000, 4096};
+    bool ok = true;
+    for (uint32_t step : steps)
+    {
+        if (!run_stream(verifier, MAX_BLOCKS, step, SDIOCRC_WORDS_PER_BLOCK * MAX_BLOCKS)) ok = false;
+        if (verifier.errors() != 0) ok = false;
+    }
+    TEST(ok);
+
+    COMMENT("Limited time for each update");
+    ok = true;
+    for (uint32_t max_words = 4; max_words <= 256; max_words *= 2)
+    {
+        if (!run_stream(verifier, MAX_BLOCKS, 100, max_words)) ok = false;
+        if (verifier.errors() != 0) ok = false;
+    }
+    TEST(ok);
+
+    COMMENT("Block is not verified before its checksum arrives");
+    verifier.start(g_data, g_checksums, 2);
+    receive(0, BLOCK_BYTES + 4);
+    verifier.update(0, SDIOCRC_WORDS_PER_BLOCK, SDIOCRC_WORDS_PER_BLOCK * 2);
+    TEST(verifier.blocksVerified() == 0);
+    receive(BLOCK_BYTES + 4, BLOCK_BYTES + 8 + 256);
+    verifier.update(1, 64, SDIOCRC_WORDS_PER_BLOCK * 2);
+    TEST(verifier.blocksVerified() == 1);
+    TEST(verifier.errors() == 0);
+
+    COMMENT("Single transfer of one block");
+    TEST(run_stream(verifier, 1, BLOCK_BYTES + 8, SDIOCRC_WORDS_PER_BLOCK));
+    TEST(verifier.errors() == 0);
+
+    return status;
+}
+
+bool test_errors()
+{
+    bool status = true;
+    COMMENT("test_errors()");
+    SDIOCRCVerifier verifier;
+
+    COMMENT("Every bit of a data block");
+    bool ok = true;
+    record_stream(3);
+    for (int bit = 0; bit < BLOCK_BYTES * 8; bit++)
+    {
+        uint32_t pos = 3 * (BLOCK_BYTES + 8) + bit / 8;
+        g_stream[pos] ^= 1 << (bit & 7);
+        if (!run_stream(verifier, MAX_BLOCKS, 520, SDIOCRC_WORDS_PER_BLOCK)) ok = false;
+        if (verifier.errors() != 1 || verifier.firstErrorBlock() != 3) ok = false;
+        g_stream[pos] ^= 1 << (bit & 7);
+    }
+    TEST(ok);
+
+    COMMENT("Every bit of received checksum");
+    ok = true;
+    for (int bit = 0; bit < 64; bit++)
+    {
+        uint32_t pos = 5 * (BLOCK_BYTES + 8) + BLOCK_BYTES + bit / 8;
+        g_stream[pos] ^= 1 << (bit & 7);
+        if (!run_stream(verifier, MAX_BLOCKS, 100, SDIOCRC_WORDS_PER_BLOCK)) ok = false;
+        if (verifier.errors() != 1 || verifier.firstErrorBlock() != 5) ok = false;
+        if (verifier.firstErrorCalculated() == verifier.firstErrorExpected()) ok = false;
+        g_stream[pos] ^= 1 << (bit & 7);
+    }
+    TEST(ok);
+
+    COMMENT("Burst error on one line over several blocks");
+    for (int blk = 2; blk < 6; blk++)
+    {
+        g_stream[blk * (BLOCK_BYTES + 8) + 17] ^= 0x44;
+    }
+    TEST(run_stream(verifier, MAX_BLOCKS, 64, SDIOCRC_WORDS_PER_BLOCK));
+    TEST(verifier.errors() == 4);
+    TEST(verifier.firstErrorBlock() == 2);
+
+    return status;
+}
+
+int main()
+{
+    if (test_checksum() && test_pipeline() && test_errors())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
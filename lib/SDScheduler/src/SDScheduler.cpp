@@ -0,0 +1,140 @@
+/*
+ * Token bucket sharing of SD card bandwidth between main loop tasks.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "SDScheduler.h"
+#include <string.h>
+
+SDScheduler::SDScheduler()
+{
+    memset(m_reserve, 0, sizeof(m_reserve));
+    memset(m_stats, 0, sizeof(m_stats));
+    configure(0, 0);
+}
+
+void SDScheduler::configure(uint32_t bytes_per_ms, uint32_t burst)
+{
+    m_rate = bytes_per_ms;
+    m_burst = (burst > 0x7FFFFFFF) ? 0x7FFFFFFF : burst;
+    m_tokens = m_burst;
+    m_last_refill = 0;
+}
+
+void SDScheduler::setReserve(SDConsumer consumer, uint32_t bytes)
+{
+    m_reserve[consumer] = bytes;
+}
+
+void SDScheduler::refill(uint32_t now)
+{
+    uint32_t elapsed = now - m_last_refill;
+    m_last_refill = now;
+
+    // Limit elapsed time to avoid overflow, bucket is full by then anyway
+    uint64_t add = (uint64_t)m_rate * elapsed;
+    if (add > (uint64_t)m_burst * 2) add = (uint64_t)m_burst * 2;
+
+    int64_t tokens = (int64_t)m_tokens + (int64_t)add;
+    if (tokens > m_burst) tokens = m_burst;
+    m_tokens = tokens;
+}
+
+void SDScheduler::take(SDConsumer consumer, uint32_t bytes)
+{
+    m_stats[consumer].bytes += bytes;
+
+    // Debt is limited to one bucket, so that a long transfer is not
+    // penalized for longer than it takes to refill the bucket once.
+    int64_t tokens = (int64_t)m_tokens - bytes;
+    if (tokens < -(int64_t)m_burst) tokens = -(int64_t)m_burst;
+    m_tokens = tokens;
+}
+
+void SDScheduler::setThrottled(SDConsumer consumer, bool throttled, uint32_t now)
+{
+    if (throttled && !m_stats[consumer].throttled)
+    {
+        m_stats[consumer].throttled = true;
+        m_stats[consumer].throttled_since = now;
+        m_stats[consumer].throttle_count++;
+    }
+    else if (!throttled && m_stats[consumer].throttled)
+    {
+        m_stats[consumer].throttled = false;
+        m_stats[consumer].throttled_ms += now - m_stats[consumer].throttled_since;
+    }
+}
+
+uint32_t SDScheduler::request(SDConsumer consumer, uint32_t wanted, uint32_t unit, uint32_t now)
+{
+    if (!enabled() || consumer == SD_CONSUMER_AUDIO)
+    {
+        consume(consumer, wanted, now);
+        return wanted;
+    }
+
+    refill(now);
+
+    int64_t reserved = 0;
+    for (int i = 0; i < consumer; i++)
+    {
+        reserved += m_reserve[i];
+    }
+
+    uint32_t granted = wanted;
+    if (consumer != SD_CONSUMER_BACKGROUND && reserved == 0)
+    {
+        // Nothing with higher priority is waiting for the card
+    }
+    else
+    {
+        int64_t available = (int64_t)m_tokens - reserved;
+        if (available < (int64_t)wanted)
+        {
+            granted = (available > 0) ? (available / unit) * unit : 0;
+        }
+
+        if (granted == 0 && consumer != SD_CONSUMER_BACKGROUND)
+        {
+            // Foreground transfers must make progress
+            granted = (unit < wanted) ? unit : wanted;
+        }
+    }
+
+    setThrottled(consumer, granted < wanted, now);
+    take(consumer, granted);
+    return granted;
+}
+
+void SDScheduler::consume(SDConsumer consumer, uint32_t bytes, uint32_t now)
+{
+    if (enabled())
+    {
+        refill(now);
+    }
+
+    take(consumer, bytes);
+}
+
+uint32_t SDScheduler::throttledMs(SDConsumer consumer, uint32_t now) const
+{
+    uint32_t total = m_stats[consumer].throttled_ms;
+    if (m_stats[consumer].throttled)
+    {
+        total += now - m_stats[consumer].throttled_since;
+    }
+    return total;
+}
@@ -0,0 +1,94 @@
+/*
+ * Token bucket sharing of SD card bandwidth between main loop tasks.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// The main loop accesses the SD card for SCSI commands, CD audio playback
+// and background work such as log saving. Each access blocks the loop, so a
+// long SCSI read can delay refilling of the audio buffers until they run dry.
+//
+// The bucket is filled at the expected SD card throughput and every access
+// takes tokens from it. A consumer can only use the tokens that are left
+// after the reserves of higher priority consumers. When the bucket runs low,
+// foreground requests are split to smaller pieces so that audio is serviced
+// in between, and background work waits until the card has had time to
+// catch up. Without any reserves, foreground requests are never reduced.
+
+#pragma once
+
+#include <stdint.h>
+
+// In priority order, highest first
+enum SDConsumer
+{
+    SD_CONSUMER_AUDIO,      // Never throttled, may take the bucket below zero
+    SD_CONSUMER_SCSI,       // Gets at least one unit per request
+    SD_CONSUMER_BACKGROUND, // Scrubbing, image clearing, log saving
+    SD_CONSUMER_COUNT
+};
+
+class SDScheduler
+{
+public:
+    SDScheduler();
+
+    // Set the throughput model in bytes per millisecond and the bucket size.
+    // Rate of 0 disables scheduling, all requests are granted.
+    void configure(uint32_t bytes_per_ms, uint32_t burst);
+
+    bool enabled() const { return m_rate != 0; }
+
+    // Bytes that lower priority consumers must leave in the bucket,
+    // e.g. one audio buffer while playback is active.
+    void setReserve(SDConsumer consumer, uint32_t bytes);
+
+    // Ask for up to wanted bytes of SD access, in multiples of unit.
+    // Returns the number of bytes that may be transferred now, and takes
+    // them from the bucket. Background requests may return 0.
+    uint32_t request(SDConsumer consumer, uint32_t wanted, uint32_t unit, uint32_t now);
+
+    // Account for an access that was made without a request
+    void consume(SDConsumer consumer, uint32_t bytes, uint32_t now);
+
+    // Current bucket level, negative when in debt
+    int32_t tokens() const { return m_tokens; }
+
+    // Statistics per consumer
+    uint64_t bytes(SDConsumer consumer) const { return m_stats[consumer].bytes; }
+    uint32_t throttleCount(SDConsumer consumer) const { return m_stats[consumer].throttle_count; }
+
+    // Total time that requests have been reduced or refused, including
+    // an ongoing throttling period.
+    uint32_t throttledMs(SDConsumer consumer, uint32_t now) const;
+
+private:
+    uint32_t m_rate;
+    int32_t m_burst;
+    int32_t m_tokens;
+    uint32_t m_last_refill;
+    uint32_t m_reserve[SD_CONSUMER_COUNT];
+
+    struct {
+        uint64_t bytes;
+        uint32_t throttle_count;
+        uint32_t throttled_ms;
+        uint32_t throttled_since;
+        bool throttled;
+    } m_stats[SD_CONSUMER_COUNT];
+
+    void refill(uint32_t now);
+    void take(SDConsumer consumer, uint32_t bytes);
+    void setThrottled(SDConsumer consumer, bool throttled, uint32_t now);
+};
@@ -0,0 +1,256 @@
+#include "SDScheduler.h"
+#include <stdio.h>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+/*****************/
+/* Test cases    */
+/*****************/
+
+bool test_disabled()
+{
+    bool status = true;
+    COMMENT("test_disabled()");
+
+    SDScheduler sched;
+    TEST(!sched.enabled());
+    TEST(sched.request(SD_CONSUMER_SCSI, 65536, 512, 0) == 65536);
+    TEST(sched.request(SD_CONSUMER_BACKGROUND, 65536, 512, 0) == 65536);
+    TEST(sched.bytes(SD_CONSUMER_SCSI) == 65536);
+    TEST(sched.throttleCount(SD_CONSUMER_SCSI) == 0);
+
+    return status;
+}
+
+bool test_priorities()
+{
+    bool status = true;
+    COMMENT("test_priorities()");
+
+    SDScheduler sched;
+    sched.configure(1000, 16384);
+    uint32_t now = 100;
+
+    COMMENT("Foreground is not reduced without reserves");
+    TEST(sched.request(SD_CONSUMER_SCSI, 65536, 512, now) == 65536);
+    TEST(sched.tokens() == -16384);
+    TEST(sched.throttleCount(SD_CONSUMER_SCSI) == 0);
+
+    COMMENT("Background waits for the bucket to refill");
+    TEST(sched.request(SD_CONSUMER_BACKGROUND, 4096, 4096, now) == 0);
+    TEST(sched.throttleCount(SD_CONSUMER_BACKGROUND) == 1);
+    now += 20;
+    TEST(sched.request(SD_CONSUMER_BACKGROUND, 4096, 4096, now) == 0);
+    now += 2;
+    TEST(sched.request(SD_CONSUMER_BACKGROUND, 4096, 4096, now) == 4096);
+    TEST(sched.throttledMs(SD_CONSUMER_BACKGROUND, now) == 22);
+
+    COMMENT("Audio reserve limits foreground");
+    now += 100;
+    sched.setReserve(SD_CONSUMER_AUDIO, 8192);
+    TEST(sched.request(SD_CONSUMER_SCSI, 32768, 512, now) == 8192);
+    TEST(sched.throttleCount(SD_CONSUMER_SCSI) == 1);
+
+    COMMENT("Foreground gets at least one unit");
+    TEST(sched.request(SD_CONSUMER_SCSI, 32768, 512, now) == 512);
+
+    COMMENT("Audio is never throttled");
+    TEST(sched.request(SD_CONSUMER_AUDIO, 8192, 8192, now) == 8192);
+    TEST(sched.tokens() < 0);
+
+    COMMENT("Throttled time ends with a full grant");
+    now += 50;
+    TEST(sched.request(SD_CONSUMER_SCSI, 4096, 512, now) == 4096);
+    TEST(sched.throttledMs(SD_CONSUMER_SCSI, now + 1000) == 50);
+
+    COMMENT("Request smaller than unit");
+    sched.request(SD_CONSUMER_AUDIO, 65536, 8192, now);
+    TEST(sched.request(SD_CONSUMER_SCSI, 256, 512, now) == 256);
+
+    COMMENT("Timer wraparound");
+    SDScheduler sched2;
+    sched2.configure(1000, 16384);
+    uint32_t t = 0xFFFFFFF0;
+    sched2.setReserve(SD_CONSUMER_AUDIO, 8192);
+    sched2.request(SD_CONSUMER_SCSI, 65536, 512, t);
+    TEST(sched2.request(SD_CONSUMER_SCSI, 8192, 512, t + 32) == 8192);
+
+    return status;
+}
+
+/*******************************************************/
+/* Simulation of the main loop: CD audio playback with */
+/* long SCSI reads and background work on a slow card  */
+/*******************************************************/
+
+#define SIM_AUDIO_BUFFER 8192
+#define SIM_AUDIO_RATE (44100 * 4 / 1000.0) // bytes per ms
+#define SIM_SECTOR 512
+#define SIM_HALF_BUFFER 32768 // diskDataIn() transfers half of scsiDev.data at a time
+
+struct Simulation
+{
+    SDScheduler sched;
+    double sd_rate; // bytes per ms
+    double now;
+    double buffered; // Audio data ready for playback
+    int underruns;
+    uint64_t scsi_bytes;
+    uint64_t background_bytes;
+
+    Simulation(double rate, bool scheduled)
+    {
+        sd_rate = rate;
+        now = 0;
+        buffered = 2 * SIM_AUDIO_BUFFER;
+        underruns = 0;
+        scsi_bytes = 0;
+        background_bytes = 0;
+        if (scheduled) sched.configure(rate, 2 * SIM_AUDIO_BUFFER);
+        sched.setReserve(SD_CONSUMER_AUDIO, SIM_AUDIO_BUFFER);
+    }
+
+    // Audio DMA keeps playing while the main loop is blocked
+    void advance(double ms)
+    {
+        now += ms;
+        buffered -= SIM_AUDIO_RATE * ms;
+        if (buffered < 0)
+        {
+            underruns++;
+            buffered = 0;
+        }
+    }
+
+    void sd_access(uint32_t bytes)
+    {
+        advance(bytes / sd_rate + 0.1);
+    }
+
+    // audio_poll(): refill a buffer when one has been played
+    void audio_poll()
+    {
+        if (buffered <= SIM_AUDIO_BUFFER)
+        {
+            sched.request(SD_CONSUMER_AUDIO, SIM_AUDIO_BUFFER, SIM_AUDIO_BUFFER, now);
+            sd_access(SIM_AUDIO_BUFFER);
+            buffered += SIM_AUDIO_BUFFER;
+        }
+        advance(0.01);
+    }
+
+    // One READ command, in the same steps as diskDataIn()
+    void scsi_read(uint32_t bytes)
+    {
+        advance(0.5); // Command phase
+        while (bytes > 0)
+        {
+            uint32_t len = (bytes < SIM_HALF_BUFFER) ? bytes : SIM_HALF_BUFFER;
+            len = sched.request(SD_CONSUMER_SCSI, len, SIM_SECTOR, now);
+            sd_access(len);
+            scsi_bytes += len;
+            bytes -= len;
+            audio_poll();
+        }
+    }
+
+    // Image scrubbing or clearing between commands
+    void background()
+    {
+        uint32_t len = sched.request(SD_CONSUMER_BACKGROUND, 4096, 4096, now);
+        if (len > 0)
+        {
+            sd_access(len);
+            background_bytes += len;
+        }
+        audio_poll();
+    }
+
+    void run(double duration, uint32_t read_size, bool host_idle)
+    {
+        double end = now + duration;
+        while (now < end)
+        {
+            audio_poll();
+            if (host_idle)
+            {
+                background();
+            }
+            else
+            {
+                scsi_read(read_size);
+            }
+        }
+    }
+};
+
+bool test_simulation()
+{
+    bool status = true;
+    COMMENT("test_simulation()");
+
+    COMMENT("Slow card, 64 kB reads cause underruns without scheduling");
+    Simulation plain(500, false);
+    plain.run(10000, 65536, false);
+    printf("Unscheduled: %d underruns, SCSI %.0f kB/s\n", plain.underruns, plain.scsi_bytes / 10000.0);
+    TEST(plain.underruns > 0);
+
+    COMMENT("Same workload with scheduling");
+    Simulation sched(500, true);
+    sched.run(10000, 65536, false);
+    uint32_t throttled = sched.sched.throttledMs(SD_CONSUMER_SCSI, sched.now);
+    printf("Scheduled: %d underruns, SCSI %.0f kB/s, throttled %u ms\n",
+           sched.underruns, sched.scsi_bytes / 10000.0, (unsigned)throttled);
+    TEST(sched.underruns == 0);
+    TEST(throttled > 0);
+    // Card time not used by audio should still go to SCSI
+    TEST(sched.scsi_bytes / 10000.0 > 0.8 * (500 - SIM_AUDIO_RATE));
+
+    COMMENT("Several card speeds and read sizes");
+    bool ok = true;
+    for (double rate = 400; rate <= 20000; rate *= 2)
+    {
+        for (uint32_t size = 512; size <= 1048576; size *= 4)
+        {
+            Simulation s(rate, true);
+            s.run(2000, size, false);
+            if (s.underruns != 0)
+            {
+                printf("Underrun at %.0f kB/s with %u byte reads\n", rate, (unsigned)size);
+                ok = false;
+            }
+        }
+    }
+    TEST(ok);
+
+    COMMENT("Background work is limited to card throughput");
+    Simulation idle(500, true);
+    idle.run(10000, 0, true);
+    printf("Background: %d underruns, %.0f kB/s\n", idle.underruns, idle.background_bytes / 10000.0);
+    TEST(idle.underruns == 0);
+    TEST(idle.background_bytes / 10000.0 < 500 - SIM_AUDIO_RATE + 10);
+    TEST(idle.background_bytes > 0);
+
+    return status;
+}
+
+int main()
+{
+    if (test_disabled() && test_priorities() && test_simulation())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -0,0 +1,130 @@
+/*
+ * Tape record framing and READ(6) result decoding for tape imaging.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "TapeImage.h"
+#include <string.h>
+
+static void tapPut32(uint8_t *dst, uint32_t value)
+{
+    dst[0] = (uint8_t)value;
+    dst[1] = (uint8_t)(value >> 8);
+    dst[2] = (uint8_t)(value >> 16);
+    dst[3] = (uint8_t)(value >> 24);
+}
+
+uint32_t tapFrameRecord(uint8_t *buf, uint32_t len)
+{
+    uint32_t size = tapRecordSize(len);
+    tapPut32(buf, len);
+    if (len & 1) buf[4 + len] = 0;
+    tapPut32(buf + size - 4, len);
+    return size;
+}
+
+uint32_t tapFrameBlocks(uint8_t *buf, uint32_t blocks, uint32_t blocksize)
+{
+    // Spread the blocks out starting from the last one,
+    // each one moves forward to make room for the framing.
+    uint32_t size = tapRecordSize(blocksize);
+    for (int i = (int)blocks - 1; i >= 0; i--)
+    {
+        memmove(buf + i * size + 4, buf + 4 + i * blocksize, blocksize);
+    }
+
+    for (uint32_t i = 0; i < blocks; i++)
+    {
+        tapFrameRecord(buf + i * size, blocksize);
+    }
+
+    return blocks * size;
+}
+
+uint32_t tapPutMarker(uint8_t *buf, uint32_t marker)
+{
+    tapPut32(buf, marker);
+    return 4;
+}
+
+TapeReadResult tapeReadResult(int status, const uint8_t sense[18],
+                              uint32_t alloc, uint32_t blocksize, uint32_t received)
+{
+    TapeReadResult result = {};
+    result.length = received;
+    if (blocksize != 0 && received % blocksize != 0)
+    {
+        // Partial block cannot be stored as a fixed size record
+        result.length -= received % blocksize;
+        result.mismatch = true;
+    }
+
+    if (status != 2)
+    {
+        return result;
+    }
+
+    result.sense_key = sense[2] & 0x0F;
+    bool filemark = sense[2] & 0x80;
+    bool eom = sense[2] & 0x40;
+    bool ili = sense[2] & 0x20;
+    bool info_valid = sense[0] & 0x80;
+    int32_t residue = (int32_t)(((uint32_t)sense[3] << 24) | ((uint32_t)sense[4] << 16) |
+                                ((uint32_t)sense[5] << 8) | sense[6]);
+
+    if (info_valid)
+    {
+        // Information field is the residue in bytes or blocks,
+        // negative if a variable length record was longer than requested.
+        int64_t expected;
+        if (blocksize != 0)
+        {
+            expected = ((int64_t)(alloc / blocksize) - residue) * blocksize;
+        }
+        else
+        {
+            expected = (int64_t)alloc - residue;
+        }
+
+        if (ili && blocksize == 0 && residue < 0)
+        {
+            result.truncated = true;
+        }
+        else if (expected != (int64_t)received)
+        {
+            result.mismatch = true;
+        }
+    }
+
+    if (result.sense_key == 8 || eom)
+    {
+        result.end_of_data = true;
+    }
+    else if (filemark)
+    {
+        result.filemark = true;
+    }
+    else if (ili && blocksize == 0)
+    {
+        // Short or long record, data is valid
+    }
+    else if (result.sense_key != 1)
+    {
+        // Anything but RECOVERED ERROR
+        result.error = true;
+    }
+
+    return result;
+}
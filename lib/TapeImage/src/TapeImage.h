@@ -0,0 +1,70 @@
+/*
+ * Tape record framing and READ(6) result decoding for tape imaging.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Tape drives are imaged record by record into a SIMH style .tap container:
+// each record is stored as 32-bit little endian length, data padded to even
+// length and the length again. Filemarks are stored as zero length and the
+// end of recorded data as 0xFFFFFFFF.
+//
+// Records are read with READ(6), in variable block mode with SILI set. The
+// drive ends the data phase after a short record and completes with GOOD
+// status, so the record length is the number of bytes received. A record
+// longer than the allocation length is still reported with CHECK CONDITION,
+// the ILI bit and a negative residue in the information field.
+
+#pragma once
+
+#include <stdint.h>
+
+#define TAP_FILEMARK 0x00000000
+#define TAP_END_OF_MEDIUM 0xFFFFFFFF
+
+// Space taken by a record of given length in the container
+static inline uint32_t tapRecordSize(uint32_t len)
+{
+    return 4 + ((len + 1) & ~1) + 4;
+}
+
+// Add length framing around record data that is already at buf + 4.
+// Returns the number of bytes used.
+uint32_t tapFrameRecord(uint8_t *buf, uint32_t len);
+
+// Frame fixed size blocks that were read back to back to buf + 4.
+// Returns the number of bytes used.
+uint32_t tapFrameBlocks(uint8_t *buf, uint32_t blocks, uint32_t blocksize);
+
+// Store a filemark or end of medium marker, returns 4
+uint32_t tapPutMarker(uint8_t *buf, uint32_t marker);
+
+struct TapeReadResult
+{
+    uint32_t length;    // Bytes of data to store, multiple of block size in fixed mode
+    bool filemark;      // Filemark was read after the data
+    bool end_of_data;   // BLANK CHECK or end of medium
+    bool truncated;     // Record was longer than the allocation length
+    bool mismatch;      // Information field disagrees with the bytes received
+    bool error;         // Other error, the read should be retried
+    uint8_t sense_key;
+};
+
+// Decode the result of READ(6).
+// status is the SCSI status byte and sense the fixed format sense data,
+// which is only used for CHECK CONDITION. alloc is the allocation length
+// in bytes, blocksize 0 in variable block mode. received is the number of
+// bytes the drive sent before ending the data phase.
+TapeReadResult tapeReadResult(int status, const uint8_t sense[18],
+                              uint32_t alloc, uint32_t blocksize, uint32_t received);
@@ -0,0 +1,286 @@
+#include "TapeImage.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+/*************************************************/
+/* Simulated tape drive, answers READ(6) with    */
+/* SILI set like a SCSI-2 sequential device.     */
+/*************************************************/
+
+#define SIM_FILEMARK -1
+
+static uint8_t sim_byte(int rec, uint32_t pos)
+{
+    return (uint8_t)(rec * 31 + pos * 7 + (pos >> 8));
+}
+
+class SimTape
+{
+public:
+    SimTape(const std::vector<int> &records): m_records(records), m_pos(0) {}
+
+    // Returns SCSI status, data goes to buf and sense data to sense.
+    // count is in bytes in variable mode and in blocks in fixed mode.
+    int read(uint32_t blocksize, uint32_t count, uint8_t *buf, uint32_t *received, uint8_t sense[18])
+    {
+        memset(sense, 0, 18);
+        sense[0] = 0xF0;
+        *received = 0;
+
+        if (blocksize == 0)
+        {
+            if (m_pos >= m_records.size())
+            {
+                return check(sense, 0x08, 0, count);
+            }
+
+            int len = m_records[m_pos];
+            if (len == SIM_FILEMARK)
+            {
+                m_pos++;
+                return check(sense, 0x00, 0x80, count);
+            }
+
+            uint32_t n = ((uint32_t)len < count) ? len : count;
+            fill(buf, m_pos, 0, n);
+            *received = n;
+            m_pos++;
+
+            // Short records are not reported because of SILI
+            if ((uint32_t)len <= count) return 0;
+            return check(sense, 0x00, 0x20, (int32_t)(count - len));
+        }
+        else
+        {
+            for (uint32_t i = 0; i < count; i++)
+            {
+                if (m_pos >= m_records.size())
+                {
+                    return check(sense, 0x08, 0, count - i);
+                }
+                if (m_records[m_pos] == SIM_FILEMARK)
+                {
+                    m_pos++;
+                    return check(sense, 0x00, 0x80, count - i);
+                }
+                fill(buf + i * blocksize, m_pos, 0, blocksize);
+                *received += blocksize;
+                m_pos++;
+            }
+            return 0;
+        }
+    }
+
+private:
+    static int check(uint8_t sense[18], uint8_t key, uint8_t flags, int32_t info)
+    {
+        sense[2] = key | flags;
+        sense[3] = (uint8_t)(info >> 24);
+        sense[4] = (uint8_t)(info >> 16);
+        sense[5] = (uint8_t)(info >> 8);
+        sense[6] = (uint8_t)info;
+        return 2;
+    }
+
+    void fill(uint8_t *dst, int rec, uint32_t start, uint32_t len)
+    {
+        for (uint32_t i = 0; i < len; i++) dst[i] = sim_byte(rec, start + i);
+    }
+
+    std::vector<int> m_records;
+    size_t m_pos;
+};
+
+// Image the whole tape the same way as the initiator does, returns .tap data
+static std::vector<uint8_t> image_tape(SimTape &tape, uint32_t blocksize, uint32_t maxlen,
+                                       int *truncated, int *mismatched)
+{
+    std::vector<uint8_t> out;
+    static uint8_t buf[256 * 1024];
+    *truncated = *mismatched = 0;
+
+    for (int i = 0; i < 10000; i++)
+    {
+        uint32_t count = blocksize ? 8 : maxlen;
+        uint32_t alloc = blocksize ? count * blocksize : count;
+        uint32_t received;
+        uint8_t sense[18];
+        int status = tape.read(blocksize, count, buf + 4, &received, sense);
+        TapeReadResult r = tapeReadResult(status, sense, alloc, blocksize, received);
+        if (r.error) break;
+        if (r.truncated) (*truncated)++;
+        if (r.mismatch) (*mismatched)++;
+
+        uint32_t used = 0;
+        if (blocksize)
+        {
+            used = tapFrameBlocks(buf, r.length / blocksize, blocksize);
+        }
+        else if (r.length > 0)
+        {
+            used = tapFrameRecord(buf, r.length);
+        }
+        if (r.filemark) used += tapPutMarker(buf + used, TAP_FILEMARK);
+        if (r.end_of_data) used += tapPutMarker(buf + used, TAP_END_OF_MEDIUM);
+        out.insert(out.end(), buf, buf + used);
+
+        if (r.end_of_data) break;
+    }
+
+    return out;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Check .tap contents against the records on the simulated tape
+static bool verify_tap(const std::vector<uint8_t> &tap, const std::vector<int> &records, uint32_t maxlen)
+{
+    size_t pos = 0;
+    for (size_t rec = 0; rec < records.size(); rec++)
+    {
+        if (pos + 4 > tap.size()) return false;
+        uint32_t len = get32(&tap[pos]);
+        if (records[rec] == SIM_FILEMARK)
+        {
+            if (len != TAP_FILEMARK) return false;
+            pos += 4;
+            continue;
+        }
+
+        uint32_t expected = ((uint32_t)records[rec] < maxlen) ? records[rec] : maxlen;
+        if (len != expected) return false;
+        if (pos + tapRecordSize(len) > tap.size()) return false;
+        for (uint32_t i = 0; i < len; i++)
+        {
+            if (tap[pos + 4 + i] != sim_byte(rec, i)) return false;
+        }
+        if ((len & 1) && tap[pos + 4 + len] != 0) return false;
+        if (get32(&tap[pos + tapRecordSize(len) - 4]) != len) return false;
+        pos += tapRecordSize(len);
+    }
+
+    return pos + 4 == tap.size() && get32(&tap[pos]) == TAP_END_OF_MEDIUM;
+}
+
+/*****************/
+/* Test cases    */
+/*****************/
+
+bool test_variable()
+{
+    bool status = true;
+    COMMENT("test_variable()");
+
+    std::vector<int> records = {1, 2, 511, 512, 513, 1023, 8192, 32768, SIM_FILEMARK,
+                                3, 65535, 80, SIM_FILEMARK, SIM_FILEMARK, 7};
+    SimTape tape(records);
+    int truncated, mismatched;
+    std::vector<uint8_t> tap = image_tape(tape, 0, 65535, &truncated, &mismatched);
+    TEST(truncated == 0);
+    TEST(mismatched == 0);
+    TEST(verify_tap(tap, records, 65535));
+
+    COMMENT("Records longer than allocation length");
+    SimTape tape2(records);
+    tap = image_tape(tape2, 0, 4096, &truncated, &mismatched);
+    TEST(truncated == 3);
+    TEST(mismatched == 0);
+    TEST(verify_tap(tap, records, 4096));
+
+    COMMENT("Odd allocation length");
+    SimTape tape3(records);
+    tap = image_tape(tape3, 0, 511, &truncated, &mismatched);
+    TEST(truncated == 6);
+    TEST(verify_tap(tap, records, 511));
+
+    return status;
+}
+
+bool test_fixed()
+{
+    bool status = true;
+    COMMENT("test_fixed()");
+
+    std::vector<int> records;
+    for (int i = 0; i < 10; i++) records.push_back(512);
+    records.push_back(SIM_FILEMARK);
+    for (int i = 0; i < 3; i++) records.push_back(512);
+    records.push_back(SIM_FILEMARK);
+    for (int i = 0; i < 8; i++) records.push_back(512);
+
+    SimTape tape(records);
+    int truncated, mismatched;
+    std::vector<uint8_t> tap = image_tape(tape, 512, 512, &truncated, &mismatched);
+    TEST(truncated == 0);
+    TEST(mismatched == 0);
+    TEST(verify_tap(tap, records, 512));
+
+    return status;
+}
+
+bool test_sense()
+{
+    bool status = true;
+    COMMENT("test_sense()");
+
+    uint8_t sense[18] = {0xF0, 0x00, 0x20, 0x00, 0x00, 0x01, 0x00};
+    TapeReadResult r = tapeReadResult(2, sense, 1024, 0, 768);
+    TEST(r.length == 768 && !r.mismatch && !r.error && !r.filemark);
+
+    COMMENT("Residue disagrees with received data");
+    r = tapeReadResult(2, sense, 1024, 0, 700);
+    TEST(r.length == 700 && r.mismatch);
+
+    COMMENT("Information field not valid");
+    sense[0] = 0x70;
+    r = tapeReadResult(2, sense, 1024, 0, 700);
+    TEST(r.length == 700 && !r.mismatch && !r.error);
+
+    COMMENT("Partial block in fixed mode");
+    r = tapeReadResult(0, sense, 4096, 512, 1100);
+    TEST(r.length == 1024 && r.mismatch);
+
+    COMMENT("Medium error is retried");
+    uint8_t medium[18] = {0xF0, 0x00, 0x03};
+    r = tapeReadResult(2, medium, 1024, 0, 0);
+    TEST(r.error && r.sense_key == 3);
+
+    COMMENT("Recovered error keeps data");
+    medium[2] = 0x01;
+    r = tapeReadResult(2, medium, 1024, 0, 1024);
+    TEST(!r.error && r.length == 1024);
+
+    COMMENT("Illegal request in fixed mode is an error");
+    uint8_t illegal[18] = {0x70, 0x00, 0x25};
+    r = tapeReadResult(2, illegal, 4096, 512, 0);
+    TEST(r.error && r.sense_key == 5);
+
+    return status;
+}
+
+int main()
+{
+    if (test_variable() && test_fixed() && test_sense())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -0,0 +1,215 @@
+/*
+ * File transfers between the SD card and the host for the Toolbox commands.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// The file is accessed through the SdFat FsFile methods, so that the same
+// code can be tested on a PC with a simulated file.
+//
+// Seeking backwards in a FAT file follows the cluster chain from the start
+// of the file, so the transfers keep track of the file position and only
+// seek when the host does not continue where the previous request ended.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/*****************************************/
+/* Receiving a file from the host        */
+/*****************************************/
+
+// When the host declares the file size in advance, the file is allocated
+// in one contiguous piece. This avoids a FAT update for every new cluster
+// and makes seeking fast if the host sends blocks out of order.
+class ToolboxUpload
+{
+public:
+    ToolboxUpload() { reset(); }
+
+    void reset();
+
+    // Prepare the file for receiving declared_size bytes, 0 if not known.
+    // With a declared size the previous content of the file is discarded.
+    // Allocation failure is not an error, the file then grows as data
+    // is written.
+    template <class File>
+    bool begin(File &file, uint64_t declared_size);
+
+    // Write data at an absolute byte offset in the file
+    template <class File>
+    bool write(File &file, uint64_t offset, const uint8_t *data, uint32_t len);
+
+    // Release allocated space beyond the last byte received
+    template <class File>
+    bool end(File &file);
+
+    bool preallocated() const { return m_preallocated; }
+    uint64_t received() const { return m_end; }
+    uint32_t seeks() const { return m_seeks; }
+
+private:
+    bool m_preallocated;
+    uint64_t m_end;
+    uint32_t m_seeks;
+};
+
+/*****************************************/
+/* Sending a file to the host            */
+/*****************************************/
+
+// The next chunk is read into a separate buffer while the current one is
+// being sent, so that a sequential download alternates between the SD card
+// and the SCSI bus less. The buffer must not be used by anything else,
+// scsiDev.data is overwritten between commands.
+class ToolboxDownload
+{
+public:
+    ToolboxDownload(uint8_t *ahead, uint32_t ahead_size):
+        m_ahead(ahead), m_ahead_size(ahead_size) { reset(); }
+
+    // Forget read-ahead data, e.g. when another file is opened
+    void reset();
+
+    // Read up to len bytes from an absolute byte offset in the file.
+    // Returns number of bytes read, or -1 on error.
+    template <class File>
+    int read(File &file, uint64_t offset, uint8_t *buf, uint32_t len);
+
+    // Read the data following the previous read() into the read-ahead buffer
+    template <class File>
+    void readAhead(File &file);
+
+    uint32_t seeks() const { return m_seeks; }
+    uint32_t aheadHits() const { return m_ahead_hits; }
+
+private:
+    uint8_t *m_ahead;
+    uint32_t m_ahead_size;
+    uint64_t m_ahead_offset;
+    int m_ahead_len; // -1 if buffer is not valid
+    uint64_t m_next; // Offset following the previous read
+    uint32_t m_seeks;
+    uint32_t m_ahead_hits;
+};
+
+/*******************************/
+/* Method definitions          */
+/*******************************/
+
+inline void ToolboxUpload::reset()
+{
+    m_preallocated = false;
+    m_end = 0;
+    m_seeks = 0;
+}
+
+template <class File>
+bool ToolboxUpload::begin(File &file, uint64_t declared_size)
+{
+    reset();
+
+    if (declared_size > 0)
+    {
+        // Allocation requires an empty file
+        if (!file.truncate(0)) return false;
+        m_preallocated = file.preAllocate(declared_size);
+    }
+
+    return file.seekSet(0);
+}
+
+template <class File>
+bool ToolboxUpload::write(File &file, uint64_t offset, const uint8_t *data, uint32_t len)
+{
+    if (file.curPosition() != offset)
+    {
+        m_seeks++;
+        if (!file.seekSet(offset)) return false;
+    }
+
+    if (file.write(data, len) != len) return false;
+
+    if (offset + len > m_end) m_end = offset + len;
+    return true;
+}
+
+template <class File>
+bool ToolboxUpload::end(File &file)
+{
+    if (m_preallocated)
+    {
+        // FAT32 sets the full size at allocation and exFAT keeps the
+        // unused clusters until truncated.
+        m_preallocated = false;
+        return file.truncate(m_end);
+    }
+
+    return true;
+}
+
+inline void ToolboxDownload::reset()
+{
+    m_ahead_offset = 0;
+    m_ahead_len = -1;
+    m_next = 0;
+    m_seeks = 0;
+    m_ahead_hits = 0;
+}
+
+template <class File>
+int ToolboxDownload::read(File &file, uint64_t offset, uint8_t *buf, uint32_t len)
+{
+    if (m_ahead_len >= 0 && offset == m_ahead_offset && len == m_ahead_size)
+    {
+        // Shorter than the buffer only at the end of file
+        int count = m_ahead_len;
+        memcpy(buf, m_ahead, count);
+        m_ahead_len = -1;
+        m_ahead_hits++;
+        m_next = offset + count;
+        return count;
+    }
+
+    m_ahead_len = -1;
+
+    if (file.curPosition() != offset)
+    {
+        m_seeks++;
+        if (!file.seekSet(offset)) return -1;
+    }
+
+    int count = file.read(buf, len);
+    if (count < 0) return -1;
+
+    m_next = offset + count;
+    return count;
+}
+
+template <class File>
+void ToolboxDownload::readAhead(File &file)
+{
+    m_ahead_len = -1;
+
+    if (file.curPosition() != m_next) return;
+
+    int count = file.read(m_ahead, m_ahead_size);
+    if (count >= 0)
+    {
+        m_ahead_offset = m_next;
+        m_ahead_len = count;
+    }
+}
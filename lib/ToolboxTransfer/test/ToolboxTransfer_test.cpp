@@ -0,0 +1,409 @@
+#include "ToolboxTransfer.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+/* Unit test helpers */
+#define COMMENT(x) printf("\n----" x "----\n");
+#define TEST(x) \
+    if (!(x)) { \
+        fprintf(stderr, "\033[31;1mFAILED:\033[22;39m %s:%d %s\n", __FILE__, __LINE__, #x); \
+        status = false; \
+    } else { \
+        printf("\033[32;1mOK:\033[22;39m %s\n", #x); \
+    }
+
+/*************************************************/
+/* Simulated file on a FAT32 formatted SD card,  */
+/* with the SdFat FsFile methods used by the     */
+/* transfers and a simple cost model in us.      */
+/*************************************************/
+
+#define SIM_CLUSTER 32768
+#define SIM_SECTOR 512
+
+class SimFile
+{
+public:
+    std::vector<uint8_t> data;
+    uint64_t pos = 0;
+    uint64_t allocated = 0;  // Bytes in allocated clusters
+    bool contiguous = false; // Set by preAllocate(), seeks don't follow the chain
+    bool allow_prealloc = true;
+
+    // Statistics
+    uint32_t seek_calls = 0;
+    uint32_t read_calls = 0;
+    uint32_t write_calls = 0;
+    uint32_t partial_sectors = 0;
+    uint32_t cluster_allocs = 0;
+    uint32_t chain_walks = 0;
+    double time_us = 0;
+
+    uint64_t size() const { return data.size(); }
+    uint64_t curPosition() const { return pos; }
+
+    bool seekSet(uint64_t p)
+    {
+        seek_calls++;
+        if (p > data.size()) return false;
+
+        if (!contiguous && p != pos)
+        {
+            // Forward seeks continue from current cluster, backward seeks
+            // start from the beginning of the file.
+            uint32_t from = (p >= pos) ? pos / SIM_CLUSTER : 0;
+            uint32_t links = p / SIM_CLUSTER - from;
+            chain_walks += links;
+            time_us += 2.0 * links;
+        }
+
+        pos = p;
+        return true;
+    }
+
+    bool truncate(uint64_t len)
+    {
+        if (len > data.size()) return false;
+        data.resize(len);
+        allocated = (len + SIM_CLUSTER - 1) / SIM_CLUSTER * SIM_CLUSTER;
+        if (len == 0) contiguous = false;
+        if (pos > len) pos = len;
+        return true;
+    }
+
+    // Like FAT32 in SdFat, the file size is set to the allocated length
+    bool preAllocate(uint64_t len)
+    {
+        if (!allow_prealloc || data.size() != 0) return false;
+        data.resize(len);
+        allocated = (len + SIM_CLUSTER - 1) / SIM_CLUSTER * SIM_CLUSTER;
+        contiguous = true;
+        time_us += 1000;
+        return true;
+    }
+
+    int read(void *buf, size_t len)
+    {
+        read_calls++;
+        if (pos + len > data.size()) len = data.size() - pos;
+        time_us += 100 + 0.1 * len; // 10 MB/s
+        memcpy(buf, &data[pos], len);
+        pos += len;
+        return len;
+    }
+
+    size_t write(const void *buf, size_t len)
+    {
+        write_calls++;
+        time_us += 100 + 0.1 * len; // 10 MB/s
+
+        // Partial sectors go through the sector cache
+        if (pos % SIM_SECTOR != 0 || (pos + len) % SIM_SECTOR != 0)
+        {
+            partial_sectors++;
+            time_us += 400;
+        }
+
+        while (pos + len > allocated)
+        {
+            cluster_allocs++;
+            time_us += 300;
+            allocated += SIM_CLUSTER;
+        }
+
+        if (pos + len > data.size()) data.resize(pos + len);
+        memcpy(&data[pos], buf, len);
+        pos += len;
+        return len;
+    }
+};
+
+static std::vector<uint8_t> make_content(size_t size)
+{
+    std::vector<uint8_t> content(size);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < size; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        content[i] = seed >> 16;
+    }
+    return content;
+}
+
+// Send content in blocks in the given order, as the host would with
+// BLUESCSI_TOOLBOX_SEND_FILE_BLOCKS.
+static bool send_blocks(ToolboxUpload &upload, SimFile &file, const std::vector<uint8_t> &content,
+                        uint32_t blocksize, bool reverse)
+{
+    uint32_t count = (content.size() + blocksize - 1) / blocksize;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t block = reverse ? (count - 1 - i) : i;
+        uint64_t offset = (uint64_t)block * blocksize;
+        uint32_t len = blocksize;
+        if (offset + len > content.size()) len = content.size() - offset;
+        if (!upload.write(file, offset, &content[offset], len)) return false;
+    }
+    return true;
+}
+
+/*****************/
+/* Test cases    */
+/*****************/
+
+bool test_upload()
+{
+    bool status = true;
+    COMMENT("test_upload()");
+
+    std::vector<uint8_t> content = make_content(1024 * 1024 + 300);
+    SimFile file;
+    ToolboxUpload upload;
+
+    TEST(upload.begin(file, content.size()));
+    TEST(upload.preallocated());
+    TEST(send_blocks(upload, file, content, 32768, false));
+    TEST(upload.end(file));
+    TEST(file.data == content);
+    TEST(upload.seeks() == 0);
+    TEST(upload.received() == content.size());
+    TEST(file.cluster_allocs == 0);
+    TEST(file.partial_sectors == 1);
+
+    COMMENT("Blocks in reverse order");
+    SimFile file2;
+    TEST(upload.begin(file2, content.size()));
+    TEST(send_blocks(upload, file2, content, 32768, true));
+    TEST(upload.end(file2));
+    TEST(file2.data == content);
+    TEST(upload.seeks() > 0);
+    TEST(file2.chain_walks == 0);
+
+    return status;
+}
+
+bool test_sizes()
+{
+    bool status = true;
+    COMMENT("test_sizes()");
+
+    std::vector<uint8_t> content = make_content(300000);
+
+    COMMENT("Existing content is replaced");
+    SimFile file;
+    file.data = make_content(2 * 1024 * 1024);
+    file.allocated = file.data.size();
+    ToolboxUpload upload;
+    TEST(upload.begin(file, content.size()));
+    TEST(send_blocks(upload, file, content, 16384, false));
+    TEST(upload.end(file));
+    TEST(file.data == content);
+
+    COMMENT("Host sends less than declared");
+    SimFile file2;
+    TEST(upload.begin(file2, 1024 * 1024));
+    TEST(send_blocks(upload, file2, content, 16384, false));
+    TEST(upload.end(file2));
+    TEST(file2.size() == content.size());
+    TEST(file2.data == content);
+
+    COMMENT("Size not declared");
+    SimFile file3;
+    TEST(upload.begin(file3, 0));
+    TEST(!upload.preallocated());
+    TEST(send_blocks(upload, file3, content, 16384, false));
+    TEST(upload.end(file3));
+    TEST(file3.data == content);
+
+    COMMENT("Allocation fails");
+    SimFile file4;
+    file4.allow_prealloc = false;
+    TEST(upload.begin(file4, content.size()));
+    TEST(!upload.preallocated());
+    TEST(send_blocks(upload, file4, content, 16384, false));
+    TEST(upload.end(file4));
+    TEST(file4.data == content);
+
+    return status;
+}
+
+/*******************************************************/
+/* Simulated upload from the host, comparing the 512   */
+/* byte BLUESCSI_TOOLBOX_SEND_FILE_10 command with the */
+/* block transfer command.                             */
+/*******************************************************/
+
+// Command, status and message phases, and the host side overhead
+#define SIM_COMMAND_US 200
+#define SIM_SCSI_US_PER_BYTE 0.2 // 5 MB/s
+
+bool test_simulation()
+{
+    bool status = true;
+    COMMENT("test_simulation()");
+
+    std::vector<uint8_t> content = make_content(4 * 1024 * 1024 + 1000);
+    double size_kb = content.size() / 1024.0;
+
+    // onSendFile10(): 512 bytes per command, written at current position
+    SimFile old_file;
+    double old_us = 0;
+    uint32_t old_commands = 0;
+    for (size_t offset = 0; offset < content.size(); offset += 512)
+    {
+        size_t len = content.size() - offset;
+        if (len > 512) len = 512;
+        old_us += SIM_COMMAND_US + SIM_SCSI_US_PER_BYTE * 512;
+        old_file.write(&content[offset], len);
+        old_commands++;
+    }
+    old_us += old_file.time_us;
+    TEST(old_file.data == content);
+    printf("512 byte commands:  %u commands, %u SD writes, %u cluster allocations, %.0f kB/s\n",
+           (unsigned)old_commands, (unsigned)old_file.write_calls, (unsigned)old_file.cluster_allocs,
+           size_kb / (old_us / 1e6));
+
+    // Block transfer with declared size
+    SimFile new_file;
+    ToolboxUpload upload;
+    const uint32_t blocksize = 32768;
+    uint32_t new_commands = 0;
+    double new_us = SIM_COMMAND_US; // Preparation command
+    upload.begin(new_file, content.size());
+    for (size_t offset = 0; offset < content.size(); offset += blocksize)
+    {
+        size_t len = content.size() - offset;
+        if (len > blocksize) len = blocksize;
+        new_us += SIM_COMMAND_US + SIM_SCSI_US_PER_BYTE * len;
+        upload.write(new_file, offset, &content[offset], len);
+        new_commands++;
+    }
+    upload.end(new_file);
+    new_us += new_file.time_us;
+    TEST(new_file.data == content);
+    printf("32 kB blocks:       %u commands, %u SD writes, %u cluster allocations, %.0f kB/s\n",
+           (unsigned)new_commands, (unsigned)new_file.write_calls, (unsigned)new_file.cluster_allocs,
+           size_kb / (new_us / 1e6));
+
+    TEST(new_us * 2 < old_us);
+
+    return status;
+}
+
+bool test_download()
+{
+    bool status = true;
+    COMMENT("test_download()");
+
+    static uint8_t ahead[4096];
+    uint8_t buf[4096];
+    SimFile file;
+    file.data = make_content(100 * 4096 + 1000);
+    ToolboxDownload download(ahead, sizeof(ahead));
+
+    // Sequential download as with BLUESCSI_TOOLBOX_GET_FILE
+    std::vector<uint8_t> received;
+    for (uint64_t offset = 0; offset < file.size(); offset += 4096)
+    {
+        int count = download.read(file, offset, buf, 4096);
+        if (count <= 0) break;
+        received.insert(received.end(), buf, buf + count);
+        download.readAhead(file);
+    }
+    TEST(received == file.data);
+    TEST(download.seeks() == 0);
+    TEST(download.aheadHits() == 100);
+    TEST(file.seek_calls == 0);
+
+    COMMENT("Host repeats the previous chunk");
+    download.reset();
+    TEST(download.read(file, 4096, buf, 4096) == 4096);
+    download.readAhead(file);
+    TEST(download.read(file, 4096, buf, 4096) == 4096);
+    TEST(memcmp(buf, &file.data[4096], 4096) == 0);
+    TEST(download.seeks() == 2);
+    download.readAhead(file);
+    TEST(download.read(file, 8192, buf, 4096) == 4096);
+    TEST(memcmp(buf, &file.data[8192], 4096) == 0);
+    TEST(download.aheadHits() == 1);
+
+    COMMENT("Read-ahead past end of file");
+    TEST(download.read(file, 100 * 4096, buf, 4096) == 1000);
+    download.readAhead(file);
+    TEST(download.read(file, 100 * 4096 + 1000, buf, 4096) == 0);
+
+    return status;
+}
+
+/*******************************************************/
+/* Simulated download to the host, comparing a seek    */
+/* and read for every chunk with read-ahead during the */
+/* SCSI transfer.                                      */
+/*******************************************************/
+
+bool test_download_simulation()
+{
+    bool status = true;
+    COMMENT("test_download_simulation()");
+
+    SimFile file;
+    file.data = make_content(4 * 1024 * 1024 + 1000);
+    double size_kb = file.data.size() / 1024.0;
+    static uint8_t buf[4096];
+
+    // Previous onGetFile10(): clear buffer, seek, read, then send
+    file.pos = 12345;
+    file.chain_walks = 0;
+    file.time_us = 0;
+    double old_us = 0;
+    for (uint64_t offset = 0; offset < file.data.size(); offset += 4096)
+    {
+        memset(buf, 0, sizeof(buf));
+        file.seekSet(offset);
+        int count = file.read(buf, sizeof(buf));
+        old_us += SIM_COMMAND_US + SIM_SCSI_US_PER_BYTE * count;
+    }
+    old_us += file.time_us;
+    printf("Seek per chunk:     %u seeks, %u chain walks, %.0f kB/s\n",
+           (unsigned)file.seek_calls, (unsigned)file.chain_walks, size_kb / (old_us / 1e6));
+
+    // SD card read of the next chunk overlaps with sending the current one
+    static uint8_t ahead[4096];
+    ToolboxDownload download(ahead, sizeof(ahead));
+    file.pos = 0;
+    file.seek_calls = 0;
+    file.chain_walks = 0;
+    double new_us = 0;
+    for (uint64_t offset = 0; offset < file.data.size(); offset += 4096)
+    {
+        file.time_us = 0;
+        int count = download.read(file, offset, buf, sizeof(buf));
+        double read_us = file.time_us;
+        file.time_us = 0;
+        download.readAhead(file);
+        double send_us = SIM_SCSI_US_PER_BYTE * count;
+        new_us += SIM_COMMAND_US + read_us + (send_us > file.time_us ? send_us : file.time_us);
+    }
+    printf("Read-ahead:         %u seeks, %u chain walks, %.0f kB/s\n",
+           (unsigned)file.seek_calls, (unsigned)file.chain_walks, size_kb / (new_us / 1e6));
+
+    TEST(file.seek_calls == 0);
+    TEST(new_us * 1.3 < old_us);
+
+    return status;
+}
+
+int main()
+{
+    if (test_upload() && test_sizes() && test_simulation() &&
+        test_download() && test_download_simulation())
+    {
+        return 0;
+    }
+    else
+    {
+        printf("Some tests failed\n");
+        return 1;
+    }
+}
@@ -93,6 +93,47 @@ extern "C" void s2s_ledOff()
   LED_OFF();
 }
 
+/*****************/
+/* Boot profiler */
+/*****************/
+
+// Time spent in each initialization stage, printed when boot has completed
+#define BOOT_PROFILE_STAGES 8
+
+static struct {
+  bool active;
+  bool wait_selection;
+  uint8_t count;
+  uint32_t start;
+  const char *name[BOOT_PROFILE_STAGES];
+  uint32_t ms[BOOT_PROFILE_STAGES];
+} g_boot_profile;
+
+static void bootProfileStage(const char *name)
+{
+  uint32_t now = millis();
+  if (g_boot_profile.active && g_boot_profile.count < BOOT_PROFILE_STAGES)
+  {
+    g_boot_profile.name[g_boot_profile.count] = name;
+    g_boot_profile.ms[g_boot_profile.count] = now - g_boot_profile.start;
+    g_boot_profile.count++;
+  }
+  g_boot_profile.start = now;
+}
+
+static void bootProfilePrint()
+{
+  log(" ");
+  log("=== Boot Timing ===");
+  for (int i = 0; i < g_boot_profile.count; i++)
+  {
+    log("* ", g_boot_profile.name[i], ": ", (int)g_boot_profile.ms[i], " ms");
+  }
+  log("Boot completed ", (int)millis(), " ms after power on");
+  g_boot_profile.active = false;
+  g_boot_profile.wait_selection = true;
+}
+
 /**************/
 /* Log saving */
 /**************/
@@ -110,8 +151,16 @@ void save_logfile(bool always = false)
     // When debug is on, save after every SCSI command.
     if (always || g_log_debug || (LOG_SAVE_INTERVAL_MS > 0 && (uint32_t)(millis() - prev_log_save) > LOG_SAVE_INTERVAL_MS))
     {
+      // Postpone while SD card bandwidth is used up by audio or SCSI, log writes are usually below one sector
+      if (!always && g_sd_scheduler.request(SD_CONSUMER_BACKGROUND, SD_SECTOR_SIZE, SD_SECTOR_SIZE, millis()) == 0)
+      {
+        return;
+      }
+
+      uint64_t old_size = g_logfile.size();
       g_logfile.write(log_get_buffer(&prev_log_pos));
       g_logfile.flush();
+      scsiDiskFreeSpaceUpdate(old_size, g_logfile.size());
 
       prev_log_len = loglen;
       prev_log_save = millis();
@@ -223,7 +272,10 @@ const char * quirksToChar(int quirks)
 bool findHDDImages()
 {
   char imgdir[MAX_FILE_PATH];
-  ini_gets("SCSI", "Dir", "/", imgdir, sizeof(imgdir), CONFIGFILE);
+  if (getDir(0, imgdir) == 0)
+  {
+    strcpy(imgdir, "/");
+  }
   int dirindex = 0;
 
   log(" ");
@@ -245,15 +297,11 @@ bool findHDDImages()
     if (!file.openNext(&root, O_READ))
     {
       // Check for additional directories with ini keys Dir1..Dir9
-      while (dirindex < 10)
+      imgdir[0] = '\0';
+      while (dirindex < CONFIG_DIR_COUNT - 1 && imgdir[0] == '\0')
       {
         dirindex++;
-        char key[5] = "Dir0";
-        key[3] += dirindex;
-        if (ini_gets("SCSI", key, "", imgdir, sizeof(imgdir), CONFIGFILE) != 0)
-        {
-          break;
-        }
+        getDir(dirindex, imgdir);
       }
 
       if (imgdir[0] != '\0')
@@ -470,6 +518,7 @@ static bool mountSDCard()
   // When switching between FAT and exFAT cards the pointers
   // are invalidated and accessing old files results in crash.
   invalidate_ini_cache();
+  g_settings.clear();
   g_logfile.close();
   scsiDiskCloseSDCardImages();
 
@@ -477,6 +526,7 @@ static bool mountSDCard()
   if (SD.begin(SD_CONFIG))
   {
     reload_ini_cache(CONFIGFILE);
+    loadSettings();
     return true;
   }
 
@@ -486,7 +536,10 @@ static bool mountSDCard()
 
   // Try to mount the whole card as FAT (without partition table)
   if (static_cast<FsVolume*>(&SD)->begin(SD.card(), true, 0))
+  {
+    loadSettings();
     return true;
+  }
 
   // Failed to mount FAT filesystem, but card can still be accessed as raw image
   return true;
@@ -494,11 +547,11 @@ static bool mountSDCard()
 
 static void reinitSCSI()
 {
-  if (ini_getbool("SCSI", "Debug", 0, CONFIGFILE))
+  if (g_settings.global.debug.get(false))
   {
     g_log_debug = true;
   }
-  if (ini_getbool("SCSI", "TestMode", 0, CONFIGFILE))
+  if (g_settings.global.testMode.get(false))
   {
     g_test_mode = true;
   }
@@ -519,7 +572,17 @@ static void reinitSCSI()
 #endif
   scsiDiskResetImages();
   readSCSIDeviceConfig();
+  bootProfileStage("Config parse");
+
   findHDDImages();
+  bootProfileStage("Image scan");
+
+  // Counting free clusters can take seconds, do it before the host can select us
+  if (g_sdcard_present)
+  {
+    scsiDiskGetFreeSpace();
+    bootProfileStage("Free space");
+  }
 
   // Error if there are 0 image files
   if (scsiDiskCheckAnyImagesConfigured())
@@ -543,12 +606,16 @@ static void reinitSCSI()
   scsiPhyReset();
   scsiDiskInit();
   scsiInit();
+  scsiDiskHeatmapLoad();
+  scsiDiskSchedulerLoad();
+  scsiDiskScrubLoad();
 
   if (scsiDiskCheckAnyNetworkDevicesConfigured())
   {
     platform_network_init(scsiDev.boardCfg.wifiMACAddress);
     platform_network_wifi_join(scsiDev.boardCfg.wifiSSID, scsiDev.boardCfg.wifiPassword);
   }
+  bootProfileStage("SCSI init");
 }
 
 extern "C" void bluescsi_setup(void)
@@ -556,6 +623,8 @@ extern "C" void bluescsi_setup(void)
   pio_clear_instruction_memory(pio0);
   pio_clear_instruction_memory(pio1);
   platform_init();
+  g_boot_profile.active = true;
+  bootProfileStage("Platform init");
 
   g_sdcard_present = mountSDCard();
 
@@ -583,11 +652,12 @@ extern "C" void bluescsi_setup(void)
     } while (!g_sdcard_present);
     log("SD card init succeeded after retry");
   }
+  bootProfileStage("SD card mount");
 
   if (g_sdcard_present)
   {
     platform_late_init();
-    if (ini_getbool("SCSI", "InitiatorMode", false, CONFIGFILE))
+    if (g_settings.global.initiatorMode.get(false))
     {
       platform_enable_initiator_mode();
     }
@@ -597,7 +667,8 @@ extern "C" void bluescsi_setup(void)
     }
 
     print_sd_info();
-  
+    bootProfileStage("SD card info");
+
     reinitSCSI();
   }
 
@@ -607,7 +678,9 @@ extern "C" void bluescsi_setup(void)
   if (g_sdcard_present)
   {
     init_logfile();
-    if (ini_getbool("SCSI", "DisableStatusLED", false, CONFIGFILE))
+    bootProfileStage("Log file");
+    bootProfilePrint();
+    if (g_settings.global.disableStatusLED.get(false))
     {
       platform_disable_led();
     }
@@ -671,6 +744,7 @@ extern "C" void bluescsi_main_loop(void)
 
   static uint32_t sd_card_check_time = 0;
   static uint32_t last_request_time = 0;
+  static uint16_t sel_latency_logged = 0;
 
   platform_reset_watchdog();
   platform_poll();
@@ -690,6 +764,19 @@ extern "C" void bluescsi_main_loop(void)
     scsiDiskPoll();
     scsiLogPhaseChange(scsiDev.phase);
 
+    if (unlikely(g_boot_profile.wait_selection) && scsiDev.selCount > 0)
+    {
+      log("First selection ", (int)millis(), " ms after power on");
+      g_boot_profile.wait_selection = false;
+    }
+
+    // Recorded during selection, where there is no time for logging
+    if (unlikely(scsiDev.selLatencyMax != sel_latency_logged))
+    {
+      sel_latency_logged = scsiDev.selLatencyMax;
+      debuglog("SEL to BSY latency ", (int)sel_latency_logged, " us, longest so far");
+    }
+
     // Save log periodically during status phase if there are new messages.
     // In debug mode, also save every 2 seconds if no SCSI requests come in.
     // SD card writing takes a while, during which the code can't handle new
@@ -720,6 +807,17 @@ extern "C" void bluescsi_main_loop(void)
         }
       }
     }
+
+    // Store read heatmap for next boot once the host has been idle for a while,
+    // continue clearing any image created from Toolbox and verify images.
+    if (scsiDev.phase == BUS_FREE && g_sdcard_present)
+    {
+      scsiDiskHeatmapSave();
+      if (!scsiDiskCreateImagePoll())
+      {
+        scsiDiskScrubPoll();
+      }
+    }
   }
 
   if (!g_sdcard_present)
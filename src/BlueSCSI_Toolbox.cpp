@@ -23,6 +23,7 @@
 #include "BlueSCSI_config.h"
 #include <minIni.h>
 #include <SdFat.h>
+#include <ToolboxTransfer.h>
 extern "C" {
 #include <scsi2sd_time.h>
 #include <sd.h>
@@ -201,6 +202,10 @@ void onSetNextCD(const char * img_dir)
 }
 
 FsFile gFile; // global so we can keep it open while transfering.
+static uint64_t gFileStartSize; // size of the received file before transfer, for free space tracking
+static ToolboxUpload gUpload;
+static uint8_t gReadAhead[4096]; // next chunk of gFile, scsiDev.data is not kept between commands
+static ToolboxDownload gDownload(gReadAhead, sizeof(gReadAhead));
 void onGetFile10(char * dir_name) {
     uint8_t index = scsiDev.cdb[1];
 
@@ -209,6 +214,7 @@ void onGetFile10(char * dir_name) {
     if (offset == 0) // first time, open the file.
     {
         gFile = get_file_from_index(index, dir_name);
+        gDownload.reset();
         if(!gFile.isDirectory() && !gFile.isReadable())
         {
             scsiDev.status = CHECK_CONDITION;
@@ -219,20 +225,45 @@ void onGetFile10(char * dir_name) {
         }
     }
 
-    uint32_t file_total = gFile.size();
-    memset(scsiDev.data, 0, 4096);
-    gFile.seekSet(offset * 4096);
-    int bytes_read = gFile.read(scsiDev.data, 4096);
-    if(offset * 4096 >= file_total) // transfer done, close.
+    uint64_t file_total = gFile.size();
+    uint64_t pos = (uint64_t)offset * 4096;
+    int bytes_read = 0;
+    if (pos < file_total)
+    {
+        // Sequential requests continue from the read-ahead buffer without seeking
+        bytes_read = gDownload.read(gFile, pos, scsiDev.data, 4096);
+    }
+
+    if (bytes_read < 0)
     {
+        log("toolbox: Reading file failed at offset ", pos, ": ", SD.sdErrorCode());
         gFile.close();
+        scsiDev.status = CHECK_CONDITION;
+        scsiDev.target->sense.code = MEDIUM_ERROR;
+        scsiDev.target->sense.asc = UNRECOVERED_READ_ERROR;
+        scsiDev.phase = STATUS;
+        return;
     }
-    scsiDev.dataLen = bytes_read;
-    scsiDev.phase = DATA_IN;
+
+    if (bytes_read == 0) // transfer done, close.
+    {
+        gFile.close();
+        scsiDev.dataLen = 0;
+        scsiDev.phase = DATA_IN;
+        return;
+    }
+
+    // Read the next chunk from SD card while this one is sent
+    scsiEnterPhase(DATA_IN);
+    scsiStartWrite(scsiDev.data, bytes_read);
+    gDownload.readAhead(gFile);
+    scsiFinishWrite();
 }
 
 /*
   Prepares a file for receving. The file name is null terminated in the scsi data.
+  If CDB bytes 2-5 give the file size in bytes, the existing file content is
+  replaced and the space is allocated in advance for BLUESCSI_TOOLBOX_SEND_FILE_BLOCKS.
 */
 void onSendFilePrep(char * dir_name)
 {
@@ -244,11 +275,27 @@ void onSendFilePrep(char * dir_name)
         file_name[i] = scsiReadByte();
     }
     SD.chdir(dir_name);
+    gDownload.reset();
     gFile.open(file_name, FILE_WRITE);
     SD.chdir("/");
     if(gFile.isOpen() && gFile.isWritable())
     {
-        gFile.rewind();
+        gFileStartSize = gFile.size();
+        uint32_t declared_size = ((uint32_t)scsiDev.cdb[2] << 24) | ((uint32_t)scsiDev.cdb[3] << 16) | ((uint32_t)scsiDev.cdb[4] << 8) | scsiDev.cdb[5];
+        if (!gUpload.begin(gFile, declared_size))
+        {
+            log("toolbox: Failed to prepare ", file_name, " for receiving");
+            gFile.close();
+            scsiDev.status = CHECK_CONDITION;
+            scsiDev.target->sense.code = ILLEGAL_REQUEST;
+            scsiDev.phase = STATUS;
+            return;
+        }
+        if (declared_size > 0)
+        {
+            debuglog("toolbox: Receiving ", file_name, ", ", (int)(declared_size / 1024), " kB",
+                     gUpload.preallocated() ? ", preallocated" : "");
+        }
         gFile.sync();
         // do i need to manually set phase to status here?
         return;
@@ -263,7 +310,9 @@ void onSendFilePrep(char * dir_name)
 
 void onSendFileEnd(void)
 {
+    gUpload.end(gFile);
     gFile.sync();
+    scsiDiskFreeSpaceUpdate(gFileStartSize, gFile.size());
     gFile.close();
     scsiDev.phase = STATUS;
 }
@@ -304,6 +353,153 @@ void onSendFile10(void)
     }
     //scsiDev.phase = STATUS;
 }
+
+/*
+  Receives a part of the file prepared by onSendFilePrep(). CDB bytes 2-5 give the
+  absolute offset in 512 byte blocks and bytes 6-8 the number of bytes, at most
+  TOOLBOX_SEND_BLOCKS_MAX. Only the last part of a file may have a length that is
+  not a multiple of 512 bytes.
+*/
+void onSendFileBlocks(void)
+{
+    uint32_t block = ((uint32_t)scsiDev.cdb[2] << 24) | ((uint32_t)scsiDev.cdb[3] << 16) | ((uint32_t)scsiDev.cdb[4] << 8) | scsiDev.cdb[5];
+    uint32_t count = ((uint32_t)scsiDev.cdb[6] << 16) | ((uint32_t)scsiDev.cdb[7] << 8) | scsiDev.cdb[8];
+    uint64_t offset = (uint64_t)block * 512;
+
+    if (!gFile.isOpen() || !gFile.isWritable() || count == 0 || count > TOOLBOX_SEND_BLOCKS_MAX)
+    {
+        scsiDev.status = CHECK_CONDITION;
+        scsiDev.target->sense.code = ILLEGAL_REQUEST;
+        scsiDev.target->sense.asc = INVALID_FIELD_IN_CDB;
+        scsiDev.phase = STATUS;
+        return;
+    }
+
+    // Write to SD card in sector aligned pieces while the rest of the data
+    // is still arriving from the SCSI bus.
+    int parityError = 0;
+    bool writeError = false;
+    scsiEnterPhase(DATA_OUT);
+    scsiStartRead(scsiDev.data, count, &parityError);
+    for (uint32_t pos = 0; pos < count && !scsiDev.resetFlag; )
+    {
+        uint32_t len = count - pos;
+        if (len > PLATFORM_OPTIMAL_LAST_SD_WRITE_SIZE) len = PLATFORM_OPTIMAL_LAST_SD_WRITE_SIZE;
+        scsiFinishRead(&scsiDev.data[pos], len, &parityError);
+
+        if (parityError && (scsiDev.boardCfg.flags & S2S_CFG_ENABLE_PARITY))
+        {
+            // Receive the remaining data but do not write it
+            writeError = true;
+        }
+        else if (!writeError && !gUpload.write(gFile, offset + pos, &scsiDev.data[pos], len))
+        {
+            log("toolbox: SD card write failed at offset ", offset + pos, ": ", SD.sdErrorCode());
+            writeError = true;
+        }
+        pos += len;
+    }
+
+    if (parityError && (scsiDev.boardCfg.flags & S2S_CFG_ENABLE_PARITY))
+    {
+        scsiDev.status = CHECK_CONDITION;
+        scsiDev.target->sense.code = ABORTED_COMMAND;
+        scsiDev.target->sense.asc = SCSI_PARITY_ERROR;
+        scsiDev.phase = STATUS;
+    }
+    else if (writeError)
+    {
+        scsiDev.status = CHECK_CONDITION;
+        scsiDev.target->sense.code = MEDIUM_ERROR;
+        scsiDev.target->sense.asc = WRITE_ERROR_AUTO_REALLOCATION_FAILED;
+        scsiDev.phase = STATUS;
+    }
+}
+/*
+  Creates a blank contiguous image file in the SD card root directory.
+  The file name is null terminated in the scsi data, size in 512 byte blocks is in CDB bytes 2-5.
+  On exFAT the image is cleared in the background after the command completes.
+*/
+void onCreateImage(void)
+{
+    char file_name[32+1];
+    memset(file_name, '\0', 32+1);
+    scsiEnterPhase(DATA_OUT);
+    for (int i = 0; i < 32+1; ++i)
+    {
+        file_name[i] = scsiReadByte();
+    }
+    file_name[32] = '\0';
+
+    uint32_t blocks = ((uint32_t)scsiDev.cdb[2] << 24) | ((uint32_t)scsiDev.cdb[3] << 16) | ((uint32_t)scsiDev.cdb[4] << 8) | scsiDev.cdb[5];
+
+    if (strchr(file_name, '/') || !toolboxFilenameValid(file_name) ||
+        !scsiDiskCreateImage(file_name, (uint64_t)blocks * 512))
+    {
+        scsiDev.status = CHECK_CONDITION;
+        scsiDev.target->sense.code = ILLEGAL_REQUEST;
+        //SCSI_ASC_INVALID_FIELD_IN_CDB
+    }
+    scsiDev.phase = STATUS;
+}
+
+/*
+  Reports background image scrubbing results for the SCSI ID in CDB byte 1.
+  If bit 0 of CDB byte 2 is set, the statistics are cleared and the
+  checksums are stored again from the current image content.
+  Returns 28 bytes: state (0 = disabled, 1 = enabled, 2 = not supported),
+  reserved, chunk size in KiB, then as 32-bit values the number of chunks,
+  current chunk, completed passes, mismatches, read errors and first bad
+  chunk (0xFFFFFFFF if none).
+*/
+void onScrubStatus()
+{
+    uint8_t id = scsiDev.cdb[1] & S2S_CFG_TARGET_ID_BITS;
+    image_config_t *img = (image_config_t*)s2s_getConfigById(id);
+    if (!img || !(img->scsiId & S2S_CFG_TARGET_ENABLED))
+    {
+        scsiDev.status = CHECK_CONDITION;
+        scsiDev.target->sense.code = ILLEGAL_REQUEST;
+        //SCSI_ASC_INVALID_FIELD_IN_CDB
+        scsiDev.phase = STATUS;
+        return;
+    }
+
+    if (scsiDev.cdb[2] & 0x01)
+    {
+        log("Image scrub: restarting ID ", (int)id, " with new checksums");
+        scsiDiskScrubRestart(*img, true);
+    }
+
+    const ImageScrub &scrub = img->scrub;
+    uint32_t values[6] = {
+        scrub.chunkCount(), scrub.currentChunk(), scrub.passes(),
+        scrub.mismatches(), scrub.readErrors(), scrub.firstBadChunk()
+    };
+
+    uint8_t state = 0;
+    if (scsiDiskScrubEnabled())
+    {
+        state = scsiDiskScrubSupported(*img) ? 1 : 2;
+    }
+
+    uint16_t chunk_kb = IMAGESCRUB_CHUNK_SIZE / 1024;
+    scsiDev.data[0] = state;
+    scsiDev.data[1] = 0;
+    scsiDev.data[2] = chunk_kb >> 8;
+    scsiDev.data[3] = chunk_kb & 0xFF;
+    for (int i = 0; i < 6; i++)
+    {
+        uint8_t *dest = &scsiDev.data[4 + 4 * i];
+        dest[0] = values[i] >> 24;
+        dest[1] = values[i] >> 16;
+        dest[2] = values[i] >> 8;
+        dest[3] = values[i];
+    }
+    scsiDev.dataLen = 28;
+    scsiDev.phase = DATA_IN;
+}
+
 void onToggleDebug()
 {
     if(scsiDev.cdb[1] == 0) // 0 == Set Debug, 1 == Get Debug State
@@ -355,6 +551,10 @@ extern "C" int scsiBlueSCSIToolboxCommand()
     {
         onSendFile10();
     }
+    else if (unlikely(command == BLUESCSI_TOOLBOX_SEND_FILE_BLOCKS))
+    {
+        onSendFileBlocks();
+    }
     else if (unlikely(command == BLUESCSI_TOOLBOX_SEND_FILE_END))
     {
         onSendFileEnd();
@@ -385,6 +585,14 @@ extern "C" int scsiBlueSCSIToolboxCommand()
         snprintf(img_dir, sizeof(img_dir), CD_IMG_DIR, (int)img.scsiId & S2S_CFG_TARGET_ID_BITS);
         doCountFiles(img_dir);
     }
+    else if (unlikely(command == BLUESCSI_TOOLBOX_CREATE_IMAGE))
+    {
+        onCreateImage();
+    }
+    else if (unlikely(command == BLUESCSI_TOOLBOX_SCRUB_STATUS))
+    {
+        onScrubStatus();
+    }
     else
     {
         commandHandled = 0;
@@ -21,6 +21,7 @@
 
 #define MAX_MAC_PATH 32
 #define CD_IMG_DIR "CD%d"
+#define TOOLBOX_SEND_BLOCKS_MAX 32768 // Bytes per BLUESCSI_TOOLBOX_SEND_FILE_BLOCKS command
 
 #define BLUESCSI_TOOLBOX_COUNT_FILES    0xD2
 #define BLUESCSI_TOOLBOX_LIST_FILES     0xD0
@@ -33,4 +34,7 @@
 #define BLUESCSI_TOOLBOX_SET_NEXT_CD    0xD8
 #define BLUESCSI_TOOLBOX_LIST_DEVICES   0xD9
 #define BLUESCSI_TOOLBOX_COUNT_CDS      0xDA
+#define BLUESCSI_TOOLBOX_CREATE_IMAGE   0xDB
+#define BLUESCSI_TOOLBOX_SCRUB_STATUS   0xDC
+#define BLUESCSI_TOOLBOX_SEND_FILE_BLOCKS 0xDD
 #define OPEN_RETRO_SCSI_TOO_MANY_FILES 0x0001
\ No newline at end of file
@@ -145,4 +145,19 @@ uint16_t audio_get_channel(uint8_t id);
  * \param id    SCSI ID to set channel information for.
  * \param chn   The new channel information.
  */
-void audio_set_channel(uint8_t id, uint16_t chn);
\ No newline at end of file
+void audio_set_channel(uint8_t id, uint16_t chn);
+/**
+ * Callback that is told how audio playback uses the SD card, so that other
+ * card access can be held back while the sample buffers are refilled.
+ *
+ * \param bytes_read    Bytes read for the last buffer refill, 0 if none.
+ * \param reserve       Bytes needed for the next refill, 0 when stopped.
+ */
+typedef void (*audio_sd_callback_t)(uint32_t bytes_read, uint32_t reserve);
+
+/**
+ * Sets the callback for SD card use, see above.
+ *
+ * \param func  Callback function, or NULL to remove.
+ */
+void audio_set_sd_callback(audio_sd_callback_t func);
@@ -3,6 +3,7 @@
  *
  * - bin/cue support for support of multiple tracks
  * - on the fly image switching
+ * - CD-R/RW recording to bin/cue
  *
  * SCSI2SD V6 - Copyright (C) 2014 Michael McMaster <michael@codesrc.com>
  * ZuluSCSI™ - Copyright (c) 2023 Rabbit Hole Computing™
@@ -33,7 +34,12 @@
 #include "BlueSCSI_config.h"
 #include "BlueSCSI_cdrom.h"
 #include <CUEParser.h>
+#include <CDBDecoder.h>
+#include <CDTOC.h>
+#include <CDRecorder.h>
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
 #ifdef ENABLE_AUDIO_OUTPUT
 #include "BlueSCSI_audio.h"
 #endif
@@ -260,6 +266,12 @@ static uint32_t getLeadOutLBA(const CUETrackInfo* lasttrack)
     if (lasttrack != nullptr && lasttrack->track_number != 0)
     {
         image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+        if (img.cdr_leadout != 0)
+        {
+            // Disc recorded by CD-R emulation, image file extends past the data
+            return img.cdr_leadout;
+        }
+
         uint32_t lastTrackBlocks = (img.file.size() - lasttrack->file_offset)
                 / lasttrack->sector_length;
         return lasttrack->track_start + lastTrackBlocks;
@@ -278,10 +290,7 @@ static void doReadTOCSimple(bool MSF, uint8_t track, uint16_t allocationLength)
         uint32_t len = sizeof(LeadoutTOC);
         memcpy(scsiDev.data, LeadoutTOC, len);
 
-        uint32_t capacity = getScsiCapacity(
-            scsiDev.target->cfg->sdSectorStart,
-            scsiDev.target->liveCfg.bytesPerSector,
-            scsiDev.target->cfg->scsiSectors);
+        uint32_t capacity = s2s_getGeometry()->capacity;
 
         // Replace start of leadout track
         if (MSF)
@@ -316,10 +325,7 @@ static void doReadTOCSimple(bool MSF, uint8_t track, uint16_t allocationLength)
             scsiDev.data[0x0A] = 0x02;
         }
 
-        uint32_t capacity = getScsiCapacity(
-            scsiDev.target->cfg->sdSectorStart,
-            scsiDev.target->liveCfg.bytesPerSector,
-            scsiDev.target->cfg->scsiSectors);
+        uint32_t capacity = s2s_getGeometry()->capacity;
 
         // Replace start of leadout track
         if (MSF)
@@ -386,10 +392,7 @@ static void doReadFullTOCSimple(uint8_t session, uint16_t allocationLength, bool
 
         // update leadout position
         // consistent 2048-byte blocks makes this easier than bin/cue version
-        uint32_t capacity = getScsiCapacity(
-            scsiDev.target->cfg->sdSectorStart,
-            scsiDev.target->liveCfg.bytesPerSector,
-            scsiDev.target->cfg->scsiSectors);
+        uint32_t capacity = s2s_getGeometry()->capacity;
         if (useBCD) {
             LBA2MSFBCD(capacity, &scsiDev.data[34], false);
         } else {
@@ -422,10 +425,7 @@ void doReadTrackInformationSimple(bool track, uint32_t lba, uint16_t allocationL
     uint32_t len = sizeof(TrackInformation);
     memcpy(scsiDev.data, TrackInformation, len);
 
-    uint32_t capacity = getScsiCapacity(
-            scsiDev.target->cfg->sdSectorStart,
-            scsiDev.target->liveCfg.bytesPerSector,
-            scsiDev.target->cfg->scsiSectors);
+    uint32_t capacity = s2s_getGeometry()->capacity;
     if (!track && lba >= capacity)
     {
         scsiDev.status = CHECK_CONDITION;
@@ -450,6 +450,366 @@ void doReadTrackInformationSimple(bool track, uint32_t lba, uint16_t allocationL
     }
 }
 
+/*********************************/
+/* CD-R/RW recorder emulation    */
+/*********************************/
+
+// A target with CDRecorder=1 acts as a CD-RW drive. The .bin image is the
+// disc surface and should be preallocated to the disc size, for example with
+// CreateImage. Tracks are recorded sequentially into it and the .cue sheet is
+// written when the session is closed, after which the disc reads like any
+// other bin/cue image. An empty .cue sheet means a blank disc.
+//
+// Only one disc can be recorded at a time and all tracks on a disc must use
+// the same block size. Track-At-Once and Session-At-Once are supported.
+// Track and next writable address bookkeeping is in lib/CDRecorder.
+
+#define CDR_WRITE_TAO 1
+#define CDR_WRITE_SAO 2
+
+enum cdr_disc_state_t
+{
+    CDR_BLANK,
+    CDR_INCOMPLETE,
+    CDR_COMPLETE
+};
+
+static struct {
+    int8_t target;          // Target that is recording, -1 if none
+    uint32_t discard_bytes; // Pregap data left to discard in SAO mode
+    CDRecorder disc;
+} g_cdr = {-1, 0, CDRecorder()};
+
+void cdromRecorderInit(image_config_t &img)
+{
+    if (img.deviceType != S2S_CFG_OPTICAL || !img.cuesheetfile.isOpen())
+    {
+        log("---- CDRecorder needs a CD-ROM target with .bin image, recording disabled");
+        img.cdr_enabled = false;
+        return;
+    }
+
+    // Default write parameters: Track-At-Once, Mode 1 data track
+    img.cdr_write_type = CDR_WRITE_TAO;
+    img.cdr_track_mode = 0x04;
+    img.cdr_block_type = 0x08;
+    img.cdr_leadout = 0;
+
+    // Recorded discs store the end of data as first line of the cue sheet
+    char buf[32] = {0};
+    img.cuesheetfile.seek(0);
+    img.cuesheetfile.read(buf, sizeof(buf) - 1);
+    if (strncmp(buf, "REM LEADOUT ", 12) == 0)
+    {
+        img.cdr_leadout = strtoul(buf + 12, NULL, 10);
+    }
+
+    if (g_cdr.target == (img.scsiId & S2S_CFG_TARGET_ID_BITS))
+    {
+        // Image was reopened, earlier recording state is no longer valid
+        g_cdr.target = -1;
+    }
+
+    log("---- CD recorder enabled, disc is ", img.cuesheetfile.size() ? "closed" : "blank");
+}
+
+static void cdrCheckCondition(uint8_t code, uint16_t asc)
+{
+    scsiDev.status = CHECK_CONDITION;
+    scsiDev.target->sense.code = code;
+    scsiDev.target->sense.asc = asc;
+    scsiDev.phase = STATUS;
+}
+
+static void cdrPut32(uint8_t *dest, uint32_t value)
+{
+    dest[0] = value >> 24;
+    dest[1] = value >> 16;
+    dest[2] = value >> 8;
+    dest[3] = value;
+}
+
+static bool cdrOwner(image_config_t &img)
+{
+    return g_cdr.target == (img.scsiId & S2S_CFG_TARGET_ID_BITS);
+}
+
+static cdr_disc_state_t cdrDiscState(image_config_t &img)
+{
+    if (img.cuesheetfile.size() > 0)
+    {
+        return CDR_COMPLETE;
+    }
+    else if (cdrOwner(img) && g_cdr.disc.recorded())
+    {
+        return CDR_INCOMPLETE;
+    }
+    else
+    {
+        return CDR_BLANK;
+    }
+}
+
+// Take the recording state for this target.
+// Fails if another target has a recording in progress.
+static bool cdrClaim(image_config_t &img)
+{
+    if (cdrOwner(img))
+    {
+        return true;
+    }
+    else if (g_cdr.target >= 0 && g_cdr.disc.recorded())
+    {
+        log("---- CD recorder is busy with ID ", (int)g_cdr.target);
+        return false;
+    }
+
+    g_cdr.disc.reset();
+    g_cdr.discard_bytes = 0;
+    g_cdr.target = img.scsiId & S2S_CFG_TARGET_ID_BITS;
+    return true;
+}
+
+// Track type selected with the write parameters mode page
+static uint8_t cdrTrackMode(image_config_t &img)
+{
+    if (!(img.cdr_track_mode & 0x04))
+    {
+        return CUETrack_AUDIO;
+    }
+    return (img.cdr_block_type == 0x00) ? CUETrack_MODE1_2352 : CUETrack_MODE1_2048;
+}
+
+static uint16_t cdrBlockSize(uint8_t mode)
+{
+    return (mode == CUETrack_MODE1_2048) ? 2048 : 2352;
+}
+
+// Disc capacity in blocks of the size being recorded
+static uint32_t cdrCapacity(image_config_t &img)
+{
+    uint16_t block_size = cdrBlockSize(cdrTrackMode(img));
+    if (cdrOwner(img) && g_cdr.disc.blockSize() != 0)
+    {
+        block_size = g_cdr.disc.blockSize();
+    }
+    return img.file.size() / block_size;
+}
+
+static void cdrReadDiscInformation(image_config_t &img, uint16_t allocationLength)
+{
+    uint32_t len = sizeof(DiscInformation);
+    memcpy(scsiDev.data, DiscInformation, len);
+
+    if (cdrDiscState(img) == CDR_BLANK)
+    {
+        // erasable, empty session, blank disc
+        scsiDev.data[2] = 0x10;
+    }
+    else
+    {
+        // erasable, incomplete session, incomplete disc
+        scsiDev.data[2] = 0x15;
+        scsiDev.data[6] = g_cdr.disc.trackCount() + 1;
+    }
+    scsiDev.data[7] = 0x20; // unrestricted use
+
+    // Lead-in start from ATIP of a typical CD-RW blank, 97:27:00
+    scsiDev.data[17] = 97;
+    scsiDev.data[18] = 27;
+    scsiDev.data[19] = 0;
+    LBA2MSF(cdrCapacity(img), &scsiDev.data[21], false);
+
+    if (len > allocationLength)
+    {
+        len = allocationLength;
+    }
+    scsiDev.dataLen = len;
+    scsiDev.phase = DATA_IN;
+}
+
+// Report tracks of an open disc. The track after the last closed one is the
+// invisible track that extends to the end of the disc.
+static void cdrReadTrackInformation(image_config_t &img, bool track, uint32_t lba, uint16_t allocationLength)
+{
+    // Disc of another target is reported as blank
+    CDRecorderTrackInfo info;
+    bool found;
+    if (cdrOwner(img))
+    {
+        found = g_cdr.disc.trackInfo(track, lba, cdrCapacity(img), cdrTrackMode(img), &info);
+    }
+    else
+    {
+        found = CDRecorder::blankTrackInfo(track, lba, cdrCapacity(img), cdrTrackMode(img), &info);
+    }
+
+    if (!found)
+    {
+        cdrCheckCondition(ILLEGAL_REQUEST, INVALID_FIELD_IN_CDB);
+        return;
+    }
+
+    uint32_t len = sizeof(TrackInformation);
+    memcpy(scsiDev.data, TrackInformation, len);
+    scsiDev.data[2] = info.number;
+    if (info.mode == CUETrack_AUDIO)
+    {
+        scsiDev.data[5] = 0x00;
+    }
+    cdrPut32(&scsiDev.data[8], info.start);
+    cdrPut32(&scsiDev.data[24], info.size);
+
+    if (info.invisible)
+    {
+        scsiDev.data[6] = info.blank ? 0x4F : 0x0F; // blank flag, data mode unknown
+        scsiDev.data[7] = 0x01; // next writable address valid
+        cdrPut32(&scsiDev.data[12], info.nwa);
+        cdrPut32(&scsiDev.data[16], info.free_blocks);
+    }
+
+    if (len > allocationLength)
+    {
+        len = allocationLength;
+    }
+    scsiDev.dataLen = len;
+    scsiDev.phase = DATA_IN;
+}
+
+// Write cue sheet for the recorded tracks, which closes the disc
+static bool cdrCloseSession(image_config_t &img)
+{
+    char name[MAX_FILE_PATH];
+    char line[MAX_FILE_PATH + 32];
+    img.file.getName(name, sizeof(name));
+    img.file.flush();
+
+    FsFile &cue = img.cuesheetfile;
+    uint64_t old_size = cue.size();
+    bool ok = cue.truncate(0);
+
+    const CDRecorder &disc = g_cdr.disc;
+    snprintf(line, sizeof(line), "REM LEADOUT %lu\nFILE \"%s\" BINARY\n", (unsigned long)disc.nextWritable(), name);
+    ok = ok && cue.write(line, strlen(line)) == strlen(line);
+
+    for (int i = 0; i < disc.trackCount(); i++)
+    {
+        const char *mode = "MODE1/2048";
+        if (disc.track(i).mode == CUETrack_AUDIO) mode = "AUDIO";
+        if (disc.track(i).mode == CUETrack_MODE1_2352) mode = "MODE1/2352";
+
+        uint8_t msf[3];
+        LBA2MSF(disc.track(i).start, msf, true);
+        snprintf(line, sizeof(line), "  TRACK %02d %s\n    INDEX 01 %02d:%02d:%02d\n",
+                 i + 1, mode, msf[0], msf[1], msf[2]);
+        ok = ok && cue.write(line, strlen(line)) == strlen(line);
+    }
+
+    ok = ok && cue.sync();
+    scsiDiskFreeSpaceUpdate(old_size, cue.size());
+
+    scsiDev.target->liveCfg.bytesPerSector = img.bytesPerSector;
+    img.cdr_leadout = disc.nextWritable();
+    g_cdr.target = -1;
+
+    if (!ok || !cdromValidateCueSheet(img))
+    {
+        log("---- CD recorder failed to write cue sheet, disc is left blank");
+        cue.truncate(0);
+        img.cdr_leadout = 0;
+        return false;
+    }
+
+    log("---- CD recorder closed session, ", (int)disc.trackCount(), " tracks and ",
+        (int)img.cdr_leadout, " blocks recorded");
+
+    // Write features are no longer current on a closed disc
+    img.cdrom_events.operationalChange(MMC_OPERATIONAL_REPORT_FEATURE_CHANGE);
+    return true;
+}
+
+// Receive and throw away the pregap that Session-At-Once hosts write before
+// track 1. The image starts at track 1 index 1, so it is not stored.
+static void cdrDiscardDataOut()
+{
+    if (g_cdr.discard_bytes > 0)
+    {
+        uint32_t len = g_cdr.discard_bytes;
+        if (len > sizeof(scsiDev.data))
+        {
+            len = sizeof(scsiDev.data);
+        }
+        g_cdr.discard_bytes -= len;
+        scsiDev.dataLen = len;
+        scsiDev.dataPtr = 0;
+        scsiDev.phase = DATA_OUT;
+        scsiDev.postDataOutHook = cdrDiscardDataOut;
+    }
+    else
+    {
+        scsiDev.status = GOOD;
+        scsiDev.phase = STATUS;
+    }
+}
+
+// Parse the MMC cue sheet received by SEND CUE SHEET into track list.
+// Each 8 byte entry is CTL/ADR, track, index, data form, SCMS, M, S, F.
+static void cdrParseCueSheet()
+{
+    g_cdr.disc.reset();
+
+    for (uint32_t i = 0; i + 8 <= scsiDev.dataLen; i += 8)
+    {
+        const uint8_t *entry = &scsiDev.data[i];
+        uint8_t track = entry[1];
+        uint8_t index = entry[2];
+        uint8_t form = entry[3];
+
+        // Skip lead-in, lead-out and pregap entries
+        if (track == 0 || track > CDRECORDER_MAX_TRACKS || index != 1) continue;
+
+        uint8_t mode;
+        if (!(entry[0] & 0x40))
+        {
+            mode = CUETrack_AUDIO;
+        }
+        else if (form == 0x10)
+        {
+            mode = CUETrack_MODE1_2048;
+        }
+        else if (form == 0x11)
+        {
+            mode = CUETrack_MODE1_2352;
+        }
+        else
+        {
+            log("---- CD recorder: unsupported data form ", form, " for track ", (int)track);
+            g_cdr.disc.reset();
+            cdrCheckCondition(ILLEGAL_REQUEST, INVALID_FIELD_IN_PARAMETER_LIST);
+            return;
+        }
+
+        uint32_t start = MSF2LBA(entry[5], entry[6], entry[7], false);
+        if (!g_cdr.disc.addCueTrack(start, mode, cdrBlockSize(mode)))
+        {
+            log("---- CD recorder: all tracks must use the same block size");
+            g_cdr.disc.reset();
+            cdrCheckCondition(ILLEGAL_REQUEST, ILLEGAL_MODE_FOR_THIS_TRACK);
+            return;
+        }
+    }
+
+    if (g_cdr.disc.trackCount() == 0)
+    {
+        cdrCheckCondition(ILLEGAL_REQUEST, INVALID_FIELD_IN_PARAMETER_LIST);
+        return;
+    }
+
+    debuglog("------ CD recorder cue sheet with ", (int)g_cdr.disc.trackCount(), " tracks");
+    scsiDev.status = GOOD;
+    scsiDev.phase = STATUS;
+}
+
 /*********************************/
 /* TOC generation from cue sheet */
 /*********************************/
@@ -477,38 +837,6 @@ static void getTrackFromLBA(CUEParser &parser, uint32_t lba, CUETrackInfo *resul
     }
 }
 
-// Format track info read from cue sheet into the format used by ReadTOC command.
-// Refer to T10/1545-D MMC-4 Revision 5a, "Response Format 0000b: Formatted TOC"
-static void formatTrackInfo(const CUETrackInfo *track, uint8_t *dest, bool use_MSF_time)
-{
-    uint8_t control_adr = 0x14; // Digital track
-
-    if (track->track_mode == CUETrack_AUDIO)
-    {
-        control_adr = 0x10; // Audio track
-    }
-
-    dest[0] = 0; // Reserved
-    dest[1] = control_adr;
-    dest[2] = track->track_number;
-    dest[3] = 0; // Reserved
-
-    if (use_MSF_time)
-    {
-        // Time in minute-second-frame format
-        dest[4] = 0;
-        LBA2MSF(track->data_start, &dest[5], false);
-    }
-    else
-    {
-        // Time as logical block address
-        dest[4] = (track->data_start >> 24) & 0xFF;
-        dest[5] = (track->data_start >> 16) & 0xFF;
-        dest[6] = (track->data_start >>  8) & 0xFF;
-        dest[7] = (track->data_start >>  0) & 0xFF;
-    }
-}
-
 // Load data from CUE sheet for the given device,
 // using the second half of scsiDev.data buffer for temporary storage.
 // Returns false if no cue sheet or it could not be opened.
@@ -535,50 +863,53 @@ static bool loadCueSheet(image_config_t &img, CUEParser &parser)
     return true;
 }
 
-static void doReadTOC(bool MSF, uint8_t track, uint16_t allocationLength)
+// TOC responses of the most recently accessed CD-ROM target, built from
+// its cue sheet on first use after the image has been loaded.
+static struct {
+    image_config_t *img; // nullptr if not loaded
+    bool has_cue;
+    int track_idx; // Track of last sub-channel position report
+    CDTOC toc;
+} g_toc_cache;
+
+void cdromInvalidateTOC(image_config_t &img)
 {
-    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
-    CUEParser parser;
-    if (!loadCueSheet(img, parser))
+    if (g_toc_cache.img == &img)
     {
-        // No CUE sheet, use hardcoded data
-        return doReadTOCSimple(MSF, track, allocationLength);
+        g_toc_cache.img = nullptr;
     }
+}
 
-    // Format track info
-    uint8_t *trackdata = &scsiDev.data[4];
-    int trackcount = 0;
-    int firsttrack = -1;
-    CUETrackInfo lasttrack = {0};
-    const CUETrackInfo *trackinfo;
-    while ((trackinfo = parser.next_track()) != NULL)
+// Get TOC of the image, or nullptr if it has no cue sheet
+static const CDTOC *getCachedTOC(image_config_t &img)
+{
+    if (g_toc_cache.img != &img)
     {
-        if (firsttrack < 0) firsttrack = trackinfo->track_number;
-        lasttrack = *trackinfo;
-
-        if (track <= trackinfo->track_number)
+        CUEParser parser;
+        g_toc_cache.img = &img;
+        g_toc_cache.has_cue = loadCueSheet(img, parser);
+        g_toc_cache.track_idx = 0;
+        if (g_toc_cache.has_cue)
         {
-            formatTrackInfo(trackinfo, &trackdata[8 * trackcount], MSF);
-            trackcount += 1;
+            g_toc_cache.toc.build(parser, img.file.size(), img.cdr_leadout);
         }
     }
 
-    // Format lead-out track info
-    CUETrackInfo leadout = {};
-    leadout.track_number = 0xAA;
-    leadout.track_mode = (lasttrack.track_number != 0) ? lasttrack.track_mode : CUETrack_MODE1_2048;
-    leadout.data_start = getLeadOutLBA(&lasttrack);
-    formatTrackInfo(&leadout, &trackdata[8 * trackcount], MSF);
-    trackcount += 1;
+    return g_toc_cache.has_cue ? &g_toc_cache.toc : nullptr;
+}
 
-    // Format response header
-    uint16_t toc_length = 2 + trackcount * 8;
-    scsiDev.data[0] = toc_length >> 8;
-    scsiDev.data[1] = toc_length & 0xFF;
-    scsiDev.data[2] = firsttrack;
-    scsiDev.data[3] = lasttrack.track_number;
+static void doReadTOC(bool MSF, uint8_t track, uint16_t allocationLength)
+{
+    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+    const CDTOC *toc = getCachedTOC(img);
+    if (!toc)
+    {
+        // No CUE sheet, use hardcoded data
+        return doReadTOCSimple(MSF, track, allocationLength);
+    }
 
-    if (track != 0xAA && trackcount < 2)
+    uint32_t len = toc->formattedTOC(MSF, track, scsiDev.data);
+    if (len == 0)
     {
         // Unknown track requested
         scsiDev.status = CHECK_CONDITION;
@@ -588,8 +919,6 @@ static void doReadTOC(bool MSF, uint8_t track, uint16_t allocationLength)
     }
     else
     {
-        uint32_t len = 2 + toc_length;
-
         if (len > allocationLength)
         {
             len = allocationLength;
@@ -603,24 +932,14 @@ static void doReadTOC(bool MSF, uint8_t track, uint16_t allocationLength)
 static void doReadSessionInfo(bool msf, uint16_t allocationLength)
 {
     image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
-    CUEParser parser;
-    if (!loadCueSheet(img, parser))
+    const CDTOC *toc = getCachedTOC(img);
+    if (!toc)
     {
         // No CUE sheet, use hardcoded data
         return doReadSessionInfoSimple(msf, allocationLength);
     }
 
-    uint32_t len = sizeof(SessionTOC);
-    memcpy(scsiDev.data, SessionTOC, len);
-
-    // Replace first track info in the session table
-    // based on data from CUE sheet.
-    const CUETrackInfo *trackinfo = parser.next_track();
-    if (trackinfo)
-    {
-        formatTrackInfo(trackinfo, &scsiDev.data[4], false);
-    }
-
+    uint32_t len = toc->sessionInfo(scsiDev.data);
     if (len > allocationLength)
     {
         len = allocationLength;
@@ -629,42 +948,11 @@ static void doReadSessionInfo(bool msf, uint16_t allocationLength)
     scsiDev.phase = DATA_IN;
 }
 
-// Format track info read from cue sheet into the format used by ReadFullTOC command.
-// Refer to T10/1545-D MMC-4 Revision 5a, "Response Format 0010b: Raw TOC"
-static void formatRawTrackInfo(const CUETrackInfo *track, uint8_t *dest, bool useBCD)
-{
-    uint8_t control_adr = 0x14; // Digital track
-
-    if (track->track_mode == CUETrack_AUDIO)
-    {
-        control_adr = 0x10; // Audio track
-    }
-
-    dest[0] = 0x01; // Session always 1
-    dest[1] = control_adr;
-    dest[2] = 0x00; // "TNO", always 0?
-    dest[3] = track->track_number; // "POINT", contains track number
-    // Next three are ATIME. The spec doesn't directly address how these
-    // should be reported in the TOC, just giving a description of Q-channel
-    // data from Red Book/ECMA-130. On all disks tested so far these are
-    // given as 00/00/00.
-    dest[4] = 0x00;
-    dest[5] = 0x00;
-    dest[6] = 0x00;
-    dest[7] = 0; // HOUR
-
-    if (useBCD) {
-        LBA2MSFBCD(track->data_start, &dest[8], false);
-    } else {
-        LBA2MSF(track->data_start, &dest[8], false);
-    }
-}
-
 static void doReadFullTOC(uint8_t session, uint16_t allocationLength, bool useBCD)
 {
     image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
-    CUEParser parser;
-    if (!loadCueSheet(img, parser))
+    const CDTOC *toc = getCachedTOC(img);
+    if (!toc)
     {
         // No CUE sheet, use hardcoded data
         return doReadFullTOCSimple(session, allocationLength, useBCD);
@@ -680,56 +968,7 @@ static void doReadFullTOC(uint8_t session, uint16_t allocationLength, bool useBC
         return;
     }
 
-    // Take the beginning of the hardcoded TOC as base
-    uint32_t len = 4 + 11 * 3; // Header, A0, A1, A2
-    memcpy(scsiDev.data, FullTOC, len);
-
-    // Add track descriptors
-    int trackcount = 0;
-    int firsttrack = -1;
-    CUETrackInfo lasttrack = {0};
-    const CUETrackInfo *trackinfo;
-    while ((trackinfo = parser.next_track()) != NULL)
-    {
-        if (firsttrack < 0)
-        {
-            firsttrack = trackinfo->track_number;
-            if (trackinfo->track_mode == CUETrack_AUDIO)
-            {
-                scsiDev.data[5] = 0x10;
-            }
-        }
-        lasttrack = *trackinfo;
-
-        formatRawTrackInfo(trackinfo, &scsiDev.data[len], useBCD);
-        trackcount += 1;
-        len += 11;
-    }
-
-    // First and last track numbers
-    scsiDev.data[12] = firsttrack;
-    if (lasttrack.track_number != 0)
-    {
-        scsiDev.data[23] = lasttrack.track_number;
-        if (lasttrack.track_mode == CUETrack_AUDIO)
-        {
-            scsiDev.data[16] = 0x10;
-            scsiDev.data[27] = 0x10;
-        }
-    }
-
-    // Leadout track position
-    if (useBCD) {
-        LBA2MSFBCD(getLeadOutLBA(&lasttrack), &scsiDev.data[34], false);
-    } else {
-        LBA2MSF(getLeadOutLBA(&lasttrack), &scsiDev.data[34], false);
-    }
-
-    // Correct the record length in header
-    uint16_t toclen = len - 2;
-    scsiDev.data[0] = toclen >> 8;
-    scsiDev.data[1] = toclen & 0xFF;
-
+    uint32_t len = toc->fullTOC(useBCD, scsiDev.data);
     if (len > allocationLength)
     {
         len = allocationLength;
@@ -798,8 +1037,13 @@ void doReadHeader(bool MSF, uint32_t lba, uint16_t allocationLength)
 void doReadDiscInformation(uint16_t allocationLength)
 {
     image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
-    CUEParser parser;
-    if (!loadCueSheet(img, parser))
+    if (img.cdr_enabled && cdrDiscState(img) != CDR_COMPLETE)
+    {
+        return cdrReadDiscInformation(img, allocationLength);
+    }
+
+    const CDTOC *toc = getCachedTOC(img);
+    if (!toc)
     {
         // No CUE sheet, use hardcoded data
         return doReadDiscInformationSimple(allocationLength);
@@ -808,17 +1052,14 @@ void doReadDiscInformation(uint16_t allocationLength)
     // Take the hardcoded header as base
     uint32_t len = sizeof(DiscInformation);
     memcpy(scsiDev.data, DiscInformation, len);
-
-    // Find first and last track number
-    int firsttrack = -1;
-    int lasttrack = -1;
-    const CUETrackInfo *trackinfo;
-    while ((trackinfo = parser.next_track()) != NULL)
+    if (img.cdr_enabled)
     {
-        if (firsttrack < 0) firsttrack = trackinfo->track_number;
-        lasttrack = trackinfo->track_number;
+        scsiDev.data[2] |= 0x10; // erasable
     }
 
+    // First and last track number
+    uint8_t firsttrack = (toc->trackCount() > 0) ? toc->firstTrack() : 0xFF;
+    uint8_t lasttrack = (toc->trackCount() > 0) ? toc->lastTrack() : 0xFF;
     scsiDev.data[3] = firsttrack;
     scsiDev.data[5] = firsttrack;
     scsiDev.data[6] = lasttrack;
@@ -834,8 +1075,13 @@ void doReadDiscInformation(uint16_t allocationLength)
 void doReadTrackInformation(bool track, uint32_t lba, uint16_t allocationLength)
 {
     image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
-    CUEParser parser;
-    if (!loadCueSheet(img, parser))
+    if (img.cdr_enabled && cdrDiscState(img) != CDR_COMPLETE)
+    {
+        return cdrReadTrackInformation(img, track, lba, allocationLength);
+    }
+
+    const CDTOC *toc = getCachedTOC(img);
+    if (!toc)
     {
         // No CUE sheet, use hardcoded data
         return doReadTrackInformationSimple(track, lba, allocationLength);
@@ -849,31 +1095,17 @@ void doReadTrackInformation(bool track, uint32_t lba, uint16_t allocationLength)
     // Result will be placed in mtrack for later use if found
     bool trackfound = false;
     uint32_t tracklen = 0;
-    CUETrackInfo mtrack = {0};
-    const CUETrackInfo *trackinfo;
-    while ((trackinfo = parser.next_track()) != NULL)
-    {
-        if (mtrack.track_number != 0) // skip 1st track, just store later
-        {
-            if ((track && lba == mtrack.track_number)
-                || (!track && lba < trackinfo->data_start))
-            {
-                trackfound = true;
-                tracklen = trackinfo->data_start - mtrack.data_start;
-                break;
-            }
-        }
-        mtrack = *trackinfo;
-    }
-    // try the last track as a final attempt if no match found beforehand
-    if (!trackfound)
+    CDTOCTrack mtrack = {};
+    for (int i = 0; i < toc->trackCount(); i++)
     {
-        uint32_t lastLba = getLeadOutLBA(&mtrack);
-        if ((track && lba == mtrack.track_number)
-            || (!track && lba < lastLba))
+        mtrack = toc->track(i);
+        uint32_t next_start = (i + 1 < toc->trackCount()) ? toc->track(i + 1).data_start : toc->leadOut();
+        if ((track && lba == mtrack.number)
+            || (!track && lba < next_start))
         {
             trackfound = true;
-            tracklen = lastLba - mtrack.data_start;
+            tracklen = next_start - mtrack.data_start;
+            break;
         }
     }
 
@@ -888,10 +1120,10 @@ void doReadTrackInformation(bool track, uint32_t lba, uint16_t allocationLength)
     }
 
     // rewrite relevant bytes, starting with track number
-    scsiDev.data[3] = mtrack.track_number;
+    scsiDev.data[3] = mtrack.number;
 
     // track mode
-    if (mtrack.track_mode == CUETrack_AUDIO)
+    if (mtrack.mode == CUETrack_AUDIO)
     {
         scsiDev.data[5] = 0x00;
     }
@@ -909,7 +1141,7 @@ void doReadTrackInformation(bool track, uint32_t lba, uint16_t allocationLength)
     scsiDev.data[26] = tracklen >> 8;
     scsiDev.data[27] = tracklen;
 
-    debuglog("------ Reporting track ", mtrack.track_number, ", start ", start,
+    debuglog("------ Reporting track ", (int)mtrack.number, ", start ", start,
             ", length ", tracklen);
     if (len > allocationLength)
     {
@@ -940,9 +1172,9 @@ void doGetConfiguration(uint8_t rt, uint16_t startFeature, uint16_t allocationLe
     scsiDev.data[5] = 0; // reserved
     if (!img.ejected)
     {
-        // disk in drive, current profile is CD-ROM
+        // disk in drive, current profile is CD-RW for recorder, otherwise CD-ROM
         scsiDev.data[6] = 0x00;
-        scsiDev.data[7] = 0x08;
+        scsiDev.data[7] = img.cdr_enabled ? 0x0A : 0x08;
     }
     else
     {
@@ -959,11 +1191,24 @@ void doGetConfiguration(uint8_t rt, uint16_t startFeature, uint16_t allocationLe
         scsiDev.data[len++] = 0x00;
         scsiDev.data[len++] = 0x00;
         scsiDev.data[len++] = 0x03; // ver 0, persist=1,current=1
-        scsiDev.data[len++] = 8; // 2 more
+        scsiDev.data[len++] = img.cdr_enabled ? 16 : 8; // 2 or 4 more
+        if (img.cdr_enabled)
+        {
+            // CD-RW profile
+            scsiDev.data[len++] = 0x00;
+            scsiDev.data[len++] = 0x0A;
+            scsiDev.data[len++] = (img.ejected) ? 0x00 : 0x01;
+            scsiDev.data[len++] = 0;
+            // CD-R profile
+            scsiDev.data[len++] = 0x00;
+            scsiDev.data[len++] = 0x09;
+            scsiDev.data[len++] = 0x00;
+            scsiDev.data[len++] = 0;
+        }
         // CD-ROM profile
         scsiDev.data[len++] = 0x00;
         scsiDev.data[len++] = 0x08;
-        scsiDev.data[len++] = (img.ejected) ? 0x00 : 0x01;
+        scsiDev.data[len++] = (img.ejected || img.cdr_enabled) ? 0x00 : 0x01;
         scsiDev.data[len++] = 0;
         // removable disk profile
         scsiDev.data[len++] = 0x00;
@@ -1071,6 +1316,41 @@ void doGetConfiguration(uint8_t rt, uint16_t startFeature, uint16_t allocationLe
         scsiDev.data[len++] = 0;
     }
 
+    // CD track at once feature (0x2D, 45)
+    if (img.cdr_enabled &&
+        ((rt == 2 && startFeature == 45)
+        || (rt == 1 && startFeature <= 45 && !img.ejected)
+        || (rt == 0 && startFeature <= 45)))
+    {
+        scsiDev.data[len++] = 0x00;
+        scsiDev.data[len++] = 0x2D;
+        // ver 2, persist=0,current=drive state
+        scsiDev.data[len++] = (img.ejected) ? 0x08 : 0x09;
+        scsiDev.data[len++] = 4;
+        scsiDev.data[len++] = 0x42; // buf=1,cd-rw=1
+        scsiDev.data[len++] = 0;
+        scsiDev.data[len++] = 0x01; // data block types 8 (mode 1)
+        scsiDev.data[len++] = 0x01; // and 0 (raw)
+    }
+
+    // CD mastering feature (0x2E, 46)
+    if (img.cdr_enabled &&
+        ((rt == 2 && startFeature == 46)
+        || (rt == 1 && startFeature <= 46 && !img.ejected)
+        || (rt == 0 && startFeature <= 46)))
+    {
+        uint32_t maxcuesheet = sizeof(scsiDev.data);
+        scsiDev.data[len++] = 0x00;
+        scsiDev.data[len++] = 0x2E;
+        // ver 0, persist=0,current=drive state
+        scsiDev.data[len++] = (img.ejected) ? 0x00 : 0x01;
+        scsiDev.data[len++] = 4;
+        scsiDev.data[len++] = 0x62; // buf=1,sao=1,cd-rw=1
+        scsiDev.data[len++] = maxcuesheet >> 16;
+        scsiDev.data[len++] = maxcuesheet >> 8;
+        scsiDev.data[len++] = maxcuesheet;
+    }
+
 #ifdef ENABLE_AUDIO_OUTPUT
     // CD audio feature (0x103, 259)
     if ((rt == 2 && startFeature == 259)
@@ -1110,6 +1390,8 @@ void doGetConfiguration(uint8_t rt, uint16_t startFeature, uint16_t allocationLe
 
 bool cdromValidateCueSheet(image_config_t &img)
 {
+    cdromInvalidateTOC(img);
+
     CUEParser parser;
     if (!loadCueSheet(img, parser))
     {
@@ -1157,7 +1439,7 @@ void cdromCloseTray(image_config_t &img)
         uint8_t target = img.scsiId & S2S_CFG_TARGET_ID_BITS;
         debuglog("------ CDROM close tray on ID ", (int)target);
         img.ejected = false;
-        img.cdrom_events = 2; // New media
+        img.cdrom_events.mediaInserted();
 
         if (scsiDev.boardCfg.flags & S2S_CFG_ENABLE_UNIT_ATTENTION)
         {
@@ -1180,7 +1462,7 @@ void cdromPerformEject(image_config_t &img)
     {
         debuglog("------ CDROM open tray on ID ", (int)target);
         img.ejected = true;
-        img.cdrom_events = 3; // Media removal
+        img.cdrom_events.mediaRemoved();
         cdromSwitchNextImage(img); // Switch media for next time
     }
     else
@@ -1258,8 +1540,13 @@ bool cdromSwitch(image_config_t &img, const char* filename)
 
         if (status)
         {
+            // Host must see the old disc go away even if tray was not opened
+            if (!img.ejected)
+            {
+                img.cdrom_events.mediaRemoved();
+            }
             img.ejected = false;
-            img.cdrom_events = 2; // New media
+            img.cdrom_events.mediaInserted();
             return true;
         }
     }
@@ -1271,48 +1558,38 @@ bool cdromSwitch(image_config_t &img, const char* filename)
     return false;
 }
 
-static void doGetEventStatusNotification(bool immed)
+static void doGetEventStatusNotification(bool immed, uint8_t request, uint16_t allocationLength)
 {
     image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
 
     if (!immed)
     {
-        // Asynchronous notification not supported
+        // Asynchronous notification is not possible on parallel SCSI,
+        // MMC requires rejecting the request in that case.
         scsiDev.status = CHECK_CONDITION;
         scsiDev.target->sense.code = ILLEGAL_REQUEST;
         scsiDev.target->sense.asc = INVALID_FIELD_IN_CDB;
         scsiDev.phase = STATUS;
+        return;
     }
-    else if (img.cdrom_events)
-    {
-        scsiDev.data[0] = 0;
-        scsiDev.data[1] = 6; // EventDataLength
-        scsiDev.data[2] = 0x04; // Media status events
-        scsiDev.data[3] = 0x04; // Supported events
-        scsiDev.data[4] = img.cdrom_events;
-        scsiDev.data[5] = 0x01; // Power status
-        scsiDev.data[6] = 0; // Start slot
-        scsiDev.data[7] = 0; // End slot
-        scsiDev.dataLen = 8;
-        scsiDev.phase = DATA_IN;
-        img.cdrom_events = 0;
 
-        if (img.ejected && img.reinsert_after_eject)
-        {
-            // We are now reporting to host that the drive is open.
-            // Simulate a "close" for next time the host polls.
-            cdromCloseTray(img);
-        }
+    uint32_t len = img.cdrom_events.poll(request, scsiDev.data);
+
+    if (scsiDev.data[2] == MMC_EVENT_CLASS_MEDIA &&
+        scsiDev.data[4] == MMC_MEDIA_REMOVAL &&
+        img.ejected && img.reinsert_after_eject)
+    {
+        // We are now reporting to host that the drive is open.
+        // Simulate a "close" for next time the host polls.
+        cdromCloseTray(img);
     }
-    else
+
+    if (len > allocationLength)
     {
-        scsiDev.data[0] = 0;
-        scsiDev.data[1] = 2; // EventDataLength
-        scsiDev.data[2] = 0x00; // Media status events
-        scsiDev.data[3] = 0x04; // Supported events
-        scsiDev.dataLen = 4;
-        scsiDev.phase = DATA_IN;
+        len = allocationLength;
     }
+    scsiDev.dataLen = len;
+    scsiDev.phase = DATA_IN;
 }
 
 /**************************************/
@@ -1734,83 +2011,120 @@ static void doReadCD(uint32_t lba, uint32_t length, uint8_t sector_type,
     scsiDev.phase = STATUS;
 }
 
-static void doReadSubchannel(bool time, bool subq, uint8_t parameter, uint8_t track_number, uint16_t allocation_length)
+// Q sub-channel data of current playback position.
+// The track is looked up from the cached TOC, starting from the one found on
+// the previous call, so polling during playback needs no cue sheet parsing.
+static int formatSubchannelPosition(image_config_t &img, uint32_t lba, bool time, uint8_t *buf)
 {
-    uint8_t *buf = scsiDev.data;
+    // Track info in case we have no .cue file
+    CDTOCTrack trackinfo = {1, CUETrack_MODE1_2048, 0, 0};
 
-    if (parameter == 0x01)
+    const CDTOC *toc = getCachedTOC(img);
+    if (toc)
     {
-        uint8_t audiostatus;
-        uint32_t lba;
-        cdromGetAudioPlaybackStatus(&audiostatus, &lba, false);
-        debuglog("------ Get audio playback position: status ", (int)audiostatus, " lba ", (int)lba);
+        int idx = toc->findTrack(lba, g_toc_cache.track_idx);
+        if (idx >= 0)
+        {
+            g_toc_cache.track_idx = idx;
+            trackinfo = toc->track(idx);
+        }
+    }
 
-        // Fetch current track info
-        image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
-        CUEParser parser;
-        CUETrackInfo trackinfo = {};
-        loadCueSheet(img, parser);
-        getTrackFromLBA(parser, lba, &trackinfo);
+    *buf++ = 0x01; // Subchannel data format
+    *buf++ = (trackinfo.mode == CUETrack_AUDIO ? 0x10 : 0x14);
+    *buf++ = trackinfo.number;
+    *buf++ = (lba >= trackinfo.data_start) ? 1 : 0; // Index number (0 = pregap)
+    if (time)
+    {
+        *buf++ = 0;
+        LBA2MSF(lba, buf, false);
+        debuglog("------ ABS M ", *buf, " S ", *(buf+1), " F ", *(buf+2));
+        buf += 3;
+    }
+    else
+    {
+        *buf++ = (lba >> 24) & 0xFF; // Absolute block address
+        *buf++ = (lba >> 16) & 0xFF;
+        *buf++ = (lba >>  8) & 0xFF;
+        *buf++ = (lba >>  0) & 0xFF;
+    }
 
-        // Request sub channel data at current playback position
-        *buf++ = 0; // Reserved
-        *buf++ = audiostatus;
+    int32_t relpos = (int32_t)lba - (int32_t)trackinfo.data_start;
+    if (time)
+    {
+        *buf++ = 0;
+        LBA2MSF(relpos, buf, true);
+        debuglog("------ REL M ", *buf, " S ", *(buf+1), " F ", *(buf+2));
+        buf += 3;
+    }
+    else
+    {
+        uint32_t urelpos = relpos;
+        *buf++ = (urelpos >> 24) & 0xFF; // Track relative position (may be negative)
+        *buf++ = (urelpos >> 16) & 0xFF;
+        *buf++ = (urelpos >>  8) & 0xFF;
+        *buf++ = (urelpos >>  0) & 0xFF;
+    }
 
-        int len;
-        if (subq)
-        {
-            len = 12;
-            *buf++ = 0;  // Subchannel data length (MSB)
-            *buf++ = len; // Subchannel data length (LSB)
-            *buf++ = 0x01; // Subchannel data format
-            *buf++ = (trackinfo.track_mode == CUETrack_AUDIO ? 0x10 : 0x14);
-            *buf++ = trackinfo.track_number;
-            *buf++ = (lba >= trackinfo.data_start) ? 1 : 0; // Index number (0 = pregap)
-            if (time)
-            {
-                *buf++ = 0;
-                LBA2MSF(lba, buf, false);
-                debuglog("------ ABS M ", *buf, " S ", *(buf+1), " F ", *(buf+2));
-                buf += 3;
-            }
-            else
-            {
-                *buf++ = (lba >> 24) & 0xFF; // Absolute block address
-                *buf++ = (lba >> 16) & 0xFF;
-                *buf++ = (lba >>  8) & 0xFF;
-                *buf++ = (lba >>  0) & 0xFF;
-            }
+    return 12;
+}
 
-            int32_t relpos = (int32_t)lba - (int32_t)trackinfo.data_start;
-            if (time)
-            {
-                *buf++ = 0;
-                LBA2MSF(relpos, buf, true);
-                debuglog("------ REL M ", *buf, " S ", *(buf+1), " F ", *(buf+2));
-                buf += 3;
-            }
-            else
+// Media catalog number from CATALOG line of the cue sheet
+static int formatSubchannelMCN(image_config_t &img, uint8_t *buf)
+{
+    const CDTOC *toc = getCachedTOC(img);
+    const char *mcn = toc ? toc->catalog() : "";
+
+    memset(buf, 0, 20);
+    buf[0] = 0x02; // Subchannel data format
+    if (mcn[0] != '\0')
+    {
+        buf[4] = 0x80; // MCVal
+        memcpy(&buf[5], mcn, strlen(mcn));
+    }
+    return 20;
+}
+
+// ISRC of the requested track from ISRC lines of the cue sheet.
+// These are rarely requested, so the cue sheet is parsed again instead of
+// keeping them with the TOC. Returns -1 if there is no such track.
+static int formatSubchannelISRC(image_config_t &img, uint8_t track_number, uint8_t *buf)
+{
+    memset(buf, 0, 20);
+    buf[0] = 0x03; // Subchannel data format
+    buf[2] = track_number;
+
+    CUEParser parser;
+    if (!loadCueSheet(img, parser))
+    {
+        // Image without cue sheet is a single data track
+        if (track_number != 1) return -1;
+        buf[1] = 0x14;
+        return 20;
+    }
+
+    const CUETrackInfo *track;
+    while ((track = parser.next_track()) != NULL)
+    {
+        if (track->track_number == track_number)
+        {
+            buf[1] = (track->track_mode == CUETrack_AUDIO ? 0x30 : 0x34);
+            if (track->isrc[0] != '\0')
             {
-                uint32_t urelpos = relpos;
-                *buf++ = (urelpos >> 24) & 0xFF; // Track relative position (may be negative)
-                *buf++ = (urelpos >> 16) & 0xFF;
-                *buf++ = (urelpos >>  8) & 0xFF;
-                *buf++ = (urelpos >>  0) & 0xFF;
+                buf[4] = 0x80; // TCVal
+                memcpy(&buf[5], track->isrc, strlen(track->isrc));
             }
+            return 20;
         }
-        else
-        {
-            len = 0;
-            *buf++ = 0;
-            *buf++ = 0;
-        }
-        len += 4;
-
-        if (len > allocation_length) len = allocation_length;
-        scsiDev.dataLen = len;
-        scsiDev.phase = DATA_IN;
     }
-    else
+    return -1;
+}
+
+static void doReadSubchannel(bool time, bool subq, uint8_t parameter, uint8_t track_number, uint16_t allocation_length)
+{
+    uint8_t *buf = scsiDev.data;
+
+    if (parameter < 0x01 || parameter > 0x03)
     {
         debuglog("---- Unsupported subchannel request");
         scsiDev.status = CHECK_CONDITION;
@@ -1820,6 +2134,48 @@ static void doReadSubchannel(bool time, bool subq, uint8_t parameter, uint8_t tr
         return;
     }
 
+    uint8_t audiostatus;
+    uint32_t lba;
+    cdromGetAudioPlaybackStatus(&audiostatus, &lba, false);
+    debuglog("------ Get audio playback position: status ", (int)audiostatus, " lba ", (int)lba);
+
+    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+
+    *buf++ = 0; // Reserved
+    *buf++ = audiostatus;
+
+    int len = 0;
+    if (subq)
+    {
+        if (parameter == 0x01)
+        {
+            len = formatSubchannelPosition(img, lba, time, buf + 2);
+        }
+        else if (parameter == 0x02)
+        {
+            len = formatSubchannelMCN(img, buf + 2);
+        }
+        else
+        {
+            len = formatSubchannelISRC(img, track_number, buf + 2);
+            if (len < 0)
+            {
+                debuglog("---- ISRC requested for nonexistent track ", (int)track_number);
+                scsiDev.status = CHECK_CONDITION;
+                scsiDev.target->sense.code = ILLEGAL_REQUEST;
+                scsiDev.target->sense.asc = INVALID_FIELD_IN_CDB;
+                scsiDev.phase = STATUS;
+                return;
+            }
+        }
+    }
+    *buf++ = 0;  // Subchannel data length (MSB)
+    *buf++ = len; // Subchannel data length (LSB)
+    len += 4;
+
+    if (len > allocation_length) len = allocation_length;
+    scsiDev.dataLen = len;
+    scsiDev.phase = DATA_IN;
 }
 
 static bool doReadCapacity(uint32_t lba, uint8_t pmi)
@@ -1876,348 +2232,609 @@ static bool doReadCapacity(uint32_t lba, uint8_t pmi)
 /* CD-ROM command dispatching         */
 /**************************************/
 
-// Handle direct-access scsi device commands
-extern "C" int scsiCDRomCommand()
+static int cdromCmdStartStopUnit(image_config_t &img)
 {
-    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
-    int commandHandled = 1;
-
-    uint8_t command = scsiDev.cdb[0];
-    if (command == 0x1B)
-    {
+    // START STOP UNIT
 #if ENABLE_AUDIO_OUTPUT
-        // terminate audio playback if active on this target (MMC-1 Annex C)
-        audio_stop(img.scsiId & S2S_CFG_TARGET_ID_BITS);
+    // terminate audio playback if active on this target (MMC-1 Annex C)
+    audio_stop(img.scsiId & S2S_CFG_TARGET_ID_BITS);
 #endif
-        if ((scsiDev.cdb[4] & 2))
+    if ((scsiDev.cdb[4] & 2))
+    {
+        // CD-ROM load & eject
+        int start = scsiDev.cdb[4] & 1;
+        if (start)
         {
-            // CD-ROM load & eject
-            int start = scsiDev.cdb[4] & 1;
-            if (start)
-            {
-                cdromCloseTray(img);
-            }
-            else
-            {
-                // Eject and switch image
-                cdromPerformEject(img);
-            }
+            cdromCloseTray(img);
+        }
+        else
+        {
+            // Eject and switch image
+            cdromPerformEject(img);
+        }
+    }
+    return 1;
+}
+
+static int cdromCmdReadCapacity(image_config_t &img)
+{
+    // READ CAPACITY
+    uint8_t reladdr = scsiDev.cdb[1] & 1;
+    uint32_t lba = cdbGet32(&scsiDev.cdb[2]);
+    uint8_t pmi = scsiDev.cdb[8] & 1;
+
+    // allow PMI as long as LBA is specified, this is permitted in SCSI-2
+    // we don't link commands, do not allow RELADDR
+    if ((!pmi && lba != 0) || reladdr)
+    {
+        scsiDev.status = CHECK_CONDITION;
+        scsiDev.target->sense.code = ILLEGAL_REQUEST;
+        scsiDev.target->sense.asc = INVALID_FIELD_IN_CDB;
+        scsiDev.phase = STATUS;
+    }
+    else
+    {
+        if (!doReadCapacity(lba, pmi))
+        {
+            // allow disk handler to resolve this one
+            return 0;
         }
     }
-    else if (command == 0x25)
+    return 1;
+}
+
+static int cdromCmdReadTOC(image_config_t &img)
+{
+    // CD-ROM Read TOC
+    if (img.cdr_enabled && cdrDiscState(img) != CDR_COMPLETE)
     {
-        // READ CAPACITY
-        uint8_t reladdr = scsiDev.cdb[1] & 1;
-        uint32_t lba = (((uint32_t) scsiDev.cdb[2]) << 24) +
-            (((uint32_t) scsiDev.cdb[3]) << 16) +
-            (((uint32_t) scsiDev.cdb[4]) << 8) +
-            scsiDev.cdb[5];
-        uint8_t pmi = scsiDev.cdb[8] & 1;
+        // Blank or open disc has no table of contents yet
+        cdrCheckCondition(ILLEGAL_REQUEST, INVALID_FIELD_IN_CDB);
+        return 1;
+    }
 
-        // allow PMI as long as LBA is specified, this is permitted in SCSI-2
-        // we don't link commands, do not allow RELADDR
-        if ((!pmi && lba != 0) || reladdr)
+    bool MSF = (scsiDev.cdb[1] & 0x02);
+    uint8_t track = scsiDev.cdb[6];
+    uint16_t allocationLength = cdbGet16(&scsiDev.cdb[7]);
+
+    // The "format" field is reserved for SCSI-2
+    uint8_t format = scsiDev.cdb[2] & 0x0F;
+
+    // Matshita SCSI-2 drives appear to use the high 2 bits of the CDB
+    // control byte to switch on session info (0x40) and full toc (0x80)
+    // responses that are very similar to the standard formats described
+    // in MMC-1. These vendor flags must have been pretty common because
+    // even a modern SATA drive (ASUS DRW-24B1ST j) responds to them
+    // (though it always replies in hex rather than bcd)
+    //
+    // The session information page is identical to MMC. The full TOC page
+    // is identical _except_ it returns addresses in bcd rather than hex.
+    bool useBCD = false;
+    if (format == 0 && scsiDev.cdb[9] == 0x80)
+    {
+        format = 2;
+        useBCD = true;
+    }
+    else if (format == 0 && scsiDev.cdb[9] == 0x40)
+    {
+        format = 1;
+    }
+
+    switch (format)
+    {
+        case 0: doReadTOC(MSF, track, allocationLength); break; // SCSI-2
+        case 1: doReadSessionInfo(MSF, allocationLength); break; // MMC2
+        case 2: doReadFullTOC(track, allocationLength, useBCD); break; // MMC2
+        default:
         {
             scsiDev.status = CHECK_CONDITION;
             scsiDev.target->sense.code = ILLEGAL_REQUEST;
             scsiDev.target->sense.asc = INVALID_FIELD_IN_CDB;
             scsiDev.phase = STATUS;
         }
-        else
+    }
+    return 1;
+}
+
+static int cdromCmdReadHeader(image_config_t &img)
+{
+    // CD-ROM Read Header
+    bool MSF = (scsiDev.cdb[1] & 0x02);
+    uint32_t lba = 0; // IGNORED for now
+    uint16_t allocationLength = cdbGet16(&scsiDev.cdb[7]);
+    doReadHeader(MSF, lba, allocationLength);
+    return 1;
+}
+
+static int cdromCmdGetConfiguration(image_config_t &img)
+{
+    // GET CONFIGURATION
+    uint8_t rt = (scsiDev.cdb[1] & 0x03);
+    uint16_t startFeature = cdbGet16(&scsiDev.cdb[2]);
+    uint16_t allocationLength = cdbGet16(&scsiDev.cdb[7]);
+    doGetConfiguration(rt, startFeature, allocationLength);
+    return 1;
+}
+
+static int cdromCmdReadDiscInformation(image_config_t &img)
+{
+    uint16_t allocationLength = cdbGet16(&scsiDev.cdb[7]);
+    doReadDiscInformation(allocationLength);
+    return 1;
+}
+
+static int cdromCmdReadTrackInformation(image_config_t &img)
+{
+    // READ TRACK INFORMATION
+    bool track = (scsiDev.cdb[1] & 0x01);
+    uint32_t lba = cdbGet32(&scsiDev.cdb[2]);
+    uint16_t allocationLength = cdbGet16(&scsiDev.cdb[7]);
+    doReadTrackInformation(track, lba, allocationLength);
+    return 1;
+}
+
+static int cdromCmdGetEventStatusNotification(image_config_t &img)
+{
+    // Get event status notifications (media change notifications)
+    bool immed = scsiDev.cdb[1] & 1;
+    uint8_t request = scsiDev.cdb[4];
+    uint16_t allocationLength = cdbGet16(&scsiDev.cdb[7]);
+    doGetEventStatusNotification(immed, request, allocationLength);
+    return 1;
+}
+
+static int cdromCmdPlayAudio10(image_config_t &img)
+{
+    // PLAY AUDIO (10)
+    uint32_t lba = cdbGet32(&scsiDev.cdb[2]);
+    uint32_t blocks = cdbGet16(&scsiDev.cdb[7]);
+
+    doPlayAudio(lba, blocks);
+    return 1;
+}
+
+static int cdromCmdPlayAudio12(image_config_t &img)
+{
+    // PLAY AUDIO (12)
+    uint32_t lba = cdbGet32(&scsiDev.cdb[2]);
+    uint32_t blocks = cdbGet32(&scsiDev.cdb[6]);
+
+    doPlayAudio(lba, blocks);
+    return 1;
+}
+
+static int cdromCmdPlayAudioMSF(image_config_t &img)
+{
+    // PLAY AUDIO (MSF)
+    uint32_t start = MSF2LBA(scsiDev.cdb[3], scsiDev.cdb[4], scsiDev.cdb[5], false);
+    uint32_t end   = MSF2LBA(scsiDev.cdb[6], scsiDev.cdb[7], scsiDev.cdb[8], false);
+
+    uint32_t lba = start;
+    if (scsiDev.cdb[3] == 0xFF
+            && scsiDev.cdb[4] == 0xFF
+            && scsiDev.cdb[5] == 0xFF)
+    {
+        // request to start playback from 'current position'
+        lba = img.file.position() / 2352;
+    }
+
+    uint32_t length = end - lba;
+    doPlayAudio(lba, length);
+    return 1;
+}
+
+static int cdromCmdPauseResume(image_config_t &img)
+{
+    // PAUSE/RESUME AUDIO
+    doPauseResumeAudio(scsiDev.cdb[8] & 1);
+    return 1;
+}
+
+static int cdromCmdMechanismStatus(image_config_t &img)
+{
+    // Mechanism status
+    uint16_t allocationLength = cdbGet16(&scsiDev.cdb[8]);
+    doMechanismStatus(allocationLength);
+    return 1;
+}
+
+static int cdromCmdSetSpeed(image_config_t &img)
+{
+    // Set CD speed (just ignored)
+    scsiDev.status = 0;
+    scsiDev.phase = STATUS;
+    return 1;
+}
+
+static int cdromCmdReadCD(image_config_t &img)
+{
+    // ReadCD (in low level format)
+    uint8_t sector_type = (scsiDev.cdb[1] >> 2) & 7;
+    uint32_t lba = cdbGet32(&scsiDev.cdb[2]);
+    uint32_t blocks = cdbGet24(&scsiDev.cdb[6]);
+    uint8_t main_channel = scsiDev.cdb[9];
+    uint8_t sub_channel = scsiDev.cdb[10];
+
+    doReadCD(lba, blocks, sector_type, main_channel, sub_channel, false);
+    return 1;
+}
+
+static int cdromCmdReadCDMSF(image_config_t &img)
+{
+    // ReadCD MSF
+    uint8_t sector_type = (scsiDev.cdb[1] >> 2) & 7;
+    uint32_t start = MSF2LBA(scsiDev.cdb[3], scsiDev.cdb[4], scsiDev.cdb[5], false);
+    uint32_t end   = MSF2LBA(scsiDev.cdb[6], scsiDev.cdb[7], scsiDev.cdb[8], false);
+    uint8_t main_channel = scsiDev.cdb[9];
+    uint8_t sub_channel = scsiDev.cdb[10];
+
+    doReadCD(start, end - start, sector_type, main_channel, sub_channel, false);
+    return 1;
+}
+
+static int cdromCmdReadSubchannel(image_config_t &img)
+{
+    // Read subchannel data
+    bool time = (scsiDev.cdb[1] & 0x02);
+    bool subq = (scsiDev.cdb[2] & 0x40);
+    uint8_t parameter = scsiDev.cdb[3];
+    uint8_t track_number = scsiDev.cdb[6];
+    uint16_t allocationLength = cdbGet16(&scsiDev.cdb[7]);
+
+    doReadSubchannel(time, subq, parameter, track_number, allocationLength);
+    return 1;
+}
+
+static int cdromCmdRead6(image_config_t &img)
+{
+    // READ(6) for CDs (may need sector translation for cue file handling)
+    uint32_t lba = cdbLBA(scsiDev.cdb);
+    uint32_t blocks = cdbBlockCount(scsiDev.cdb);
+
+    doReadCD(lba, blocks, 0, 0x10, 0, true);
+    return 1;
+}
+
+static int cdromCmdRead10(image_config_t &img)
+{
+    // READ(10) for CDs (may need sector translation for cue file handling)
+    uint32_t lba = cdbLBA(scsiDev.cdb);
+    uint32_t blocks = cdbTransferLength(scsiDev.cdb);
+
+    doReadCD(lba, blocks, 0, 0x10, 0, true);
+    return 1;
+}
+
+static int cdromCmdRead12(image_config_t &img)
+{
+    // READ(12) for CDs (may need sector translation for cue file handling)
+    uint32_t lba = cdbLBA(scsiDev.cdb);
+    uint32_t blocks = cdbTransferLength(scsiDev.cdb);
+
+    doReadCD(lba, blocks, 0, 0x10, 0, true);
+    return 1;
+}
+
+static int cdromCmdStopPlayScan(image_config_t &img)
+{
+    // STOP PLAY/SCAN
+    doStopAudio();
+    scsiDev.status = 0;
+    scsiDev.phase = STATUS;
+    return 1;
+}
+
+static int cdromCmdRezeroUnit(image_config_t &img)
+{
+    // REZERO UNIT
+    // AppleCD Audio Player uses this as a nonstandard
+    // "stop audio playback" command
+    doStopAudio();
+    scsiDev.status = 0;
+    scsiDev.phase = STATUS;
+    return 1;
+}
+
+static int cdromCmdSeek(image_config_t &img)
+{
+    // SEEK
+    // implement Annex C termination requirement and pass to disk handler
+    doStopAudio();
+    // this may need more specific handling, the Win9x player appears to
+    // expect a pickup move to the given LBA
+    return 0;
+}
+
+static int cdromCmdWrite(image_config_t &img)
+{
+    // WRITE(6), WRITE(10), WRITE AND VERIFY, WRITE(12) on CD recorder
+    if (!img.cdr_enabled)
+    {
+        // let disk handler reject the write to read-only drive
+        return 0;
+    }
+
+    int32_t lba = (int32_t)cdbLBA(scsiDev.cdb);
+    uint32_t blocks = cdbBlockCount(scsiDev.cdb);
+    bool sao = (img.cdr_write_type == CDR_WRITE_SAO);
+
+    if (cdrDiscState(img) == CDR_COMPLETE || !cdrClaim(img))
+    {
+        log("WARNING: Host attempted write to closed disc on ID ", (int)(img.scsiId & S2S_CFG_TARGET_ID_BITS));
+        cdrCheckCondition(ILLEGAL_REQUEST, INVALID_ADDRESS_FOR_WRITE);
+        return 1;
+    }
+
+    CDRecorder &disc = g_cdr.disc;
+    if (sao && disc.trackCount() == 0)
+    {
+        // Session-At-Once recording starts with SEND CUE SHEET
+        cdrCheckCondition(ILLEGAL_REQUEST, COMMAND_SEQUENCE_ERROR);
+        return 1;
+    }
+
+    uint8_t mode = sao ? disc.trackMode() : cdrTrackMode(img);
+    uint16_t block_size = sao ? disc.blockSize() : cdrBlockSize(mode);
+    if (disc.recorded() && block_size != disc.blockSize())
+    {
+        log("---- CD recorder: all tracks must use the same block size as the first, ",
+            (int)disc.blockSize(), " bytes");
+        cdrCheckCondition(ILLEGAL_REQUEST, ILLEGAL_MODE_FOR_THIS_TRACK);
+        return 1;
+    }
+
+    if (blocks == 0)
+    {
+        scsiDev.status = GOOD;
+        scsiDev.phase = STATUS;
+    }
+    else if (lba < 0)
+    {
+        if (!sao || lba + (int32_t)blocks > 0)
         {
-            if (!doReadCapacity(lba, pmi))
-            {
-                // allow disk handler to resolve this one
-                commandHandled = 0;
-            }
+            cdrCheckCondition(ILLEGAL_REQUEST, INVALID_ADDRESS_FOR_WRITE);
+            return 1;
         }
+
+        g_cdr.discard_bytes = blocks * block_size;
+        cdrDiscardDataOut();
     }
-    else if (command == 0x43)
-    {
-        // CD-ROM Read TOC
-        bool MSF = (scsiDev.cdb[1] & 0x02);
-        uint8_t track = scsiDev.cdb[6];
-        uint16_t allocationLength =
-            (((uint32_t) scsiDev.cdb[7]) << 8) +
-            scsiDev.cdb[8];
-
-        // The "format" field is reserved for SCSI-2
-        uint8_t format = scsiDev.cdb[2] & 0x0F;
-
-        // Matshita SCSI-2 drives appear to use the high 2 bits of the CDB
-        // control byte to switch on session info (0x40) and full toc (0x80)
-        // responses that are very similar to the standard formats described
-        // in MMC-1. These vendor flags must have been pretty common because
-        // even a modern SATA drive (ASUS DRW-24B1ST j) responds to them
-        // (though it always replies in hex rather than bcd)
-        //
-        // The session information page is identical to MMC. The full TOC page
-        // is identical _except_ it returns addresses in bcd rather than hex.
-        bool useBCD = false;
-        if (format == 0 && scsiDev.cdb[9] == 0x80)
+    else if (!disc.writeStart(lba, blocks, mode, block_size, sao))
+    {
+        if ((uint32_t)lba != disc.nextWritable())
         {
-            format = 2;
-            useBCD = true;
+            log("---- CD recorder: write at ", (int)lba, " but next writable address is ", (int)disc.nextWritable());
         }
-        else if (format == 0 && scsiDev.cdb[9] == 0x40)
+        cdrCheckCondition(ILLEGAL_REQUEST, INVALID_ADDRESS_FOR_WRITE);
+    }
+    else
+    {
+        // Data goes through the normal pipelined disk write path, which
+        // paces the host and commits every block to SD before status.
+        // The next writable address moves in cdromRecorderWriteDone().
+        scsiDev.target->liveCfg.bytesPerSector = block_size;
+        scsiDiskStartWrite(lba, blocks);
+        if (scsiDev.phase != DATA_OUT)
         {
-            format = 1;
+            disc.writeDone(false);
         }
+    }
+    return 1;
+}
 
-        switch (format)
+void cdromRecorderWriteDone(image_config_t &img, bool ok)
+{
+    if (img.cdr_enabled && cdrOwner(img))
+    {
+        g_cdr.disc.writeDone(ok);
+    }
+}
+
+static int cdromCmdSynchronizeCache(image_config_t &img)
+{
+    // SYNCHRONIZE CACHE ends Session-At-Once recording
+    if (img.cdr_enabled && img.cdr_write_type == CDR_WRITE_SAO &&
+        cdrOwner(img) && g_cdr.disc.trackOpen())
+    {
+        if (!cdrCloseSession(img))
         {
-            case 0: doReadTOC(MSF, track, allocationLength); break; // SCSI-2
-            case 1: doReadSessionInfo(MSF, allocationLength); break; // MMC2
-            case 2: doReadFullTOC(track, allocationLength, useBCD); break; // MMC2
-            default:
-            {
-                scsiDev.status = CHECK_CONDITION;
-                scsiDev.target->sense.code = ILLEGAL_REQUEST;
-                scsiDev.target->sense.asc = INVALID_FIELD_IN_CDB;
-                scsiDev.phase = STATUS;
-            }
+            cdrCheckCondition(MEDIUM_ERROR, PERIPHERAL_DEVICE_WRITE_FAULT);
+            return 1;
         }
     }
-    else if (command == 0x44)
-    {
-        // CD-ROM Read Header
-        bool MSF = (scsiDev.cdb[1] & 0x02);
-        uint32_t lba = 0; // IGNORED for now
-        uint16_t allocationLength =
-            (((uint32_t) scsiDev.cdb[7]) << 8) +
-            scsiDev.cdb[8];
-        doReadHeader(MSF, lba, allocationLength);
-    }
-    else if (command == 0x46)
-    {
-        // GET CONFIGURATION
-        uint8_t rt = (scsiDev.cdb[1] & 0x03);
-        uint16_t startFeature =
-            (((uint16_t) scsiDev.cdb[2]) << 8) +
-            scsiDev.cdb[3];
-        uint16_t allocationLength =
-            (((uint32_t) scsiDev.cdb[7]) << 8) +
-            scsiDev.cdb[8];
-        doGetConfiguration(rt, startFeature, allocationLength);
-    }
-    else if (command == 0x51)
-    {
-        uint16_t allocationLength =
-            (((uint32_t) scsiDev.cdb[7]) << 8) +
-            scsiDev.cdb[8];
-        doReadDiscInformation(allocationLength);
-    }
-    else if (command == 0x52)
-    {
-        // READ TRACK INFORMATION
-        bool track = (scsiDev.cdb[1] & 0x01);
-        uint32_t lba = (((uint32_t) scsiDev.cdb[2]) << 24) +
-            (((uint32_t) scsiDev.cdb[3]) << 16) +
-            (((uint32_t) scsiDev.cdb[4]) << 8) +
-            scsiDev.cdb[5];
-        uint16_t allocationLength =
-            (((uint32_t) scsiDev.cdb[7]) << 8) +
-            scsiDev.cdb[8];
-        doReadTrackInformation(track, lba, allocationLength);
-    }
-    else if (command == 0x4A)
-    {
-        // Get event status notifications (media change notifications)
-        bool immed = scsiDev.cdb[1] & 1;
-        doGetEventStatusNotification(immed);
-    }
-    else if (command == 0x45)
-    {
-        // PLAY AUDIO (10)
-        uint32_t lba =
-            (((uint32_t) scsiDev.cdb[2]) << 24) +
-            (((uint32_t) scsiDev.cdb[3]) << 16) +
-            (((uint32_t) scsiDev.cdb[4]) << 8) +
-            scsiDev.cdb[5];
-        uint32_t blocks =
-            (((uint32_t) scsiDev.cdb[7]) << 8) +
-            scsiDev.cdb[8];
-
-        doPlayAudio(lba, blocks);
-    }
-    else if (command == 0xA5)
-    {
-        // PLAY AUDIO (12)
-        uint32_t lba =
-            (((uint32_t) scsiDev.cdb[2]) << 24) +
-            (((uint32_t) scsiDev.cdb[3]) << 16) +
-            (((uint32_t) scsiDev.cdb[4]) << 8) +
-            scsiDev.cdb[5];
-        uint32_t blocks =
-            (((uint32_t) scsiDev.cdb[6]) << 24) +
-            (((uint32_t) scsiDev.cdb[7]) << 16) +
-            (((uint32_t) scsiDev.cdb[8]) << 8) +
-            scsiDev.cdb[9];
-
-        doPlayAudio(lba, blocks);
-    }
-    else if (command == 0x47)
-    {
-        // PLAY AUDIO (MSF)
-        uint32_t start = MSF2LBA(scsiDev.cdb[3], scsiDev.cdb[4], scsiDev.cdb[5], false);
-        uint32_t end   = MSF2LBA(scsiDev.cdb[6], scsiDev.cdb[7], scsiDev.cdb[8], false);
-
-        uint32_t lba = start;
-        if (scsiDev.cdb[3] == 0xFF
-                && scsiDev.cdb[4] == 0xFF
-                && scsiDev.cdb[5] == 0xFF)
+
+    // let disk handler report success
+    return 0;
+}
+
+static int cdromCmdReserveTrack(image_config_t &img)
+{
+    // RESERVE TRACK, tracks are recorded sequentially so there is nothing to do
+    if (!img.cdr_enabled) return 0;
+    scsiDev.status = GOOD;
+    scsiDev.phase = STATUS;
+    return 1;
+}
+
+static int cdromCmdCloseTrackSession(image_config_t &img)
+{
+    // CLOSE TRACK/SESSION
+    if (!img.cdr_enabled) return 0;
+    uint8_t function = scsiDev.cdb[2] & 0x07;
+
+    CDRecorder &disc = g_cdr.disc;
+    if (cdrOwner(img) && img.cdr_write_type != CDR_WRITE_SAO && disc.closeTrack())
+    {
+        debuglog("------ CD recorder closed track ", (int)disc.trackCount(), " at ", (int)disc.trackStart(),
+                 ", ", (int)(disc.nextWritable() - disc.trackStart()), " blocks");
+    }
+
+    if (function >= 2 && cdrOwner(img) && disc.trackCount() > 0)
+    {
+        if (!cdrCloseSession(img))
         {
-            // request to start playback from 'current position'
-            image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
-            lba = img.file.position() / 2352;
+            cdrCheckCondition(MEDIUM_ERROR, PERIPHERAL_DEVICE_WRITE_FAULT);
+            return 1;
         }
+    }
 
-        uint32_t length = end - lba;
-        doPlayAudio(lba, length);
+    scsiDev.status = GOOD;
+    scsiDev.phase = STATUS;
+    return 1;
+}
+
+static int cdromCmdReadBufferCapacity(image_config_t &img)
+{
+    // READ BUFFER CAPACITY
+    // Written data is committed to SD card before status is returned, so
+    // the buffer is always empty when host asks. As data flows only when
+    // there is room for it, the recording can never underrun.
+    if (!img.cdr_enabled) return 0;
+    bool block = scsiDev.cdb[1] & 1;
+    uint16_t allocationLength = cdbGet16(&scsiDev.cdb[7]);
+    uint32_t buffer = sizeof(scsiDev.data);
+
+    uint32_t len = 12;
+    memset(scsiDev.data, 0, len);
+    scsiDev.data[1] = len - 2;
+    if (block)
+    {
+        scsiDev.data[3] = 0x01;
+        cdrPut32(&scsiDev.data[8], buffer / cdrBlockSize(cdrTrackMode(img)));
     }
-    else if (command == 0x4B)
+    else
     {
-        // PAUSE/RESUME AUDIO
-        doPauseResumeAudio(scsiDev.cdb[8] & 1);
+        cdrPut32(&scsiDev.data[4], buffer);
+        cdrPut32(&scsiDev.data[8], buffer);
     }
-    else if (command == 0xBD)
+
+    if (len > allocationLength)
     {
-        // Mechanism status
-        uint16_t allocationLength = (((uint32_t) scsiDev.cdb[8]) << 8) + scsiDev.cdb[9];
-        doMechanismStatus(allocationLength);
+        len = allocationLength;
     }
-    else if (command == 0xBB)
+    scsiDev.dataLen = len;
+    scsiDev.phase = DATA_IN;
+    return 1;
+}
+
+static int cdromCmdSendCueSheet(image_config_t &img)
+{
+    // SEND CUE SHEET
+    if (!img.cdr_enabled) return 0;
+    uint32_t length = cdbGet24(&scsiDev.cdb[6]);
+
+    if (cdrDiscState(img) == CDR_COMPLETE ||
+        (cdrOwner(img) && g_cdr.disc.trackOpen()) ||
+        !cdrClaim(img))
     {
-        // Set CD speed (just ignored)
-        scsiDev.status = 0;
-        scsiDev.phase = STATUS;
+        cdrCheckCondition(ILLEGAL_REQUEST, COMMAND_SEQUENCE_ERROR);
     }
-    else if (command == 0xBE)
-    {
-        // ReadCD (in low level format)
-        uint8_t sector_type = (scsiDev.cdb[1] >> 2) & 7;
-        uint32_t lba =
-            (((uint32_t) scsiDev.cdb[2]) << 24) +
-            (((uint32_t) scsiDev.cdb[3]) << 16) +
-            (((uint32_t) scsiDev.cdb[4]) << 8) +
-            scsiDev.cdb[5];
-        uint32_t blocks =
-            (((uint32_t) scsiDev.cdb[6]) << 16) +
-            (((uint32_t) scsiDev.cdb[7]) << 8) +
-            (((uint32_t) scsiDev.cdb[8]));
-        uint8_t main_channel = scsiDev.cdb[9];
-        uint8_t sub_channel = scsiDev.cdb[10];
-
-        doReadCD(lba, blocks, sector_type, main_channel, sub_channel, false);
-    }
-    else if (command == 0xB9)
-    {
-        // ReadCD MSF
-        uint8_t sector_type = (scsiDev.cdb[1] >> 2) & 7;
-        uint32_t start = MSF2LBA(scsiDev.cdb[3], scsiDev.cdb[4], scsiDev.cdb[5], false);
-        uint32_t end   = MSF2LBA(scsiDev.cdb[6], scsiDev.cdb[7], scsiDev.cdb[8], false);
-        uint8_t main_channel = scsiDev.cdb[9];
-        uint8_t sub_channel = scsiDev.cdb[10];
-
-        doReadCD(start, end - start, sector_type, main_channel, sub_channel, false);
-    }
-    else if (command == 0x42)
-    {
-        // Read subchannel data
-        bool time = (scsiDev.cdb[1] & 0x02);
-        bool subq = (scsiDev.cdb[2] & 0x40);
-        uint8_t parameter = scsiDev.cdb[3];
-        uint8_t track_number = scsiDev.cdb[6];
-        uint16_t allocationLength = (((uint32_t) scsiDev.cdb[7]) << 8) + scsiDev.cdb[8];
-
-        doReadSubchannel(time, subq, parameter, track_number, allocationLength);
-    }
-    else if (command == 0x08)
-    {
-        // READ(6) for CDs (may need sector translation for cue file handling)
-        uint32_t lba =
-            (((uint32_t) scsiDev.cdb[1] & 0x1F) << 16) +
-            (((uint32_t) scsiDev.cdb[2]) << 8) +
-            scsiDev.cdb[3];
-        uint32_t blocks = scsiDev.cdb[4];
-        if (blocks == 0) blocks = 256;
-
-        doReadCD(lba, blocks, 0, 0x10, 0, true);
-    }
-    else if (command == 0x28)
-    {
-        // READ(10) for CDs (may need sector translation for cue file handling)
-        uint32_t lba =
-            (((uint32_t) scsiDev.cdb[2]) << 24) +
-            (((uint32_t) scsiDev.cdb[3]) << 16) +
-            (((uint32_t) scsiDev.cdb[4]) << 8) +
-            scsiDev.cdb[5];
-        uint32_t blocks =
-            (((uint32_t) scsiDev.cdb[7]) << 8) +
-            scsiDev.cdb[8];
-
-        doReadCD(lba, blocks, 0, 0x10, 0, true);
-    }
-    else if (command == 0xA8)
-    {
-        // READ(12) for CDs (may need sector translation for cue file handling)
-        uint32_t lba =
-            (((uint32_t) scsiDev.cdb[2]) << 24) +
-            (((uint32_t) scsiDev.cdb[3]) << 16) +
-            (((uint32_t) scsiDev.cdb[4]) << 8) +
-            scsiDev.cdb[5];
-        uint32_t blocks =
-            (((uint32_t) scsiDev.cdb[6]) << 24) +
-            (((uint32_t) scsiDev.cdb[7]) << 16) +
-            (((uint32_t) scsiDev.cdb[8]) << 8) +
-            scsiDev.cdb[9];
-
-        doReadCD(lba, blocks, 0, 0x10, 0, true);
-    }
-    else if (command == 0x4E)
-    {
-        // STOP PLAY/SCAN
-        doStopAudio();
-        scsiDev.status = 0;
-        scsiDev.phase = STATUS;
+    else if (length == 0 || (length % 8) != 0 || length > sizeof(scsiDev.data))
+    {
+        cdrCheckCondition(ILLEGAL_REQUEST, INVALID_FIELD_IN_CDB);
     }
-    else if (command == 0x01)
+    else
     {
-        // REZERO UNIT
-        // AppleCD Audio Player uses this as a nonstandard
-        // "stop audio playback" command
-        doStopAudio();
-        scsiDev.status = 0;
-        scsiDev.phase = STATUS;
+        g_cdr.disc.reset();
+        scsiDev.dataLen = length;
+        scsiDev.dataPtr = 0;
+        scsiDev.phase = DATA_OUT;
+        scsiDev.postDataOutHook = cdrParseCueSheet;
+    }
+    return 1;
+}
+
+static int cdromCmdBlank(image_config_t &img)
+{
+    // BLANK, any blanking type erases the whole disc
+    if (!img.cdr_enabled) return 0;
+
+    if (cdrOwner(img))
+    {
+        g_cdr.target = -1;
     }
-    else if (command == 0x0B || command == 0x2B)
-    {
-        // SEEK
-        // implement Annex C termination requirement and pass to disk handler
-        doStopAudio();
-        // this may need more specific handling, the Win9x player appears to
-        // expect a pickup move to the given LBA
-        commandHandled = 0;
-    }
-    else if (scsiDev.target->cfg->quirks == S2S_CFG_QUIRKS_APPLE
-            && command == 0xCD)
-    {
-        // vendor-specific command issued by the AppleCD Audio Player in
-        // response to fast-forward or rewind commands. Might be seek,
-        // might be reposition. Exact MSF value below is unknown.
-        //
-        // Byte 0: 0xCD
-        // Byte 1: 0x10 for rewind, 0x00 for fast-forward
-        // Byte 2: 0x00
-        // Byte 3: 'M' in hex
-        // Byte 4: 'S' in hex
-        // Byte 5: 'F' in hex
-        commandHandled = 0;
+
+    uint64_t old_size = img.cuesheetfile.size();
+    if (!img.cuesheetfile.truncate(0) || !img.cuesheetfile.sync())
+    {
+        cdrCheckCondition(MEDIUM_ERROR, PERIPHERAL_DEVICE_WRITE_FAULT);
+        return 1;
+    }
+    scsiDiskFreeSpaceUpdate(old_size, 0);
+    cdromInvalidateTOC(img);
+
+    img.cdr_leadout = 0;
+    scsiDev.target->liveCfg.bytesPerSector = img.bytesPerSector;
+    log("---- CD recorder disc on ID ", (int)(img.scsiId & S2S_CFG_TARGET_ID_BITS), " blanked");
+    img.cdrom_events.operationalChange(MMC_OPERATIONAL_REPORT_FEATURE_CHANGE);
+
+    scsiDev.status = GOOD;
+    scsiDev.phase = STATUS;
+    return 1;
+}
+
+static constexpr scsi_opcode_entry_t g_cdrom_opcodes[] = {
+    { 0x01, cdromCmdRezeroUnit },
+    { 0x08, cdromCmdRead6 },
+    { 0x0A, cdromCmdWrite },
+    { 0x0B, cdromCmdSeek },
+    { 0x1B, cdromCmdStartStopUnit },
+    { 0x25, cdromCmdReadCapacity },
+    { 0x28, cdromCmdRead10 },
+    { 0x2A, cdromCmdWrite },
+    { 0x2B, cdromCmdSeek },
+    { 0x2E, cdromCmdWrite },
+    { 0x35, cdromCmdSynchronizeCache },
+    { 0x42, cdromCmdReadSubchannel },
+    { 0x43, cdromCmdReadTOC },
+    { 0x44, cdromCmdReadHeader },
+    { 0x45, cdromCmdPlayAudio10 },
+    { 0x46, cdromCmdGetConfiguration },
+    { 0x47, cdromCmdPlayAudioMSF },
+    { 0x4A, cdromCmdGetEventStatusNotification },
+    { 0x4B, cdromCmdPauseResume },
+    { 0x4E, cdromCmdStopPlayScan },
+    { 0x51, cdromCmdReadDiscInformation },
+    { 0x52, cdromCmdReadTrackInformation },
+    { 0x53, cdromCmdReserveTrack },
+    { 0x5B, cdromCmdCloseTrackSession },
+    { 0x5C, cdromCmdReadBufferCapacity },
+    { 0x5D, cdromCmdSendCueSheet },
+    { 0xA1, cdromCmdBlank },
+    { 0xA5, cdromCmdPlayAudio12 },
+    { 0xA8, cdromCmdRead12 },
+    { 0xAA, cdromCmdWrite },
+    { 0xB9, cdromCmdReadCDMSF },
+    { 0xBB, cdromCmdSetSpeed },
+    { 0xBD, cdromCmdMechanismStatus },
+    { 0xBE, cdromCmdReadCD },
+
+    // 0xCD is a vendor-specific command issued by the AppleCD Audio Player in
+    // response to fast-forward or rewind commands. Might be seek,
+    // might be reposition. Exact MSF value is unknown, so it is left unhandled.
+    //
+    // Byte 0: 0xCD
+    // Byte 1: 0x10 for rewind, 0x00 for fast-forward
+    // Byte 2: 0x00
+    // Byte 3: 'M' in hex
+    // Byte 4: 'S' in hex
+    // Byte 5: 'F' in hex
+};
+
+static constexpr scsi_opcode_table_t g_cdrom_opcode_table = scsiOpcodeTable(g_cdrom_opcodes);
+
+// Handle CD-ROM specific scsi device commands
+extern "C" int scsiCDRomCommand()
+{
+    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+    scsi_opcode_handler_t handler = g_cdrom_opcode_table.handler[scsiDev.cdb[0]];
+
+    if (handler)
+    {
+        return handler(img);
     }
     else
     {
-        commandHandled = 0;
+        return 0;
     }
-
-    return commandHandled;
 }
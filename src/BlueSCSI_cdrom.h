@@ -3,6 +3,7 @@
 //
 // - bin/cue support for support of multiple tracks
 // - on the fly image switching
+// - CD-R/RW recording to bin/cue
 
 #pragma once
 
@@ -28,6 +29,17 @@ bool cdromSwitchNextImage(image_config_t &img);
 // and print warnings about unsupported track types
 bool cdromValidateCueSheet(image_config_t &img);
 
+// Forget the TOC built from cue sheet, called when the image changes
+void cdromInvalidateTOC(image_config_t &img);
+
+// Set up CD-R/RW recorder emulation for a target configured with CDRecorder=1.
+// Called after the .bin image and its cue sheet have been opened.
+void cdromRecorderInit(image_config_t &img);
+
+// Called when the data of a recorder write has been received.
+// ok is false if it was not all stored on the SD card.
+void cdromRecorderWriteDone(image_config_t &img, bool ok);
+
 // Audio playback status
 // boolean flag is true if just basic mechanism status (playback true/false)
 // is desired, or false if historical audio status codes should be returned
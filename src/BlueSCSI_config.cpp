@@ -19,13 +19,33 @@
 
 #include "minIni.h"
 #include "BlueSCSI_config.h"
+#include "BlueSCSI_log.h"
+#include <string.h>
 
-int getBlockSize(char *filename, int scsiId, int default_size)
+static_assert(CONFIG_TARGET_COUNT == NUM_SCSIID, "Settings must cover all SCSI IDs");
+static_assert(CONFIG_IMAGE_COUNT == IMAGE_INDEX_MAX + 1, "Settings must cover all IMG keys");
+static_assert(CONFIG_MAX_VALUE == MAX_FILE_PATH, "Settings must hold full file paths");
+
+ConfigSettings g_settings;
+
+// Values are read through the minIni cache
+struct MinIniReader
+{
+  int gets(const char *section, const char *key, char *buf, int size)
+  {
+    return ini_gets(section, key, "", buf, size, CONFIGFILE);
+  }
+};
+
+void loadSettings()
 {
-  char section[6] = "SCSI0";
-  section[4] = '0' + scsiId;
+  MinIniReader reader;
+  g_settings.load(reader);
+}
 
-  default_size = ini_getl(section, "BlockSize", default_size, CONFIGFILE);
+int getBlockSize(char *filename, int scsiId, int default_size)
+{
+  default_size = g_settings.target[scsiId].keys.blockSize.get(default_size);
   // Parse block size (HD00_NNNN)
   const char *blksize = strchr(filename, '_');
   if (blksize)
@@ -42,28 +62,25 @@ int getBlockSize(char *filename, int scsiId, int default_size)
 
 int getImgDir(int scsiId, char* dirname)
 {
-  char section[6] = "SCSI0";
-  section[4] = '0' + scsiId;
-
-  char key[] = "ImgDir";
-  int dirlen = ini_gets(section, key, "", dirname, sizeof(dirname), CONFIGFILE);
-  return dirlen;
+  strncpy(dirname, g_settings.str(g_settings.target[scsiId].imgDir), MAX_FILE_PATH);
+  return strlen(dirname);
 }
 
 
 int getImg(int scsiId, int img_index, char* filename)
 {
-  char section[6] = "SCSI0";
-  section[4] = '0' + scsiId;
-
-  char key[] = "IMG0";
-  key[3] = '0' + img_index;
+  MinIniReader reader;
+  return g_settings.readImg(reader, scsiId, img_index, filename, MAX_FILE_PATH);
+}
 
-  int dirlen = ini_gets(section, key, "", filename, sizeof(filename), CONFIGFILE);
-  return dirlen;
+int getDir(int dir_index, char* dirname)
+{
+  MinIniReader reader;
+  return g_settings.readDir(reader, dir_index, dirname, MAX_FILE_PATH);
 }
 
 int getToolBoxSharedDir(char * dir_name)
 {
-  return ini_gets("SCSI", "ToolBoxSharedDir", "/shared", dir_name, MAX_FILE_PATH, CONFIGFILE);
+  strncpy(dir_name, g_settings.str(g_settings.global.toolBoxSharedDir, "/shared"), MAX_FILE_PATH);
+  return strlen(dir_name);
 }
\ No newline at end of file
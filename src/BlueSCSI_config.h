@@ -4,6 +4,7 @@
 #pragma once
 
 #include <BlueSCSI_platform.h>
+#include <ConfigSettings.h>
 
 // Use variables for version number
 #define FW_VER_NUM      "2024.02.23"
@@ -77,6 +78,28 @@
 #define PREFETCH_BUFFER_SIZE 8192
 #endif
 
+// Read access heatmap, used to warm the read cache on next boot.
+// Regions are counted in units of PREFETCH_BUFFER_SIZE.
+#define HEATMAPFILE "bluescsi.hot"
+#define HEATMAP_ENTRIES 16
+#define HEATMAP_SAVE_IDLE_MS 10000
+
+// SD card bandwidth sharing between CD audio, SCSI commands and background
+// work. Disabled unless the card throughput is set with SDThroughputKB in ini.
+#define SD_SCHED_BURST_BYTES 16384
+
+// Background image scrubbing, checksums are stored in image name + SCRUB_FILE_EXT
+#define SCRUB_FILE_EXT ".crc"
+#define SCRUB_IDLE_MS 5000
+#define SCRUB_READ_SIZE 4096
+
+// Mode page values saved by the host are stored in image name + MODE_FILE_EXT
+#define MODE_FILE_EXT ".mode"
+
+// Settings from CONFIGFILE, read by loadSettings() when the SD card is mounted
+extern ConfigSettings g_settings;
+void loadSettings();
+
 /**
  * @filename - name of the file to be evaluated for block size
  * @scsiId - ID of the device we're looking to get the block size for
@@ -84,8 +107,12 @@
 */
 int getBlockSize(char *filename, int scsiId, int default_size);
 
+// dirname and filename must have space for MAX_FILE_PATH bytes
 int getImgDir(int scsiId, char* dirname);
 
 int getImg(int scsiId, int img_index, char* filename);
 
+// Image directory Dir (index 0) or Dir1 to Dir9, empty if not given
+int getDir(int dir_index, char* dirname);
+
 int getToolBoxSharedDir(char * dir_name);
\ No newline at end of file
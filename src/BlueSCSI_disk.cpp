@@ -16,8 +16,10 @@
 #include "BlueSCSI_cdrom.h"
 #include "BlueSCSI_platform_config_hook.h"
 #include "ImageBackingStore.h"
+#include "PrefetchCache.h"
 #include "ROMDrive.h"
 #include <minIni.h>
+#include <CDBDecoder.h>
 #include <string.h>
 #include <strings.h>
 #include <assert.h>
@@ -102,7 +104,7 @@ bool scsiDiskActivateRomDrive()
         return false;
     }
 
-    if (ini_getbool("SCSI", "DisableROMDrive", 0, CONFIGFILE))
+    if (g_settings.global.disableROMDrive.get(false))
     {
         log("---- ROM drive disabled in ini file, not enabling");
         return false;
@@ -112,7 +114,7 @@ bool scsiDiskActivateRomDrive()
         debuglog("---- ROM drive enabled");
     }
 
-    long rom_scsi_id = ini_getl("SCSI", "ROMDriveSCSIID", -1, CONFIGFILE);
+    long rom_scsi_id = g_settings.global.romDriveSCSIID.get(-1);
     if (rom_scsi_id >= 0 && rom_scsi_id <= 7)
     {
         hdr.scsi_id = rom_scsi_id;
@@ -152,6 +154,15 @@ SdDevice sdDev = {2, 256 * 1024 * 1024 * 2}; /* For SCSI2SD */
 
 static image_config_t g_DiskImages[S2S_MAX_TARGETS];
 
+// Image file being cleared after scsiDiskCreateImage()
+static struct {
+    FsFile file;
+    uint64_t remain; // Bytes still to be zero-filled
+    int target_idx; // Target that gets the image when done, -1 for Toolbox
+    uint8_t ini_pending; // Targets waiting to create their CreateImage file
+    char path[MAX_FILE_PATH + 1];
+} g_image_create = {FsFile(), 0, -1, 0, ""};
+
 void scsiDiskResetImages()
 {
     for (int i = 0; i < S2S_MAX_TARGETS; i++)
@@ -176,7 +187,15 @@ void scsiDiskCloseSDCardImages()
         }
 
         g_DiskImages[i].cuesheetfile.close();
+        scsiDiskScrubRestart(g_DiskImages[i], false);
     }
+
+    g_image_create.file.close();
+    g_image_create.target_idx = -1;
+    g_image_create.ini_pending = 0;
+
+    // Card may be changed before it is mounted again
+    scsiDiskFreeSpaceInvalidate();
 }
 
 // Verify format conformance to SCSI spec:
@@ -362,9 +381,19 @@ static void setDefaultDriveInfo(int target_idx)
 
 bool scsiDiskOpenHDDImage(int target_idx, const char *filename, int scsi_id, int scsi_lun, int blocksize, S2S_CFG_TYPE type)
 {
+    if (g_image_create.file.isOpen() && strcasecmp(filename, g_image_create.path) == 0)
+    {
+        // exFAT reports only the cleared part of the file as its size
+        log("---- Image ", filename, " is still being cleared, not opening it yet");
+        return false;
+    }
+
     image_config_t &img = g_DiskImages[target_idx];
     img.cuesheetfile.close();
+    cdromInvalidateTOC(img);
+    scsiDiskScrubRestart(img, false);
     img.file = ImageBackingStore(filename, blocksize);
+    strlcpy(img.image_path, filename, sizeof(img.image_path));
 
     if (img.file.isOpen())
     {
@@ -454,15 +483,21 @@ bool scsiDiskOpenHDDImage(int target_idx, const char *filename, int scsi_id, int
         PLATFORM_CONFIG_HOOK(&img);
 #endif
 
+        scsiDiskModeShadowLoad(target_idx);
+
         if (img.deviceType == S2S_CFG_OPTICAL &&
             strncasecmp(filename + strlen(filename) - 4, ".bin", 4) == 0)
         {
             char cuesheetname[MAX_FILE_PATH + 1] = {0};
             strncpy(cuesheetname, filename, strlen(filename) - 4);
             strlcat(cuesheetname, ".cue", sizeof(cuesheetname));
-            img.cuesheetfile = SD.open(cuesheetname, O_RDONLY);
+            img.cuesheetfile = SD.open(cuesheetname, img.cdr_enabled ? (O_RDWR | O_CREAT) : O_RDONLY);
 
-            if (img.cuesheetfile.isOpen())
+            if (img.cdr_enabled && img.cuesheetfile.isOpen() && img.cuesheetfile.size() == 0)
+            {
+                log("---- CD recorder with blank disc, cue sheet will be written to ", cuesheetname);
+            }
+            else if (img.cuesheetfile.isOpen())
             {
                 log("---- Found CD-ROM CUE sheet at ", cuesheetname);
                 if (!cdromValidateCueSheet(img))
@@ -477,6 +512,11 @@ bool scsiDiskOpenHDDImage(int target_idx, const char *filename, int scsi_id, int
             }
         }
 
+        if (img.cdr_enabled)
+        {
+            cdromRecorderInit(img);
+        }
+
         return true;
     }
     else
@@ -510,7 +550,7 @@ bool scsiDiskFilenameValid(const char* name)
     if (extension)
     {
         const char *ignore_exts[] = {
-            ".rom_loaded", ".cue",
+            ".rom_loaded", ".cue", ".zonemap", SCRUB_FILE_EXT, MODE_FILE_EXT,
             NULL
         };
         const char *archive_exts[] = {
@@ -549,9 +589,7 @@ bool scsiDiskFilenameValid(const char* name)
 static void scsiDiskConfigDefaults(int target_idx)
 {
     // Get default values from system preset, if any
-    char presetName[32];
-    ini_gets("SCSI", "System", "", presetName, sizeof(presetName), CONFIGFILE);
-    preset_config_t defaults = getSystemPreset(presetName);
+    preset_config_t defaults = getSystemPreset(g_settings.str(g_settings.global.system));
 
     image_config_t &img = g_DiskImages[target_idx];
     img.scsiId = target_idx;
@@ -570,49 +608,38 @@ static void scsiDiskConfigDefaults(int target_idx)
     memset(img.serial, 0, sizeof(img.serial));
 }
 
-// Load values for target configuration from given section if they exist.
+// Load values for target configuration from [SCSI] or [SCSIx] if they exist.
 // Otherwise keep current settings.
-static void scsiDiskLoadConfig(int target_idx, const char *section)
+static void scsiDiskLoadConfig(int target_idx, const ConfigTargetKeys &keys, bool target_section)
 {
     image_config_t &img = g_DiskImages[target_idx];
-    img.deviceType = ini_getl(section, "Type", img.deviceType, CONFIGFILE);
-    img.deviceTypeModifier = ini_getl(section, "TypeModifier", img.deviceTypeModifier, CONFIGFILE);
-    img.sectorsPerTrack = ini_getl(section, "SectorsPerTrack", img.sectorsPerTrack, CONFIGFILE);
-    img.headsPerCylinder = ini_getl(section, "HeadsPerCylinder", img.headsPerCylinder, CONFIGFILE);
-    img.bytesPerSector = ini_getl(section, "BlockSize", img.bytesPerSector, CONFIGFILE);
-    img.quirks = ini_getl(section, "Quirks", img.quirks, CONFIGFILE);
-    img.rightAlignStrings = ini_getbool(section, "RightAlignStrings", 0, CONFIGFILE);
-    img.name_from_image = ini_getbool(section, "NameFromImage", 0, CONFIGFILE);
-    img.prefetchbytes = ini_getl(section, "PrefetchBytes", img.prefetchbytes, CONFIGFILE);
-    img.reinsert_on_inquiry = ini_getbool(section, "ReinsertCDOnInquiry", img.reinsert_on_inquiry, CONFIGFILE);
-    img.reinsert_after_eject = ini_getbool(section, "ReinsertAfterEject", img.reinsert_after_eject, CONFIGFILE);
-    img.ejectButton = ini_getl(section, "EjectButton", 0, CONFIGFILE);
+    img.deviceType = keys.type.get(img.deviceType);
+    img.deviceTypeModifier = keys.typeModifier.get(img.deviceTypeModifier);
+    img.sectorsPerTrack = keys.sectorsPerTrack.get(img.sectorsPerTrack);
+    img.headsPerCylinder = keys.headsPerCylinder.get(img.headsPerCylinder);
+    img.bytesPerSector = keys.blockSize.get(img.bytesPerSector);
+    img.quirks = keys.quirks.get(img.quirks);
+    img.rightAlignStrings = keys.rightAlignStrings.get(false);
+    img.name_from_image = keys.nameFromImage.get(false);
+    img.prefetchbytes = keys.prefetchBytes.get(img.prefetchbytes);
+    img.reinsert_on_inquiry = keys.reinsertCDOnInquiry.get(img.reinsert_on_inquiry);
+    img.reinsert_after_eject = keys.reinsertAfterEject.get(img.reinsert_after_eject);
+    img.ejectButton = keys.ejectButton.get(0);
+    img.cdr_enabled = keys.cdRecorder.get(img.cdr_enabled);
 #ifdef ENABLE_AUDIO_OUTPUT
-    uint16_t vol = ini_getl(section, "CDAVolume", DEFAULT_VOLUME_LEVEL, CONFIGFILE) & 0xFF;
+    uint16_t vol = keys.cdaVolume.get(DEFAULT_VOLUME_LEVEL) & 0xFF;
     // Set volume on both channels
     audio_set_volume(target_idx, (vol << 8) | vol);
 #endif
 
-    char tmp[32];
-    memset(tmp, 0, sizeof(tmp));
-    ini_gets(section, "Vendor", "", tmp, sizeof(tmp), CONFIGFILE);
-    if (tmp[0]) memcpy(img.vendor, tmp, sizeof(img.vendor));
+    if (keys.vendor[0]) memcpy(img.vendor, keys.vendor, sizeof(img.vendor));
+    if (keys.product[0]) memcpy(img.prodId, keys.product, sizeof(img.prodId));
+    if (keys.version[0]) memcpy(img.revision, keys.version, sizeof(img.revision));
+    if (keys.serial[0]) memcpy(img.serial, keys.serial, sizeof(img.serial));
 
-    memset(tmp, 0, sizeof(tmp));
-    ini_gets(section, "Product", "", tmp, sizeof(tmp), CONFIGFILE);
-    if (tmp[0]) memcpy(img.prodId, tmp, sizeof(img.prodId));
-
-    memset(tmp, 0, sizeof(tmp));
-    ini_gets(section, "Version", "", tmp, sizeof(tmp), CONFIGFILE);
-    if (tmp[0]) memcpy(img.revision, tmp, sizeof(img.revision));
-
-    memset(tmp, 0, sizeof(tmp));
-    ini_gets(section, "Serial", "", tmp, sizeof(tmp), CONFIGFILE);
-    if (tmp[0]) memcpy(img.serial, tmp, sizeof(img.serial));
-
-    if (strlen(section) == 5 && strncmp(section, "SCSI", 4) == 0) // allow within target [SCSIx] blocks only
+    if (target_section) // allow within target [SCSIx] blocks only
     {
-        ini_gets(section, "ImgDir", "", tmp, sizeof(tmp), CONFIGFILE);
+        char tmp[MAX_FILE_PATH];
         getImgDir(target_idx, tmp);
         if (tmp[0])
         {
@@ -803,30 +830,263 @@ int scsiDiskGetNextImageName(image_config_t &img, char *buf, size_t buflen)
     }
 }
 
-void scsiDiskLoadConfig(int target_idx)
+/**************************/
+/* SD card free space     */
+/**************************/
+
+// Counting free clusters walks the whole FAT or allocation bitmap,
+// which takes seconds on large cards. The count is computed once at boot,
+// before the SCSI bus is enabled, and then kept up to date for the space
+// allocated by BlueSCSI itself.
+static struct {
+    bool valid;
+    uint32_t bytes_per_cluster;
+    int64_t free_clusters;
+} g_sd_free;
+
+static uint32_t clustersForSize(uint64_t size)
+{
+    uint32_t bpc = g_sd_free.bytes_per_cluster;
+    return (size + bpc - 1) / bpc;
+}
+
+uint64_t scsiDiskGetFreeSpace()
+{
+    if (!g_sd_free.valid)
+    {
+        uint32_t start = millis();
+        int32_t count = SD.freeClusterCount();
+        if (count < 0)
+        {
+            log("---- Failed to determine SD card free space");
+            return 0;
+        }
+
+        g_sd_free.bytes_per_cluster = SD.bytesPerCluster();
+        g_sd_free.free_clusters = count;
+        g_sd_free.valid = true;
+        debuglog("---- Counted ", count, " free clusters in ", (int)(millis() - start), " ms");
+    }
+
+    if (g_sd_free.free_clusters <= 0)
+    {
+        return 0;
+    }
+
+    return (uint64_t)g_sd_free.free_clusters * g_sd_free.bytes_per_cluster;
+}
+
+void scsiDiskFreeSpaceUpdate(uint64_t old_size, uint64_t new_size)
+{
+    if (g_sd_free.valid)
+    {
+        g_sd_free.free_clusters -= (int64_t)clustersForSize(new_size) - clustersForSize(old_size);
+    }
+}
+
+void scsiDiskFreeSpaceInvalidate()
+{
+    g_sd_free.valid = false;
+}
+
+/***************************************/
+/* Creation of blank contiguous images */
+/***************************************/
+
+static bool scsiDiskCreateImage(const char *filename, uint64_t size, int target_idx)
 {
-    char section[6] = "SCSI0";
-    section[4] = '0' + target_idx;
+    if (g_image_create.file.isOpen())
+    {
+        log("---- Cannot create ", filename, ", previous image creation still in progress");
+        return false;
+    }
 
+    if (SD.exists(filename))
+    {
+        log("---- Cannot create ", filename, ", file already exists");
+        return false;
+    }
+
+    if (size == 0 || scsiDiskGetFreeSpace() < size)
+    {
+        log("---- Cannot create ", filename, ", not enough free space for ", (int)(size / 1048576), " MB");
+        return false;
+    }
+
+    FsFile &file = g_image_create.file;
+    if (!file.open(filename, O_RDWR | O_CREAT | O_EXCL))
+    {
+        log("---- Failed to create image file ", filename);
+        return false;
+    }
+
+    // Allocating the whole file at once guarantees a contiguous extent,
+    // so the image always qualifies for raw sector access.
+    if (!file.preAllocate(size))
+    {
+        log("---- Failed to allocate ", (int)(size / 1048576), " MB contiguous space for ", filename);
+        file.close();
+        SD.remove(filename);
+        return false;
+    }
+
+    scsiDiskFreeSpaceUpdate(0, size);
+
+    if (file.size() >= size)
+    {
+        // FAT32 sets the file size directly, previous card contents remain in the image
+        log("---- Created image ", filename, " of ", (int)(size / 1048576), " MB");
+        file.close();
+        return true;
+    }
+
+    // exFAT tracks the initialized length separately, which can only be
+    // extended by writing. Continue zero-filling in scsiDiskCreateImagePoll().
+    log("---- Created image ", filename, " of ", (int)(size / 1048576), " MB, clearing in background");
+    g_image_create.remain = size - file.size();
+    g_image_create.target_idx = target_idx;
+    strlcpy(g_image_create.path, filename, sizeof(g_image_create.path));
+    file.seekEnd();
+    return true;
+}
+
+bool scsiDiskCreateImage(const char *filename, uint64_t size)
+{
+    if (g_image_create.ini_pending)
+    {
+        log("---- Cannot create ", filename, ", images from ini file are still being created");
+        return false;
+    }
+
+    return scsiDiskCreateImage(filename, size, -1);
+}
+
+// Create the CreateImage file of a target if it does not exist yet.
+// Returns true if the image is being cleared and should be opened only
+// after scsiDiskCreateImagePoll() is done with it.
+static bool scsiDiskCreateConfiguredImage(int target_idx)
+{
+    const ConfigTarget &target = g_settings.target[target_idx];
+    const char *filename = g_settings.str(target.createImage);
+    if (!filename[0] || SD.exists(filename))
+    {
+        return false;
+    }
+
+    if (g_image_create.file.isOpen())
+    {
+        // Only one image is cleared at a time
+        log("-- Creating '", filename, "' for ID:", target_idx, " after previous image is done");
+        g_image_create.ini_pending |= 1 << target_idx;
+        return true;
+    }
+
+    uint64_t size = (uint64_t)target.createImageSizeMB.get(0) * 1048576;
+    log("-- Creating '", filename, "' for ID:", target_idx);
+    return scsiDiskCreateImage(filename, size, target_idx) && g_image_create.file.isOpen();
+}
+
+// Open the image configured for a target, or the created image if the
+// configuration does not name any.
+static void scsiDiskOpenConfiguredImage(int target_idx, const char *created)
+{
+    char filename[MAX_FILE_PATH + 1];
+    image_config_t &img = g_DiskImages[target_idx];
+    img.image_index = IMAGE_INDEX_MAX;
+    if (!scsiDiskGetNextImageName(img, filename, sizeof(filename)))
+    {
+        if (!created) return;
+        strlcpy(filename, created, sizeof(filename));
+    }
+
+    int blocksize = getBlockSize(filename, target_idx, (img.deviceType == S2S_CFG_OPTICAL) ? 2048 : 512);
+    log("-- Opening '", filename, "' for ID:", target_idx);
+    scsiDiskOpenHDDImage(target_idx, filename, target_idx, 0, blocksize);
+}
+
+bool scsiDiskCreateImagePoll()
+{
+    if (!g_image_create.file.isOpen())
+    {
+        return false;
+    }
+
+    // Write a limited amount at a time, so that SCSI requests are not delayed much.
+    // The data buffer is unused while the bus is free.
+    uint32_t len = sizeof(scsiDev.data);
+    if (len > g_image_create.remain) len = g_image_create.remain;
+    len = g_sd_scheduler.request(SD_CONSUMER_BACKGROUND, len, SD_SECTOR_SIZE, millis());
+    if (len == 0) return true;
+    memset(scsiDev.data, 0, len);
+
+    if (g_image_create.file.write(scsiDev.data, len) != len)
+    {
+        log("---- Clearing created image failed with ", (int)(g_image_create.remain / 1048576), " MB remaining");
+        g_image_create.remain = 0;
+    }
+    else
+    {
+        g_image_create.remain -= len;
+    }
+
+    if (g_image_create.remain > 0)
+    {
+        return true;
+    }
+
+    g_image_create.file.close();
+    log("---- Image creation complete");
+
+    // Targets waiting for their image may have got one from
+    // the SD card root directory scan at boot, that is kept.
+    int target_idx = g_image_create.target_idx;
+    g_image_create.target_idx = -1;
+    if (target_idx >= 0 && !g_DiskImages[target_idx].file.isOpen())
+    {
+        scsiDiskOpenConfiguredImage(target_idx, g_image_create.path);
+
+        // SCSI was initialized at boot without this target
+        scsiInitTarget(target_idx);
+    }
+
+    // Continue with the next image requested in ini file
+    for (int i = 0; i < S2S_MAX_TARGETS; i++)
+    {
+        if (g_image_create.ini_pending & (1 << i))
+        {
+            g_image_create.ini_pending &= ~(1 << i);
+            if (scsiDiskCreateConfiguredImage(i)) break;
+            if (!g_DiskImages[i].file.isOpen())
+            {
+                scsiDiskOpenConfiguredImage(i, NULL);
+                scsiInitTarget(i);
+            }
+        }
+    }
+
+    return g_image_create.file.isOpen();
+}
+
+void scsiDiskLoadConfig(int target_idx)
+{
     // Set default settings
     scsiDiskConfigDefaults(target_idx);
 
     // First load global settings
-    scsiDiskLoadConfig(target_idx, "SCSI");
+    scsiDiskLoadConfig(target_idx, g_settings.allTargets, false);
 
     // Then settings specific to target ID
-    scsiDiskLoadConfig(target_idx, section);
+    scsiDiskLoadConfig(target_idx, g_settings.target[target_idx].keys, true);
 
-    // Check if we have image specified by name
-    char filename[MAX_FILE_PATH];
-    image_config_t &img = g_DiskImages[target_idx];
-    img.image_index = IMAGE_INDEX_MAX;
-    if (scsiDiskGetNextImageName(img, filename, sizeof(filename)))
+    // Create blank image if requested. On exFAT it is cleared while the
+    // bus is free and the target gets its image only after that.
+    if (scsiDiskCreateConfiguredImage(target_idx))
     {
-        int blocksize = getBlockSize(filename, target_idx, (img.deviceType == S2S_CFG_OPTICAL) ? 2048 : 512);
-        log("-- Opening '", filename, "' for ID:", target_idx);
-        scsiDiskOpenHDDImage(target_idx, filename, target_idx, 0, blocksize);
+        return;
     }
+
+    // Check if we have image specified by name
+    scsiDiskOpenConfiguredImage(target_idx, NULL);
 }
 
 bool scsiDiskCheckAnyImagesConfigured()
@@ -839,7 +1099,8 @@ bool scsiDiskCheckAnyImagesConfigured()
         }
     }
 
-    return false;
+    // Images from CreateImage are opened once they have been cleared
+    return g_image_create.target_idx >= 0 || g_image_create.ini_pending != 0;
 }
 
 image_config_t &scsiDiskGetImageConfig(int target_idx)
@@ -936,8 +1197,8 @@ void s2s_configInit(S2S_BoardCfg* config)
     }
 
     // Get default values from system preset, if any
-    ini_gets("SCSI", "System", "", tmp, sizeof(tmp), CONFIGFILE);
-    preset_config_t defaults = getSystemPreset(tmp);
+    const ConfigGlobal &settings = g_settings.global;
+    preset_config_t defaults = getSystemPreset(g_settings.str(settings.system));
 
     if (defaults.presetName)
     {
@@ -952,11 +1213,11 @@ void s2s_configInit(S2S_BoardCfg* config)
     memcpy(config->magic, "BCFG", 4);
     config->flags = 0;
     config->startupDelay = 0;
-    config->selectionDelay = ini_getl("SCSI", "SelectionDelay", defaults.selectionDelay, CONFIGFILE);
+    config->selectionDelay = settings.selectionDelay.get(defaults.selectionDelay);
     config->flags6 = 0;
     config->scsiSpeed = PLATFORM_MAX_SCSI_SPEED;
 
-    int maxSyncSpeed = ini_getl("SCSI", "MaxSyncSpeed", defaults.maxSyncSpeed, CONFIGFILE);
+    int maxSyncSpeed = settings.maxSyncSpeed.get(defaults.maxSyncSpeed);
     if (maxSyncSpeed < 5 && config->scsiSpeed > S2S_CFG_SPEED_ASYNC_50)
         config->scsiSpeed = S2S_CFG_SPEED_ASYNC_50;
     else if (maxSyncSpeed < 10 && config->scsiSpeed > S2S_CFG_SPEED_SYNC_5)
@@ -971,7 +1232,7 @@ void s2s_configInit(S2S_BoardCfg* config)
         log("-- SelectionDelay: ", (int)config->selectionDelay);
     }
 
-    if (ini_getbool("SCSI", "EnableUnitAttention", defaults.enableUnitAttention, CONFIGFILE))
+    if (settings.enableUnitAttention.get(defaults.enableUnitAttention))
     {
         log("-- EnableUnitAttention is on");
         config->flags |= S2S_CFG_ENABLE_UNIT_ATTENTION;
@@ -981,7 +1242,7 @@ void s2s_configInit(S2S_BoardCfg* config)
         debuglog("-- EnableUnitAttention is off");
     }
 
-    if (ini_getbool("SCSI", "EnableSCSI2", defaults.enableSCSI2, CONFIGFILE))
+    if (settings.enableSCSI2.get(defaults.enableSCSI2))
     {
         debuglog("-- EnableSCSI2 is on");
         config->flags |= S2S_CFG_ENABLE_SCSI2;
@@ -991,7 +1252,7 @@ void s2s_configInit(S2S_BoardCfg* config)
         log("-- EnableSCSI2 is off");
     }
 
-    if (ini_getbool("SCSI", "EnableSelLatch", defaults.enableSelLatch, CONFIGFILE))
+    if (settings.enableSelLatch.get(defaults.enableSelLatch))
     {
         log("-- EnableSelLatch is on");
         config->flags |= S2S_CFG_ENABLE_SEL_LATCH;
@@ -1001,7 +1262,7 @@ void s2s_configInit(S2S_BoardCfg* config)
         debuglog("-- EnableSelLatch is off");
     }
 
-    if (ini_getbool("SCSI", "MapLunsToIDs", defaults.mapLunsToIDs, CONFIGFILE))
+    if (settings.mapLunsToIDs.get(defaults.mapLunsToIDs))
     {
         log("-- MapLunsToIDs is on");
         config->flags |= S2S_CFG_MAP_LUNS_TO_IDS;
@@ -1011,12 +1272,12 @@ void s2s_configInit(S2S_BoardCfg* config)
         debuglog("-- MapLunsToIDs is off");
     }
 
-    if (ini_getbool("SCSI", "Debug", 0, CONFIGFILE))
+    if (settings.debug.get(false))
     {
         log("-- Debug is enabled");
     }
 
-    if (ini_getbool("SCSI", "EnableParity", defaults.enableParity, CONFIGFILE))
+    if (settings.enableParity.get(defaults.enableParity))
     {
         debuglog("-- Parity is enabled");
         config->flags |= S2S_CFG_ENABLE_PARITY;
@@ -1026,7 +1287,7 @@ void s2s_configInit(S2S_BoardCfg* config)
         log("-- Parity is disabled");
     }
 
-    if (ini_getbool("SCSI", "ReinsertCDOnInquiry", defaults.reinsertOnInquiry, CONFIGFILE))
+    if (g_settings.allTargets.reinsertCDOnInquiry.get(defaults.reinsertOnInquiry))
     {
         log("-- ReinsertCDOnInquiry is enabled");
     }
@@ -1035,8 +1296,7 @@ void s2s_configInit(S2S_BoardCfg* config)
         debuglog("-- ReinsertCDOnInquiry is disabled");
     }
 
-    memset(tmp, 0, sizeof(tmp));
-    ini_gets("SCSI", "WiFiMACAddress", "", tmp, sizeof(tmp), CONFIGFILE);
+    strncpy(tmp, g_settings.str(settings.wifiMACAddress), sizeof(tmp));
     if (tmp[0])
     {
         // convert from "01:23:45:67:89" to { 0x01, 0x23, 0x45, 0x67, 0x89 }
@@ -1057,15 +1317,13 @@ void s2s_configInit(S2S_BoardCfg* config)
         }
     }
 
-    memset(tmp, 0, sizeof(tmp));
-    ini_gets("SCSI", "WiFiSSID", "", tmp, sizeof(tmp), CONFIGFILE);
+    strncpy(tmp, g_settings.str(settings.wifiSSID), sizeof(tmp));
     if (tmp[0])
     {
         memcpy(config->wifiSSID, tmp, sizeof(config->wifiSSID));
     }
 
-    memset(tmp, 0, sizeof(tmp));
-    ini_gets("SCSI", "WiFiPassword", "", tmp, sizeof(tmp), CONFIGFILE);
+    strncpy(tmp, g_settings.str(settings.wifiPassword), sizeof(tmp));
     if (tmp[0])
     {
         memcpy(config->wifiPassword, tmp, sizeof(config->wifiPassword));
@@ -1083,9 +1341,14 @@ void s2s_configPoll(void)
 }
 
 extern "C"
-void s2s_configSave(int scsiId, uint16_t byesPerSector)
+void s2s_configSave(int scsiId, uint16_t bytesPerSector)
 {
-    // Modification of config over SCSI bus is not implemented.
+    // Block size set by the host is restored when the image is opened again
+    image_config_t *img = (image_config_t*)s2s_getConfigById(scsiId);
+    if (img && img->mode_shadow.saveBlockSize(bytesPerSector))
+    {
+        scsiDiskModeShadowSave(*img);
+    }
 }
 
 extern "C"
@@ -1101,6 +1364,29 @@ const S2S_TargetCfg* s2s_getConfigByIndex(int index)
     }
 }
 
+extern "C"
+const ScsiGeometry* s2s_getGeometry(void)
+{
+    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+    ScsiGeometry &geom = img.geometry;
+    uint16_t bytesPerSector = scsiDev.target->liveCfg.bytesPerSector;
+    uint64_t imageBytes = img.file.size();
+
+    // Recompute after image switch or sector size change
+    if (unlikely(geom.bytesPerSector != bytesPerSector ||
+                 geom.imageBytes != imageBytes ||
+                 geom.scsiSectors != img.scsiSectors ||
+                 geom.sdSectorStart != img.sdSectorStart ||
+                 geom.headsPerCylinder != img.headsPerCylinder ||
+                 geom.sectorsPerTrack != img.sectorsPerTrack))
+    {
+        scsiGeometryInit(&geom, img.sdSectorStart, bytesPerSector, img.scsiSectors,
+                         img.headsPerCylinder, img.sectorsPerTrack, imageBytes);
+    }
+
+    return &geom;
+}
+
 extern "C"
 const S2S_TargetCfg* s2s_getConfigById(int scsiId)
 {
@@ -1193,10 +1479,7 @@ static void doFormatUnitHeader(void)
 
 static void doReadCapacity()
 {
-    uint32_t lba = (((uint32_t) scsiDev.cdb[2]) << 24) +
-        (((uint32_t) scsiDev.cdb[3]) << 16) +
-        (((uint32_t) scsiDev.cdb[4]) << 8) +
-        scsiDev.cdb[5];
+    uint32_t lba = cdbGet32(&scsiDev.cdb[2]);
     int pmi = scsiDev.cdb[8] & 1;
 
     image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
@@ -1209,7 +1492,7 @@ static void doReadCapacity()
     }
     else
     {
-        capacity = img.file.size() / bytesPerSector;
+        capacity = s2s_getGeometry()->imageSectors;
     }
 
     if (!pmi && lba)
@@ -1307,7 +1590,7 @@ static void doSeek(uint32_t lba)
 {
     image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
     uint32_t bytesPerSector = scsiDev.target->liveCfg.bytesPerSector;
-    uint32_t capacity = img.file.size() / bytesPerSector;
+    uint32_t capacity = s2s_getGeometry()->imageSectors;
 
     if (lba >= capacity)
     {
@@ -1349,12 +1632,481 @@ static struct {
 #ifdef PREFETCH_BUFFER_SIZE
 static struct {
     uint8_t buffer[PREFETCH_BUFFER_SIZE];
-    uint32_t sector;
-    uint32_t bytes;
-    uint8_t scsiId;
+    PrefetchCache cache{PREFETCH_BUFFER_SIZE}; // What the buffer holds, see lib/PrefetchCache
 } g_scsi_prefetch;
 #endif
 
+/*********************************/
+/* Read heatmap for cache warmup */
+/*********************************/
+
+// Operating systems read mostly the same sectors on every boot.
+// Track the most frequently read regions of each image and store them
+// on the SD card, so that the hottest region can be preloaded into the
+// prefetch buffer on next power-on while the host is still starting up.
+
+#define HEATMAP_MAGIC 0x50414D48 // "HMAP"
+
+static struct {
+    bool enabled;
+    bool dirty;
+    uint32_t last_access;
+} g_heatmap;
+
+struct heatmap_record_t {
+    uint32_t magic;
+    uint8_t scsiId;
+    uint8_t reserved;
+    uint16_t bytesPerSector;
+    uint32_t scsiSectors;
+    decltype(image_config_t::heatmap) heatmap;
+};
+
+// Count a read access using the space-saving algorithm:
+// a region that is not yet tracked replaces the least used entry.
+static void heatmapRecord(image_config_t &img, uint32_t lba, uint32_t bytesPerSector)
+{
+    if (!g_heatmap.enabled) return;
+
+    uint32_t region = (uint64_t)lba * bytesPerSector / PREFETCH_BUFFER_SIZE;
+    int min_idx = 0;
+    int idx;
+    for (idx = 0; idx < HEATMAP_ENTRIES; idx++)
+    {
+        if (img.heatmap[idx].hits > 0 && img.heatmap[idx].region == region) break;
+        if (img.heatmap[idx].hits < img.heatmap[min_idx].hits) min_idx = idx;
+    }
+
+    if (idx == HEATMAP_ENTRIES)
+    {
+        idx = min_idx;
+        img.heatmap[idx].region = region;
+    }
+
+    if (img.heatmap[idx].hits == 0xFFFF)
+    {
+        // Age all counts so that old access patterns fade out
+        for (int i = 0; i < HEATMAP_ENTRIES; i++)
+        {
+            img.heatmap[i].hits >>= 1;
+        }
+    }
+
+    img.heatmap[idx].hits++;
+    g_heatmap.dirty = true;
+    g_heatmap.last_access = millis();
+}
+
+void scsiDiskHeatmapLoad()
+{
+    g_heatmap.enabled = g_settings.global.bootCacheWarmup.get(false);
+    g_heatmap.dirty = false;
+
+#ifdef PREFETCH_BUFFER_SIZE
+    g_scsi_prefetch.cache.clear();
+#endif
+
+    if (!g_heatmap.enabled) return;
+
+    FsFile file = SD.open(HEATMAPFILE, O_RDONLY);
+    if (!file.isOpen())
+    {
+        debuglog("No read heatmap found, cache warmup skipped");
+        return;
+    }
+
+    heatmap_record_t record;
+    while (file.read(&record, sizeof(record)) == sizeof(record))
+    {
+        if (record.magic != HEATMAP_MAGIC) break;
+
+        for (int i = 0; i < S2S_MAX_TARGETS; i++)
+        {
+            image_config_t &img = g_DiskImages[i];
+            if (img.scsiId == record.scsiId &&
+                img.bytesPerSector == record.bytesPerSector &&
+                img.scsiSectors == record.scsiSectors)
+            {
+                memcpy(img.heatmap, record.heatmap, sizeof(img.heatmap));
+            }
+        }
+    }
+    file.close();
+
+#ifdef PREFETCH_BUFFER_SIZE
+    // Only fixed drives are warmed up, removable media may change before use
+    image_config_t *hot_img = NULL;
+    uint32_t hot_region = 0;
+    uint16_t hot_hits = 0;
+    for (int i = 0; i < S2S_MAX_TARGETS; i++)
+    {
+        image_config_t &img = g_DiskImages[i];
+        if (!(img.scsiId & S2S_CFG_TARGET_ENABLED) || img.deviceType != S2S_CFG_FIXED) continue;
+
+        for (int j = 0; j < HEATMAP_ENTRIES; j++)
+        {
+            if (img.heatmap[j].hits > hot_hits)
+            {
+                hot_img = &img;
+                hot_region = img.heatmap[j].region;
+                hot_hits = img.heatmap[j].hits;
+            }
+        }
+    }
+
+    if (hot_img)
+    {
+        uint32_t bytesPerSector = hot_img->bytesPerSector;
+        uint32_t sector = (uint64_t)hot_region * PREFETCH_BUFFER_SIZE / bytesPerSector;
+        uint32_t sectors = PREFETCH_BUFFER_SIZE / bytesPerSector;
+        if (sector >= hot_img->scsiSectors) return;
+        if (sector + sectors > hot_img->scsiSectors) sectors = hot_img->scsiSectors - sector;
+
+        if (hot_img->file.seek((uint64_t)sector * bytesPerSector) &&
+            hot_img->file.read(g_scsi_prefetch.buffer, sectors * bytesPerSector) == (ssize_t)(sectors * bytesPerSector))
+        {
+            g_scsi_prefetch.cache.warmUp(hot_img->scsiId, sector, sectors * bytesPerSector);
+            log("Read cache warmed up with ", (int)sectors, " sectors at ", (int)sector,
+                " for SCSI ID ", (int)(hot_img->scsiId & S2S_CFG_TARGET_ID_BITS), " (", (int)hot_hits, " hits)");
+        }
+        else
+        {
+            log("Read cache warmup failed for SCSI ID ", (int)(hot_img->scsiId & S2S_CFG_TARGET_ID_BITS));
+        }
+    }
+#endif
+}
+
+void scsiDiskHeatmapSave()
+{
+    if (!g_heatmap.enabled || !g_heatmap.dirty ||
+        (uint32_t)(millis() - g_heatmap.last_access) < HEATMAP_SAVE_IDLE_MS)
+    {
+        return;
+    }
+
+    g_heatmap.dirty = false;
+
+    FsFile file = SD.open(HEATMAPFILE, O_WRONLY | O_CREAT | O_TRUNC);
+    if (!file.isOpen())
+    {
+        log("Failed to save read heatmap to ", HEATMAPFILE);
+        return;
+    }
+
+    for (int i = 0; i < S2S_MAX_TARGETS; i++)
+    {
+        image_config_t &img = g_DiskImages[i];
+        if (!(img.scsiId & S2S_CFG_TARGET_ENABLED)) continue;
+
+        heatmap_record_t record = {};
+        record.magic = HEATMAP_MAGIC;
+        record.scsiId = img.scsiId;
+        record.bytesPerSector = img.bytesPerSector;
+        record.scsiSectors = img.scsiSectors;
+        memcpy(record.heatmap, img.heatmap, sizeof(record.heatmap));
+        file.write(&record, sizeof(record));
+    }
+    file.close();
+    debuglog("Saved read heatmap to ", HEATMAPFILE);
+}
+
+/****************************/
+/* SD card bandwidth sharing */
+/****************************/
+
+SDScheduler g_sd_scheduler;
+
+#ifdef ENABLE_AUDIO_OUTPUT
+static void scsiDiskAudioSDUse(uint32_t bytes_read, uint32_t reserve)
+{
+    uint32_t now = millis();
+    g_sd_scheduler.consume(SD_CONSUMER_AUDIO, bytes_read, now);
+    g_sd_scheduler.setReserve(SD_CONSUMER_AUDIO, reserve);
+
+    if (reserve == 0)
+    {
+        debuglog("------ SD scheduler: SCSI throttled ", (int)g_sd_scheduler.throttledMs(SD_CONSUMER_SCSI, now),
+            " ms, background throttled ", (int)g_sd_scheduler.throttledMs(SD_CONSUMER_BACKGROUND, now), " ms");
+    }
+}
+#endif
+
+void scsiDiskSchedulerLoad()
+{
+    // Card speeds vary too much for a built-in model, so sharing is only
+    // done when the throughput of the card in use is given.
+    int32_t kbps = g_settings.global.sdThroughputKB.get(0);
+    if (kbps < 0) kbps = 0;
+    g_sd_scheduler.configure((uint32_t)kbps * 1024 / 1000, SD_SCHED_BURST_BYTES);
+
+#ifdef ENABLE_AUDIO_OUTPUT
+    audio_set_sd_callback(kbps > 0 ? scsiDiskAudioSDUse : NULL);
+#endif
+
+    if (kbps > 0)
+    {
+        log("SD card bandwidth sharing enabled for ", (int)kbps, " kB/s");
+    }
+}
+
+/******************************/
+/* Background image scrubbing */
+/******************************/
+
+// Images are read a few kilobytes at a time while the bus is idle and
+// compared against checksums stored on the previous pass, see ImageScrub.h.
+// One image is verified at a time, each has its own sidecar file.
+
+static struct {
+    bool enabled;
+    int target; // Index of image being verified, -1 if none
+    FsFile sidecar;
+    uint8_t selCount; // Last seen scsiDev.selCount
+    uint32_t last_activity;
+} g_scrub;
+
+bool scsiDiskScrubSupported(image_config_t &img)
+{
+    if (!(img.scsiId & S2S_CFG_TARGET_ENABLED) || !img.file.isOpen()) return false;
+    if (!img.file.isFile()) return false;
+    if (img.deviceType == S2S_CFG_NETWORK) return false;
+#ifdef ENABLE_AUDIO_OUTPUT
+    // Audio playback streams from the image file
+    if (audio_is_playing(img.scsiId & S2S_CFG_TARGET_ID_BITS)) return false;
+#endif
+    return true;
+}
+
+static bool scrubOpenSidecar(image_config_t &img)
+{
+    char filename[MAX_FILE_PATH + sizeof(SCRUB_FILE_EXT)];
+    strlcpy(filename, img.image_path, sizeof(filename));
+    strlcat(filename, SCRUB_FILE_EXT, sizeof(filename));
+
+    g_scrub.sidecar = SD.open(filename, O_RDWR | O_CREAT);
+    if (!g_scrub.sidecar.isOpen())
+    {
+        log("Image scrub: failed to open ", filename);
+        return false;
+    }
+
+    debuglog("Image scrub: verifying ID ", (int)(img.scsiId & S2S_CFG_TARGET_ID_BITS), " against ", filename);
+    return true;
+}
+
+void scsiDiskScrubLoad()
+{
+    g_scrub.enabled = g_settings.global.imageScrub.get(false);
+    g_scrub.sidecar.close();
+    g_scrub.target = -1;
+    g_scrub.selCount = scsiDev.selCount;
+    g_scrub.last_activity = millis();
+
+    if (g_scrub.enabled)
+    {
+        log("Background image scrubbing enabled");
+    }
+}
+
+bool scsiDiskScrubEnabled()
+{
+    return g_scrub.enabled;
+}
+
+void scsiDiskScrubRestart(image_config_t &img, bool discard)
+{
+    if (g_scrub.target >= 0 && &g_DiskImages[g_scrub.target] == &img)
+    {
+        g_scrub.sidecar.close();
+        g_scrub.target = -1;
+    }
+
+    img.scrub.reset(discard);
+}
+
+void scsiDiskScrubPoll()
+{
+    if (!g_scrub.enabled) return;
+
+    // Wait until the host has been quiet for a while
+    if (g_scrub.selCount != scsiDev.selCount)
+    {
+        g_scrub.selCount = scsiDev.selCount;
+        g_scrub.last_activity = millis();
+        return;
+    }
+
+    if ((uint32_t)(millis() - g_scrub.last_activity) < SCRUB_IDLE_MS) return;
+
+    if (g_scrub.target >= 0 && !scsiDiskScrubSupported(g_DiskImages[g_scrub.target]))
+    {
+        g_scrub.sidecar.close();
+        g_scrub.target = -1;
+    }
+
+    if (g_scrub.target < 0)
+    {
+        // Targets with unsaved write records go first, then round-robin
+        static int next_target;
+        int idx = -1;
+        for (int i = 0; i < S2S_MAX_TARGETS; i++)
+        {
+            image_config_t &img = g_DiskImages[i];
+            if (img.scrub.headerPending() && scsiDiskScrubSupported(img))
+            {
+                idx = i;
+                break;
+            }
+        }
+
+        for (int i = 0; i < S2S_MAX_TARGETS && idx < 0; i++)
+        {
+            int candidate = (next_target + i) % S2S_MAX_TARGETS;
+            if (scsiDiskScrubSupported(g_DiskImages[candidate])) idx = candidate;
+        }
+
+        if (idx < 0) return;
+        next_target = (idx + 1) % S2S_MAX_TARGETS;
+
+        if (!scrubOpenSidecar(g_DiskImages[idx]))
+        {
+            // Try again after next idle period
+            g_scrub.last_activity = millis();
+            return;
+        }
+        g_scrub.target = idx;
+    }
+
+    if (g_sd_scheduler.request(SD_CONSUMER_BACKGROUND, SCRUB_READ_SIZE, SCRUB_READ_SIZE, millis()) == 0)
+    {
+        return;
+    }
+
+    image_config_t &img = g_DiskImages[g_scrub.target];
+    int id = img.scsiId & S2S_CFG_TARGET_ID_BITS;
+
+    // Position is restored for CD audio and tape emulation
+    uint64_t position = img.file.position();
+    ImageScrubResult result = img.scrub.step(img.file, g_scrub.sidecar, img.file.size(),
+                                             scsiDev.data, SCRUB_READ_SIZE);
+    img.file.seek(position);
+
+    if (result == IMAGESCRUB_MISMATCH)
+    {
+        log("Image scrub: ID ", id, " checksum mismatch in bytes ",
+            (uint64_t)img.scrub.lastChunk() * IMAGESCRUB_CHUNK_SIZE, " to ",
+            (uint64_t)(img.scrub.lastChunk() + 1) * IMAGESCRUB_CHUNK_SIZE - 1);
+    }
+    else if (result == IMAGESCRUB_READ_ERROR)
+    {
+        log("Image scrub: ID ", id, " read error in bytes ",
+            (uint64_t)img.scrub.lastChunk() * IMAGESCRUB_CHUNK_SIZE, " to ",
+            (uint64_t)(img.scrub.lastChunk() + 1) * IMAGESCRUB_CHUNK_SIZE - 1);
+    }
+    else if (result == IMAGESCRUB_FILE_ERROR)
+    {
+        log("Image scrub: ID ", id, " sidecar file access failed");
+        g_scrub.sidecar.close();
+        g_scrub.target = -1;
+        g_scrub.last_activity = millis();
+        return;
+    }
+
+    if (img.scrub.currentChunk() == 0 && result != IMAGESCRUB_BUSY)
+    {
+        // End of pass, continue with the next target
+        log("Image scrub: ID ", id, " pass ", (int)img.scrub.passes(), " done, ",
+            (int)img.scrub.mismatches(), " mismatches, ", (int)img.scrub.readErrors(), " read errors");
+        g_scrub.sidecar.close();
+        g_scrub.target = -1;
+    }
+}
+
+/*******************************/
+/* Mode page values from host  */
+/*******************************/
+
+// Sidecar files are used only for images on the SD card filesystem
+static bool modeShadowSidecarName(image_config_t &img, char *filename)
+{
+    if (!img.file.isFile()) return false;
+    if (img.deviceType == S2S_CFG_NETWORK) return false;
+
+    strlcpy(filename, img.image_path, MAX_FILE_PATH + 1);
+    strlcat(filename, MODE_FILE_EXT, MAX_FILE_PATH + sizeof(MODE_FILE_EXT));
+    return true;
+}
+
+void scsiDiskModeShadowLoad(int target_idx)
+{
+    image_config_t &img = g_DiskImages[target_idx];
+    img.mode_shadow.reset();
+
+    char filename[MAX_FILE_PATH + sizeof(MODE_FILE_EXT)];
+    if (!modeShadowSidecarName(img, filename)) return;
+
+    FsFile file = SD.open(filename, O_RDONLY);
+    if (!file.isOpen()) return;
+
+    ModeShadowSaved saved;
+    bool valid = (file.read(&saved, sizeof(saved)) == sizeof(saved)) && img.mode_shadow.restore(saved);
+    file.close();
+    if (!valid)
+    {
+        log("---- Ignoring invalid mode page file ", filename);
+        return;
+    }
+
+    uint32_t blocksize = img.mode_shadow.savedBlockSize();
+    if (blocksize >= MIN_SECTOR_SIZE && blocksize <= MAX_SECTOR_SIZE &&
+        blocksize != img.bytesPerSector)
+    {
+        log("---- Block size ", (int)blocksize, " set by host, from ", filename);
+        img.bytesPerSector = blocksize;
+        img.scsiSectors = img.file.size() / blocksize;
+
+        // Image can be switched while SCSI is running
+        if (scsiDev.targets[target_idx].cfg == &img)
+        {
+            scsiDev.targets[target_idx].liveCfg.bytesPerSector = blocksize;
+        }
+    }
+    else
+    {
+        debuglog("---- Mode page values loaded from ", filename);
+    }
+
+#ifdef ENABLE_AUDIO_OUTPUT
+    if (img.mode_shadow.changed(0x0E))
+    {
+        // Port channels and volumes from CD audio control page
+        uint8_t page[MODESHADOW_PAGE_BYTES] = {0x0E, 0x0E};
+        img.mode_shadow.sense(MODESHADOW_PC_CURRENT, page, sizeof(page));
+        audio_set_channel(target_idx, (page[10] << 8) | page[8]);
+        audio_set_volume(target_idx, (page[11] << 8) | page[9]);
+    }
+#endif
+}
+
+void scsiDiskModeShadowSave(image_config_t &img)
+{
+    char filename[MAX_FILE_PATH + sizeof(MODE_FILE_EXT)];
+    if (!modeShadowSidecarName(img, filename)) return;
+
+    FsFile file = SD.open(filename, O_WRONLY | O_CREAT | O_TRUNC);
+    const ModeShadowSaved &saved = img.mode_shadow.saved();
+    if (!file.isOpen() || file.write(&saved, sizeof(saved)) != sizeof(saved))
+    {
+        log("Failed to save mode page values to ", filename);
+    }
+    else
+    {
+        debuglog("Saved mode page values to ", filename);
+    }
+    file.close();
+}
+
 /*****************/
 /* Write command */
 /*****************/
@@ -1369,12 +2121,12 @@ void scsiDiskStartWrite(uint32_t lba, uint32_t blocks)
 
     image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
     uint32_t bytesPerSector = scsiDev.target->liveCfg.bytesPerSector;
-    uint32_t capacity = img.file.size() / bytesPerSector;
+    uint32_t capacity = s2s_getGeometry()->imageSectors;
 
     debuglog("------ Write ", (int)blocks, "x", (int)bytesPerSector, " starting at ", (int)lba);
 
     if (unlikely(blockDev.state & DISK_WP) ||
-        unlikely(scsiDev.target->cfg->deviceType == S2S_CFG_OPTICAL) ||
+        unlikely(scsiDev.target->cfg->deviceType == S2S_CFG_OPTICAL && !img.cdr_enabled) ||
         unlikely(!img.file.isWritable()))
 
     {
@@ -1404,10 +2156,12 @@ void scsiDiskStartWrite(uint32_t lba, uint32_t blocks)
         scsiDev.dataLen = 0;
         scsiDev.dataPtr = 0;
 
+        // Checksums of the written area are stored again on next scrub pass
+        img.scrub.markWritten((uint64_t)lba * bytesPerSector, (uint64_t)blocks * bytesPerSector);
+
 #ifdef PREFETCH_BUFFER_SIZE
         // Invalidate prefetch buffer
-        g_scsi_prefetch.bytes = 0;
-        g_scsi_prefetch.sector = 0;
+        g_scsi_prefetch.cache.clear();
 #endif
 
         image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
@@ -1543,6 +2297,12 @@ void diskDataOut()
             }
         }
 
+        if (len > 0)
+        {
+            // Split the write if CD audio is waiting for the card
+            len = g_sd_scheduler.request(SD_CONSUMER_SCSI, len, SD_SECTOR_SIZE, millis());
+        }
+
         if (len == 0)
         {
             // Nothing ready to transfer, check if we can read more from SCSI bus
@@ -1611,7 +2371,7 @@ void scsiDiskStartRead(uint32_t lba, uint32_t blocks)
 
     image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
     uint32_t bytesPerSector = scsiDev.target->liveCfg.bytesPerSector;
-    uint32_t capacity = img.file.size() / bytesPerSector;
+    uint32_t capacity = s2s_getGeometry()->imageSectors;
 
     debuglog("------ Read ", (int)blocks, "x", (int)bytesPerSector, " starting at ", (int)lba);
 
@@ -1634,20 +2394,18 @@ void scsiDiskStartRead(uint32_t lba, uint32_t blocks)
         scsiDev.phase = DATA_IN;
         scsiDev.dataLen = 0;
         scsiDev.dataPtr = 0;
+        heatmapRecord(img, lba, bytesPerSector);
 
 #ifdef PREFETCH_BUFFER_SIZE
-        uint32_t sectors_in_prefetch = g_scsi_prefetch.bytes / bytesPerSector;
-        if (img.scsiId == g_scsi_prefetch.scsiId &&
-            transfer.lba >= g_scsi_prefetch.sector &&
-            transfer.lba < g_scsi_prefetch.sector + sectors_in_prefetch)
+        uint32_t start_offset = 0;
+        uint32_t count = g_scsi_prefetch.cache.lookup(img.scsiId, transfer.lba, transfer.blocks,
+                                                      bytesPerSector, &start_offset);
+        if (count > 0)
         {
             // We have the some sectors already in prefetch cache
             scsiEnterPhase(DATA_IN);
 
-            uint32_t start_offset = transfer.lba - g_scsi_prefetch.sector;
-            uint32_t count = sectors_in_prefetch - start_offset;
-            if (count > transfer.blocks) count = transfer.blocks;
-            scsiStartWrite(g_scsi_prefetch.buffer + start_offset * bytesPerSector, count * bytesPerSector);
+            scsiStartWrite(g_scsi_prefetch.buffer + start_offset, count * bytesPerSector);
             debuglog("------ Found ", (int)count, " sectors in prefetch cache");
             transfer.currentBlock += count;
         }
@@ -1763,10 +2521,12 @@ static void diskDataIn()
 
     // Start transfer in first half of buffer
     // Waits for the previous first half transfer to finish first.
+    // The transfers are made shorter if CD audio is waiting for the card.
     uint32_t remain = (transfer.blocks - transfer.currentBlock);
     if (remain > 0)
     {
         uint32_t transfer_blocks = std::min(remain, maxblocks_half);
+        transfer_blocks = g_sd_scheduler.request(SD_CONSUMER_SCSI, transfer_blocks * bytesPerSector, bytesPerSector, millis()) / bytesPerSector;
         uint32_t transfer_bytes = transfer_blocks * bytesPerSector;
         start_dataInTransfer(&scsiDev.data[0], transfer_bytes);
         transfer.currentBlock += transfer_blocks;
@@ -1778,6 +2538,7 @@ static void diskDataIn()
     if (remain > 0)
     {
         uint32_t transfer_blocks = std::min(remain, maxblocks_half);
+        transfer_blocks = g_sd_scheduler.request(SD_CONSUMER_SCSI, transfer_blocks * bytesPerSector, bytesPerSector, millis()) / bytesPerSector;
         uint32_t transfer_bytes = transfer_blocks * bytesPerSector;
         start_dataInTransfer(&scsiDev.data[maxblocks_half * bytesPerSector], transfer_bytes);
         transfer.currentBlock += transfer_blocks;
@@ -1791,17 +2552,9 @@ static void diskDataIn()
         image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
         int prefetchbytes = img.prefetchbytes;
         if (prefetchbytes > PREFETCH_BUFFER_SIZE) prefetchbytes = PREFETCH_BUFFER_SIZE;
-        uint32_t prefetch_sectors = prefetchbytes / bytesPerSector;
         uint32_t img_sector_count = img.file.size() / bytesPerSector;
-        g_scsi_prefetch.sector = transfer.lba + transfer.blocks;
-        g_scsi_prefetch.bytes = 0;
-        g_scsi_prefetch.scsiId = scsiDev.target->cfg->scsiId;
-
-        if (g_scsi_prefetch.sector + prefetch_sectors > img_sector_count)
-        {
-            // Don't try to read past image end.
-            prefetch_sectors = img_sector_count - g_scsi_prefetch.sector;
-        }
+        uint32_t prefetch_sectors = g_scsi_prefetch.cache.begin(scsiDev.target->cfg->scsiId,
+            transfer.lba + transfer.blocks, prefetchbytes / bytesPerSector, img_sector_count, bytesPerSector);
 
         while (!scsiIsWriteFinished(NULL) && prefetch_sectors > 0 && !scsiDev.resetFlag)
         {
@@ -1809,7 +2562,7 @@ static void diskDataIn()
             diskEjectButtonUpdate(false);
 
             // Check if prefetch buffer is free
-            g_disk_transfer.buffer = g_scsi_prefetch.buffer + g_scsi_prefetch.bytes;
+            g_disk_transfer.buffer = g_scsi_prefetch.buffer + g_scsi_prefetch.cache.bytes();
             if (!scsiIsWriteFinished(g_disk_transfer.buffer) ||
                 !scsiIsWriteFinished(g_disk_transfer.buffer + bytesPerSector - 1))
             {
@@ -1828,7 +2581,7 @@ static void diskDataIn()
                 prefetch_sectors = 0;
                 break;
             }
-            g_scsi_prefetch.bytes += status;
+            g_scsi_prefetch.cache.added(status);
             platform_set_sd_callback(NULL, NULL);
             prefetch_sectors--;
         }
@@ -1849,220 +2602,226 @@ static void diskDataIn()
 /* Command dispatch */
 /********************/
 
-// Handle direct-access scsi device commands
-extern "C"
-int scsiDiskCommand()
+static int diskCmdStartStopUnit(image_config_t &img)
 {
-    int commandHandled = 1;
-    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+    // START STOP UNIT
+    // Enable or disable media access operations.
+    //int immed = scsiDev.cdb[1] & 1;
+    int start = scsiDev.cdb[4] & 1;
 
-    uint8_t command = scsiDev.cdb[0];
-    if (unlikely(command == 0x1B))
+    if (start)
     {
-        // START STOP UNIT
-        // Enable or disable media access operations.
-        //int immed = scsiDev.cdb[1] & 1;
-        int start = scsiDev.cdb[4] & 1;
-
-        if (start)
-        {
-            scsiDev.target->started = 1;
-        }
-        else
-        {
-            scsiDev.target->started = 0;
-        }
+        scsiDev.target->started = 1;
     }
-    else if (unlikely(command == 0x00))
+    else
     {
-        // TEST UNIT READY
-        doTestUnitReady();
+        scsiDev.target->started = 0;
     }
-    else if (unlikely(!doTestUnitReady()))
+    return 1;
+}
+
+static int diskCmdTestUnitReady(image_config_t &img)
+{
+    // TEST UNIT READY
+    doTestUnitReady();
+    return 1;
+}
+
+static int diskCmdRead(image_config_t &img)
+{
+    // READ(6), READ(10)
+    // Ignore all cache control bits - we don't support a memory cache.
+    uint32_t lba = cdbLBA(scsiDev.cdb);
+    uint32_t blocks = cdbBlockCount(scsiDev.cdb);
+    scsiDiskStartRead(lba, blocks);
+    return 1;
+}
+
+static int diskCmdWrite(image_config_t &img)
+{
+    // WRITE(6), WRITE(10), WRITE AND VERIFY
+    // Ignore all cache control bits - we don't support a memory cache.
+    // Don't bother verifying either. The SD card likely stores ECC
+    // along with each flash row.
+    uint32_t lba = cdbLBA(scsiDev.cdb);
+    uint32_t blocks = cdbBlockCount(scsiDev.cdb);
+    scsiDiskStartWrite(lba, blocks);
+    return 1;
+}
+
+static int diskCmdFormatUnit(image_config_t &img)
+{
+    // FORMAT UNIT
+    // We don't really do any formatting, but we need to read the correct
+    // number of bytes in the DATA_OUT phase to make the SCSI host happy.
+
+    int fmtData = (scsiDev.cdb[1] & 0x10) ? 1 : 0;
+    if (fmtData)
     {
-        // Status and sense codes already set by doTestUnitReady
-    }
-    else if (likely(command == 0x08))
-    {
-        // READ(6)
-        uint32_t lba =
-            (((uint32_t) scsiDev.cdb[1] & 0x1F) << 16) +
-            (((uint32_t) scsiDev.cdb[2]) << 8) +
-            scsiDev.cdb[3];
-        uint32_t blocks = scsiDev.cdb[4];
-        if (unlikely(blocks == 0)) blocks = 256;
-        scsiDiskStartRead(lba, blocks);
-    }
-    else if (likely(command == 0x28))
-    {
-        // READ(10)
-        // Ignore all cache control bits - we don't support a memory cache.
-
-        uint32_t lba =
-            (((uint32_t) scsiDev.cdb[2]) << 24) +
-            (((uint32_t) scsiDev.cdb[3]) << 16) +
-            (((uint32_t) scsiDev.cdb[4]) << 8) +
-            scsiDev.cdb[5];
-        uint32_t blocks =
-            (((uint32_t) scsiDev.cdb[7]) << 8) +
-            scsiDev.cdb[8];
-
-        scsiDiskStartRead(lba, blocks);
-    }
-    else if (likely(command == 0x0A))
-    {
-        // WRITE(6)
-        uint32_t lba =
-            (((uint32_t) scsiDev.cdb[1] & 0x1F) << 16) +
-            (((uint32_t) scsiDev.cdb[2]) << 8) +
-            scsiDev.cdb[3];
-        uint32_t blocks = scsiDev.cdb[4];
-        if (unlikely(blocks == 0)) blocks = 256;
-        scsiDiskStartWrite(lba, blocks);
-    }
-    else if (likely(command == 0x2A) || // WRITE(10)
-        unlikely(command == 0x2E)) // WRITE AND VERIFY
-    {
-        // Ignore all cache control bits - we don't support a memory cache.
-        // Don't bother verifying either. The SD card likely stores ECC
-        // along with each flash row.
-
-        uint32_t lba =
-            (((uint32_t) scsiDev.cdb[2]) << 24) +
-            (((uint32_t) scsiDev.cdb[3]) << 16) +
-            (((uint32_t) scsiDev.cdb[4]) << 8) +
-            scsiDev.cdb[5];
-        uint32_t blocks =
-            (((uint32_t) scsiDev.cdb[7]) << 8) +
-            scsiDev.cdb[8];
-
-        scsiDiskStartWrite(lba, blocks);
-    }
-    else if (unlikely(command == 0x04))
-    {
-        // FORMAT UNIT
-        // We don't really do any formatting, but we need to read the correct
-        // number of bytes in the DATA_OUT phase to make the SCSI host happy.
-
-        int fmtData = (scsiDev.cdb[1] & 0x10) ? 1 : 0;
-        if (fmtData)
-        {
-            // We need to read the parameter list, but we don't know how
-            // big it is yet. Start with the header.
-            scsiDev.dataLen = 4;
-            scsiDev.phase = DATA_OUT;
-            scsiDev.postDataOutHook = doFormatUnitHeader;
-        }
-        else
-        {
-            // No data to read, we're already finished!
-        }
+        // We need to read the parameter list, but we don't know how
+        // big it is yet. Start with the header.
+        scsiDev.dataLen = 4;
+        scsiDev.phase = DATA_OUT;
+        scsiDev.postDataOutHook = doFormatUnitHeader;
     }
-    else if (unlikely(command == 0x25))
+    else
     {
-        // READ CAPACITY
-        doReadCapacity();
+        // No data to read, we're already finished!
     }
-    else if (unlikely(command == 0x0B))
-    {
-        // SEEK(6)
-        uint32_t lba =
-            (((uint32_t) scsiDev.cdb[1] & 0x1F) << 16) +
-            (((uint32_t) scsiDev.cdb[2]) << 8) +
-            scsiDev.cdb[3];
+    return 1;
+}
 
-        doSeek(lba);
-    }
+static int diskCmdReadCapacity(image_config_t &img)
+{
+    // READ CAPACITY
+    doReadCapacity();
+    return 1;
+}
 
-    else if (unlikely(command == 0x2B))
-    {
-        // SEEK(10)
-        uint32_t lba =
-            (((uint32_t) scsiDev.cdb[2]) << 24) +
-            (((uint32_t) scsiDev.cdb[3]) << 16) +
-            (((uint32_t) scsiDev.cdb[4]) << 8) +
-            scsiDev.cdb[5];
+static int diskCmdSeek(image_config_t &img)
+{
+    // SEEK(6), SEEK(10)
+    uint32_t lba = cdbLBA(scsiDev.cdb);
 
-        doSeek(lba);
-    }
-    else if (unlikely(command == 0x36))
-    {
-        // LOCK UNLOCK CACHE
-        // We don't have a cache to lock data into. do nothing.
-    }
-    else if (unlikely(command == 0x34))
+    doSeek(lba);
+    return 1;
+}
+
+static int diskCmdLockUnlockCache(image_config_t &img)
+{
+    // LOCK UNLOCK CACHE
+    // We don't have a cache to lock data into. do nothing.
+    return 1;
+}
+
+static int diskCmdPrefetch(image_config_t &img)
+{
+    // PRE-FETCH.
+    // We don't have a cache to pre-fetch into. do nothing.
+    return 1;
+}
+
+static int diskCmdPreventAllowRemoval(image_config_t &img)
+{
+    // PREVENT ALLOW MEDIUM REMOVAL
+    // Not much we can do to prevent the user removing the SD card.
+    // do nothing.
+    return 1;
+}
+
+static int diskCmdRezeroUnit(image_config_t &img)
+{
+    // REZERO UNIT
+    // Set the lun to a vendor-specific state. Ignore.
+    return 1;
+}
+
+static int diskCmdSynchronizeCache(image_config_t &img)
+{
+    // SYNCHRONIZE CACHE
+    // We don't have a cache. do nothing.
+    return 1;
+}
+
+static int diskCmdVerify(image_config_t &img)
+{
+    // VERIFY
+    // TODO: When they supply data to verify, we should read the data and
+    // verify it. If they don't supply any data, just say success.
+    if ((scsiDev.cdb[1] & 0x02) == 0)
     {
-        // PRE-FETCH.
-        // We don't have a cache to pre-fetch into. do nothing.
+        // They are asking us to do a medium verification with no data
+        // comparison. Assume success, do nothing.
     }
-    else if (unlikely(command == 0x1E))
+    else
     {
-        // PREVENT ALLOW MEDIUM REMOVAL
-        // Not much we can do to prevent the user removing the SD card.
-        // do nothing.
+        // TODO. This means they are supplying data to verify against.
+        // Technically we should probably grab the data and compare it.
+        scsiDev.status = CHECK_CONDITION;
+        scsiDev.target->sense.code = ILLEGAL_REQUEST;
+        scsiDev.target->sense.asc = INVALID_FIELD_IN_CDB;
+        scsiDev.phase = STATUS;
     }
-    else if (unlikely(command == 0x01))
+    return 1;
+}
+
+static int diskCmdReadDefectData(image_config_t &img)
+{
+    // READ DEFECT DATA
+    uint32_t allocLength = cdbGet16(&scsiDev.cdb[7]);
+
+    scsiDev.data[0] = 0;
+    scsiDev.data[1] = scsiDev.cdb[1];
+    scsiDev.data[2] = 0;
+    scsiDev.data[3] = 0;
+    scsiDev.dataLen = 4;
+
+    if (scsiDev.dataLen > allocLength)
     {
-        // REZERO UNIT
-        // Set the lun to a vendor-specific state. Ignore.
+        scsiDev.dataLen = allocLength;
     }
-    else if (unlikely(command == 0x35))
+
+    scsiDev.phase = DATA_IN;
+    return 1;
+}
+
+static constexpr scsi_opcode_entry_t g_disk_opcodes[] = {
+    { 0x00, diskCmdTestUnitReady },
+    { 0x01, diskCmdRezeroUnit },
+    { 0x04, diskCmdFormatUnit },
+    { 0x08, diskCmdRead },
+    { 0x0A, diskCmdWrite },
+    { 0x0B, diskCmdSeek },
+    { 0x1B, diskCmdStartStopUnit },
+    { 0x1E, diskCmdPreventAllowRemoval },
+    { 0x25, diskCmdReadCapacity },
+    { 0x28, diskCmdRead },
+    { 0x2A, diskCmdWrite },
+    { 0x2B, diskCmdSeek },
+    { 0x2E, diskCmdWrite },
+    { 0x2F, diskCmdVerify },
+    { 0x34, diskCmdPrefetch },
+    { 0x35, diskCmdSynchronizeCache },
+    { 0x36, diskCmdLockUnlockCache },
+    { 0x37, diskCmdReadDefectData },
+};
+
+static constexpr scsi_opcode_table_t g_disk_opcode_table = scsiOpcodeTable(g_disk_opcodes);
+
+// Handle direct-access scsi device commands
+extern "C"
+int scsiDiskCommand()
+{
+    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+    uint8_t command = scsiDev.cdb[0];
+    scsi_opcode_handler_t handler = g_disk_opcode_table.handler[command];
+
+    if (unlikely(command == 0x1B || command == 0x00))
     {
-        // SYNCHRONIZE CACHE
-        // We don't have a cache. do nothing.
+        // START STOP UNIT and TEST UNIT READY work also when unit is not ready
+        return handler(img);
     }
-    else if (unlikely(command == 0x2F))
+    else if (unlikely(!doTestUnitReady()))
     {
-        // VERIFY
-        // TODO: When they supply data to verify, we should read the data and
-        // verify it. If they don't supply any data, just say success.
-        if ((scsiDev.cdb[1] & 0x02) == 0)
-        {
-            // They are asking us to do a medium verification with no data
-            // comparison. Assume success, do nothing.
-        }
-        else
-        {
-            // TODO. This means they are supplying data to verify against.
-            // Technically we should probably grab the data and compare it.
-            scsiDev.status = CHECK_CONDITION;
-            scsiDev.target->sense.code = ILLEGAL_REQUEST;
-            scsiDev.target->sense.asc = INVALID_FIELD_IN_CDB;
-            scsiDev.phase = STATUS;
-        }
+        // Status and sense codes already set by doTestUnitReady
+        return 1;
     }
-    else if (unlikely(command == 0x37))
+    else if (likely(handler != NULL))
     {
-        // READ DEFECT DATA
-        uint32_t allocLength = (((uint16_t)scsiDev.cdb[7]) << 8) |
-            scsiDev.cdb[8];
-
-        scsiDev.data[0] = 0;
-        scsiDev.data[1] = scsiDev.cdb[1];
-        scsiDev.data[2] = 0;
-        scsiDev.data[3] = 0;
-        scsiDev.dataLen = 4;
-
-        if (scsiDev.dataLen > allocLength)
-        {
-            scsiDev.dataLen = allocLength;
-        }
-
-        scsiDev.phase = DATA_IN;
+        return handler(img);
     }
     else if (img.file.isRom())
     {
         // Special handling for ROM drive to make SCSI2SD code report it as read-only
         blockDev.state |= DISK_WP;
-        commandHandled = scsiModeCommand();
+        int commandHandled = scsiModeCommand();
         blockDev.state &= ~DISK_WP;
+        return commandHandled;
     }
     else
     {
-        commandHandled = 0;
+        return 0;
     }
-
-    return commandHandled;
 }
 
 extern "C"
@@ -2077,6 +2836,13 @@ void scsiDiskPoll()
         transfer.currentBlock != transfer.blocks)
     {
         diskDataOut();
+
+        image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+        if (img.cdr_enabled && transfer.currentBlock == transfer.blocks)
+        {
+            // Recorded data counts only if it all reached the SD card
+            cdromRecorderWriteDone(img, scsiDev.phase == DATA_OUT && !scsiDev.resetFlag);
+        }
     }
 
     if (scsiDev.phase == STATUS && scsiDev.target)
@@ -2118,8 +2884,8 @@ void scsiDiskReset()
     transfer.multiBlock = 0;
 
 #ifdef PREFETCH_BUFFER_SIZE
-    g_scsi_prefetch.bytes = 0;
-    g_scsi_prefetch.sector = 0;
+    // Hosts typically reset the bus during boot, keep warmed up cache contents
+    g_scsi_prefetch.cache.busReset();
 #endif
 
     // Reinsert any ejected CD-ROMs on BUS RESET and restart from first image
@@ -33,6 +33,10 @@
 #include <scsiPhy.h>
 #include "ImageBackingStore.h"
 #include "BlueSCSI_config.h"
+#include "MMCEvents.h"
+#include "ImageScrub.h"
+#include "ModeShadow.h"
+#include "SDScheduler.h"
 
 extern "C" {
 #include <disk.h>
@@ -47,9 +51,12 @@ struct image_config_t: public S2S_TargetCfg
 
     ImageBackingStore file;
 
+    // Path of the image file as it was opened, sidecar files are stored next to it
+    char image_path[MAX_FILE_PATH + 1];
+
     // For CD-ROM drive ejection
     bool ejected;
-    uint8_t cdrom_events;
+    MMCEvents cdrom_events;
     bool reinsert_on_inquiry; // Reinsert on Inquiry command (to reinsert automatically after boot)
     bool reinsert_after_eject; // Reinsert next image after ejection
 
@@ -73,6 +80,15 @@ struct image_config_t: public S2S_TargetCfg
     // Cue sheet file for CD-ROM images
     FsFile cuesheetfile;
 
+    // CD-R/RW recorder emulation, the disc is blank while cue sheet is empty
+    bool cdr_enabled;
+    // Write parameters from mode page 0x05
+    uint8_t cdr_write_type;
+    uint8_t cdr_track_mode;
+    uint8_t cdr_block_type;
+    // End of recorded data on a closed disc, rest of the image is unused
+    uint32_t cdr_leadout;
+
     // Right-align vendor / product type strings (for Apple)
     // Standard SCSI uses left alignment
     // This field uses -1 for default when field is not set in .ini
@@ -87,6 +103,21 @@ struct image_config_t: public S2S_TargetCfg
     // Warning about geometry settings
     bool geometrywarningprinted;
 
+    // Capacity and geometry at current sector size, see s2s_getGeometry()
+    ScsiGeometry geometry;
+
+    // Most frequently read regions of the image, used for boot time cache warm-up
+    struct {
+        uint32_t region;
+        uint16_t hits;
+    } heatmap[HEATMAP_ENTRIES];
+
+    // Background verification against checksums in sidecar file
+    ImageScrub scrub;
+
+    // Mode page values set by the host with MODE SELECT
+    ModeShadow mode_shadow;
+
     // Clear any image state to zeros
     void clear();
 
@@ -122,7 +153,8 @@ bool scsiDiskProgramRomDrive(const char *filename, int scsi_id, int blocksize, S
 bool scsiDiskCheckRomDrive();
 bool scsiDiskActivateRomDrive();
 
-// Returns true if there is at least one image active
+// Returns true if there is at least one image active, or one is being
+// created for a target from CreateImage in ini file
 bool scsiDiskCheckAnyImagesConfigured();
 
 // Gets the next image filename for the target, if configured for multiple
@@ -143,3 +175,94 @@ void scsiDiskStartWrite(uint32_t lba, uint32_t blocks);
 
 // Returns true if there is at least one network device active
 bool scsiDiskCheckAnyNetworkDevicesConfigured();
+
+// Free space on SD card in bytes.
+// The first call counts free clusters, which can take several seconds on
+// large cards, so it is made at boot before the SCSI bus is enabled.
+// Later calls return a cached value.
+uint64_t scsiDiskGetFreeSpace();
+
+// Account for a file that BlueSCSI has grown or shrunk, to keep the
+// cached free space up to date without counting clusters again.
+void scsiDiskFreeSpaceUpdate(uint64_t old_size, uint64_t new_size);
+
+// Forget the cached free space, e.g. when SD card is removed
+void scsiDiskFreeSpaceInvalidate();
+
+// Create a blank image file of given size in a single contiguous extent.
+// On FAT32 the space is allocated without clearing it. On exFAT the file
+// has to be zero-filled, which continues in scsiDiskCreateImagePoll().
+bool scsiDiskCreateImage(const char *filename, uint64_t size);
+
+// Continue clearing an image created by scsiDiskCreateImage() or by the
+// CreateImage ini setting. Images from ini are opened on their target once
+// cleared. Should be called when the bus is free. Returns true if there is
+// more work left.
+bool scsiDiskCreateImagePoll();
+
+// Load read access heatmap from SD card and preload the hottest region into
+// the read cache. Call after images have been opened and SCSI initialized.
+void scsiDiskHeatmapLoad();
+
+// Save read access heatmap to SD card if it has changed and the bus
+// has been idle long enough.
+void scsiDiskHeatmapSave();
+
+// Shares SD card access between CD audio, SCSI transfers and background work
+extern SDScheduler g_sd_scheduler;
+
+// Load SD card bandwidth model from ini file
+void scsiDiskSchedulerLoad();
+
+// Load image scrubbing settings. Call after images have been opened.
+void scsiDiskScrubLoad();
+
+// Returns true if background image scrubbing is enabled in ini file
+bool scsiDiskScrubEnabled();
+
+// Returns true if the image can be read back for scrubbing without side
+// effects, i.e. it is an open regular file that is not in use for audio.
+bool scsiDiskScrubSupported(image_config_t &img);
+
+// Verify the next part of an image against its sidecar checksums.
+// Should be called when the bus is free, does nothing until the bus
+// has been idle for SCRUB_IDLE_MS.
+void scsiDiskScrubPoll();
+
+// Restart scrubbing of a target from the beginning, e.g. when the image
+// has been changed. If discard is true, stored checksums are replaced.
+void scsiDiskScrubRestart(image_config_t &img, bool discard);
+
+// Restore mode page values and block size saved by the host, called when
+// an image is opened.
+void scsiDiskModeShadowLoad(int target_idx);
+
+// Store saved mode page values and block size of a target in its sidecar file
+void scsiDiskModeShadowSave(image_config_t &img);
+
+// Opcode dispatch tables for the device type specific command handlers.
+// Handler returns 1 if the command was handled, 0 to pass it on to the next handler.
+typedef int (*scsi_opcode_handler_t)(image_config_t &img);
+
+struct scsi_opcode_entry_t
+{
+    uint8_t opcode;
+    scsi_opcode_handler_t handler;
+};
+
+struct scsi_opcode_table_t
+{
+    scsi_opcode_handler_t handler[256];
+};
+
+// Expand a list of opcodes to a 256-entry lookup table at compile time
+template <size_t N>
+constexpr scsi_opcode_table_t scsiOpcodeTable(const scsi_opcode_entry_t (&entries)[N])
+{
+    scsi_opcode_table_t table = {};
+    for (size_t i = 0; i < N; i++)
+    {
+        table.handler[entries[i].opcode] = entries[i].handler;
+    }
+    return table;
+}
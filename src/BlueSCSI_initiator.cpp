@@ -9,8 +9,10 @@
 #include "BlueSCSI_log.h"
 #include "BlueSCSI_log_trace.h"
 #include "BlueSCSI_initiator.h"
+#include "BlueSCSI_disk.h"
 #include <BlueSCSI_platform.h>
 #include <minIni.h>
+#include <TapeImage.h>
 #include "SdFat.h"
 
 #include <scsi2sd.h>
@@ -46,6 +48,12 @@ bool scsiInitiatorReadCapacity(int target_id, uint32_t *sectorcount, uint32_t *s
  * High level initiator mode logic   *
  *************************************/
 
+// Surface scan divides the drive into zones that are classified by sample reads
+#define INITIATOR_SCAN_ZONES 64
+#define INITIATOR_SCAN_SAMPLE_SECTORS 64
+#define INITIATOR_CAREFUL_TRANSFER 16
+enum zone_status_t { ZONE_OK = 0, ZONE_SLOW, ZONE_FAILED };
+
 static struct {
     // Bitmap of all drives that have been imaged
     uint32_t drives_imaged;
@@ -73,17 +81,44 @@ static struct {
     uint32_t failposition;
     bool ejectWhenDone;
 
+    // Surface scan results, see scsiInitiatorSurfaceScan()
+    bool surfaceScan;
+    uint8_t imagingPass; // 0 = all sectors in order, 1 = healthy zones, 2 = problem zones
+    uint32_t zoneSize; // Sectors per zone
+    uint8_t zoneStatus[INITIATOR_SCAN_ZONES];
+    uint16_t zoneLatency[INITIATOR_SCAN_ZONES]; // Milliseconds for sample reads
+
+    // Tape imaging state, see scsiInitiatorTapeStep()
+    uint32_t tape_max_read; // Allocation length for variable block reads
+    uint32_t tape_min_read; // Shortest record the drive can return
+    uint32_t tape_block_size; // Block size from MODE SENSE, used if variable mode is refused
+    uint32_t tape_buffered; // Bytes of .tap data in scsiDev.data waiting to be written
+    uint32_t tape_records;
+    uint32_t tape_filemarks;
+    uint64_t tape_bytes;
+
     FsFile target_file;
+    uint64_t target_file_allocated; // Bytes already subtracted from cached SD free space
 } g_initiator_state;
 
 extern SdFs SD;
 
+// Close the image file and account its final size in the cached free space
+static void scsiInitiatorCloseTargetFile()
+{
+    uint64_t size = g_initiator_state.target_file.size();
+    uint64_t allocated = g_initiator_state.target_file_allocated;
+    scsiDiskFreeSpaceUpdate(allocated, (size > allocated) ? size : allocated);
+    g_initiator_state.target_file_allocated = 0;
+    g_initiator_state.target_file.close();
+}
+
 // Initialization of initiator mode
 void scsiInitiatorInit()
 {
     scsiHostPhyReset();
 
-    g_initiator_state.initiator_id = ini_getl("SCSI", "InitiatorID", 7, CONFIGFILE);
+    g_initiator_state.initiator_id = g_settings.global.initiatorID.get(7);
     if (g_initiator_state.initiator_id > 7)
     {
         log("InitiatorID set to illegal value in, ", CONFIGFILE, ", defaulting to 7");
@@ -92,7 +127,8 @@ void scsiInitiatorInit()
     {
         log_f("InitiatorID set to ID %d", g_initiator_state.initiator_id);
     }
-    g_initiator_state.maxRetryCount = ini_getl("SCSI", "InitiatorMaxRetry", 5, CONFIGFILE);
+    g_initiator_state.maxRetryCount = g_settings.global.initiatorMaxRetry.get(5);
+    g_initiator_state.surfaceScan = g_settings.global.initiatorSurfaceScan.get(false);
 
     // treat initiator id as already imaged drive so it gets skipped
     g_initiator_state.drives_imaged = 1 << g_initiator_state.initiator_id;
@@ -142,6 +178,495 @@ void delay_with_poll(uint32_t ms)
     }
 }
 
+/*************************************
+ * Surface scan before imaging       *
+ *************************************/
+
+// Failing drives often have regions that take very long to read.
+// The optional surface scan samples each zone of the drive with VERIFY
+// (or READ if VERIFY is not supported) and measures the latency.
+// Healthy zones are imaged first at full transfer size and problem zones
+// are left for a final careful pass, so that most data is saved even if
+// the drive dies during imaging.
+
+static int scsiInitiatorSampleSectors(int target_id, uint32_t lba, uint32_t count, bool verify)
+{
+    uint32_t sectorsize = g_initiator_state.sectorsize;
+    if (verify)
+    {
+        uint8_t command[10] = {0x2F, 0x00,
+            (uint8_t)(lba >> 24), (uint8_t)(lba >> 16),
+            (uint8_t)(lba >> 8), (uint8_t)lba,
+            0x00,
+            (uint8_t)(count >> 8), (uint8_t)count,
+            0x00
+        };
+        return scsiInitiatorRunCommand(target_id, command, sizeof(command), NULL, 0, NULL, 0);
+    }
+    else if (g_initiator_state.ansiVersion < 0x02)
+    {
+        uint8_t command[6] = {0x08,
+            (uint8_t)(lba >> 16), (uint8_t)(lba >> 8), (uint8_t)lba,
+            (uint8_t)count, 0x00
+        };
+        return scsiInitiatorRunCommand(target_id, command, sizeof(command),
+                                       scsiDev.data, count * sectorsize, NULL, 0);
+    }
+    else
+    {
+        uint8_t command[10] = {0x28, 0x00,
+            (uint8_t)(lba >> 24), (uint8_t)(lba >> 16),
+            (uint8_t)(lba >> 8), (uint8_t)lba,
+            0x00,
+            (uint8_t)(count >> 8), (uint8_t)count,
+            0x00
+        };
+        return scsiInitiatorRunCommand(target_id, command, sizeof(command),
+                                       scsiDev.data, count * sectorsize, NULL, 0);
+    }
+}
+
+static const char *zoneStatusName(uint8_t status)
+{
+    switch (status)
+    {
+        case ZONE_OK: return "ok";
+        case ZONE_SLOW: return "slow";
+        default: return "failed";
+    }
+}
+
+// Scan the drive and store zone map to log and to a file next to the image
+static void scsiInitiatorSurfaceScan(const char *imagename)
+{
+    int target_id = g_initiator_state.target_id;
+    uint32_t sectorcount = g_initiator_state.sectorcount;
+    uint32_t zonesize = (sectorcount + INITIATOR_SCAN_ZONES - 1) / INITIATOR_SCAN_ZONES;
+    g_initiator_state.zoneSize = zonesize;
+
+    uint32_t samplecount = INITIATOR_SCAN_SAMPLE_SECTORS;
+    if (samplecount > sizeof(scsiDev.data) / g_initiator_state.sectorsize)
+        samplecount = sizeof(scsiDev.data) / g_initiator_state.sectorsize;
+    if (samplecount > zonesize / 2)
+        samplecount = zonesize / 2;
+    if (samplecount == 0)
+        samplecount = 1;
+
+    log("Starting surface scan of ", INITIATOR_SCAN_ZONES, " zones of ", (int)zonesize, " sectors");
+    bool verify = (g_initiator_state.ansiVersion >= 0x02);
+    uint32_t total_ms = 0;
+    int total_ok = 0;
+    for (int zone = 0; zone < INITIATOR_SCAN_ZONES; zone++)
+    {
+        uint32_t start = zone * zonesize;
+        g_initiator_state.zoneStatus[zone] = ZONE_OK;
+        g_initiator_state.zoneLatency[zone] = 0;
+        if (start >= sectorcount) continue;
+
+        // Sample at the beginning and middle of the zone
+        uint32_t samples[2] = {start, start + zonesize / 2};
+        uint32_t zone_ms = 0;
+        for (int i = 0; i < 2; i++)
+        {
+            uint32_t lba = samples[i];
+            uint32_t count = samplecount;
+            if (lba + count > sectorcount) count = sectorcount - lba;
+            if (lba >= sectorcount || count == 0) continue;
+
+            platform_reset_watchdog();
+            scsiInitiatorUpdateLed();
+            uint32_t time_start = millis();
+            int status = scsiInitiatorSampleSectors(target_id, lba, count, verify);
+            uint32_t elapsed = millis() - time_start;
+
+            if (status == 2)
+            {
+                uint8_t sense_key;
+                scsiRequestSense(target_id, &sense_key);
+
+                if (sense_key == 5 && verify)
+                {
+                    // VERIFY is optional, use READ instead
+                    log("Drive does not support VERIFY, sampling with READ");
+                    verify = false;
+                    i--;
+                    continue;
+                }
+            }
+
+            if (status != 0)
+            {
+                g_initiator_state.zoneStatus[zone] = ZONE_FAILED;
+            }
+            zone_ms += elapsed;
+        }
+
+        g_initiator_state.zoneLatency[zone] = (zone_ms > 0xFFFF) ? 0xFFFF : zone_ms;
+        if (g_initiator_state.zoneStatus[zone] == ZONE_OK)
+        {
+            total_ms += zone_ms;
+            total_ok++;
+        }
+    }
+
+    // Zones much slower than average are likely retrying internally
+    uint32_t average_ms = total_ok ? total_ms / total_ok : 0;
+    uint32_t slow_limit = average_ms * 4;
+    if (slow_limit < average_ms + 100) slow_limit = average_ms + 100;
+
+    int problem_zones = 0;
+    for (int zone = 0; zone < INITIATOR_SCAN_ZONES; zone++)
+    {
+        if (g_initiator_state.zoneStatus[zone] == ZONE_OK &&
+            g_initiator_state.zoneLatency[zone] > slow_limit)
+        {
+            g_initiator_state.zoneStatus[zone] = ZONE_SLOW;
+        }
+
+        if (g_initiator_state.zoneStatus[zone] != ZONE_OK)
+        {
+            problem_zones++;
+            log("Zone ", zone, " sectors ", (int)(zone * zonesize), " - ", (int)((zone + 1) * zonesize - 1),
+                " is ", zoneStatusName(g_initiator_state.zoneStatus[zone]),
+                ", ", (int)g_initiator_state.zoneLatency[zone], " ms");
+        }
+    }
+    log("Surface scan done, average zone latency ", (int)average_ms, " ms, ", problem_zones, " problem zones");
+
+    char mapname[MAX_FILE_PATH];
+    strncpy(mapname, imagename, sizeof(mapname) - 1);
+    mapname[sizeof(mapname) - 1] = '\0';
+    strlcat(mapname, ".zonemap", sizeof(mapname));
+    FsFile mapfile = SD.open(mapname, O_WRONLY | O_CREAT | O_TRUNC);
+    if (mapfile.isOpen())
+    {
+        char line[80];
+        snprintf(line, sizeof(line), "# SCSI ID %d, %lu sectors x %lu bytes, %d zones\n",
+                 target_id, (unsigned long)sectorcount, (unsigned long)g_initiator_state.sectorsize,
+                 INITIATOR_SCAN_ZONES);
+        mapfile.write(line, strlen(line));
+        strlcpy(line, "# zone first_sector last_sector status latency_ms\n", sizeof(line));
+        mapfile.write(line, strlen(line));
+        for (int zone = 0; zone < INITIATOR_SCAN_ZONES; zone++)
+        {
+            uint32_t start = zone * zonesize;
+            if (start >= sectorcount) break;
+            uint32_t end = start + zonesize - 1;
+            if (end >= sectorcount) end = sectorcount - 1;
+            snprintf(line, sizeof(line), "%d %lu %lu %s %d\n", zone,
+                     (unsigned long)start, (unsigned long)end,
+                     zoneStatusName(g_initiator_state.zoneStatus[zone]),
+                     (int)g_initiator_state.zoneLatency[zone]);
+            mapfile.write(line, strlen(line));
+        }
+        mapfile.close();
+        log("Zone map saved to ", mapname);
+    }
+
+    g_initiator_state.imagingPass = (problem_zones > 0) ? 1 : 0;
+}
+
+// Adjust imaging position according to the zone plan.
+// In pass 1 problem zones are filled with zeros, in pass 2 only they are read.
+// The zeros are written one buffer per call so that the main loop keeps
+// running, returns true if a buffer was written.
+static bool scsiInitiatorZoneSchedule()
+{
+    uint32_t zonesize = g_initiator_state.zoneSize;
+    while (g_initiator_state.sectors_done < g_initiator_state.sectorcount)
+    {
+        int zone = g_initiator_state.sectors_done / zonesize;
+        bool problem = (g_initiator_state.zoneStatus[zone] != ZONE_OK);
+        uint32_t zone_end = (zone + 1) * zonesize;
+        if (zone_end > g_initiator_state.sectorcount) zone_end = g_initiator_state.sectorcount;
+
+        if (g_initiator_state.imagingPass == 1 && problem)
+        {
+            // Reserve space in the image, the zone is read in pass 2
+            uint32_t count = zone_end - g_initiator_state.sectors_done;
+            uint32_t max_count = sizeof(scsiDev.data) / g_initiator_state.sectorsize;
+            if (count > max_count) count = max_count;
+            memset(scsiDev.data, 0, count * g_initiator_state.sectorsize);
+            g_initiator_state.target_file.write(scsiDev.data, count * g_initiator_state.sectorsize);
+            g_initiator_state.sectors_done += count;
+            return true;
+        }
+        else if (g_initiator_state.imagingPass == 2 && !problem)
+        {
+            g_initiator_state.sectors_done = zone_end;
+            g_initiator_state.target_file.seek((uint64_t)zone_end * g_initiator_state.sectorsize);
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+/*************************************
+ * Tape drive imaging                *
+ *************************************/
+
+// Tape drives are imaged record by record into a SIMH style .tap container,
+// see lib/TapeImage. The records are collected in scsiDev.data and written
+// to the SD card in large chunks.
+
+static void tapeAddMarker(uint32_t marker)
+{
+    g_initiator_state.tape_buffered += tapPutMarker(&scsiDev.data[g_initiator_state.tape_buffered], marker);
+}
+
+static bool tapFlush()
+{
+    uint32_t len = g_initiator_state.tape_buffered;
+    g_initiator_state.tape_buffered = 0;
+    if (len > 0 && g_initiator_state.target_file.write(scsiDev.data, len) != len)
+    {
+        log("Tape imaging: SD card write failed");
+        return false;
+    }
+    g_initiator_state.target_file.flush();
+    return true;
+}
+
+static void scsiInitiatorTapeFinish(bool ok)
+{
+    tapeAddMarker(TAP_END_OF_MEDIUM);
+    tapFlush();
+    scsiInitiatorCloseTargetFile();
+
+    // Rewind the tape, leaving it in the drive
+    uint8_t command[6] = {0x01, 0, 0, 0, 0, 0};
+    scsiInitiatorRunCommand(g_initiator_state.target_id, command, sizeof(command), NULL, 0, NULL, 0);
+
+    log(ok ? "Finished imaging tape with id " : "Stopped imaging tape with id ", g_initiator_state.target_id);
+    log_f("Tape contained %d records in %d files, %d kB total",
+          (int)g_initiator_state.tape_records, (int)g_initiator_state.tape_filemarks,
+          (int)(g_initiator_state.tape_bytes / 1024));
+    if (g_initiator_state.badSectorCount != 0)
+    {
+        log_f("NOTE: There were %d tape blocks that could not be read.", g_initiator_state.badSectorCount);
+    }
+
+    log("Marking this ID as imaged, wont ask it again.");
+    g_initiator_state.drives_imaged |= (1 << g_initiator_state.target_id);
+    g_initiator_state.imaging = false;
+    LED_OFF();
+}
+
+static void scsiInitiatorStartTapeImaging(const uint8_t *inquiry_data)
+{
+    int target_id = g_initiator_state.target_id;
+    log_f("SCSI-%d: Vendor: %.8s, Product: %.16s, Version: %.4s",
+        g_initiator_state.ansiVersion,
+        &inquiry_data[8],
+        &inquiry_data[16],
+        &inquiry_data[32]);
+    log("SCSI ID ", target_id, " is a tape drive");
+
+    // Rewind to beginning of tape
+    uint8_t rewind[6] = {0x01, 0, 0, 0, 0, 0};
+    if (scsiInitiatorRunCommand(target_id, rewind, sizeof(rewind), NULL, 0, NULL, 0) != 0)
+    {
+        uint8_t sense_key;
+        scsiRequestSense(target_id, &sense_key);
+        log("REWIND on target ", target_id, " failed, sense key ", sense_key, ", is there a tape loaded?");
+        return;
+    }
+
+    // Largest record that fits in the buffer together with the framing
+    uint32_t bufmax = (sizeof(scsiDev.data) - 12) & ~1;
+
+    // READ BLOCK LIMITS gives the largest record the drive can return.
+    // Reading with that allocation length handles any record in one command.
+    uint8_t limits[6] = {0};
+    uint8_t limitscmd[6] = {0x05, 0, 0, 0, 0, 0};
+    uint32_t maxlen = bufmax;
+    uint32_t minlen = 0;
+    if (scsiInitiatorRunCommand(target_id, limitscmd, sizeof(limitscmd), limits, sizeof(limits), NULL, 0) == 0)
+    {
+        maxlen = ((uint32_t)limits[1] << 16) | ((uint32_t)limits[2] << 8) | limits[3];
+        minlen = ((uint32_t)limits[4] << 8) | limits[5];
+        log("Tape block limits: ", (int)minlen, " - ", (int)maxlen, " bytes");
+        if (maxlen == 0 || maxlen > bufmax) maxlen = bufmax;
+    }
+    g_initiator_state.tape_max_read = maxlen;
+    g_initiator_state.tape_min_read = minlen;
+
+    // Block descriptor from MODE SENSE tells if the drive is in fixed block mode.
+    // Variable mode is tried first, fixed mode is used if the drive refuses it.
+    uint8_t modesense[12] = {0};
+    uint8_t modecmd[6] = {0x1A, 0, 0, 0, sizeof(modesense), 0};
+    g_initiator_state.tape_block_size = 0;
+    if (scsiInitiatorRunCommand(target_id, modecmd, sizeof(modecmd), modesense, sizeof(modesense), NULL, 0) == 0 &&
+        modesense[3] >= 8)
+    {
+        uint32_t blocksize = ((uint32_t)modesense[9] << 16) | ((uint32_t)modesense[10] << 8) | modesense[11];
+        log("Tape drive reports block size ", (int)blocksize, blocksize ? "" : " (variable)");
+        if (blocksize <= bufmax / 2)
+        {
+            g_initiator_state.tape_block_size = blocksize;
+        }
+    }
+
+    char filename[32] = "TP00_imaged.tap";
+    int lun = 0;
+    filename[2] += target_id;
+    while (SD.exists(filename))
+    {
+        filename[3] = lun++ + '0';
+    }
+    if (lun != 0)
+    {
+        log("Using filename: ", filename, " to avoid overwriting existing file.");
+    }
+
+    g_initiator_state.target_file = SD.open(filename, O_WRONLY | O_CREAT | O_TRUNC);
+    if (!g_initiator_state.target_file.isOpen())
+    {
+        log("Failed to open file for writing: ", filename);
+        return;
+    }
+
+    g_initiator_state.tape_buffered = 0;
+    g_initiator_state.tape_records = 0;
+    g_initiator_state.tape_filemarks = 0;
+    g_initiator_state.tape_bytes = 0;
+    g_initiator_state.sectorsize = 0; // Fixed block size in use, 0 for variable mode
+    g_initiator_state.sectorcount = 0;
+
+    log("Starting to copy tape data to ", filename);
+    g_initiator_state.imaging = true;
+}
+
+// Read the next record(s) from tape and add them to the container
+static void scsiInitiatorTapeStep()
+{
+    int target_id = g_initiator_state.target_id;
+    uint32_t blocksize = g_initiator_state.sectorsize;
+    bool fixed = (blocksize != 0);
+
+    // Make sure the largest possible read fits in the remaining buffer
+    uint32_t needed = fixed ? tapRecordSize(blocksize) : tapRecordSize(g_initiator_state.tape_max_read);
+    if (g_initiator_state.tape_buffered + needed + 4 > sizeof(scsiDev.data))
+    {
+        if (!tapFlush())
+        {
+            scsiInitiatorTapeFinish(false);
+            return;
+        }
+
+        log_f("Tape imaging: %d records, %d filemarks, %d kB",
+              (int)g_initiator_state.tape_records, (int)g_initiator_state.tape_filemarks,
+              (int)(g_initiator_state.tape_bytes / 1024));
+    }
+
+    if ((millis() & 255) < 128) LED_ON(); else LED_OFF();
+
+    // In fixed block mode read as many blocks as fit in the buffer with framing,
+    // in variable mode read one record. SILI is set in variable mode so that a
+    // short record completes with GOOD status, its length is the number of bytes
+    // received before the drive ends the data phase.
+    uint32_t space = sizeof(scsiDev.data) - g_initiator_state.tape_buffered - 4;
+    uint32_t count = fixed ? space / tapRecordSize(blocksize) : g_initiator_state.tape_max_read;
+    uint32_t alloc = fixed ? count * blocksize : count;
+    uint8_t *buf = &scsiDev.data[g_initiator_state.tape_buffered];
+
+    uint8_t command[6] = {0x08, (uint8_t)(fixed ? 0x01 : 0x02),
+        (uint8_t)(count >> 16), (uint8_t)(count >> 8), (uint8_t)count, 0};
+    uint32_t received = 0;
+    int status = scsiInitiatorRunCommand(target_id, command, sizeof(command), buf + 4, alloc, NULL, 0,
+                                         false, &received, g_initiator_state.tape_min_read, blocksize);
+
+    uint8_t sense[18] = {0};
+    if (status == 2)
+    {
+        scsiRequestSenseData(target_id, sense);
+    }
+    else if (status != 0)
+    {
+        if (g_initiator_state.retrycount < g_initiator_state.maxRetryCount)
+        {
+            log("Tape read failed with status ", status, ", retrying");
+            g_initiator_state.retrycount++;
+            delay_with_poll(200);
+            return;
+        }
+        scsiInitiatorTapeFinish(false);
+        return;
+    }
+
+    TapeReadResult result = tapeReadResult(status, sense, alloc, blocksize, received);
+    if (result.error)
+    {
+        if (result.sense_key == 5 && !fixed && g_initiator_state.tape_records == 0 &&
+            g_initiator_state.tape_block_size != 0)
+        {
+            log("Tape drive does not accept variable block reads, using fixed ",
+                (int)g_initiator_state.tape_block_size, " byte blocks");
+            g_initiator_state.sectorsize = g_initiator_state.tape_block_size;
+            return;
+        }
+        else if (g_initiator_state.retrycount < g_initiator_state.maxRetryCount)
+        {
+            log("Tape read failed with sense key ", result.sense_key, ", retrying ",
+                g_initiator_state.retrycount + 1, "/", (int)g_initiator_state.maxRetryCount);
+            g_initiator_state.retrycount++;
+            delay_with_poll(200);
+            return;
+        }
+        else
+        {
+            log("Retry limit exceeded, stopping tape imaging");
+            g_initiator_state.badSectorCount++;
+            scsiInitiatorTapeFinish(false);
+            return;
+        }
+    }
+
+    if (result.truncated)
+    {
+        log("Tape record at ", (int)g_initiator_state.tape_records, " is longer than ",
+            (int)count, " bytes, data was truncated");
+        g_initiator_state.badSectorCount++;
+    }
+    else if (result.mismatch)
+    {
+        log("Tape record at ", (int)g_initiator_state.tape_records, ": received ", (int)received,
+            " bytes, sense data reports a different length");
+        g_initiator_state.badSectorCount++;
+    }
+
+    g_initiator_state.retrycount = 0;
+
+    uint32_t records = 0;
+    if (fixed)
+    {
+        records = result.length / blocksize;
+        g_initiator_state.tape_buffered += tapFrameBlocks(buf, records, blocksize);
+    }
+    else if (result.length > 0)
+    {
+        records = 1;
+        g_initiator_state.tape_buffered += tapFrameRecord(buf, result.length);
+    }
+    g_initiator_state.tape_records += records;
+    g_initiator_state.tape_bytes += result.length;
+
+    if (result.filemark)
+    {
+        tapeAddMarker(TAP_FILEMARK);
+        g_initiator_state.tape_filemarks++;
+        debuglog("Filemark after record ", (int)g_initiator_state.tape_records);
+    }
+
+    if (result.end_of_data)
+    {
+        scsiInitiatorTapeFinish(true);
+    }
+}
+
 // High level logic of the initiator mode
 void scsiInitiatorMainLoop()
 {
@@ -162,9 +687,14 @@ void scsiInitiatorMainLoop()
         g_initiator_state.max_sector_per_transfer = 512;
         g_initiator_state.badSectorCount = 0;
         g_initiator_state.ejectWhenDone = false;
+        g_initiator_state.deviceType = DEVICE_TYPE_DIRECT_ACCESS;
+        g_initiator_state.imagingPass = 0;
 
         if (!(g_initiator_state.drives_imaged & (1 << g_initiator_state.target_id)))
         {
+            // Count SD card free space while idle, it is needed once a drive is found.
+            // Only the first call is slow, later ones return the cached value.
+            scsiDiskGetFreeSpace();
             delay_with_poll(1000);
 
             uint8_t inquiry_data[36] = {0};
@@ -184,6 +714,14 @@ void scsiInitiatorMainLoop()
             g_initiator_state.ansiVersion = inquiry_data[2] & 0x7;
             LED_OFF();
 
+            if (inquiryok && (inquiry_data[0] & 0x1F) == DEVICE_TYPE_SEQUENTIAL)
+            {
+                // Tapes have no capacity, they are read until end of data
+                g_initiator_state.deviceType = DEVICE_TYPE_SEQUENTIAL;
+                scsiInitiatorStartTapeImaging(inquiry_data);
+                return;
+            }
+
             uint64_t total_bytes = 0;
             if (readcapok)
             {
@@ -258,7 +796,7 @@ void scsiInitiatorMainLoop()
                 strncpy(filename, filename_format, sizeof(filename) - 1);
                 filename[2] += g_initiator_state.target_id;
 
-                uint64_t sd_card_free_bytes = (uint64_t)SD.vol()->freeClusterCount() * SD.vol()->bytesPerCluster();
+                uint64_t sd_card_free_bytes = scsiDiskGetFreeSpace();
                 if(sd_card_free_bytes < total_bytes)
                 {
                     log("SD Card only has ", (int)(sd_card_free_bytes / (1024 * 1024)), " MiB - not enough free space to image this drive!");
@@ -286,7 +824,17 @@ void scsiInitiatorMainLoop()
                     // Only preallocate on exFAT, on FAT32 preallocating can result in false garbage data in the
                     // file if write is interrupted.
                     log("Preallocating image file");
-                    g_initiator_state.target_file.preAllocate((uint64_t)g_initiator_state.sectorcount * g_initiator_state.sectorsize);
+                    uint64_t image_size = (uint64_t)g_initiator_state.sectorcount * g_initiator_state.sectorsize;
+                    if (g_initiator_state.target_file.preAllocate(image_size))
+                    {
+                        scsiDiskFreeSpaceUpdate(0, image_size);
+                        g_initiator_state.target_file_allocated = image_size;
+                    }
+                }
+
+                if (g_initiator_state.surfaceScan && readcapok)
+                {
+                    scsiInitiatorSurfaceScan(filename);
                 }
 
                 log("Starting to copy drive data to ", filename);
@@ -294,9 +842,31 @@ void scsiInitiatorMainLoop()
             }
         }
     }
+    else if (g_initiator_state.deviceType == DEVICE_TYPE_SEQUENTIAL)
+    {
+        scsiInitiatorTapeStep();
+    }
     else
     {
         // Copy sectors from SCSI drive to file
+        if (g_initiator_state.imagingPass != 0 && scsiInitiatorZoneSchedule())
+        {
+            scsiInitiatorUpdateLed();
+            return;
+        }
+
+        if (g_initiator_state.sectors_done >= g_initiator_state.sectorcount &&
+            g_initiator_state.imagingPass == 1)
+        {
+            log("Healthy zones imaged, starting careful pass over problem zones");
+            g_initiator_state.imagingPass = 2;
+            g_initiator_state.sectors_done = 0;
+            g_initiator_state.retrycount = 0;
+            g_initiator_state.failposition = 0;
+            g_initiator_state.target_file.seek(0);
+            return;
+        }
+
         if (g_initiator_state.sectors_done >= g_initiator_state.sectorcount)
         {
             scsiStartStopUnit(g_initiator_state.target_id, false);
@@ -320,7 +890,7 @@ void scsiInitiatorMainLoop()
                 g_initiator_state.drives_imaged |= (1 << g_initiator_state.target_id);
             }
             g_initiator_state.imaging = false;
-            g_initiator_state.target_file.close();
+            scsiInitiatorCloseTargetFile();
             return;
         }
 
@@ -331,6 +901,17 @@ void scsiInitiatorMainLoop()
         if (numtoread > g_initiator_state.max_sector_per_transfer)
             numtoread = g_initiator_state.max_sector_per_transfer;
 
+        if (g_initiator_state.imagingPass != 0)
+        {
+            // Don't cross into the next zone, it may need different handling
+            uint32_t zone_end = (g_initiator_state.sectors_done / g_initiator_state.zoneSize + 1) * g_initiator_state.zoneSize;
+            if (g_initiator_state.sectors_done + numtoread > zone_end)
+                numtoread = zone_end - g_initiator_state.sectors_done;
+
+            if (g_initiator_state.imagingPass == 2 && numtoread > INITIATOR_CAREFUL_TRANSFER)
+                numtoread = INITIATOR_CAREFUL_TRANSFER;
+        }
+
         // Retry sector-by-sector after failure
         if (g_initiator_state.sectors_done < g_initiator_state.failposition)
             numtoread = 1;
@@ -392,7 +973,8 @@ int scsiInitiatorRunCommand(int target_id,
                             const uint8_t *command, size_t cmdLen,
                             uint8_t *bufIn, size_t bufInLen,
                             const uint8_t *bufOut, size_t bufOutLen,
-                            bool returnDataPhase)
+                            bool returnDataPhase, uint32_t *bufInReceived,
+                            uint32_t bufInMin, uint32_t bufInBlockSize)
 {
     if (!scsiHostPhySelect(target_id, g_initiator_state.initiator_id))
     {
@@ -431,7 +1013,17 @@ int scsiInitiatorRunCommand(int target_id,
                 break;
             }
 
-            if (scsiHostRead(bufIn, bufInLen) == 0)
+            if (bufInReceived)
+            {
+                *bufInReceived = scsiHostReadUntilPhaseChange(bufIn, bufInLen, bufInMin, bufInBlockSize);
+                if (*bufInReceived == 0)
+                {
+                    log("scsiHostReadUntilPhaseChange failed, tried to read ", (int)bufInLen, " bytes");
+                    status = -2;
+                    break;
+                }
+            }
+            else if (scsiHostRead(bufIn, bufInLen) == 0)
             {
                 log("scsiHostRead failed, tried to read ", (int)bufInLen, " bytes");
                 status = -2;
@@ -511,17 +1103,25 @@ bool scsiInitiatorReadCapacity(int target_id, uint32_t *sectorcount, uint32_t *s
 // Execute REQUEST SENSE command to get more information about error status
 bool scsiRequestSense(int target_id, uint8_t *sense_key)
 {
-    uint8_t command[6] = {0x03, 0, 0, 0, 18, 0};
     uint8_t response[18] = {0};
+    bool status = scsiRequestSenseData(target_id, response);
+    log("RequestSense response: ", bytearray(response, 18));
+    *sense_key = response[2] & 0x0F;
+    return status;
+}
+
+bool scsiRequestSenseData(int target_id, uint8_t sense_data[18])
+{
+    uint8_t command[6] = {0x03, 0, 0, 0, 18, 0};
+    memset(sense_data, 0, 18);
 
     int status = scsiInitiatorRunCommand(target_id,
                                          command, sizeof(command),
-                                         response, sizeof(response),
+                                         sense_data, 18,
                                          NULL, 0);
 
-    log("RequestSense response: ", bytearray(response, 18));
+    debuglog("RequestSense response: ", bytearray(sense_data, 18));
 
-    *sense_key = response[2] & 0x0F;
     return status == 0;
 }
 
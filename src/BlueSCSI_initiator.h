@@ -7,17 +7,24 @@
 
 #define DEVICE_TYPE_CD 5
 #define DEVICE_TYPE_DIRECT_ACCESS 0
+#define DEVICE_TYPE_SEQUENTIAL 1
 
 void scsiInitiatorInit();
 
 void scsiInitiatorMainLoop();
 
-// Select target and execute SCSI command
+// Select target and execute SCSI command.
+// If bufInReceived is given, the target may end the data in phase early
+// and the number of bytes received is stored there. bufInMin and
+// bufInBlockSize tell how much the target is known to send, see
+// scsiHostReadUntilPhaseChange().
 int scsiInitiatorRunCommand(int target_id,
                             const uint8_t *command, size_t cmdLen,
                             uint8_t *bufIn, size_t bufInLen,
                             const uint8_t *bufOut, size_t bufOutLen,
-                            bool returnDataPhase = false);
+                            bool returnDataPhase = false,
+                            uint32_t *bufInReceived = NULL,
+                            uint32_t bufInMin = 0, uint32_t bufInBlockSize = 0);
 
 // Execute READ CAPACITY command
 bool scsiInitiatorReadCapacity(int target_id, uint32_t *sectorcount, uint32_t *sectorsize);
@@ -25,6 +32,9 @@ bool scsiInitiatorReadCapacity(int target_id, uint32_t *sectorcount, uint32_t *s
 // Execute REQUEST SENSE command to get more information about error status
 bool scsiRequestSense(int target_id, uint8_t *sense_key);
 
+// Execute REQUEST SENSE command and return the full fixed format sense data
+bool scsiRequestSenseData(int target_id, uint8_t sense_data[18]);
+
 // Execute UNIT START STOP command to load/unload media
 bool scsiStartStopUnit(int target_id, bool start);
 
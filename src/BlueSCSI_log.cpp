@@ -27,15 +27,20 @@ void log_raw(const char *str)
         g_logpos = 0;
     }
 
+    uint32_t pos = g_logpos;
     const char *p = str;
     while (*p)
     {
-        g_logbuffer[g_logpos & LOGBUFMASK] = *p++;
-        g_logpos++;
+        g_logbuffer[pos & LOGBUFMASK] = *p++;
+        pos++;
     }
 
     // Keep buffer null-terminated
-    g_logbuffer[g_logpos & LOGBUFMASK] = '\0';
+    g_logbuffer[pos & LOGBUFMASK] = '\0';
+
+    // USB log transfer can run on the other core. The release store
+    // makes the characters visible before the new position.
+    __atomic_store_n(&g_logpos, pos, __ATOMIC_RELEASE);
 
     platform_log(str);
 }
@@ -167,7 +172,7 @@ void log_buf(const unsigned char *buf, unsigned long size)
 
 uint32_t log_get_buffer_len()
 {
-    return g_logpos;
+    return __atomic_load_n(&g_logpos, __ATOMIC_ACQUIRE);
 }
 
 const char *log_get_buffer(uint32_t *startpos, uint32_t *available)
@@ -178,24 +183,27 @@ const char *log_get_buffer(uint32_t *startpos, uint32_t *available)
         startpos = &default_pos;
     }
 
+    // Read the write position once, characters up to it are complete
+    uint32_t logpos = log_get_buffer_len();
+
     // Check oldest data available in buffer
-    uint32_t lag = (g_logpos - *startpos);
+    uint32_t lag = (logpos - *startpos);
     if (lag >= LOGBUFSIZE)
     {
         // If we lose data, skip 512 bytes forward to give us time to transmit
         // pending data before new log messages arrive. Also skip to next line
         // break to keep formatting consistent.
-        uint32_t oldest = g_logpos - LOGBUFSIZE + 512;
-        while (oldest < g_logpos)
+        uint32_t oldest = logpos - LOGBUFSIZE + 512;
+        while (oldest < logpos)
         {
             char c = g_logbuffer[oldest & LOGBUFMASK];
             if (c == '\r' || c == '\n') break;
             oldest++;
         }
 
-        if (oldest > g_logpos)
+        if (oldest > logpos)
         {
-            oldest = g_logpos;
+            oldest = logpos;
         }
 
         *startpos = oldest;
@@ -205,10 +213,10 @@ const char *log_get_buffer(uint32_t *startpos, uint32_t *available)
 
     // Calculate number of bytes available
     uint32_t len;
-    if ((g_logpos & LOGBUFMASK) >= (*startpos & LOGBUFMASK))
+    if ((logpos & LOGBUFMASK) >= (*startpos & LOGBUFMASK))
     {
-        // Can read directly to g_logpos
-        len = g_logpos - *startpos;
+        // Can read directly to logpos
+        len = logpos - *startpos;
     }
     else
     {
@@ -6,6 +6,7 @@
 #include "BlueSCSI_log_trace.h"
 #include "BlueSCSI_log.h"
 #include <scsi2sd.h>
+#include <DataCRC32.h>
 #include "BlueSCSI_Toolbox.h"
 
 extern "C" {
@@ -17,7 +18,7 @@ static bool g_LogData = false;
 static bool g_LogInitiatorCommand = false;
 static int g_InByteCount = 0;
 static int g_OutByteCount = 0;
-static uint16_t g_DataChecksum = 0;
+static uint32_t g_DataChecksum = 0;
 
 static const char *getCommandName(uint8_t cmd)
 {
@@ -72,6 +73,12 @@ static const char *getCommandName(uint8_t cmd)
         case 0x47: return "CDROM PlayAudioMSF";
         case 0x48: return "CDROM PauseResume";
         case 0x52: return "CDROM ReadTrackInformation";
+        case 0x53: return "CDROM ReserveTrack";
+        case 0x5B: return "CDROM CloseTrackSession";
+        case 0x5C: return "CDROM ReadBufferCapacity";
+        case 0x5D: return "CDROM SendCueSheet";
+        case 0xA1: return "CDROM Blank";
+        case 0xAA: return "Write12";
         case 0xBB: return "CDROM SetCDSpeed";
         case 0xBD: return "CDROM MechanismStatus";
         case 0xBE: return "ReadCD";
@@ -95,6 +102,7 @@ static const char *getCommandName(uint8_t cmd)
         case BLUESCSI_TOOLBOX_SET_NEXT_CD: return "BLUESCSI_TOOLBOX_SET_NEXT_CD";
         case BLUESCSI_TOOLBOX_LIST_DEVICES: return "BLUESCSI_TOOLBOX_LIST_DEVICES";
         case BLUESCSI_TOOLBOX_COUNT_CDS: return "BLUESCSI_TOOLBOX_COUNT_CDS";
+        case BLUESCSI_TOOLBOX_CREATE_IMAGE: return "BLUESCSI_TOOLBOX_CREATE_IMAGE";
         default:   return "Unknown";
     }
 }
@@ -203,7 +211,7 @@ void scsiLogPhaseChange(int new_phase)
     {
         if (old_phase == DATA_IN || old_phase == DATA_OUT)
         {
-            debuglog("---- Total IN: ", g_InByteCount, " OUT: ", g_OutByteCount, " CHECKSUM: ", (int)g_DataChecksum);
+            debuglog("---- Total IN: ", g_InByteCount, " OUT: ", g_OutByteCount, " CHECKSUM: ", g_DataChecksum);
         }
 	// log Xebec vendor command
         if (old_phase == DATA_OUT && scsiDev.cdb[0] == 0x0C && g_OutByteCount == 8)
@@ -258,7 +266,7 @@ void scsiLogInitiatorPhaseChange(int new_phase)
     {
         if (old_phase == DATA_IN || old_phase == DATA_OUT)
         {
-            debuglog("---- Total IN: ", g_InByteCount, " OUT: ", g_OutByteCount, " CHECKSUM: ", (int)g_DataChecksum);
+            debuglog("---- Total IN: ", g_InByteCount, " OUT: ", g_OutByteCount, " CHECKSUM: ", g_DataChecksum);
         }
         g_InByteCount = g_OutByteCount = 0;
         g_DataChecksum = 0;
@@ -268,27 +276,22 @@ void scsiLogInitiatorPhaseChange(int new_phase)
     }
 }
 
-void scsiLogDataIn(const uint8_t *buf, uint32_t length)
+void scsiLogDataIn(const uint8_t *buf, uint32_t length, bool dma_checksum)
 {
     if (g_LogData)
     {
         debuglog("------ IN: ", bytearray(buf, length));
     }
 
-    if (g_log_debug)
+    if (g_log_debug && !dma_checksum)
     {
-        // BSD checksum algorithm
-        for (uint32_t i = 0; i < length; i++)
-        {
-            g_DataChecksum = (g_DataChecksum >> 1) + ((g_DataChecksum & 1) << 15);
-            g_DataChecksum += buf[i];
-        }
+        g_DataChecksum = crc32_update(g_DataChecksum, buf, length);
     }
 
     g_InByteCount += length;
 }
 
-void scsiLogDataOut(const uint8_t *buf, uint32_t length)
+void scsiLogDataOut(const uint8_t *buf, uint32_t length, bool dma_checksum)
 {
     if (buf == scsiDev.cdb || g_LogInitiatorCommand)
     {
@@ -300,15 +303,20 @@ void scsiLogDataOut(const uint8_t *buf, uint32_t length)
         debuglog("------ OUT: ", bytearray(buf, length));
     }
 
-    if (g_log_debug)
+    if (g_log_debug && !dma_checksum)
     {
-        // BSD checksum algorithm
-        for (uint32_t i = 0; i < length; i++)
-        {
-            g_DataChecksum = (g_DataChecksum >> 1) + ((g_DataChecksum & 1) << 15);
-            g_DataChecksum += buf[i];
-        }
+        g_DataChecksum = crc32_update(g_DataChecksum, buf, length);
     }
 
     g_OutByteCount += length;
 }
+
+uint32_t scsiLogDataChecksum()
+{
+    return g_DataChecksum;
+}
+
+void scsiLogSetDataChecksum(uint32_t crc)
+{
+    g_DataChecksum = crc;
+}
@@ -7,5 +7,13 @@
 // Called from scsiPhy.cpp
 void scsiLogPhaseChange(int new_phase);
 void scsiLogInitiatorPhaseChange(int new_phase);
-void scsiLogDataIn(const uint8_t *buf, uint32_t length);
-void scsiLogDataOut(const uint8_t *buf, uint32_t length);
\ No newline at end of file
+// Set dma_checksum when the platform computes the data checksum during
+// the DMA transfer, see scsiLogDataChecksum().
+void scsiLogDataIn(const uint8_t *buf, uint32_t length, bool dma_checksum = false);
+void scsiLogDataOut(const uint8_t *buf, uint32_t length, bool dma_checksum = false);
+
+// CRC-32 of the data bytes in the current phase, only updated when debug
+// logging is enabled. Platform code seeds the DMA checksum with this value
+// and stores the result back when the transfer ends.
+uint32_t scsiLogDataChecksum();
+void scsiLogSetDataChecksum(uint32_t crc);
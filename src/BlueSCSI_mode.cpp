@@ -29,6 +29,7 @@
 #include "BlueSCSI_audio.h"
 #endif
 #include "BlueSCSI_cdrom.h"
+#include "BlueSCSI_disk.h"
 #include "BlueSCSI_log.h"
 
 extern "C" {
@@ -62,6 +63,28 @@ static const uint8_t CDROMAudioControlParametersPage[] =
 };
 #endif
 
+// 0x05 Write Parameters Page, only reported by CD recorder targets
+static const uint8_t CDROMWriteParametersPage[] =
+{
+0x05, // page code
+0x32, // page length
+0x41, // BUFE set, Track-At-Once
+0x04, // single session, data track
+0x08, // data block type: Mode 1, 2048 bytes
+0x00, // link size
+0x00, // reserved
+0x00, // host application code
+0x00, // session format: CD-DA or CD-ROM
+0x00, // reserved
+0x00, 0x00, 0x00, 0x00, // packet size
+0x00, 0x96, // audio pause length, 150 blocks
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // media catalog number
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // ISRC
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00 // sub-header
+};
+
 // 0x2A CD-ROM Capabilities and Mechanical Status Page
 // This seems to have been standardized in MMC-1 but was de-facto present in
 // earlier SCSI-2 drives. The below mirrors one of those earlier SCSI-2
@@ -125,6 +148,39 @@ int modeSenseCDDevicePage(int pc, int idx, int pageCode, int* pageFound)
     }
 }
 
+extern "C"
+int modeSenseCDWriteParametersPage(int pc, int idx, int pageCode, int* pageFound)
+{
+    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+    if (img.cdr_enabled && (pageCode == 0x05 || pageCode == 0x3F))
+    {
+        *pageFound = 1;
+        pageIn(
+            pc,
+            idx,
+            CDROMWriteParametersPage,
+            sizeof(CDROMWriteParametersPage));
+        if (pc == 0x00)
+        {
+            scsiDev.data[idx+2] = 0x40 | img.cdr_write_type;
+            scsiDev.data[idx+3] = img.cdr_track_mode;
+            scsiDev.data[idx+4] = img.cdr_block_type;
+        }
+        else if (pc == 0x01)
+        {
+            // write type, track mode and data block type can be set
+            scsiDev.data[idx+2] = 0x0F;
+            scsiDev.data[idx+3] = 0x0F;
+            scsiDev.data[idx+4] = 0x0F;
+        }
+        return sizeof(CDROMWriteParametersPage);
+    }
+    else
+    {
+        return 0;
+    }
+}
+
 extern "C"
 int modeSenseCDAudioControlPage(int pc, int idx, int pageCode, int* pageFound)
 {
@@ -138,9 +194,11 @@ int modeSenseCDAudioControlPage(int pc, int idx, int pageCode, int* pageFound)
             idx,
             CDROMAudioControlParametersPage,
             sizeof(CDROMAudioControlParametersPage));
+        image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
         if (pc == 0x00)
         {
             // report current port assignments and volume level
+            img.mode_shadow.sense(pc, &scsiDev.data[idx], sizeof(CDROMAudioControlParametersPage));
             uint16_t chn = audio_get_channel(scsiDev.target->targetId);
             uint16_t vol = audio_get_volume(scsiDev.target->targetId);
             scsiDev.data[idx+8] = chn & 0xFF;
@@ -151,20 +209,17 @@ int modeSenseCDAudioControlPage(int pc, int idx, int pageCode, int* pageFound)
         else if (pc == 0x01)
         {
             // report bits that can be set
-            scsiDev.data[idx+8] = 0xFF;
-            scsiDev.data[idx+9] = 0xFF;
-            scsiDev.data[idx+10] = 0xFF;
-            scsiDev.data[idx+11] = 0xFF;
+            img.mode_shadow.sense(pc, &scsiDev.data[idx], sizeof(CDROMAudioControlParametersPage));
         }
         else
         {
-            // report defaults for 0x02
-            // also report same for 0x03, though we are actually supposed
-            // to terminate with CHECK CONDITION and SAVING PARAMETERS NOT SUPPORTED
+            // report defaults for 0x02, and for 0x03 unless the host
+            // has saved values
             scsiDev.data[idx+8] = AUDIO_CHANNEL_ENABLE_MASK & 0xFF;
             scsiDev.data[idx+9] = DEFAULT_VOLUME_LEVEL & 0xFF;
             scsiDev.data[idx+10] = AUDIO_CHANNEL_ENABLE_MASK >> 8;
             scsiDev.data[idx+11] = DEFAULT_VOLUME_LEVEL >> 8;
+            img.mode_shadow.sense(pc, &scsiDev.data[idx], sizeof(CDROMAudioControlParametersPage));
         }
         return sizeof(CDROMAudioControlParametersPage);
     }
@@ -188,6 +243,14 @@ int modeSenseCDCapabilitiesPage(int pc, int idx, int pageCode, int* pageFound)
             idx,
             CDROMCapabilitiesPage,
             sizeof(CDROMCapabilitiesPage));
+
+        image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+        if (img.cdr_enabled && pc != 0x01)
+        {
+            scsiDev.data[idx+2] = 0x03; // CD-R/RW reading
+            scsiDev.data[idx+3] = 0x03; // CD-R/RW writing
+            scsiDev.data[idx+4] |= 0x80; // buffer underrun free
+        }
         return sizeof(CDROMCapabilitiesPage);
     }
     else
@@ -196,6 +259,33 @@ int modeSenseCDCapabilitiesPage(int pc, int idx, int pageCode, int* pageFound)
     }
 }
 
+extern "C"
+int modeSelectCDWriteParametersPage(int pageLen, int idx)
+{
+    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+    if (!img.cdr_enabled)
+    {
+        // page 0x05 is ignored on other device types
+        return 1;
+    }
+
+    if (pageLen < 3) return 0;
+    uint8_t write_type = scsiDev.data[idx+2] & 0x0F;
+    uint8_t track_mode = scsiDev.data[idx+3] & 0x0F;
+    uint8_t block_type = scsiDev.data[idx+4] & 0x0F;
+    debuglog("------ CD write parameters: write type ", write_type,
+             ", track mode ", track_mode, ", data block type ", block_type);
+
+    // Track-At-Once or Session-At-Once, raw or Mode 1 data blocks
+    if (write_type != 1 && write_type != 2) return 0;
+    if (block_type != 0x00 && block_type != 0x08) return 0;
+
+    img.cdr_write_type = write_type;
+    img.cdr_track_mode = track_mode;
+    img.cdr_block_type = block_type;
+    return 1;
+}
+
 extern "C"
 int modeSelectCDAudioControlPage(int pageLen, int idx)
 {
@@ -206,6 +296,7 @@ int modeSelectCDAudioControlPage(int pageLen, int idx)
         uint16_t chn = (scsiDev.data[idx+10] << 8) + scsiDev.data[idx+8];
         uint16_t vol = (scsiDev.data[idx+11] << 8) + scsiDev.data[idx+9];
         debuglog("------ CD audio control page channels (", chn, "), volume (", vol, ")");
+        modeSelectShadowPage(pageLen, idx);
         audio_set_channel(scsiDev.target->targetId, chn);
         audio_set_volume(scsiDev.target->targetId, vol);
         return 1;
@@ -218,3 +309,28 @@ int modeSelectCDAudioControlPage(int pageLen, int idx)
     return 0;
 #endif
 }
+
+extern "C"
+void modeSenseShadowPage(int pc, int idx, int pageLen)
+{
+    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+    img.mode_shadow.sense(pc, &scsiDev.data[idx], pageLen);
+}
+
+extern "C"
+int modeSelectShadowPage(int pageLen, int idx)
+{
+    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+    bool save = scsiDev.cdb[1] & 1; // SP Save Pages flag
+    bool saved_changed;
+    if (!img.mode_shadow.select(&scsiDev.data[idx], pageLen + 2, save, &saved_changed)) return 0;
+
+    debuglog("------ Mode page ", scsiDev.data[idx] & 0x3F, save ? " set and saved" : " set");
+    if (saved_changed)
+    {
+        // Hosts often save the same values on every boot, the sidecar file
+        // on the SD card is only written when they differ.
+        scsiDiskModeShadowSave(img);
+    }
+    return 1;
+}
@@ -21,8 +21,14 @@
 
 #pragma once
 
+int modeSenseCDWriteParametersPage(int pc, int idx, int pageCode, int* pageFound);
 int modeSenseCDDevicePage(int pc, int idx, int pageCode, int* pageFound);
 int modeSenseCDAudioControlPage(int pc, int idx, int pageCode, int* pageFound);
 int modeSenseCDCapabilitiesPage(int pc, int idx, int pageCode, int* pageFound);
 
+int modeSelectCDWriteParametersPage(int pageLen, int idx);
 int modeSelectCDAudioControlPage(int pageLen, int idx);
+
+// Pages that keep the values set by the host, see ModeShadow.h
+void modeSenseShadowPage(int pc, int idx, int pageLen);
+int modeSelectShadowPage(int pageLen, int idx);
@@ -26,14 +26,52 @@
 #include "BlueSCSI_log.h"
 #include "BlueSCSI_config.h"
 #include <minIni.h>
+#include <FatChain.h>
 #include <strings.h>
 #include <string.h>
 #include <assert.h>
 
+// FAT sectors read at a time when checking image contiguity
+#define IMAGE_FAT_READ_SECTORS 4
+
+// Same as FsFile::contiguousRange(), but on FAT volumes reads the FAT in
+// batches and checks only the clusters that hold file data, see lib/FatChain.
+static bool imageContiguousRange(FsFile &file, uint32_t* bgnSector, uint32_t* endSector)
+{
+    FsVolume *vol = SD.vol();
+    int fat_type = vol->fatType();
+    uint32_t first = file.firstSector();
+    if (first == 0 || (fat_type != 16 && fat_type != 32))
+    {
+        // exFAT files have a contiguous flag that SdFat checks directly
+        return file.contiguousRange(bgnSector, endSector);
+    }
+
+    uint32_t spc = vol->sectorsPerCluster();
+    uint64_t cluster_bytes = (uint64_t)spc * SD_SECTOR_SIZE;
+    uint32_t cluster = (first - vol->dataStartSector()) / spc + 2;
+    uint32_t clusters = (file.size() + cluster_bytes - 1) / cluster_bytes;
+
+    // FAT is read directly from the card, write out changes still in SdFat cache
+    file.flush();
+
+    uint8_t buf[IMAGE_FAT_READ_SECTORS * SD_SECTOR_SIZE];
+    FatChain chain(fat_type, vol->fatStartSector());
+    if (!chain.contiguous(*SD.card(), cluster, clusters, buf, IMAGE_FAT_READ_SECTORS))
+    {
+        return false;
+    }
+
+    *bgnSector = first;
+    *endSector = first + clusters * spc - 1;
+    return true;
+}
+
 ImageBackingStore::ImageBackingStore()
 {
     m_israw = false;
     m_isrom = false;
+    m_isfile = false;
     m_isreadonly_attr = false;
     m_blockdev = nullptr;
     m_bgnsector = m_endsector = m_cursector = 0;
@@ -92,10 +130,11 @@ ImageBackingStore::ImageBackingStore(const char *filename, uint32_t scsi_block_s
         {
             m_fsfile = SD.open(filename, O_RDWR);
         }
+        m_isfile = m_fsfile.isOpen();
 
         uint32_t sectorcount = m_fsfile.size() / SD_SECTOR_SIZE;
         uint32_t begin = 0, end = 0;
-        if (m_fsfile.contiguousRange(&begin, &end) && end >= begin + sectorcount
+        if (imageContiguousRange(m_fsfile, &begin, &end) && end >= begin + sectorcount
             && (scsi_block_size % SD_SECTOR_SIZE) == 0)
         {
             // Convert to raw mapping, this avoids some unnecessary
@@ -136,8 +175,14 @@ bool ImageBackingStore::isRaw()
     return m_israw;
 }
 
+bool ImageBackingStore::isFile()
+{
+    return m_isfile;
+}
+
 bool ImageBackingStore::close()
 {
+    m_isfile = false;
     if (m_israw)
     {
         m_blockdev = nullptr;
@@ -306,12 +351,14 @@ void ImageBackingStore::flush()
 
 void ImageBackingStore::getName(char * name, size_t len)
 {
-    if(m_isrom)
-        name = (char*)"ROM:";
-    else if(m_israw)
-        name = (char*)"RAW:";
-    else
+    if (m_isfile)
         m_fsfile.getName(name, len);
+    else if (m_isrom)
+        strlcpy(name, "ROM:", len);
+    else if (m_israw)
+        strlcpy(name, "RAW:", len);
+    else if (len > 0)
+        name[0] = '\0';
 }
 
 uint64_t ImageBackingStore::position()
@@ -52,6 +52,10 @@ public:
     // Is the image using the raw SD card?
     bool isRaw();
 
+    // Is the image a file on the SD card filesystem?
+    // Also true for contiguous files that are accessed as raw sectors.
+    bool isFile();
+
     // Close the image so that .isOpen() will return false.
     bool close();
 
@@ -84,6 +88,7 @@ public:
 protected:
     bool m_israw;
     bool m_isrom;
+    bool m_isfile;
     bool m_isreadonly_attr;
     romdrive_hdr_t m_romhdr;
     FsFile m_fsfile;
@@ -92,3 +97,4 @@ protected:
     uint32_t m_endsector;
     uint32_t m_cursector;
 };
+